@@ -0,0 +1,32 @@
+// Timing helpers shared by the benchmarks
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+/**
+ * @brief Median wall time of `runs` calls of `f`, in milliseconds.
+ */
+template <typename F>
+double benchMedianMs(int runs, F&& f) {
+    std::vector<double> times;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+/**
+ * @brief Prints one result line as `name: value unit`.
+ */
+inline void benchReport(const char* name, double value, const char* unit) {
+    std::printf("%-40s %12.3f %s\n", name, value, unit);
+}
+
+#endif // BENCH_H
@@ -0,0 +1,86 @@
+// Clone restores against fresh boots, on a live libvirt host
+//
+// Usage: bench_clone <uri> <template-vm> <save-path> [rounds] [ready-pattern]   (default 10, "login:")
+//
+// The template VM must be shut off, with a file-backed disk and a serial console
+// that prints `ready-pattern` once the guest is up. Each round boots it until
+// the pattern appears and destroys it; the last boot is saved as a clone
+// template, and each round then restores a clone from it and destroys it. The
+// template's definition is put back at the end.
+#include "vm.h"
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include "bench.h"
+
+static double medianOf(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: bench_clone <uri> <template-vm> <save-path> [rounds] [ready-pattern]\n";
+        return 2;
+    }
+    std::string uri = argv[1], name = argv[2], save_path = argv[3];
+    int rounds = argc > 4 ? std::atoi(argv[4]) : 10;
+    std::string pattern = argc > 5 ? argv[5] : "login:";
+    if (rounds < 1) return 2;
+
+    if (!VMManager::startEventLoop()) return 1;
+    VMManager manager(QEMU);
+    if (!manager.connect(uri)) return 1;
+    manager.configureReadiness({pattern}, ReadinessMode::Console);
+    virDomainPtr vm = manager.lookupVM(name);
+    if (!vm) return 1;
+    char* inactive = virDomainGetXMLDesc(vm, VIR_DOMAIN_XML_INACTIVE);
+    if (!inactive) return 1;
+    std::string definition(inactive);
+    free(inactive);
+
+    std::vector<double> boot_ms;
+    for (int r = 0; r < rounds; r++) {
+        auto start = std::chrono::steady_clock::now();
+        if (!manager.startVMAndWait(vm, std::chrono::minutes(5))) return 1;
+        boot_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        // The last boot stays up to become the template
+        if (r + 1 < rounds && !manager.destroyVM(vm)) return 1;
+    }
+
+    CloneTemplate tpl;
+    if (!manager.createCloneTemplate(vm, save_path, tpl)) return 1;
+    virDomainFree(vm);
+
+    std::string clone_name = name + "-bench-clone";
+    size_t slash = tpl.base_disk.rfind('/');
+    std::string overlay = (slash == std::string::npos ? "." : tpl.base_disk.substr(0, slash)) + "/" + clone_name + ".qcow2";
+    std::vector<double> restore_ms;
+    for (int r = 0; r < rounds; r++) {
+        auto start = std::chrono::steady_clock::now();
+        virDomainPtr clone = manager.restoreClone(tpl, clone_name);
+        if (!clone) break;
+        restore_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        // Restored clones are transient: destroying one removes it
+        bool destroyed = manager.destroyVM(clone);
+        virDomainFree(clone);
+        unlink(overlay.c_str());
+        if (!destroyed) break;
+    }
+
+    virConnectPtr conn = virConnectOpen(uri.c_str());
+    virDomainPtr redefined = conn ? virDomainDefineXML(conn, definition.c_str()) : nullptr;
+    if (!redefined) std::cerr << "Failed to redefine template VM '" << name << "'\n";
+    else virDomainFree(redefined);
+    if (conn) virConnectClose(conn);
+    unlink(save_path.c_str());
+    if (restore_ms.size() != static_cast<size_t>(rounds)) return 1;
+
+    double boot = medianOf(boot_ms), restore = medianOf(restore_ms);
+    benchReport("fresh boot to ready (median)", boot, "ms");
+    benchReport("clone restore to running (median)", restore, "ms");
+    benchReport("boots per second per host", 1000.0 / boot, "");
+    benchReport("clones per second per host", 1000.0 / restore, "");
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Fleet config audit: Merkle diff against a full compare of every domain's XML
+//
+// Usage: bench_config_audit [hosts] [domains per host] [drifted]   (default 200, 500, 3)
+#include "digest.h"
+
+#include <cstdlib>
+#include <random>
+
+#include "bench.h"
+
+static std::string domainXML(size_t host, size_t d, unsigned memory_gib) {
+    std::string name = "vm-" + std::to_string(host) + "-" + std::to_string(d);
+    return "<domain type='kvm'>\n  <name>" + name + "</name>\n  <uuid>00000000-0000-0000-0000-" +
+           std::to_string(100000000000 + host * 1000 + d) + "</uuid>\n  <memory unit='GiB'>" +
+           std::to_string(memory_gib) + "</memory>\n  <vcpu placement='static'>4</vcpu>\n"
+           "  <os><type arch='x86_64' machine='q35'>hvm</type><boot dev='hd'/></os>\n"
+           "  <devices>\n    <disk type='file' device='disk'>\n      <driver name='qemu' type='qcow2'/>\n"
+           "      <source file='/var/lib/libvirt/images/" + name + ".qcow2'/>\n"
+           "      <target dev='vda' bus='virtio'/>\n      <alias name='virtio-disk0'/>\n    </disk>\n"
+           "    <interface type='network'><source network='default'/><model type='virtio'/></interface>\n"
+           "  </devices>\n</domain>\n";
+}
+
+int main(int argc, char** argv) {
+    size_t num_hosts = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    size_t per_host = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500;
+    size_t num_drifted = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 3;
+
+    // Desired and actual XML agree except for the drifted domains' memory
+    std::mt19937_64 rng(5);
+    std::map<std::pair<size_t, size_t>, bool> drifted;
+    while (drifted.size() < num_drifted) drifted[{rng() % num_hosts, rng() % per_host}] = true;
+    std::vector<std::vector<std::string>> desired_xml(num_hosts), actual_xml(num_hosts);
+    std::vector<ConfigMerkle> desired(num_hosts), actual(num_hosts);
+    for (size_t h = 0; h < num_hosts; h++) {
+        for (size_t d = 0; d < per_host; d++) {
+            std::string name = "vm-" + std::to_string(h) + "-" + std::to_string(d);
+            desired_xml[h].push_back(domainXML(h, d, 8));
+            actual_xml[h].push_back(domainXML(h, d, drifted.count({h, d}) ? 16 : 8));
+            desired[h].set(name, digestDomainXML(desired_xml[h].back()));
+            actual[h].set(name, digestDomainXML(actual_xml[h].back()));
+        }
+    }
+
+    size_t nodes = 0, found = 0;
+    double merkle_ms = benchMedianMs(5, [&] {
+        nodes = found = 0;
+        for (size_t h = 0; h < num_hosts; h++) {
+            DriftReport report = desired[h].diff(actual[h]);
+            nodes += report.nodes_compared;
+            found += report.changed.size();
+        }
+    });
+    if (found != num_drifted) return 1;
+
+    size_t full_found = 0;
+    double full_ms = benchMedianMs(1, [&] {
+        for (size_t h = 0; h < num_hosts; h++) {
+            for (size_t d = 0; d < per_host; d++) {
+                if (canonicalizeDomainXML(desired_xml[h][d]) != canonicalizeDomainXML(actual_xml[h][d])) full_found++;
+            }
+        }
+    });
+    if (full_found != num_drifted) return 1;
+
+    benchReport("domains", static_cast<double>(num_hosts * per_host), "");
+    benchReport("drifted domains found", static_cast<double>(found), "");
+    benchReport("tree nodes compared", static_cast<double>(nodes), "");
+    benchReport("Merkle diff of all hosts (median of 5)", merkle_ms, "ms");
+    benchReport("canonical compare of every domain", full_ms, "ms");
+    return 0;
+}
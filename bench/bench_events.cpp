@@ -0,0 +1,81 @@
+// Event coalescing throughput and consumer CPU under a synthetic lifecycle event storm
+//
+// Usage: bench_events [events] [domains] [producers]   (default 2000000, 10000, 4)
+#include "events.h"
+
+#include <cstdlib>
+#include <random>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    size_t num_events = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+    size_t num_domains = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000;
+    size_t num_producers = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 4;
+    if (!num_domains || !num_producers) return 2;
+
+    std::vector<std::string> names;
+    for (size_t d = 0; d < num_domains; d++) names.push_back("vm" + std::to_string(d));
+    static const int storm[] = {VIR_DOMAIN_EVENT_STARTED, VIR_DOMAIN_EVENT_SUSPENDED, VIR_DOMAIN_EVENT_RESUMED,
+                                VIR_DOMAIN_EVENT_STOPPED, VIR_DOMAIN_EVENT_DEFINED};
+
+    // Baseline: the consumer handles every event of the storm, one call each
+    {
+        std::unordered_map<std::string, int> state;
+        std::mt19937 rng(0);
+        double ms = benchMedianMs(1, [&] {
+            for (size_t i = 0; i < num_events; i++) {
+                std::vector<DomainEvent> one(1);
+                one[0].domain = names[rng() % num_domains];
+                one[0].event = storm[i % 5];
+                for (const auto& e : one) state[e.domain] = eventToState(e.event);
+            }
+        });
+        benchReport("uncoalesced: consumer time per event", ms * 1e6 / static_cast<double>(num_events), "ns");
+    }
+
+    // A window of 0 dispatches whatever piled up while the dispatcher was busy
+    struct Config {
+        const char* label;
+        int window_ms;
+        size_t max_batch;
+    };
+    for (const Config& config : {Config{"no window", 0, 1}, Config{"10 ms window", 10, 4096},
+                                 Config{"50 ms window", 50, 4096}}) {
+        EventCoalescer coalescer(std::chrono::milliseconds(config.window_ms), config.max_batch);
+        // The consumer maintains a state cache, as VMManager's subscriber does
+        std::unordered_map<std::string, int> state;
+        coalescer.subscribe([&state](const std::vector<DomainEvent>& batch) {
+            for (const auto& e : batch) state[e.domain] = eventToState(e.event);
+        });
+        coalescer.start();
+
+        double ms = benchMedianMs(1, [&] {
+            std::vector<std::thread> producers;
+            for (size_t p = 0; p < num_producers; p++) {
+                producers.emplace_back([&, p] {
+                    std::mt19937 rng(static_cast<unsigned>(p));
+                    for (size_t i = p; i < num_events; i += num_producers) {
+                        DomainEvent e;
+                        e.domain = names[rng() % num_domains];
+                        e.event = storm[i % 5];
+                        e.received = std::chrono::steady_clock::now();
+                        coalescer.push(std::move(e));
+                    }
+                });
+            }
+            for (auto& t : producers) t.join();
+            coalescer.stop();  // drains what is still pending
+        });
+
+        EventStats stats = coalescer.stats();
+        std::string label = config.label;
+        benchReport((label + ": sustained events/s").c_str(), static_cast<double>(stats.received) * 1000.0 / ms, "");
+        benchReport((label + ": dispatched events").c_str(), static_cast<double>(stats.dispatched), "");
+        benchReport((label + ": folded events").c_str(), static_cast<double>(stats.coalesced), "");
+        benchReport((label + ": batches").c_str(), static_cast<double>(stats.batches), "");
+        benchReport((label + ": consumer CPU per event").c_str(),
+                    static_cast<double>(stats.handler_cpu_ns) / static_cast<double>(stats.received), "ns");
+    }
+    return 0;
+}
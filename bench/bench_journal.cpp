@@ -0,0 +1,79 @@
+// Operation journal per-operation overhead and recovery time after a crash
+//
+// Usage: bench_journal [ops] [threads] [open]   (default 20000, 16, 1000)
+#include "journal.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <thread>
+#include <unistd.h>
+
+#include "bench.h"
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Runs `ops` begin/complete pairs split over `threads` callers, returning elapsed ms.
+ */
+static double runOps(OperationJournal& journal, size_t ops, size_t threads) {
+    return benchMedianMs(1, [&] {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&journal, ops, threads, t] {
+                for (size_t i = t; i < ops; i += threads) {
+                    uint64_t id = journal.begin(JournalOp::Start, "vm" + std::to_string(i));
+                    if (!id) std::exit(1);
+                    journal.complete(id, true);
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+    });
+}
+
+int main(int argc, char** argv) {
+    size_t num_ops = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    size_t num_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 16;
+    size_t num_open = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1000;
+    fs::path dir = fs::temp_directory_path() / ("augustus-bench-journal-" + std::to_string(getpid()));
+    fs::create_directories(dir);
+
+    for (size_t threads : {size_t{1}, num_threads}) {
+        OperationJournal journal;
+        if (!journal.open(dir / ("ops-" + std::to_string(threads)))) return 1;
+        double ms = runOps(journal, num_ops, threads);
+        JournalStats stats = journal.stats();
+        std::string label = std::to_string(threads) + " thread(s)";
+        benchReport((label + ": time per operation").c_str(), ms * 1000.0 / static_cast<double>(num_ops), "us");
+        benchReport((label + ": records per sync").c_str(), stats.recordsPerSync(), "");
+        benchReport((label + ": avg intent commit").c_str(), stats.avgCommitMicros(), "us");
+    }
+
+    // Crash with `num_open` operations in flight behind a long history of finished
+    // ones, with and without checkpoints bounding the file
+    for (bool checkpoints : {false, true}) {
+        fs::path path = dir / (checkpoints ? "crash-checkpointed" : "crash-unbounded");
+        fs::path crashed = path.string() + ".crashed";
+        {
+            OperationJournal journal;
+            if (!journal.open(path)) return 1;
+            journal.setCheckpointBytes(checkpoints ? OperationJournal::default_checkpoint_bytes : SIZE_MAX);
+            for (size_t i = 0; i < num_open; i++) journal.begin(JournalOp::Create, "open" + std::to_string(i), "<domain/>");
+            runOps(journal, num_ops * 10, num_threads);
+            if (!journal.sync()) return 1;
+            fs::copy_file(path, crashed);
+        }
+        size_t found = 0;
+        double recover_ms = benchMedianMs(5, [&] {
+            OperationJournal journal;
+            if (!journal.open(crashed)) std::exit(1);
+            found = journal.inFlight().size();
+        });
+        if (found != num_open) return 1;
+        std::string label = checkpoints ? "checkpointed" : "unbounded";
+        benchReport((label + ": journal bytes at crash").c_str(), static_cast<double>(fs::file_size(crashed)), "B");
+        benchReport((label + ": recovery open").c_str(), recover_ms, "ms");
+    }
+    fs::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,42 @@
+// TimerWheel insert and expiry throughput on virtual time
+//
+// Usage: bench_lease [leases]   (default 1000000)
+#include "lease.h"
+
+#include <cstdlib>
+#include <random>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    size_t num_leases = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < num_leases; i++) names.push_back("vm" + std::to_string(i));
+    std::mt19937_64 rng(9);
+    std::uniform_int_distribution<uint64_t> ttl(60000, 24ull * 3600 * 1000);  // a minute to a day
+    std::vector<uint64_t> deadlines;
+    for (size_t i = 0; i < num_leases; i++) deadlines.push_back(ttl(rng));
+
+    TimerWheel wheel(1000);
+    double insert_ms = benchMedianMs(1, [&] {
+        for (size_t i = 0; i < num_leases; i++) wheel.schedule(names[i], deadlines[i], 0);
+    });
+    // Half the leases renewed once: each renewal moves an existing timer
+    double renew_ms = benchMedianMs(1, [&] {
+        for (size_t i = 0; i < num_leases; i += 2) wheel.schedule(names[i], deadlines[i] + 60000, 0);
+    });
+
+    // A day of one-second expiry passes
+    size_t expired = 0;
+    double expire_ms = benchMedianMs(1, [&] {
+        for (uint64_t now = 0; now <= 24ull * 3600 * 1000 + 60000; now += 1000) expired += wheel.advance(now).size();
+    });
+    if (expired != num_leases || wheel.size() != 0) return 1;
+
+    benchReport("leases", static_cast<double>(num_leases), "");
+    benchReport("inserts per second", static_cast<double>(num_leases) / (insert_ms / 1000.0), "/s");
+    benchReport("renewals per second", static_cast<double>(num_leases / 2) / (renew_ms / 1000.0), "/s");
+    benchReport("expiries per second (incl. 86460 ticks)", static_cast<double>(expired) / (expire_ms / 1000.0), "/s");
+    return 0;
+}
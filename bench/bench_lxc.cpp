@@ -0,0 +1,110 @@
+// LXC container density and start latency against QEMU guests, on a live libvirt host
+//
+// Usage: bench_lxc <rootfs-dir> [containers] [qemu-template-vm] [settle-s]   (default 20, none, 10)
+//
+// Defines `containers` LXC system containers sharing the root filesystem at
+// `rootfs-dir`, starts them one after another and keeps them all running to
+// measure their memory footprint from the drop in MemAvailable once they have
+// settled. With `qemu-template-vm` (a shut-off guest on qemu:///system), the
+// same start latency and settled footprint are measured for that guest, one
+// start per round. Everything the benchmark defines or starts is removed again.
+#include "vm.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#include "bench.h"
+
+static double medianOf(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+// Host memory available for new workloads, in MiB
+static double memAvailableMiB() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key, unit;
+    uint64_t kib;
+    while (meminfo >> key >> kib >> unit) {
+        if (key == "MemAvailable:") return static_cast<double>(kib) / 1024.0;
+    }
+    return 0;
+}
+
+static void reportInstances(const std::string& label, const std::vector<double>& start_ms, double footprint_mib) {
+    benchReport((label + ": start to running (median)").c_str(), medianOf(start_ms), "ms");
+    benchReport((label + ": starts per second").c_str(), 1000.0 / medianOf(start_ms), "");
+    benchReport((label + ": settled footprint per instance").c_str(), footprint_mib, "MiB");
+    if (footprint_mib > 0) benchReport((label + ": instances per GiB").c_str(), 1024.0 / footprint_mib, "");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: bench_lxc <rootfs-dir> [containers] [qemu-template-vm] [settle-s]\n";
+        return 2;
+    }
+    std::string rootfs = argv[1];
+    int count = argc > 2 ? std::atoi(argv[2]) : 20;
+    std::string qemu_template = argc > 3 ? argv[3] : "";
+    auto settle = std::chrono::seconds(argc > 4 ? std::atoi(argv[4]) : 10);
+    if (count < 1) return 2;
+
+    VMManager lxc(LXC);
+    if (!lxc.connect("lxc:///system")) return 1;
+    double available_before = memAvailableMiB();
+    std::vector<virDomainPtr> containers;
+    std::vector<double> lxc_start_ms;
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        VMSpec spec;
+        spec.name = "bench-lxc-" + std::to_string(i);
+        spec.memory = 128;
+        spec.vcpus = 1;
+        spec.type = LXC;
+        spec.lxc = LxcSpec{};
+        spec.lxc->root_dir = rootfs;
+        virDomainPtr dom = lxc.createVM(spec);
+        if (!dom) {
+            ok = false;
+            break;
+        }
+        containers.push_back(dom);
+        auto start = std::chrono::steady_clock::now();
+        ok = lxc.startVM(dom);
+        if (ok) lxc_start_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    double lxc_footprint = 0;
+    if (ok) {
+        std::this_thread::sleep_for(settle);
+        lxc_footprint = (available_before - memAvailableMiB()) / count;
+    }
+    for (virDomainPtr dom : containers) {
+        lxc.destroyVM(dom);
+        lxc.undefineVM(dom);
+        virDomainFree(dom);
+    }
+    if (!ok) return 1;
+    reportInstances("lxc", lxc_start_ms, lxc_footprint);
+
+    if (qemu_template.empty()) return 0;
+    VMManager qemu(KVM);
+    if (!qemu.connect("qemu:///system")) return 1;
+    virDomainPtr vm = qemu.lookupVM(qemu_template);
+    if (!vm) return 1;
+    std::vector<double> qemu_start_ms, qemu_footprint;
+    int rounds = std::min(count, 5);
+    for (int r = 0; r < rounds; r++) {
+        double available = memAvailableMiB();
+        auto start = std::chrono::steady_clock::now();
+        if (!qemu.startVM(vm)) break;
+        qemu_start_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        std::this_thread::sleep_for(settle);
+        qemu_footprint.push_back(available - memAvailableMiB());
+        if (!qemu.destroyVM(vm)) break;
+    }
+    virDomainFree(vm);
+    if (qemu_footprint.size() != static_cast<size_t>(rounds)) return 1;
+    reportInstances("qemu", qemu_start_ms, medianOf(qemu_footprint));
+    return 0;
+}
@@ -0,0 +1,69 @@
+// Metering pipeline throughput and usage log size
+//
+// Usage: bench_metering [domains] [tenants] [hours]   (default 10000, 1000, 24; one sample per domain every 10 s)
+#include "metering.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <unistd.h>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    size_t num_domains = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    size_t num_tenants = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    uint64_t hours = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 24;
+    const uint64_t period_ms = 10000;
+
+    std::vector<MeterSample> domains(num_domains);
+    for (size_t d = 0; d < num_domains; d++) {
+        domains[d].vm = "vm" + std::to_string(d);
+        domains[d].tenant = "tenant" + std::to_string(d % num_tenants);
+        domains[d].instance = 1;
+        domains[d].memory_kib = (1 + d % 16) << 20;
+    }
+
+    std::filesystem::path log = std::filesystem::temp_directory_path() /
+                                ("augustus-bench-metering-" + std::to_string(getpid()) + ".log");
+    MeteringPipeline pipeline;
+    size_t samples = 0, buckets = 0;
+    double consume_ms = 0, append_ms = 0;
+    for (uint64_t now = 0; now <= hours * 3600000; now += period_ms) {
+        consume_ms += benchMedianMs(1, [&] {
+            for (size_t d = 0; d < num_domains; d++) {
+                MeterSample& s = domains[d];
+                s.timestamp_ms = now;
+                s.cpu_ns += 1000000000ull * (1 + d % 4);
+                s.rx_bytes += 4096 * (d % 7);
+                s.tx_bytes += 1024 * (d % 5);
+                // A few domains restart every hour
+                if (d % 100 == 0 && now % 3600000 == 0) {
+                    s.instance++;
+                    s.cpu_ns = 0;
+                }
+                pipeline.consume(s);
+            }
+        });
+        samples += num_domains;
+        if (now % 3600000 != 0) continue;
+        std::vector<MeterBucket> closed = pipeline.closeBuckets(now);
+        buckets += closed.size();
+        append_ms += benchMedianMs(1, [&] {
+            if (!appendMeterBuckets(log, closed)) std::exit(1);
+        });
+    }
+
+    std::vector<MeterBucket> loaded;
+    double load_ms = benchMedianMs(1, [&] { loadMeterBuckets(log, loaded); });
+    uintmax_t log_bytes = std::filesystem::file_size(log);
+    std::filesystem::remove(log);
+    if (loaded.size() != buckets) return 1;
+
+    benchReport("samples consumed", static_cast<double>(samples), "");
+    benchReport("time per sample", consume_ms * 1e6 / static_cast<double>(samples), "ns");
+    benchReport("tenant-hour buckets written", static_cast<double>(buckets), "");
+    benchReport("log bytes per tenant-hour", static_cast<double>(log_bytes) / static_cast<double>(buckets), "B");
+    benchReport("append and sync per hour", append_ms / static_cast<double>(hours), "ms");
+    benchReport("load whole log", load_ms, "ms");
+    return 0;
+}
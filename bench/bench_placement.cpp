@@ -0,0 +1,82 @@
+// Constrained placement throughput on a synthetic fleet
+//
+// Usage: bench_placement [hosts] [groups] [placements]   (default 1000, 5000, 50000)
+#include "placement.h"
+
+#include <cstdlib>
+#include <random>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    size_t num_hosts = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    size_t num_groups = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5000;
+    size_t num_placements = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 50000;
+
+    FleetModel fleet;
+    for (size_t h = 0; h < num_hosts; h++) {
+        FleetHost host;
+        host.uri = "host" + std::to_string(h);
+        host.rack = "rack" + std::to_string(h / 20);
+        host.zone = "zone" + std::to_string(h % 4);
+        host.memory_kib = 1024ull << 20;
+        host.cpus = 256;
+        host.cells = {FleetCell{512ull << 20, 128}, FleetCell{512ull << 20, 128}};
+        fleet.upsertHost(host);
+    }
+
+    // Groups alternate between host and rack anti-affinity; every tenth is a
+    // preferred zone affinity instead
+    PlacementScheduler sched;
+    std::string error;
+    for (size_t g = 0; g < num_groups; g++) {
+        AffinityRule rule;
+        rule.name = "group" + std::to_string(g);
+        rule.label_key = "group";
+        rule.label_value = std::to_string(g);
+        if (g % 10 == 9) {
+            rule.type = AffinityType::Affinity;
+            rule.topology_key = "zone";
+            rule.required = false;
+        } else {
+            rule.topology_key = g % 2 ? "rack" : "host";
+            rule.max_per_domain = g % 2 ? 2 : 1;
+        }
+        if (!sched.addRule(rule, error)) return 1;
+    }
+    sched.rebuild(fleet);
+
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<size_t> group(0, num_groups - 1);
+    std::uniform_int_distribution<unsigned> gib(1, 8);
+    size_t placed = 0;
+    double ms = benchMedianMs(1, [&] {
+        for (size_t i = 0; i < num_placements; i++) {
+            FleetVM vm;
+            vm.name = "vm" + std::to_string(i);
+            vm.memory_kib = static_cast<uint64_t>(gib(rng)) << 20;
+            vm.vcpus = 2;
+            vm.labels["group"] = std::to_string(group(rng));
+            if (!sched.place(fleet, vm, error).empty()) placed++;
+        }
+    });
+
+    // Brute-force check of every required rule against the final placement
+    std::map<std::pair<size_t, std::string>, unsigned> per_domain;
+    for (const auto& [name, vm] : fleet.getVMs()) {
+        size_t g = std::stoul(vm.labels.at("group"));
+        const AffinityRule& rule = sched.getRules()[g];
+        if (!rule.required) continue;
+        per_domain[{g, topologyDomain(*fleet.host(vm.host), rule.topology_key)}]++;
+    }
+    size_t violations = 0;
+    for (const auto& [key, n] : per_domain) {
+        if (n > sched.getRules()[key.first].max_per_domain) violations++;
+    }
+
+    benchReport("placements attempted", static_cast<double>(num_placements), "");
+    benchReport("placements made", static_cast<double>(placed), "");
+    benchReport("constraint violations", static_cast<double>(violations), "");
+    benchReport("time per placement", ms * 1000.0 / static_cast<double>(num_placements), "us");
+    return violations ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+// PlacementIndex throughput under a mix of placements and releases
+//
+// Usage: bench_placement_index [hosts] [operations]   (default 10000 hosts of 2 cells, 1000000 operations)
+#include "placement_index.h"
+
+#include <cstdlib>
+#include <random>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    size_t num_hosts = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    size_t num_ops = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+    FleetModel fleet;
+    for (size_t h = 0; h < num_hosts; h++) {
+        FleetHost host;
+        host.uri = "host" + std::to_string(h);
+        host.memory_kib = 768ull << 20;
+        host.cpus = 192;
+        host.cells = {FleetCell{384ull << 20, 96}, FleetCell{384ull << 20, 96}};
+        fleet.upsertHost(host);
+    }
+    PlacementIndex index(256);
+    index.build(fleet);
+
+    struct Placed {
+        CellRef cell;
+        uint64_t mem;
+        unsigned vcpus;
+    };
+    std::vector<Placed> placed;
+    std::mt19937_64 rng(3);
+    std::uniform_int_distribution<unsigned> gib(1, 32);
+    std::uniform_int_distribution<unsigned> vcpus(1, 16);
+    size_t placements = 0, releases = 0, misses = 0;
+
+    // Two placements per release, so the fleet fills up as the run goes on
+    double ms = benchMedianMs(1, [&] {
+        for (size_t i = 0; i < num_ops; i++) {
+            if (i % 3 == 2 && !placed.empty()) {
+                size_t k = rng() % placed.size();
+                index.release(placed[k].cell, placed[k].mem, placed[k].vcpus);
+                placed[k] = placed.back();
+                placed.pop_back();
+                releases++;
+                continue;
+            }
+            uint64_t mem = static_cast<uint64_t>(gib(rng)) << 20;
+            unsigned v = vcpus(rng);
+            std::optional<CellRef> cell = i % 2 ? index.bestFit(mem, v) : index.spread(mem, v);
+            if (!cell || !index.reserve(*cell, mem, v)) {
+                misses++;
+                continue;
+            }
+            placed.push_back(Placed{*cell, mem, v});
+            placements++;
+        }
+    });
+
+    benchReport("cells", static_cast<double>(index.size()), "");
+    benchReport("placements", static_cast<double>(placements), "");
+    benchReport("releases", static_cast<double>(releases), "");
+    benchReport("requests that fit nowhere", static_cast<double>(misses), "");
+    benchReport("operations per second", static_cast<double>(num_ops) / (ms / 1000.0), "ops/s");
+    return 0;
+}
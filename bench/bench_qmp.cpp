@@ -0,0 +1,113 @@
+// QmpMux replies per second against fake monitors, next to one-at-a-time round trips
+//
+// Usage: bench_qmp [domains] [rounds] [service_us]
+//   (default 200 domains, 50 rounds of two commands, 50 us per command in the monitor)
+#include "qmp.h"
+
+#include <cstdlib>
+#include <memory>
+
+#include "bench.h"
+#include "fake_qmp.h"
+
+/**
+ * @brief A blocking client that sends one command and waits for its reply before the next,
+ * the way commands reach monitors one by one through virDomainQemuMonitorCommand.
+ */
+struct SerialClient {
+    int fd = -1;
+    std::string in;
+    uint64_t next_id = 1;
+
+    bool connect(const std::string& path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) return false;
+        return call(QmpCommand{"qmp_capabilities", ""});
+    }
+
+    bool call(const QmpCommand& cmd) {
+        uint64_t id = next_id++;
+        std::string line = qmpCommandJson(cmd, std::to_string(id)) + "\r\n";
+        if (::send(fd, line.data(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(line.size())) return false;
+        char buf[16384];
+        while (true) {
+            size_t nl;
+            while ((nl = in.find('\n')) != std::string::npos) {
+                JsonValue msg;
+                bool parsed = parseJson(in.substr(0, nl), msg);
+                in.erase(0, nl + 1);
+                if (parsed && msg.has("id") && msg["id"].asUint() == id) return msg.has("return");
+            }
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) return false;
+            in.append(buf, static_cast<size_t>(n));
+        }
+    }
+
+    ~SerialClient() {
+        if (fd >= 0) close(fd);
+    }
+};
+
+int main(int argc, char** argv) {
+    size_t num_domains = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    size_t rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50;
+    long service_us = argc > 3 ? std::strtol(argv[3], nullptr, 10) : 50;
+
+    char tmpl[] = "/tmp/augustus-bench-qmp-XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    if (!dir) return 1;
+    std::vector<std::unique_ptr<FakeQmpMonitor>> monitors;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < num_domains; i++) {
+        paths.push_back(std::string(dir) + "/vm" + std::to_string(i) + ".sock");
+        monitors.push_back(std::make_unique<FakeQmpMonitor>("vm" + std::to_string(i), paths.back()));
+        monitors.back()->service_time = std::chrono::microseconds(service_us);
+    }
+    std::vector<QmpCommand> commands = {{"query-blockstats", ""}, {"query-stats", "{\"target\":\"vcpu\"}"}};
+    size_t expected = rounds * num_domains * commands.size();
+
+    size_t mux_ok = 0;
+    double mux_ms;
+    {
+        QmpMux mux;
+        for (size_t i = 0; i < num_domains; i++) mux.add("vm" + std::to_string(i), paths[i]);
+        mux.query(commands, 5000);  // connect and negotiate outside the timing
+        mux_ms = benchMedianMs(1, [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                for (const auto& reply : mux.query(commands, 5000)) mux_ok += reply.ok;
+            }
+        });
+    }
+
+    // One connection per monitor as well, kept open, so only the round trips differ
+    size_t serial_ok = 0;
+    double serial_ms;
+    {
+        std::vector<std::unique_ptr<SerialClient>> clients;
+        for (const auto& path : paths) {
+            clients.push_back(std::make_unique<SerialClient>());
+            if (!clients.back()->connect(path)) return 1;
+        }
+        serial_ms = benchMedianMs(1, [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                for (auto& client : clients) {
+                    for (const auto& cmd : commands) serial_ok += client->call(cmd);
+                }
+            }
+        });
+    }
+    monitors.clear();
+    rmdir(dir);
+
+    benchReport("domains", static_cast<double>(num_domains), "");
+    benchReport("replies per round", static_cast<double>(num_domains * commands.size()), "");
+    benchReport("monitor service time per command", static_cast<double>(service_us), "us");
+    benchReport("QmpMux replies per second", static_cast<double>(mux_ok) / (mux_ms / 1000.0), "/s");
+    benchReport("one-at-a-time replies per second", static_cast<double>(serial_ok) / (serial_ms / 1000.0), "/s");
+    benchReport("QmpMux time per round", mux_ms / static_cast<double>(rounds), "ms");
+    return mux_ok == expected && serial_ok == expected ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+// Reservation admission and reservation-aware placement on a synthetic fleet
+//
+// Usage: bench_reservation [hosts] [reservations] [placements]   (default 100, 1000000, 20000)
+#include "placement.h"
+
+#include <cstdlib>
+#include <random>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    size_t num_hosts = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100;
+    size_t num_reservations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+    size_t num_placements = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 20000;
+
+    FleetModel fleet;
+    std::vector<std::string> pool;
+    for (size_t h = 0; h < num_hosts; h++) {
+        FleetHost host;
+        host.uri = "host" + std::to_string(h);
+        host.memory_kib = 4096ull << 20;
+        host.cpus = 4096;
+        fleet.upsertHost(host);
+        pool.push_back(host.uri);
+    }
+    ReservationBook book;
+    book.syncFleet(fleet, 0);
+
+    // A year of windows from an hour to a week, a few GiB each
+    const uint64_t hour = 3600ull * 1000, year = 365 * 24 * hour;
+    std::mt19937_64 rng(17);
+    std::uniform_int_distribution<uint64_t> start(0, year), length(hour, 7 * 24 * hour);
+    std::uniform_int_distribution<unsigned> gib(1, 16);
+    std::vector<Reservation> requests;
+    for (size_t i = 0; i < num_reservations; i++) {
+        Reservation r;
+        r.id = "r" + std::to_string(i);
+        r.host = pool[i % num_hosts];
+        r.memory_kib = static_cast<uint64_t>(gib(rng)) << 20;
+        r.vcpus = gib(rng);
+        r.start_ms = start(rng);
+        r.end_ms = r.start_ms + length(rng);
+        requests.push_back(r);
+    }
+    size_t accepted = 0;
+    std::string error;
+    double reserve_ms = benchMedianMs(1, [&] {
+        for (const auto& r : requests) accepted += book.reserve(r, error);
+    });
+
+    // Placements now must fit under every future reservation of their host
+    PlacementScheduler sched;
+    sched.rebuild(fleet);
+    sched.useReservations(&book);
+    size_t placed = 0;
+    double place_ms = benchMedianMs(1, [&] {
+        for (size_t i = 0; i < num_placements; i++) {
+            FleetVM vm;
+            vm.name = "vm" + std::to_string(i);
+            vm.memory_kib = static_cast<uint64_t>(gib(rng)) << 20;
+            vm.vcpus = 2;
+            if (!sched.place(fleet, vm, error, "", 1).empty()) placed++;
+        }
+    });
+
+    benchReport("hosts", static_cast<double>(num_hosts), "");
+    benchReport("reservations accepted", static_cast<double>(accepted), "");
+    benchReport("reservations refused", static_cast<double>(num_reservations - accepted), "");
+    benchReport("time per reserve", reserve_ms * 1000.0 / static_cast<double>(num_reservations), "us");
+    benchReport("placements made", static_cast<double>(placed), "");
+    benchReport("time per reservation-aware placement", place_ms * 1000.0 / static_cast<double>(num_placements), "us");
+    return accepted ? 0 : 1;
+}
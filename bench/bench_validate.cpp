@@ -0,0 +1,60 @@
+// Spec validation against cached hypervisor limits
+//
+// Usage: bench_validate [specs]   (default 1000000)
+#include "validate.h"
+
+#include <cstdlib>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    size_t num_specs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::string caps = "<capabilities><guest><os_type>hvm</os_type><arch name='x86_64'>"
+                       "<emulator>/usr/bin/qemu-system-x86_64</emulator>";
+    for (int i = 0; i < 40; i++) caps += "<machine maxCpus='255'>pc-i440fx-" + std::to_string(i) + "</machine>";
+    caps += "<machine canonical='pc-q35-8.2' maxCpus='4096'>q35</machine>"
+            "<domain type='qemu'/><domain type='kvm'/></arch></guest></capabilities>";
+    std::string domcaps = "<domainCapabilities><machine>pc-q35-8.2</machine><vcpu max='4096'/>"
+                          "<cpu><mode name='host-model' supported='yes'><model>Icelake-Server</model>"
+                          "<feature policy='disable' name='hle'/></mode></cpu></domainCapabilities>";
+    std::string expanded = "<cpu>";
+    for (const char* f : {"sse4.2", "avx", "avx2", "avx512f", "vmx", "aes", "pdpe1gb", "x2apic"}) {
+        expanded += "<feature policy='require' name='" + std::string(f) + "'/>";
+    }
+    expanded += "</cpu>";
+
+    std::string emulator;
+    HypervisorLimits limits;
+    double parse_ms = benchMedianMs(5, [&] {
+        emulator = capabilitiesEmulator(caps, "kvm");
+        limits = parseHypervisorLimits(caps, domcaps, "kvm", expanded);
+    });
+    if (emulator.empty()) return 1;
+    limits.host_cpus = 64;
+
+    // Every fourth spec is invalid (unknown machine, too many vCPUs or a missing feature)
+    std::vector<VMSpec> specs(4);
+    for (size_t i = 0; i < specs.size(); i++) {
+        specs[i].name = "vm" + std::to_string(i);
+        specs[i].memory = 4096;
+        specs[i].vcpus = 8;
+        specs[i].machine = i % 2 ? "q35" : "pc-i440fx-39";
+        specs[i].cpu_features = {"avx2", "aes"};
+    }
+    specs[3].cpu_features.push_back("hle");
+    size_t rejected = 0;
+    double ms = benchMedianMs(5, [&] {
+        rejected = 0;
+        for (size_t i = 0; i < num_specs; i++) {
+            if (!validateVMSpec(specs[i % specs.size()], "kvm", &limits).empty()) rejected++;
+        }
+    });
+    if (rejected != num_specs / 4) return 1;
+
+    benchReport("specs validated", static_cast<double>(num_specs), "");
+    benchReport("specs rejected", static_cast<double>(rejected), "");
+    benchReport("parse capabilities (once per virt type)", parse_ms * 1000.0, "us");
+    benchReport("time per validation", ms * 1e6 / static_cast<double>(num_specs), "ns");
+    return 0;
+}
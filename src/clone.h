@@ -0,0 +1,115 @@
+// Memory-snapshot clone templates
+#ifndef CLONE_H
+#define CLONE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "xml.h"
+
+/**
+ * @brief A saved template VM that clones are restored from.
+ *
+ * `save_path` holds the template's memory image and `base_disk` its disk at
+ * the moment of the save; both must stay untouched while clones exist, since
+ * every clone resumes from that memory state on an overlay of that disk.
+ */
+struct CloneTemplate {
+    std::string name;
+    std::string save_path;
+    std::string base_disk;
+    std::string base_format = "qcow2";  // image format of `base_disk`
+    std::string xml;        // domain XML embedded in the save image
+    std::string uuid;       // shared by every clone restored from the image
+    std::string interface;  // NIC detached before saving, re-plugged per clone
+};
+
+/**
+ * @brief Per-clone identity applied when restoring from a template.
+ *
+ * There is no per-clone UUID: libvirt's ABI check rejects a restore XML whose
+ * UUID differs from the saved domain's, so clones keep the template's.
+ */
+struct CloneIdentity {
+    std::string name;
+    std::string mac;
+    std::string disk_path;  // qcow2 overlay backed by the template's disk
+};
+
+struct CloneReport {
+    size_t requested = 0;
+    size_t restored = 0;
+    double elapsed_ms = 0.0;
+
+    double clonesPerSecond() const { return elapsed_ms > 0 ? restored * 1000.0 / elapsed_ms : 0.0; }
+};
+
+/**
+ * @brief Generates a random MAC address in the QEMU/KVM OUI (52:54:00).
+ */
+inline std::string generateMAC() {
+    static thread_local std::mt19937 rng{std::random_device{}()};
+    char buf[18];
+    snprintf(buf, sizeof(buf), "52:54:00:%02x:%02x:%02x", static_cast<unsigned>(rng() & 0xff),
+             static_cast<unsigned>(rng() & 0xff), static_cast<unsigned>(rng() & 0xff));
+    return buf;
+}
+
+/**
+ * @brief Rewrites a template's saved domain XML with a clone's identity.
+ *
+ * Replaces the domain name and points the first file-backed disk at the
+ * clone's overlay; the UUID is left as saved, which libvirt requires for a
+ * restore. The MAC is not part of the restore XML either: the template is
+ * saved without a NIC and the clone's interface is hot-plugged after restore
+ * (see cloneInterfaceXML()).
+ *
+ * @param xml Domain XML from the template's save image.
+ * @param id Identity of the clone.
+ * @return std::string Domain XML for `virDomainRestoreFlags`.
+ */
+inline std::string rewriteCloneXML(const std::string& xml, const CloneIdentity& id) {
+    std::string out = xml;
+    xmlReplaceElement(out, "name", "<name>" + xmlEscape(id.name) + "</name>");
+
+    size_t begin, end, from = 0;
+    while (xmlFindElement(out, "disk", from, begin, end)) {
+        std::string disk = out.substr(begin, end - begin);
+        if (xmlAttr(disk, "device") == "disk" && xmlAttr(disk, "type") == "file") {
+            size_t src_begin, src_end;
+            if (xmlFindElement(out, "source", begin, src_begin, src_end) && src_end <= end) {
+                xmlSetAttr(out, src_begin, "file", id.disk_path);
+            }
+            // The overlay is qcow2 regardless of the template's format
+            size_t drv_begin, drv_end;
+            if (xmlFindElement(out, "driver", begin, drv_begin, drv_end) && drv_end <= end) {
+                xmlSetAttr(out, drv_begin, "type", "qcow2");
+            }
+            break;
+        }
+        from = end;
+    }
+    return out;
+}
+
+/**
+ * @brief Builds the interface XML hot-plugged into a restored clone.
+ *
+ * Device aliases, PCI addresses and host-side target names are dropped so that
+ * libvirt assigns fresh ones.
+ */
+inline std::string cloneInterfaceXML(const std::string& interface, const std::string& mac) {
+    std::string out = interface;
+    xmlRemoveElements(out, "mac");
+    xmlRemoveElements(out, "alias");
+    xmlRemoveElements(out, "address");
+    xmlRemoveElements(out, "target");
+    size_t start_end = out.find('>');
+    if (start_end == std::string::npos) return out;
+    out.insert(start_end + 1, "<mac address='" + mac + "'/>");
+    return out;
+}
+
+#endif // CLONE_H
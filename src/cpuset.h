@@ -0,0 +1,67 @@
+// Host CPU set parsing and formatting
+#ifndef CPUSET_H
+#define CPUSET_H
+
+#include <cstdint>
+#include <set>
+#include <string>
+
+// Highest CPU id + 1 accepted in a cpuset, as in libvirt's cpumask
+constexpr uint64_t cpuset_max_cpus = 8192;
+
+/**
+ * @brief Parses one end of a cpuset range; false if it is not a CPU id below cpuset_max_cpus.
+ */
+inline bool parseCpusetId(const std::string& text, uint64_t& id) {
+    if (text.empty() || text.size() > 5 || text.find_first_not_of("0123456789") != std::string::npos) return false;
+    id = std::stoull(text);
+    return id < cpuset_max_cpus;
+}
+
+/**
+ * @brief Parses a libvirt/kernel cpuset string ("0-3,8,^2") into CPU ids.
+ *
+ * @return std::set<unsigned> The CPUs in the set; empty if the string is malformed
+ * (open or reversed ranges, ids of cpuset_max_cpus or more).
+ */
+inline std::set<unsigned> parseCpuset(const std::string& cpuset) {
+    std::set<unsigned> cpus;
+    size_t pos = 0;
+    while (pos < cpuset.size()) {
+        size_t comma = cpuset.find(',', pos);
+        std::string item = cpuset.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? cpuset.size() : comma + 1;
+        while (!item.empty() && (item.back() == '\n' || item.back() == ' ')) item.pop_back();
+        if (item.empty()) continue;
+
+        bool exclude = item[0] == '^';
+        if (exclude) item.erase(0, 1);
+        size_t dash = item.find('-');
+        uint64_t first, last;
+        if (!parseCpusetId(item.substr(0, dash), first)) return {};
+        if (dash == std::string::npos) last = first;
+        else if (!parseCpusetId(item.substr(dash + 1), last) || last < first) return {};
+        for (uint64_t c = first; c <= last; c++) {
+            if (exclude) cpus.erase(static_cast<unsigned>(c));
+            else cpus.insert(static_cast<unsigned>(c));
+        }
+    }
+    return cpus;
+}
+
+/**
+ * @brief Formats CPU ids as a compact cpuset string ("0-3,8").
+ */
+inline std::string formatCpuset(const std::set<unsigned>& cpus) {
+    std::string out;
+    for (auto it = cpus.begin(); it != cpus.end();) {
+        unsigned first = *it, last = *it;
+        for (++it; it != cpus.end() && *it == last + 1; ++it) last = *it;
+        if (!out.empty()) out += ",";
+        out += std::to_string(first);
+        if (last != first) out += "-" + std::to_string(last);
+    }
+    return out;
+}
+
+#endif // CPUSET_H
@@ -0,0 +1,348 @@
+// Canonical domain config digests and Merkle trees for drift detection
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "xml.h"
+
+using Digest = std::array<uint8_t, 32>;
+
+/**
+ * @brief SHA-256 (FIPS 180-4) of a byte string.
+ */
+inline Digest sha256(const std::string& data) {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+
+    std::string msg = data;
+    uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+    msg += static_cast<char>(0x80);
+    while (msg.size() % 64 != 56) msg += '\0';
+    for (int i = 7; i >= 0; i--) msg += static_cast<char>((bits >> (i * 8)) & 0xff);
+
+    for (size_t off = 0; off < msg.size(); off += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            const auto* p = reinterpret_cast<const uint8_t*>(msg.data() + off + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+
+    Digest out;
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++) out[i * 4 + j] = static_cast<uint8_t>(h[i] >> (24 - j * 8));
+    }
+    return out;
+}
+
+inline std::string digestHex(const Digest& d) {
+    static const char* hex = "0123456789abcdef";
+    std::string out;
+    for (uint8_t b : d) {
+        out += hex[b >> 4];
+        out += hex[b & 0xf];
+    }
+    return out;
+}
+
+// Elements libvirt generates or that do not describe the guest's configuration
+static const std::vector<std::string> volatile_config_elements = {"uuid", "alias", "seclabel", "metadata"};
+
+/**
+ * @brief Rewrites domain XML into a canonical form for hashing.
+ *
+ * Volatile elements and auto-assigned device addresses (`<address type=...>`)
+ * are dropped, whitespace between tags and comments are removed, attributes
+ * are sorted and single-quoted, and `<x></x>` becomes `<x/>`, so equivalent
+ * configs produce identical bytes.
+ */
+inline std::string canonicalizeDomainXML(const std::string& domain_xml) {
+    std::string xml = domain_xml;
+    for (const auto& tag : volatile_config_elements) xmlRemoveElements(xml, tag);
+    size_t begin, end, from = 0;
+    while (xmlFindElement(xml, "address", from, begin, end)) {
+        if (!xmlAttr(xml.substr(begin, end - begin), "type").empty()) {
+            xml.erase(begin, end - begin);
+            from = begin;
+        } else {
+            from = end;
+        }
+    }
+
+    std::string out;
+    size_t open_start = std::string::npos;  // where the last start tag was emitted, if nothing followed it
+    size_t pos = 0;
+    while (pos < xml.size()) {
+        if (xml[pos] != '<') {
+            size_t next = xml.find('<', pos);
+            std::string text = xml.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+            size_t first = text.find_first_not_of(" \t\r\n");
+            if (first != std::string::npos) {
+                size_t last = text.find_last_not_of(" \t\r\n");
+                out += text.substr(first, last - first + 1);
+                open_start = std::string::npos;
+            }
+            pos = next == std::string::npos ? xml.size() : next;
+            continue;
+        }
+        if (xml.compare(pos, 4, "<!--") == 0) {
+            size_t close = xml.find("-->", pos);
+            pos = close == std::string::npos ? xml.size() : close + 3;
+            continue;
+        }
+        if (xml.compare(pos, 2, "<?") == 0) {
+            size_t close = xml.find("?>", pos);
+            pos = close == std::string::npos ? xml.size() : close + 2;
+            continue;
+        }
+
+        // Find the end of the tag, skipping '>' inside quoted attribute values
+        size_t cur = pos + 1;
+        char quote = 0;
+        for (; cur < xml.size(); cur++) {
+            if (quote) {
+                if (xml[cur] == quote) quote = 0;
+            } else if (xml[cur] == '\'' || xml[cur] == '"') {
+                quote = xml[cur];
+            } else if (xml[cur] == '>') {
+                break;
+            }
+        }
+        std::string tag = xml.substr(pos + 1, cur - pos - 1);
+        pos = cur + 1;
+
+        if (!tag.empty() && tag[0] == '/') {
+            std::string name = tag.substr(1);
+            name.erase(name.find_last_not_of(" \t\r\n") + 1);
+            if (open_start != std::string::npos) {
+                out.insert(out.size() - 1, "/");  // <x ...></x> -> <x .../>
+            } else {
+                out += "</" + name + ">";
+            }
+            open_start = std::string::npos;
+            continue;
+        }
+
+        bool self_closing = !tag.empty() && tag.back() == '/';
+        if (self_closing) tag.pop_back();
+        size_t name_end = tag.find_first_of(" \t\r\n");
+        std::string name = tag.substr(0, name_end);
+        std::vector<std::pair<std::string, std::string>> attrs;
+        size_t a = name_end;
+        while (a != std::string::npos && a < tag.size()) {
+            a = tag.find_first_not_of(" \t\r\n", a);
+            if (a == std::string::npos) break;
+            size_t eq = tag.find('=', a);
+            if (eq == std::string::npos) break;
+            std::string key = tag.substr(a, eq - a);
+            key.erase(key.find_last_not_of(" \t\r\n") + 1);
+            size_t vstart = tag.find_first_of("'\"", eq);
+            if (vstart == std::string::npos) break;
+            size_t vend = tag.find(tag[vstart], vstart + 1);
+            if (vend == std::string::npos) break;
+            std::string value = tag.substr(vstart + 1, vend - vstart - 1);
+            for (size_t q = value.find('\''); q != std::string::npos; q = value.find('\'', q)) {
+                value.replace(q, 1, "&apos;");
+            }
+            attrs.emplace_back(key, value);
+            a = vend + 1;
+        }
+        std::sort(attrs.begin(), attrs.end());
+
+        size_t start = out.size();
+        out += "<" + name;
+        for (const auto& [key, value] : attrs) out += " " + key + "='" + value + "'";
+        out += self_closing ? "/>" : ">";
+        open_start = self_closing ? std::string::npos : start;
+    }
+    return out;
+}
+
+/**
+ * @brief Digest of a domain's canonical config.
+ */
+inline Digest digestDomainXML(const std::string& domain_xml) {
+    return sha256(canonicalizeDomainXML(domain_xml));
+}
+
+/**
+ * @brief Differences between a desired and an actual config tree.
+ */
+struct DriftReport {
+    std::vector<std::string> missing;     // desired but not defined
+    std::vector<std::string> unexpected;  // defined but not desired
+    std::vector<std::string> changed;     // defined with a different config
+    size_t nodes_compared = 0;            // tree nodes visited to find the differences
+
+    bool clean() const { return missing.empty() && unexpected.empty() && changed.empty(); }
+};
+
+/**
+ * @brief Merkle tree over the config digests of one host's domains.
+ *
+ * Domains hash into a fixed number of buckets by name, so two trees with the
+ * same bucket count line up node for node whatever domains they hold. Equal
+ * roots mean identical configs; otherwise diff() descends only into subtrees
+ * whose digests differ. Nodes are recomputed lazily, after updates, on the
+ * next root()/diff().
+ */
+class ConfigMerkle {
+    private:
+        size_t width;                                            // bucket count, a power of two
+        std::vector<std::map<std::string, Digest>> buckets;
+        mutable std::vector<Digest> nodes;                       // 1-based heap, leaves at [width, 2*width)
+        mutable std::vector<bool> dirty;                         // per bucket
+        mutable bool stale = false;
+
+        size_t bucketOf(const std::string& name) const {
+            uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+            for (unsigned char c : name) {
+                hash ^= c;
+                hash *= 1099511628211ULL;
+            }
+            return hash & (width - 1);
+        }
+
+        void refresh() const {
+            if (!stale) return;
+            for (size_t b = 0; b < width; b++) {
+                if (!dirty[b]) continue;
+                dirty[b] = false;
+                if (buckets[b].empty()) {
+                    nodes[width + b] = Digest{};
+                    continue;
+                }
+                std::string leaf;
+                for (const auto& [name, digest] : buckets[b]) {
+                    leaf += name;
+                    leaf += '\0';
+                    leaf.append(reinterpret_cast<const char*>(digest.data()), digest.size());
+                }
+                nodes[width + b] = sha256(leaf);
+            }
+            for (size_t n = width - 1; n >= 1; n--) {
+                const Digest& l = nodes[2 * n];
+                const Digest& r = nodes[2 * n + 1];
+                if (l == Digest{} && r == Digest{}) {
+                    nodes[n] = Digest{};
+                    continue;
+                }
+                std::string pair(reinterpret_cast<const char*>(l.data()), l.size());
+                pair.append(reinterpret_cast<const char*>(r.data()), r.size());
+                nodes[n] = sha256(pair);
+            }
+            stale = false;
+        }
+
+        void diffNode(const ConfigMerkle& actual, size_t n, DriftReport& report) const {
+            report.nodes_compared++;
+            if (nodes[n] == actual.nodes[n]) return;
+            if (n < width) {
+                diffNode(actual, 2 * n, report);
+                diffNode(actual, 2 * n + 1, report);
+                return;
+            }
+            const auto& want = buckets[n - width];
+            const auto& have = actual.buckets[n - width];
+            for (const auto& [name, digest] : want) {
+                auto it = have.find(name);
+                if (it == have.end()) report.missing.push_back(name);
+                else if (it->second != digest) report.changed.push_back(name);
+            }
+            for (const auto& [name, digest] : have) {
+                if (!want.count(name)) report.unexpected.push_back(name);
+            }
+        }
+
+    public:
+        explicit ConfigMerkle(size_t bucket_count = 256) {
+            width = 1;
+            while (width < bucket_count) width *= 2;
+            buckets.resize(width);
+            nodes.assign(2 * width, Digest{});
+            dirty.assign(width, false);
+        }
+
+        void set(const std::string& name, const Digest& digest) {
+            size_t b = bucketOf(name);
+            buckets[b][name] = digest;
+            dirty[b] = true;
+            stale = true;
+        }
+
+        void remove(const std::string& name) {
+            size_t b = bucketOf(name);
+            if (buckets[b].erase(name)) {
+                dirty[b] = true;
+                stale = true;
+            }
+        }
+
+        const Digest& root() const {
+            refresh();
+            return nodes[1];
+        }
+
+        size_t bucketCount() const { return width; }
+
+        /**
+         * @brief Compares this (desired) tree with an actual one.
+         *
+         * Trees with different bucket counts cannot be aligned and are compared
+         * domain by domain.
+         */
+        DriftReport diff(const ConfigMerkle& actual) const {
+            DriftReport report;
+            refresh();
+            actual.refresh();
+            if (width == actual.width) {
+                diffNode(actual, 1, report);
+                return report;
+            }
+            std::map<std::string, Digest> want, have;
+            for (const auto& b : buckets) want.insert(b.begin(), b.end());
+            for (const auto& b : actual.buckets) have.insert(b.begin(), b.end());
+            for (const auto& [name, digest] : want) {
+                auto it = have.find(name);
+                if (it == have.end()) report.missing.push_back(name);
+                else if (it->second != digest) report.changed.push_back(name);
+            }
+            for (const auto& [name, digest] : have) {
+                if (!want.count(name)) report.unexpected.push_back(name);
+            }
+            return report;
+        }
+};
+
+#endif // DIGEST_H
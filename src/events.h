@@ -0,0 +1,287 @@
+// Domain event coalescing and batched dispatch
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <libvirt/libvirt.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief A domain lifecycle event as delivered to subscribers.
+ *
+ * `coalesced` counts how many earlier events for the same domain were folded
+ * into this one during the coalescing window.
+ */
+struct DomainEvent {
+    std::string domain;
+    int event = 0;   // VIR_DOMAIN_EVENT_* type
+    int detail = 0;  // event-specific detail code
+    std::chrono::steady_clock::time_point received;
+    uint32_t coalesced = 0;
+};
+
+using EventBatchHandler = std::function<void(const std::vector<DomainEvent>&)>;
+
+struct EventStats {
+    uint64_t received = 0;
+    uint64_t coalesced = 0;     // events folded into a later one and never dispatched
+    uint64_t dispatched = 0;
+    uint64_t batches = 0;
+    uint64_t handler_cpu_ns = 0; // CPU time spent inside subscriber handlers
+};
+
+/**
+ * @brief Maps a lifecycle event to the domain state it leaves the domain in.
+ *
+ * @return int A `VIR_DOMAIN_*` state, or -1 if the event does not imply one
+ * (definition changes) or the domain no longer exists (undefine).
+ */
+inline int eventToState(int event) {
+    switch (event) {
+        case VIR_DOMAIN_EVENT_STARTED:
+        case VIR_DOMAIN_EVENT_RESUMED: return VIR_DOMAIN_RUNNING;
+        case VIR_DOMAIN_EVENT_SUSPENDED: return VIR_DOMAIN_PAUSED;
+        case VIR_DOMAIN_EVENT_STOPPED: return VIR_DOMAIN_SHUTOFF;
+        case VIR_DOMAIN_EVENT_SHUTDOWN: return VIR_DOMAIN_SHUTDOWN;
+        case VIR_DOMAIN_EVENT_PMSUSPENDED: return VIR_DOMAIN_PMSUSPENDED;
+        case VIR_DOMAIN_EVENT_CRASHED: return VIR_DOMAIN_CRASHED;
+        default: return -1;
+    }
+}
+
+/**
+ * @brief Process-wide libvirt default event loop running on its own thread.
+ *
+ * libvirt only delivers domain events to connections opened after an event
+ * implementation is registered, so start() must be called before connecting.
+ */
+class LibvirtEventLoop {
+    private:
+        std::thread loop;
+        std::mutex mutex;
+        bool running;
+        int wakeup_timer;
+
+        LibvirtEventLoop() : running(false), wakeup_timer(-1) {}
+
+        // Periodic no-op timeout so virEventRunDefaultImpl() returns and can observe stop()
+        static void wakeup(int, void*) {}
+
+    public:
+        ~LibvirtEventLoop() { stop(); }
+
+        static LibvirtEventLoop& instance() {
+            static LibvirtEventLoop loop;
+            return loop;
+        }
+
+        bool start() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (running) return true;
+            static bool registered = false;
+            if (!registered) {
+                if (virEventRegisterDefaultImpl() < 0) return false;
+                registered = true;
+            }
+            wakeup_timer = virEventAddTimeout(1000, wakeup, nullptr, nullptr);
+            running = true;
+            loop = std::thread([this] {
+                while (true) {
+                    {
+                        std::lock_guard<std::mutex> guard(mutex);
+                        if (!running) break;
+                    }
+                    if (virEventRunDefaultImpl() < 0) break;
+                }
+            });
+            return true;
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!running) return;
+                running = false;
+            }
+            if (loop.joinable()) loop.join();
+            if (wakeup_timer >= 0) virEventRemoveTimeout(wakeup_timer);
+            wakeup_timer = -1;
+        }
+};
+
+/**
+ * @brief Buffers domain events over a short window and dispatches them in batches.
+ *
+ * Within a window, a new event for a domain replaces the domain's last pending
+ * event when only the final state matters: run-state transitions collapse into
+ * the latest one, and repeated definitions collapse into one. Undefines and
+ * crashes are never folded away, so subscribers always see a domain
+ * disappear or crash even if it was recreated or restarted in the same window.
+ *
+ * Batches are delivered on a single dispatcher thread once the oldest pending
+ * event is `window` old or `max_batch` domains have pending events. Without
+ * start(), flush() dispatches synchronously on the caller's thread.
+ */
+class EventCoalescer {
+    private:
+        std::chrono::milliseconds window;
+        size_t max_batch;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<DomainEvent> pending;                           // in arrival order
+        std::unordered_map<std::string, size_t> last_pending;       // domain -> index in `pending`
+        std::vector<EventBatchHandler> handlers;
+        EventStats counters;
+        std::thread dispatcher;
+        bool running;
+
+        static bool isStateTransition(int event) {
+            return eventToState(event) >= 0;
+        }
+
+        static bool coalescable(const DomainEvent& older, const DomainEvent& newer) {
+            if (older.event == VIR_DOMAIN_EVENT_CRASHED) return false;
+            if (isStateTransition(older.event) && isStateTransition(newer.event)) return true;
+            return older.event == VIR_DOMAIN_EVENT_DEFINED && newer.event == VIR_DOMAIN_EVENT_DEFINED;
+        }
+
+        static uint64_t threadCpuNanos() {
+            struct timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+        }
+
+        std::vector<DomainEvent> takePending() {
+            std::vector<DomainEvent> batch;
+            batch.swap(pending);
+            last_pending.clear();
+            return batch;
+        }
+
+        void dispatch(const std::vector<DomainEvent>& batch, const std::vector<EventBatchHandler>& targets) {
+            if (batch.empty()) return;
+            uint64_t cpu_start = threadCpuNanos();
+            for (const auto& handler : targets) handler(batch);
+            uint64_t cpu_used = threadCpuNanos() - cpu_start;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.dispatched += batch.size();
+            counters.batches++;
+            counters.handler_cpu_ns += cpu_used;
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (running) {
+                cv.wait(lock, [this] { return !running || !pending.empty(); });
+                if (!running) break;
+
+                auto deadline = pending.front().received + window;
+                cv.wait_until(lock, deadline, [this] { return !running || pending.size() >= max_batch; });
+
+                std::vector<DomainEvent> batch = takePending();
+                std::vector<EventBatchHandler> targets = handlers;
+                lock.unlock();
+                dispatch(batch, targets);
+                lock.lock();
+            }
+        }
+
+    public:
+        explicit EventCoalescer(std::chrono::milliseconds window = std::chrono::milliseconds(50),
+                                size_t max_batch = 4096)
+            : window(window), max_batch(max_batch), running(false) {}
+        ~EventCoalescer() { stop(); }
+
+        EventCoalescer(const EventCoalescer&) = delete;
+        EventCoalescer& operator=(const EventCoalescer&) = delete;
+
+        /**
+         * @brief Changes the coalescing window for subsequent batches.
+         */
+        void setWindow(std::chrono::milliseconds new_window) {
+            std::lock_guard<std::mutex> lock(mutex);
+            window = new_window;
+        }
+
+        /**
+         * @brief Registers a handler that receives every dispatched batch.
+         */
+        void subscribe(EventBatchHandler handler) {
+            std::lock_guard<std::mutex> lock(mutex);
+            handlers.push_back(std::move(handler));
+        }
+
+        /**
+         * @brief Queues an event, folding it into the domain's pending event when allowed.
+         */
+        void push(DomainEvent event) {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.received++;
+            auto it = last_pending.find(event.domain);
+            if (it != last_pending.end() && coalescable(pending[it->second], event)) {
+                DomainEvent& slot = pending[it->second];
+                event.coalesced = slot.coalesced + 1;
+                event.received = slot.received;  // keep the window anchored to the first event
+                slot = std::move(event);
+                counters.coalesced++;
+                return;
+            }
+            last_pending[event.domain] = pending.size();
+            pending.push_back(std::move(event));
+            if (pending.size() == 1 || pending.size() >= max_batch) cv.notify_one();
+        }
+
+        /**
+         * @brief Dispatches everything pending on the calling thread.
+         */
+        void flush() {
+            std::vector<DomainEvent> batch;
+            std::vector<EventBatchHandler> targets;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                batch = takePending();
+                targets = handlers;
+            }
+            dispatch(batch, targets);
+        }
+
+        /**
+         * @brief Starts the background dispatcher thread.
+         */
+        void start() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (running) return;
+            running = true;
+            dispatcher = std::thread(&EventCoalescer::run, this);
+        }
+
+        /**
+         * @brief Stops the dispatcher thread and delivers whatever is still pending.
+         */
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!running) return;
+                running = false;
+            }
+            cv.notify_all();
+            if (dispatcher.joinable()) dispatcher.join();
+            flush();
+        }
+
+        EventStats stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return counters;
+        }
+};
+
+#endif // EVENTS_H
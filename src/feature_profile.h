@@ -0,0 +1,181 @@
+// Paravirtual guest feature profiles (Hyper-V enlightenments, KVM PV features, clocks, PMU)
+#ifndef FEATURE_PROFILE_H
+#define FEATURE_PROFILE_H
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "xml.h"
+
+/**
+ * @brief A `<clock>` timer: `present` and `tickpolicy` are omitted when empty.
+ */
+struct TimerSpec {
+    std::string name;
+    std::string present;
+    std::string tickpolicy;
+};
+
+/**
+ * @brief A named set of guest-visible platform features.
+ *
+ * Hyper-V enlightenments let Windows use paravirtual timers, IPIs and TLB
+ * flushes instead of trapping on APIC and MSR accesses; Linux guests get the
+ * equivalent from kvmclock and the KVM PV features. Disabling the virtual PMU
+ * avoids the exits caused by guests programming perf counters.
+ */
+struct FeatureProfile {
+    std::string name;
+    std::vector<std::string> hyperv;      // enlightenments, in dependency order
+    unsigned spinlock_retries = 8191;     // used when "spinlocks" is enabled
+    std::vector<std::string> kvm;         // KVM PV features (poll-control, pv-ipi, ...)
+    bool kvm_hidden = false;              // hide the KVM signature (vendor GPU drivers)
+    std::string clock_offset = "utc";
+    std::vector<TimerSpec> timers;
+    std::optional<bool> pmu;              // unset leaves the hypervisor default
+};
+
+/**
+ * @brief Built-in profiles, selected by `VMSpec::profile`.
+ *
+ * "generic" keeps the plain acpi/apic block. The Hyper-V list is ordered so
+ * each enlightenment follows those it depends on (synic needs vpindex, stimer
+ * needs synic and the reference clock).
+ */
+static const std::map<std::string, FeatureProfile> feature_profiles = {
+    {"generic", {"generic", {}, 8191, {}, false, "utc", {}, std::nullopt}},
+    {"linux", {"linux", {}, 8191, {"poll-control", "pv-ipi"}, false, "utc",
+               {{"kvmclock", "yes", ""}, {"rtc", "", "catchup"}, {"pit", "", "delay"}, {"hpet", "no", ""}},
+               false}},
+    {"windows", {"windows",
+                 {"relaxed", "vapic", "spinlocks", "vpindex", "runtime", "synic", "stimer", "reset",
+                  "frequencies", "tlbflush", "ipi"},
+                 8191, {}, false, "localtime",
+                 {{"hypervclock", "yes", ""}, {"rtc", "", "catchup"}, {"pit", "", "delay"}, {"hpet", "no", ""}},
+                 false}},
+    {"windows-gpu", {"windows-gpu",
+                     {"relaxed", "vapic", "spinlocks", "vpindex", "runtime", "synic", "stimer", "reset",
+                      "frequencies", "tlbflush", "ipi"},
+                     8191, {}, true, "localtime",
+                     {{"hypervclock", "yes", ""}, {"rtc", "", "catchup"}, {"pit", "", "delay"}, {"hpet", "no", ""}},
+                     false}},
+};
+
+/**
+ * @brief Looks up a profile by name; unknown or empty names yield "generic".
+ */
+inline const FeatureProfile& findFeatureProfile(const std::string& name) {
+    auto it = feature_profiles.find(name);
+    return it == feature_profiles.end() ? feature_profiles.at("generic") : it->second;
+}
+
+/**
+ * @brief Builds the `<features>` element for a profile.
+ */
+inline std::string buildFeaturesXML(const FeatureProfile& profile) {
+    std::string xml = "  <features>"
+                      "    <acpi/>"
+                      "    <apic/>";
+    if (!profile.hyperv.empty()) {
+        xml += "    <hyperv mode='custom'>";
+        for (const auto& f : profile.hyperv) {
+            if (f == "spinlocks") {
+                xml += "      <spinlocks state='on' retries='" + std::to_string(profile.spinlock_retries) + "'/>";
+            } else {
+                xml += "      <" + f + " state='on'/>";
+            }
+        }
+        xml += "    </hyperv>";
+    }
+    if (!profile.kvm.empty() || profile.kvm_hidden) {
+        xml += "    <kvm>";
+        if (profile.kvm_hidden) xml += "      <hidden state='on'/>";
+        for (const auto& f : profile.kvm) xml += "      <" + f + " state='on'/>";
+        xml += "    </kvm>";
+    }
+    if (profile.pmu) xml += std::string("    <pmu state='") + (*profile.pmu ? "on" : "off") + "'/>";
+    return xml + "  </features>";
+}
+
+/**
+ * @brief Builds the `<clock>` element for a profile (empty for profiles without timers).
+ */
+inline std::string buildClockXML(const FeatureProfile& profile) {
+    if (profile.timers.empty() && profile.clock_offset == "utc") return "";
+    std::string xml = "  <clock offset='" + xmlEscape(profile.clock_offset) + "'>";
+    for (const auto& t : profile.timers) {
+        xml += "    <timer name='" + xmlEscape(t.name) + "'";
+        if (!t.present.empty()) xml += " present='" + t.present + "'";
+        if (!t.tickpolicy.empty()) xml += " tickpolicy='" + t.tickpolicy + "'";
+        xml += "/>";
+    }
+    return xml + "  </clock>";
+}
+
+/**
+ * @brief Drops the parts of a profile that the hypervisor does not support.
+ *
+ * Hyper-V enlightenments are checked against the `<hyperv>` enum of domain
+ * capabilities (all are dropped if Hyper-V is unsupported); KVM PV features
+ * and kvmclock/hypervclock need a KVM domain.
+ *
+ * @param profile Requested profile.
+ * @param domcaps Output of `virConnectGetDomainCapabilities`.
+ * @param dropped Names of the features that were removed.
+ * @return FeatureProfile The profile restricted to supported features.
+ */
+inline FeatureProfile filterFeatureProfile(const FeatureProfile& profile, const std::string& domcaps,
+                                           std::vector<std::string>& dropped) {
+    FeatureProfile result = profile;
+    bool kvm = xmlChildText(domcaps, "domain") == "kvm";
+
+    std::string hyperv = xmlElement(xmlElement(domcaps, "features"), "hyperv");
+    bool hyperv_ok = kvm && xmlAttr(hyperv, "supported") == "yes";
+    std::set<std::string> supported;
+    bool listed = false;
+    for (const auto& e : xmlElements(hyperv, "enum")) {
+        if (xmlAttr(e, "name") != "features") continue;
+        listed = true;
+        for (const auto& v : xmlElements(e, "value")) supported.insert(xmlText(v));
+    }
+    // An enlightenment is only usable if the ones it builds on are kept
+    static const std::map<std::string, std::vector<std::string>> hyperv_deps = {
+        {"synic", {"vpindex"}},
+        {"stimer", {"synic"}},
+        {"tlbflush", {"vpindex"}},
+        {"ipi", {"vpindex"}},
+    };
+    std::set<std::string> kept;
+    result.hyperv.clear();
+    for (const auto& f : profile.hyperv) {
+        bool ok = hyperv_ok && (!listed || supported.count(f));
+        auto deps = hyperv_deps.find(f);
+        if (ok && deps != hyperv_deps.end()) {
+            for (const auto& d : deps->second) ok = ok && kept.count(d);
+        }
+        if (ok) {
+            kept.insert(f);
+            result.hyperv.push_back(f);
+        } else {
+            dropped.push_back("hyperv/" + f);
+        }
+    }
+
+    if (!kvm) {
+        for (const auto& f : profile.kvm) dropped.push_back("kvm/" + f);
+        result.kvm.clear();
+        if (profile.kvm_hidden) dropped.push_back("kvm/hidden");
+        result.kvm_hidden = false;
+        result.timers.clear();
+        for (const auto& t : profile.timers) {
+            if (t.name == "kvmclock" || t.name == "hypervclock") dropped.push_back("timer/" + t.name);
+            else result.timers.push_back(t);
+        }
+    }
+    return result;
+}
+
+#endif // FEATURE_PROFILE_H
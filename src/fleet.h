@@ -0,0 +1,377 @@
+// Fleet-wide host/VM capacity model and consolidation planning
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Guest capacity of one host NUMA cell.
+ */
+struct FleetCell {
+    uint64_t memory_kib = 0;
+    unsigned cpus = 0;
+};
+
+/**
+ * @brief A hypervisor host in the fleet model, identified by its connection URI.
+ */
+struct FleetHost {
+    std::string uri;
+    std::string rack;              // topology labels for placement constraints
+    std::string zone;
+    uint64_t memory_kib = 0;       // memory available to guests
+    unsigned cpus = 0;             // vCPUs available to guests (after any overcommit)
+    uint64_t used_memory_kib = 0;
+    unsigned used_vcpus = 0;
+    bool schedulable = true;       // false: never a migration target (maintenance, draining)
+    std::vector<FleetCell> cells;  // NUMA cells; empty = one cell spanning the host
+
+    uint64_t freeMemory() const { return memory_kib > used_memory_kib ? memory_kib - used_memory_kib : 0; }
+    unsigned freeVcpus() const { return cpus > used_vcpus ? cpus - used_vcpus : 0; }
+    bool fits(uint64_t mem, unsigned vcpus) const { return freeMemory() >= mem && freeVcpus() >= vcpus; }
+};
+
+/**
+ * @brief A guest in the fleet model.
+ *
+ * `migration_cost` is in arbitrary units; the default of one unit per GiB of
+ * memory approximates the pre-copy transfer. Raise it for VMs with high dirty
+ * rates or latency-sensitive workloads.
+ */
+struct FleetVM {
+    std::string name;
+    std::string host;
+    uint64_t memory_kib = 0;
+    unsigned vcpus = 1;
+    double migration_cost = 0.0;   // 0: derived from memory size
+    bool movable = true;           // false for pinned/realtime/passthrough guests
+    std::map<std::string, std::string> labels;  // e.g. app=db, matched by placement rules
+    int cell = -1;                 // host NUMA cell the VM is confined to; -1 = unknown
+
+    double cost() const {
+        return migration_cost > 0.0 ? migration_cost : static_cast<double>(memory_kib) / (1024.0 * 1024.0);
+    }
+};
+
+/**
+ * @brief Cached capacity and placement of hosts and VMs across connections.
+ */
+class FleetModel {
+    private:
+        std::map<std::string, FleetHost> hosts;
+        std::unordered_map<std::string, FleetVM> vms;
+        std::map<std::string, std::set<std::string>> vms_by_host;
+
+    public:
+        /**
+         * @brief Adds or replaces a host; its usage is recomputed from the VMs placed on it.
+         */
+        void upsertHost(const FleetHost& host) {
+            FleetHost& h = hosts[host.uri];
+            h = host;
+            h.used_memory_kib = 0;
+            h.used_vcpus = 0;
+            for (const auto& name : vms_by_host[host.uri]) {
+                h.used_memory_kib += vms.at(name).memory_kib;
+                h.used_vcpus += vms.at(name).vcpus;
+            }
+        }
+
+        /**
+         * @brief Adds or replaces a VM, moving its usage to its (possibly new) host.
+         *
+         * @return true if the VM's host is known, false otherwise (the VM is not added).
+         */
+        bool upsertVM(const FleetVM& vm) {
+            if (!hosts.count(vm.host)) return false;
+            removeVM(vm.name);
+            vms[vm.name] = vm;
+            vms_by_host[vm.host].insert(vm.name);
+            FleetHost& h = hosts.at(vm.host);
+            h.used_memory_kib += vm.memory_kib;
+            h.used_vcpus += vm.vcpus;
+            return true;
+        }
+
+        void removeVM(const std::string& name) {
+            auto it = vms.find(name);
+            if (it == vms.end()) return;
+            FleetHost& h = hosts.at(it->second.host);
+            h.used_memory_kib -= std::min(h.used_memory_kib, it->second.memory_kib);
+            h.used_vcpus -= std::min(h.used_vcpus, it->second.vcpus);
+            vms_by_host[it->second.host].erase(name);
+            vms.erase(it);
+        }
+
+        /**
+         * @brief Removes a host and every VM recorded on it.
+         */
+        void removeHost(const std::string& uri) {
+            for (const auto& name : std::set<std::string>(vms_by_host[uri])) removeVM(name);
+            vms_by_host.erase(uri);
+            hosts.erase(uri);
+        }
+
+        /**
+         * @brief Moves a VM to another host in the model (after a migration).
+         */
+        bool moveVM(const std::string& name, const std::string& to) {
+            auto it = vms.find(name);
+            if (it == vms.end() || !hosts.count(to)) return false;
+            FleetVM vm = it->second;
+            vm.host = to;
+            return upsertVM(vm);
+        }
+
+        const std::map<std::string, FleetHost>& getHosts() const { return hosts; }
+        const std::unordered_map<std::string, FleetVM>& getVMs() const { return vms; }
+
+        const FleetHost* host(const std::string& uri) const {
+            auto it = hosts.find(uri);
+            return it == hosts.end() ? nullptr : &it->second;
+        }
+
+        const FleetVM* vm(const std::string& name) const {
+            auto it = vms.find(name);
+            return it == vms.end() ? nullptr : &it->second;
+        }
+
+        const std::set<std::string>& vmsOn(const std::string& uri) const {
+            static const std::set<std::string> none;
+            auto it = vms_by_host.find(uri);
+            return it == vms_by_host.end() ? none : it->second;
+        }
+};
+
+/**
+ * @brief One planned live migration.
+ */
+struct Migration {
+    std::string vm;
+    std::string from;
+    std::string to;
+    double cost = 0.0;
+};
+
+/**
+ * @brief Bounds and goal of a consolidation plan.
+ *
+ * Without a shape goal the planner frees as many hosts as the budgets allow;
+ * with one it stops as soon as `shape_count` hosts can each fit the shape.
+ */
+struct ConsolidationPolicy {
+    size_t max_migrations = 100;
+    double max_total_cost = 1e18;
+    double max_vm_cost = 1e18;          // never move a single VM costlier than this
+    unsigned max_concurrent = 8;        // migrations running at once, fleet-wide
+    unsigned max_per_host = 2;          // concurrent migrations touching one host (in or out)
+    double max_target_utilization = 0.9;  // don't fill targets beyond this fraction of memory/vCPUs
+    uint64_t shape_memory_kib = 0;
+    unsigned shape_vcpus = 0;
+    unsigned shape_count = 0;
+};
+
+/**
+ * @brief The outcome of consolidation planning.
+ *
+ * `waves` partitions `migrations` into batches that respect the concurrency
+ * limits; a wave should complete before the next one starts.
+ */
+struct ConsolidationPlan {
+    std::vector<Migration> migrations;
+    std::vector<std::vector<Migration>> waves;
+    unsigned max_concurrent = 8;  // fleet-wide limit the executor enforces within a wave
+    std::vector<std::string> freed_hosts;
+    double total_cost = 0.0;
+    bool goal_met = false;
+};
+
+/**
+ * @brief Splits migrations into waves honouring fleet-wide and per-host concurrency.
+ */
+inline std::vector<std::vector<Migration>> scheduleMigrationWaves(const std::vector<Migration>& migrations,
+                                                                  unsigned max_concurrent, unsigned max_per_host) {
+    std::vector<std::vector<Migration>> waves;
+    std::vector<std::map<std::string, unsigned>> per_host;
+    max_concurrent = std::max(1u, max_concurrent);
+    max_per_host = std::max(1u, max_per_host);
+    for (const auto& m : migrations) {
+        size_t w = 0;
+        for (; w < waves.size(); w++) {
+            if (waves[w].size() < max_concurrent && per_host[w][m.from] < max_per_host &&
+                per_host[w][m.to] < max_per_host) break;
+        }
+        if (w == waves.size()) {
+            waves.emplace_back();
+            per_host.emplace_back();
+        }
+        waves[w].push_back(m);
+        per_host[w][m.from]++;
+        per_host[w][m.to]++;
+    }
+    return waves;
+}
+
+/**
+ * @brief Plans live migrations that consolidate load onto fewer hosts.
+ *
+ * Hosts are drained emptiest first. A host is drained only if every one of
+ * its VMs fits elsewhere within the budgets, placed largest first on the
+ * fullest host that still fits (best fit), so hosts are either emptied
+ * completely or left alone. Hosts that receive VMs are never drained later,
+ * so no VM moves twice. Targets are found in a free-memory index that leaves
+ * out hosts without vCPU headroom; a search still steps over indexed hosts
+ * with too few vCPUs for the VM at hand, so a plan is O(V log H) for V VMs on
+ * H hosts only while memory is the tighter resource, and O(V H) at worst.
+ *
+ * @param fleet Current fleet model (not modified).
+ * @param policy Budgets and goal.
+ * @return ConsolidationPlan The migrations, their waves and the hosts they free.
+ */
+inline ConsolidationPlan planConsolidation(const FleetModel& fleet, const ConsolidationPolicy& policy) {
+    ConsolidationPlan plan;
+    const auto& hosts = fleet.getHosts();
+
+    struct Slot {
+        uint64_t mem_cap, mem_free;
+        unsigned cpu_cap, cpu_free;
+    };
+    std::map<std::string, Slot> slots;
+    // Free memory -> hosts with that much headroom under the utilization cap
+    std::multimap<uint64_t, std::string> by_free;
+    std::map<std::string, std::multimap<uint64_t, std::string>::iterator> index;
+    auto headroom = [&](const Slot& s) {
+        uint64_t cap = static_cast<uint64_t>(s.mem_cap * policy.max_target_utilization);
+        return cap > s.mem_cap - s.mem_free ? cap - (s.mem_cap - s.mem_free) : 0;
+    };
+    auto cpuHeadroom = [&](const Slot& s) {
+        unsigned cap = static_cast<unsigned>(s.cpu_cap * policy.max_target_utilization);
+        return cap > s.cpu_cap - s.cpu_free ? cap - (s.cpu_cap - s.cpu_free) : 0u;
+    };
+    // Hosts without vCPU headroom can take no VM: keep them out of the index so
+    // searches do not walk past memory-rich but CPU-bound hosts
+    auto reindex = [&](const std::string& uri) {
+        auto it = index.find(uri);
+        if (it != index.end()) {
+            by_free.erase(it->second);
+            index.erase(it);
+        }
+        const Slot& s = slots.at(uri);
+        if (cpuHeadroom(s) > 0) index[uri] = by_free.emplace(headroom(s), uri);
+    };
+    auto unindex = [&](const std::string& uri) {
+        auto it = index.find(uri);
+        if (it == index.end()) return;
+        by_free.erase(it->second);
+        index.erase(it);
+    };
+    auto shapeHosts = [&]() {
+        unsigned n = 0;
+        for (const auto& [uri, s] : slots) {
+            if (s.mem_free >= policy.shape_memory_kib && s.cpu_free >= policy.shape_vcpus) n++;
+        }
+        return n;
+    };
+    bool shape_goal = policy.shape_count > 0;
+
+    for (const auto& [uri, h] : hosts) {
+        slots[uri] = Slot{h.memory_kib, h.freeMemory(), h.cpus, h.freeVcpus()};
+        if (h.schedulable) reindex(uri);
+    }
+    if (shape_goal && shapeHosts() >= policy.shape_count) {
+        plan.goal_met = true;
+        return plan;
+    }
+
+    // Drain candidates: non-empty hosts, least memory used first
+    std::vector<std::string> candidates;
+    for (const auto& [uri, h] : hosts) {
+        if (!fleet.vmsOn(uri).empty()) candidates.push_back(uri);
+    }
+    std::sort(candidates.begin(), candidates.end(), [&](const std::string& a, const std::string& b) {
+        const FleetHost& ha = hosts.at(a);
+        const FleetHost& hb = hosts.at(b);
+        if (ha.used_memory_kib != hb.used_memory_kib) return ha.used_memory_kib < hb.used_memory_kib;
+        return a < b;
+    });
+
+    std::set<std::string> targets;  // hosts that received VMs; never drained
+    for (const auto& uri : candidates) {
+        if (targets.count(uri)) continue;
+        const auto& names = fleet.vmsOn(uri);
+        if (plan.migrations.size() + names.size() > policy.max_migrations) continue;
+
+        std::vector<const FleetVM*> vms;
+        double cost = 0.0;
+        bool movable = true;
+        for (const auto& name : names) {
+            const FleetVM* vm = fleet.vm(name);
+            if (!vm->movable || vm->cost() > policy.max_vm_cost) {
+                movable = false;
+                break;
+            }
+            cost += vm->cost();
+            vms.push_back(vm);
+        }
+        if (!movable || plan.total_cost + cost > policy.max_total_cost) continue;
+        std::sort(vms.begin(), vms.end(), [](const FleetVM* a, const FleetVM* b) {
+            if (a->memory_kib != b->memory_kib) return a->memory_kib > b->memory_kib;
+            return a->name < b->name;
+        });
+
+        // Tentatively place every VM; undo if any does not fit
+        unindex(uri);
+        std::vector<Migration> moves;
+        bool placed_all = true;
+        for (const FleetVM* vm : vms) {
+            auto it = by_free.lower_bound(vm->memory_kib);
+            while (it != by_free.end() && cpuHeadroom(slots.at(it->second)) < vm->vcpus) ++it;
+            if (it == by_free.end()) {
+                placed_all = false;
+                break;
+            }
+            std::string to = it->second;
+            Slot& s = slots.at(to);
+            s.mem_free -= vm->memory_kib;
+            s.cpu_free -= vm->vcpus;
+            reindex(to);
+            moves.push_back(Migration{vm->name, uri, to, vm->cost()});
+        }
+        if (!placed_all) {
+            for (const auto& m : moves) {
+                Slot& s = slots.at(m.to);
+                const FleetVM* vm = fleet.vm(m.vm);
+                s.mem_free += vm->memory_kib;
+                s.cpu_free += vm->vcpus;
+                reindex(m.to);
+            }
+            if (hosts.at(uri).schedulable) reindex(uri);
+            continue;
+        }
+
+        Slot& drained = slots.at(uri);
+        drained.mem_free = drained.mem_cap;
+        drained.cpu_free = drained.cpu_cap;
+        for (const auto& m : moves) targets.insert(m.to);
+        plan.migrations.insert(plan.migrations.end(), moves.begin(), moves.end());
+        plan.total_cost += cost;
+        plan.freed_hosts.push_back(uri);
+        if (shape_goal && shapeHosts() >= policy.shape_count) {
+            plan.goal_met = true;
+            break;
+        }
+    }
+    if (!shape_goal) plan.goal_met = !plan.freed_hosts.empty();
+    plan.waves = scheduleMigrationWaves(plan.migrations, policy.max_concurrent, policy.max_per_host);
+    plan.max_concurrent = std::max(1u, policy.max_concurrent);
+    return plan;
+}
+
+#endif // FLEET_H
@@ -0,0 +1,141 @@
+// IOThread polling control from block latency and host CPU headroom
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+#include <libvirt/libvirt.h>
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "spec.h"
+
+/**
+ * @brief Thresholds of the IOThread polling controller.
+ *
+ * Polling trades host CPU for block latency: while guests see slow I/O and
+ * the host has idle CPU the poll window is doubled, and it is halved once
+ * latency is comfortably low or the host runs short of CPU.
+ */
+struct PollingPolicy {
+    double target_latency_us = 200.0;  // grow polling while average latency is above this
+    double relax_latency_us = 25.0;    // shrink polling while average latency is below this
+    double min_host_idle = 0.20;       // shrink polling while host idle CPU fraction is below this
+    uint64_t min_poll_ns = 4096;       // smallest non-zero window; halving below it disables polling
+    uint64_t max_poll_ns = 256000;
+};
+
+/**
+ * @brief Cumulative block I/O counters and IOThread polling settings of one domain,
+ * from a bulk-stats record.
+ */
+struct BlockLatencySample {
+    uint64_t requests = 0;  // read + write + flush requests, all disks
+    uint64_t time_ns = 0;   // total time spent in those requests
+    std::map<unsigned, IOThreadPolling> iothreads;
+};
+
+/**
+ * @brief Cumulative host CPU time, from `virNodeGetCPUStats`.
+ */
+struct HostCpuSample {
+    uint64_t idle_ns = 0;   // idle + iowait
+    uint64_t total_ns = 0;
+};
+
+/**
+ * @brief Extracts block and IOThread stats from a bulk-stats parameter list.
+ *
+ * Reads `block.<n>.{rd,wr,fl}.{reqs,times}` and
+ * `iothread.<id>.poll-{max-ns,grow,shrink}`; other fields are ignored.
+ */
+inline BlockLatencySample parseBlockLatencyStats(const virTypedParameter* params, int nparams) {
+    BlockLatencySample sample;
+    for (int i = 0; i < nparams; i++) {
+        std::string field(params[i].field);
+        uint64_t value;
+        switch (params[i].type) {
+            case VIR_TYPED_PARAM_ULLONG: value = params[i].value.ul; break;
+            case VIR_TYPED_PARAM_LLONG:  value = static_cast<uint64_t>(params[i].value.l); break;
+            case VIR_TYPED_PARAM_UINT:   value = params[i].value.ui; break;
+            case VIR_TYPED_PARAM_INT:    value = static_cast<uint64_t>(params[i].value.i); break;
+            default: continue;
+        }
+
+        size_t dot = field.rfind('.');
+        if (dot == std::string::npos) continue;
+        std::string leaf = field.substr(dot + 1);
+        if (field.compare(0, 6, "block.") == 0) {
+            // block.<n>.rd.reqs, block.<n>.fl.times, ...
+            std::string op = field.substr(0, dot);
+            op = op.substr(op.rfind('.') + 1);
+            if (op != "rd" && op != "wr" && op != "fl") continue;
+            if (leaf == "reqs") sample.requests += value;
+            else if (leaf == "times") sample.time_ns += value;
+        } else if (field.compare(0, 9, "iothread.") == 0) {
+            size_t id_end = field.find('.', 9);
+            if (id_end == std::string::npos) continue;  // iothread.count
+            std::string id = field.substr(9, id_end - 9);
+            if (id.empty() || id.find_first_not_of("0123456789") != std::string::npos) continue;
+            std::string key = field.substr(id_end + 1);
+            IOThreadPolling& p = sample.iothreads[static_cast<unsigned>(std::stoul(id))];
+            if (key == "poll-max-ns") p.max_ns = value;
+            else if (key == "poll-grow") p.grow = static_cast<unsigned>(value);
+            else if (key == "poll-shrink") p.shrink = static_cast<unsigned>(value);
+        }
+    }
+    return sample;
+}
+
+/**
+ * @brief Average block request latency between two samples, in microseconds.
+ *
+ * @return double Latency, or a negative value if no requests completed in between.
+ */
+inline double computeBlockLatencyUs(const BlockLatencySample& prev, const BlockLatencySample& cur) {
+    if (cur.requests <= prev.requests || cur.time_ns < prev.time_ns) return -1.0;
+    return static_cast<double>(cur.time_ns - prev.time_ns) / (cur.requests - prev.requests) / 1000.0;
+}
+
+/**
+ * @brief Fraction of host CPU time spent idle between two samples.
+ *
+ * Without a previous sample the ratio since boot is returned.
+ */
+inline double computeHostIdle(const HostCpuSample* prev, const HostCpuSample& cur) {
+    uint64_t idle = cur.idle_ns, total = cur.total_ns;
+    if (prev && cur.total_ns > prev->total_ns && cur.idle_ns >= prev->idle_ns) {
+        idle -= prev->idle_ns;
+        total -= prev->total_ns;
+    }
+    return total ? static_cast<double>(idle) / total : 0.0;
+}
+
+/**
+ * @brief Decides an IOThread's next polling window.
+ *
+ * @param current Current polling settings of the iothread.
+ * @param latency_us Average block latency of the domain over the last interval,
+ * negative if it did no I/O.
+ * @param host_idle Fraction of host CPU idle over the last interval.
+ * @param policy Controller thresholds.
+ * @return IOThreadPolling New settings; equal to `current` when no change is needed.
+ */
+inline IOThreadPolling decideIOThreadPolling(const IOThreadPolling& current, double latency_us, double host_idle,
+                                             const PollingPolicy& policy) {
+    IOThreadPolling next = current;
+    auto shrink = [&] { next.max_ns = current.max_ns / 2 < policy.min_poll_ns ? 0 : current.max_ns / 2; };
+
+    if (host_idle < policy.min_host_idle) {
+        shrink();
+    } else if (latency_us < 0) {
+        // No I/O: nothing to learn, and QEMU does not poll an idle iothread anyway
+    } else if (latency_us > policy.target_latency_us) {
+        next.max_ns = std::min(policy.max_poll_ns, std::max(policy.min_poll_ns, current.max_ns * 2));
+    } else if (latency_us < policy.relax_latency_us) {
+        shrink();
+    }
+    return next;
+}
+
+#endif // IOTHREAD_H
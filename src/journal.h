@@ -0,0 +1,473 @@
+// Write-ahead journal of mutating VMManager operations
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+enum class JournalOp {
+    Create = 0,
+    Start = 1,
+    Stop = 2,
+    Destroy = 3,
+    Undefine = 4,
+    Restore = 5,
+    Update = 6,
+    Migrate = 7,
+};
+
+static const std::map<JournalOp, std::string> journal_op_strings = {
+    {JournalOp::Create, "create"},
+    {JournalOp::Start, "start"},
+    {JournalOp::Stop, "stop"},
+    {JournalOp::Destroy, "destroy"},
+    {JournalOp::Undefine, "undefine"},
+    {JournalOp::Restore, "restore"},
+    {JournalOp::Update, "update"},
+    {JournalOp::Migrate, "migrate"},
+};
+
+/**
+ * @brief Packs two strings into one journal payload as `<first_len>\n<first><second>`.
+ */
+inline std::string packJournalPayload(const std::string& first, const std::string& second) {
+    return std::to_string(first.size()) + "\n" + first + second;
+}
+
+/**
+ * @brief Splits a payload built by packJournalPayload().
+ *
+ * @return true if `payload` was well-formed, false otherwise.
+ */
+inline bool unpackJournalPayload(const std::string& payload, std::string& first, std::string& second) {
+    size_t eol = payload.find('\n');
+    if (eol == std::string::npos || eol == 0) return false;
+    size_t len = std::strtoull(payload.substr(0, eol).c_str(), nullptr, 10);
+    if (eol + 1 + len > payload.size()) return false;
+    first = payload.substr(eol + 1, len);
+    second = payload.substr(eol + 1 + len);
+    return true;
+}
+
+/**
+ * @brief An operation whose intent was journaled.
+ *
+ * `payload` carries whatever recovery needs to replay or roll back the
+ * operation: the domain XML for creates and undefines, the save image path and
+ * restore XML for restores, the previous and new XML for config updates,
+ * the destination URI for migrations, empty otherwise.
+ */
+struct JournalEntry {
+    uint64_t id = 0;
+    JournalOp op = JournalOp::Create;
+    std::string domain;
+    std::string payload;
+};
+
+struct JournalStats {
+    uint64_t records = 0;          // intent + completion records appended
+    uint64_t syncs = 0;            // fdatasync calls issued
+    uint64_t commit_wait_ns = 0;   // total time callers spent waiting for durability
+    uint64_t commits = 0;          // durable (waited-for) intent records
+    uint64_t checkpoints = 0;      // compactions down to the open intents
+
+    double recordsPerSync() const { return syncs ? static_cast<double>(records) / syncs : 0.0; }
+    double avgCommitMicros() const { return commits ? commit_wait_ns / 1000.0 / commits : 0.0; }
+};
+
+/**
+ * @brief Append-only operation journal with group-commit fsync batching.
+ *
+ * Every mutating operation writes an intent record before touching libvirt and
+ * a completion record afterwards. Intents are durable before begin() returns;
+ * concurrent callers share a single fdatasync (the first waiter flushes the
+ * whole pending buffer on behalf of the others). Completions are buffered and
+ * ride along with the next flush, since losing one only causes recovery to
+ * re-check an operation that already finished.
+ *
+ * Record layout: a header line `I <id> <op> <domain_len> <payload_len> <sum>`
+ * followed by the raw domain and payload bytes and a newline, or
+ * `C <id> <ok> <sum>` for completions. A torn or corrupt tail is discarded on
+ * open.
+ *
+ * A failed write or sync puts the batch back in front of `pending` and cuts the
+ * file back to its last durable length, so the next flush rewrites it whole. If
+ * the file cannot be cut back the journal is marked failed and refuses new
+ * intents. Once the file outgrows the checkpoint size it is compacted down to
+ * the open intents as soon as an operation completes.
+ */
+class OperationJournal {
+    private:
+        int fd;
+        std::string path;
+        mutable std::mutex mutex;
+        std::condition_variable flushed_cv;
+        std::string pending;          // encoded records not yet written
+        uint64_t next_id;
+        uint64_t appended_seq;        // sequence of the last record added to `pending`
+        uint64_t durable_seq;         // sequence of the last record known to be on disk
+        size_t durable_bytes;         // file length up to the last successful sync
+        size_t checkpoint_bytes;      // compact once the file grows past this
+        bool flushing;
+        bool failed;                  // file could not be restored after a failed flush
+        std::map<uint64_t, JournalEntry> open_ops;   // intents without a completion
+        JournalStats counters;
+
+        static uint64_t checksum(const std::string& data) {
+            uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+            for (unsigned char c : data) {
+                hash ^= c;
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        static std::string encodeIntent(const JournalEntry& e) {
+            std::string body = e.domain + e.payload;
+            std::ostringstream out;
+            out << "I " << e.id << ' ' << static_cast<int>(e.op) << ' ' << e.domain.size() << ' '
+                << e.payload.size() << ' ' << checksum(body) << '\n' << body << '\n';
+            return out.str();
+        }
+
+        static std::string encodeCompletion(uint64_t id, bool ok) {
+            std::string key = std::to_string(id) + (ok ? "1" : "0");
+            return "C " + std::to_string(id) + ' ' + (ok ? "1" : "0") + ' ' + std::to_string(checksum(key)) + '\n';
+        }
+
+        /**
+         * @brief Writes pending records and syncs them until `seq` is durable.
+         *
+         * Must be called with `lock` held. Whoever finds no flush in progress becomes
+         * the leader and flushes everything buffered so far; everyone else waits.
+         */
+        bool waitDurable(std::unique_lock<std::mutex>& lock, uint64_t seq) {
+            while (durable_seq < seq) {
+                if (failed) return false;
+                if (flushing) {
+                    flushed_cv.wait(lock);
+                    continue;
+                }
+                flushing = true;
+                std::string batch;
+                batch.swap(pending);
+                uint64_t batch_seq = appended_seq;
+                lock.unlock();
+
+                bool ok = writeAll(fd, batch) && fdatasync(fd) == 0;
+
+                lock.lock();
+                flushing = false;
+                counters.syncs++;
+                if (ok) {
+                    durable_seq = batch_seq;
+                    durable_bytes += batch.size();
+                } else {
+                    // Rewrite the batch with the next flush rather than leave a torn record
+                    // mid-file or a gap that a later durable_seq would paper over
+                    pending.insert(0, batch);
+                    if (ftruncate(fd, static_cast<off_t>(durable_bytes)) < 0) failed = true;
+                }
+                flushed_cv.notify_all();
+                if (!ok) {
+                    std::cerr << "Failed to sync operation journal '" << path << "'"
+                              << (failed ? ", refusing further operations" : "") << "\n";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool writeAll(int out, const std::string& data) {
+            size_t off = 0;
+            while (off < data.size()) {
+                ssize_t n = ::write(out, data.data() + off, data.size() - off);
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0) return false;
+                off += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        /**
+         * @brief Rewrites the journal to hold only the open intents.
+         *
+         * Must be called with the lock held and no flush in progress. Buffered records
+         * are dropped: completions are reflected by their intent being left out, and
+         * every open intent is written out again. With nothing open the file is simply
+         * truncated; otherwise the intents go to a temporary file that replaces the
+         * journal, so a crash leaves either the old or the new file.
+         */
+        bool compactLocked() {
+            std::string live;
+            for (const auto& [id, entry] : open_ops) live += encodeIntent(entry);
+
+            if (live.empty()) {
+                if (ftruncate(fd, 0) < 0 || fdatasync(fd) < 0) {
+                    std::cerr << "Failed to checkpoint operation journal '" << path << "'\n";
+                    return false;
+                }
+            } else {
+                std::string tmp = path + ".tmp";
+                int tmp_fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+                if (tmp_fd < 0) {
+                    std::cerr << "Failed to checkpoint operation journal '" << path << "'\n";
+                    return false;
+                }
+                if (!writeAll(tmp_fd, live) || fdatasync(tmp_fd) < 0 || ::rename(tmp.c_str(), path.c_str()) < 0) {
+                    ::close(tmp_fd);
+                    ::unlink(tmp.c_str());
+                    std::cerr << "Failed to checkpoint operation journal '" << path << "'\n";
+                    return false;
+                }
+                ::close(fd);
+                fd = tmp_fd;
+                syncDirectory();
+            }
+            pending.clear();
+            durable_seq = appended_seq;
+            durable_bytes = live.size();
+            counters.checkpoints++;
+            flushed_cv.notify_all();
+            return true;
+        }
+
+        /**
+         * @brief Makes a rename of the journal file durable.
+         */
+        void syncDirectory() {
+            size_t slash = path.rfind('/');
+            std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+            int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd < 0) return;
+            fsync(dir_fd);
+            ::close(dir_fd);
+        }
+
+        /**
+         * @brief Parses an existing journal, returning the byte length of its valid prefix.
+         */
+        size_t replay(const std::string& data) {
+            size_t pos = 0;
+            while (pos < data.size()) {
+                size_t eol = data.find('\n', pos);
+                if (eol == std::string::npos) break;
+                std::istringstream header(data.substr(pos, eol - pos));
+                char kind = 0;
+                header >> kind;
+
+                if (kind == 'I') {
+                    JournalEntry e;
+                    int op = 0;
+                    size_t dlen = 0, plen = 0;
+                    uint64_t sum = 0;
+                    if (!(header >> e.id >> op >> dlen >> plen >> sum)) break;
+                    size_t body_start = eol + 1;
+                    if (body_start + dlen + plen + 1 > data.size()) break;
+                    std::string body = data.substr(body_start, dlen + plen);
+                    if (checksum(body) != sum || data[body_start + dlen + plen] != '\n') break;
+                    e.op = static_cast<JournalOp>(op);
+                    e.domain = body.substr(0, dlen);
+                    e.payload = body.substr(dlen);
+                    if (e.id >= next_id) next_id = e.id + 1;
+                    open_ops[e.id] = e;
+                    pos = body_start + dlen + plen + 1;
+                } else if (kind == 'C') {
+                    uint64_t id = 0, sum = 0;
+                    int ok = 0;
+                    if (!(header >> id >> ok >> sum)) break;
+                    if (checksum(std::to_string(id) + (ok ? "1" : "0")) != sum) break;
+                    open_ops.erase(id);
+                    pos = eol + 1;
+                } else {
+                    break;
+                }
+            }
+            return pos;
+        }
+
+    public:
+        static constexpr size_t default_checkpoint_bytes = 4 << 20;
+
+        OperationJournal()
+            : fd(-1), next_id(1), appended_seq(0), durable_seq(0), durable_bytes(0),
+              checkpoint_bytes(default_checkpoint_bytes), flushing(false), failed(false) {}
+        ~OperationJournal() { close(); }
+
+        OperationJournal(const OperationJournal&) = delete;
+        OperationJournal& operator=(const OperationJournal&) = delete;
+
+        /**
+         * @brief Opens (or creates) the journal at `journal_path` and loads in-flight operations.
+         *
+         * A torn record at the end of the file, left by a crash mid-write, is truncated away.
+         *
+         * @param journal_path Path of the journal file.
+         * @return true if the journal was opened successfully, false otherwise.
+         */
+        bool open(const std::string& journal_path) {
+            close();
+            path = journal_path;
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+            if (fd < 0) {
+                std::cerr << "Failed to open operation journal '" << path << "'\n";
+                return false;
+            }
+
+            std::string data;
+            char buf[65536];
+            ssize_t n;
+            while ((n = ::pread(fd, buf, sizeof(buf), static_cast<off_t>(data.size()))) > 0) {
+                data.append(buf, static_cast<size_t>(n));
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            open_ops.clear();
+            pending.clear();
+            failed = false;
+            size_t valid = replay(data);
+            durable_bytes = valid;
+            if (valid < data.size()) {
+                std::cerr << "Discarding " << data.size() - valid << " bytes of torn journal tail\n";
+                if (ftruncate(fd, static_cast<off_t>(valid)) < 0) {
+                    std::cerr << "Failed to truncate operation journal '" << path << "'\n";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief Flushes buffered completions and closes the journal file.
+         */
+        void close() {
+            if (fd < 0) return;
+            sync();
+            ::close(fd);
+            fd = -1;
+        }
+
+        bool isOpen() const { return fd >= 0; }
+
+        /**
+         * @brief Sets the file size past which a completion triggers a checkpoint.
+         */
+        void setCheckpointBytes(size_t bytes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            checkpoint_bytes = bytes;
+        }
+
+        /**
+         * @brief Durably records the intent to perform an operation.
+         *
+         * @param op Operation about to be performed.
+         * @param domain Domain name the operation targets.
+         * @param payload Data needed to replay or roll back the operation.
+         * @return uint64_t Operation id to pass to complete(), or 0 if the intent
+         * could not be made durable; the operation must not be performed then.
+         */
+        uint64_t begin(JournalOp op, const std::string& domain, const std::string& payload = "") {
+            auto started = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(mutex);
+            if (fd < 0 || failed) {
+                std::cerr << "Failed to journal operation on '" << domain << "': journal "
+                          << (failed ? "failed" : "closed") << "\n";
+                return 0;
+            }
+            JournalEntry e{next_id++, op, domain, payload};
+            pending += encodeIntent(e);
+            uint64_t seq = ++appended_seq;
+            counters.records++;
+            open_ops[e.id] = e;
+
+            if (!waitDurable(lock, seq)) {
+                // The intent may still reach disk with a later flush; close it so
+                // recovery does not act on an operation that never ran
+                pending += encodeCompletion(e.id, false);
+                ++appended_seq;
+                counters.records++;
+                open_ops.erase(e.id);
+                return 0;
+            }
+            counters.commits++;
+            counters.commit_wait_ns += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - started).count());
+            return e.id;
+        }
+
+        /**
+         * @brief Records that an operation finished (successfully or not).
+         *
+         * The completion is buffered and written with the next group commit. Once
+         * the file has grown past the checkpoint size, it is compacted here.
+         *
+         * @param id Operation id returned by begin().
+         * @param ok Whether the operation succeeded.
+         */
+        void complete(uint64_t id, bool ok) {
+            if (id == 0) return;
+            std::lock_guard<std::mutex> lock(mutex);
+            pending += encodeCompletion(id, ok);
+            ++appended_seq;
+            counters.records++;
+            open_ops.erase(id);
+            if (!flushing && !failed && durable_bytes + pending.size() >= checkpoint_bytes) compactLocked();
+        }
+
+        /**
+         * @brief Forces all buffered records to disk.
+         */
+        bool sync() {
+            std::unique_lock<std::mutex> lock(mutex);
+            return waitDurable(lock, appended_seq);
+        }
+
+        /**
+         * @brief Compacts the journal down to the operations still in flight.
+         *
+         * @return true if the journal was compacted, false on failure.
+         */
+        bool checkpoint() {
+            std::unique_lock<std::mutex> lock(mutex);
+            flushed_cv.wait(lock, [this] { return !flushing; });
+            if (fd < 0 || failed) return false;
+            return compactLocked();
+        }
+
+        /**
+         * @brief Current size of the journal file, including buffered records.
+         */
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return durable_bytes + pending.size();
+        }
+
+        /**
+         * @brief Returns operations whose intent was recorded without a completion.
+         */
+        std::vector<JournalEntry> inFlight() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<JournalEntry> result;
+            for (const auto& [id, entry] : open_ops) result.push_back(entry);
+            return result;
+        }
+
+        JournalStats stats() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return counters;
+        }
+};
+
+#endif // JOURNAL_H
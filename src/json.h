@@ -0,0 +1,259 @@
+// Minimal JSON reader and string quoting for QMP and other line protocols
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A parsed JSON value.
+ *
+ * Integers are also kept exactly, in `integer` and, when non-negative, in
+ * `uinteger`: counters such as byte totals exceed the 53 bits of a double.
+ */
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Array, Object } type = Null;
+    bool boolean = false;
+    double number = 0.0;
+    int64_t integer = 0;
+    uint64_t uinteger = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    bool has(const std::string& key) const { return type == Object && object.count(key) > 0; }
+
+    /**
+     * @return const JsonValue& The member `key`, or a null value if this is not an object or lacks it.
+     */
+    const JsonValue& operator[](const std::string& key) const {
+        static const JsonValue null_value;
+        if (type != Object) return null_value;
+        auto it = object.find(key);
+        return it == object.end() ? null_value : it->second;
+    }
+
+    uint64_t asUint() const {
+        return type == Number ? uinteger : 0;
+    }
+};
+
+namespace json_detail {
+
+inline void skipSpace(const std::string& s, size_t& i) {
+    while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r' || s[i] == '\n')) i++;
+}
+
+inline void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+inline bool parseHex4(const std::string& s, size_t& i, uint32_t& cp) {
+    if (i + 4 > s.size()) return false;
+    cp = 0;
+    for (size_t k = 0; k < 4; k++) {
+        char c = s[i++];
+        cp <<= 4;
+        if (c >= '0' && c <= '9') cp |= c - '0';
+        else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+inline bool parseString(const std::string& s, size_t& i, std::string& out) {
+    if (i >= s.size() || s[i] != '"') return false;
+    i++;
+    while (i < s.size()) {
+        char c = s[i++];
+        if (c == '"') return true;
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (i >= s.size()) return false;
+        switch (s[i++]) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!parseHex4(s, i, cp)) return false;
+                if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < s.size() && s[i] == '\\' && s[i + 1] == 'u') {
+                    size_t j = i + 2;
+                    uint32_t low;
+                    if (parseHex4(s, j, low) && low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        i = j;
+                    }
+                }
+                appendUtf8(out, cp);
+                break;
+            }
+            default: return false;
+        }
+    }
+    return false;
+}
+
+inline bool parseValue(const std::string& s, size_t& i, JsonValue& v, int depth) {
+    if (depth > 64) return false;
+    skipSpace(s, i);
+    if (i >= s.size()) return false;
+    char c = s[i];
+    if (c == '{') {
+        v.type = JsonValue::Object;
+        i++;
+        skipSpace(s, i);
+        if (i < s.size() && s[i] == '}') {
+            i++;
+            return true;
+        }
+        while (true) {
+            skipSpace(s, i);
+            std::string key;
+            if (!parseString(s, i, key)) return false;
+            skipSpace(s, i);
+            if (i >= s.size() || s[i++] != ':') return false;
+            if (!parseValue(s, i, v.object[key], depth + 1)) return false;
+            skipSpace(s, i);
+            if (i >= s.size()) return false;
+            if (s[i] == ',') {
+                i++;
+                continue;
+            }
+            if (s[i++] != '}') return false;
+            return true;
+        }
+    }
+    if (c == '[') {
+        v.type = JsonValue::Array;
+        i++;
+        skipSpace(s, i);
+        if (i < s.size() && s[i] == ']') {
+            i++;
+            return true;
+        }
+        while (true) {
+            v.array.emplace_back();
+            if (!parseValue(s, i, v.array.back(), depth + 1)) return false;
+            skipSpace(s, i);
+            if (i >= s.size()) return false;
+            if (s[i] == ',') {
+                i++;
+                continue;
+            }
+            if (s[i++] != ']') return false;
+            return true;
+        }
+    }
+    if (c == '"') {
+        v.type = JsonValue::String;
+        return parseString(s, i, v.string);
+    }
+    if (s.compare(i, 4, "true") == 0 || s.compare(i, 5, "false") == 0) {
+        v.type = JsonValue::Bool;
+        v.boolean = s[i] == 't';
+        i += v.boolean ? 4 : 5;
+        return true;
+    }
+    if (s.compare(i, 4, "null") == 0) {
+        v.type = JsonValue::Null;
+        i += 4;
+        return true;
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        size_t start = i;
+        bool integral = true;
+        if (s[i] == '-') i++;
+        while (i < s.size() && ((s[i] >= '0' && s[i] <= '9') || s[i] == '.' || s[i] == 'e' || s[i] == 'E' ||
+                                s[i] == '+' || s[i] == '-')) {
+            if (s[i] == '.' || s[i] == 'e' || s[i] == 'E') integral = false;
+            i++;
+        }
+        std::string text = s.substr(start, i - start);
+        char* end = nullptr;
+        v.type = JsonValue::Number;
+        v.number = std::strtod(text.c_str(), &end);
+        if (end != text.c_str() + text.size()) return false;
+        if (integral && text[0] == '-') {
+            v.integer = std::strtoll(text.c_str(), nullptr, 10);
+        } else if (integral) {
+            v.uinteger = std::strtoull(text.c_str(), nullptr, 10);
+            v.integer = v.uinteger > INT64_MAX ? INT64_MAX : static_cast<int64_t>(v.uinteger);
+        } else {
+            v.integer = static_cast<int64_t>(v.number);
+            v.uinteger = v.number > 0 ? static_cast<uint64_t>(v.number) : 0;
+        }
+        return true;
+    }
+    return false;
+}
+
+}  // namespace json_detail
+
+/**
+ * @brief Parses one JSON document.
+ *
+ * @param text Input; trailing whitespace is allowed, anything else after the value is not.
+ * @param value Set to the parsed value.
+ * @return true if `text` is well-formed, false otherwise.
+ */
+inline bool parseJson(const std::string& text, JsonValue& value) {
+    value = JsonValue{};
+    size_t i = 0;
+    if (!json_detail::parseValue(text, i, value, 0)) return false;
+    json_detail::skipSpace(text, i);
+    return i == text.size();
+}
+
+/**
+ * @brief Quotes a string as a JSON string literal.
+ */
+inline std::string jsonQuote(const std::string& s) {
+    static const char hex[] = "0123456789abcdef";
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xF];
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    return out + "\"";
+}
+
+#endif // JSON_H
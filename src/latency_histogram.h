@@ -0,0 +1,284 @@
+// Per-disk block latency histograms kept by QEMU and their metrics exposition
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "json.h"
+#include "xml.h"
+
+/**
+ * @brief Bucket boundaries for QEMU's block latency histograms, in nanoseconds.
+ *
+ * `boundaries` applies to every operation unless `read`, `write` or `flush`
+ * overrides it. Bins are [0, b0), [b0, b1), ..., [bn, +inf).
+ */
+struct LatencyHistogramConfig {
+    std::vector<uint64_t> boundaries = {
+        10000, 50000, 100000, 250000, 500000,           // 10 us .. 500 us
+        1000000, 2500000, 5000000, 10000000, 25000000,  // 1 ms .. 25 ms
+        50000000, 100000000, 250000000, 1000000000      // 50 ms .. 1 s
+    };
+    std::vector<uint64_t> read;
+    std::vector<uint64_t> write;
+    std::vector<uint64_t> flush;
+};
+
+/**
+ * @brief Arguments of `block-latency-histogram-set` for the guest device `id`.
+ */
+inline std::string buildLatencyHistogramArguments(const std::string& id, const LatencyHistogramConfig& config) {
+    auto list = [](const std::vector<uint64_t>& values) {
+        std::string out = "[";
+        for (size_t i = 0; i < values.size(); i++) out += (i ? "," : "") + std::to_string(values[i]);
+        return out + "]";
+    };
+    std::string args = "{\"id\":" + jsonQuote(id);
+    if (!config.boundaries.empty()) args += ",\"boundaries\":" + list(config.boundaries);
+    if (!config.read.empty()) args += ",\"boundaries-read\":" + list(config.read);
+    if (!config.write.empty()) args += ",\"boundaries-write\":" + list(config.write);
+    if (!config.flush.empty()) args += ",\"boundaries-flush\":" + list(config.flush);
+    return args + "}";
+}
+
+/**
+ * @brief A disk of a domain as QEMU names it: target device and device alias.
+ */
+struct HistogramDisk {
+    std::string dev;    // e.g. "vda"
+    std::string alias;  // qdev id, e.g. "virtio-disk0"
+};
+
+/**
+ * @brief Lists a running domain's disks with the aliases libvirt gave them.
+ */
+inline std::vector<HistogramDisk> parseHistogramDisks(const std::string& domain_xml) {
+    std::vector<HistogramDisk> disks;
+    for (const auto& disk : xmlElements(domain_xml, "disk")) {
+        if (xmlAttr(disk, "device") != "disk") continue;
+        HistogramDisk d{xmlAttr(xmlElement(disk, "target"), "dev"), xmlAttr(xmlElement(disk, "alias"), "name")};
+        if (!d.dev.empty() && !d.alias.empty()) disks.push_back(d);
+    }
+    return disks;
+}
+
+/**
+ * @brief Maps a device name from query-blockstats back to the disk's target device.
+ *
+ * QEMU reports the qdev id or path ("virtio-disk0",
+ * "/machine/peripheral/virtio-disk0/virtio-backend") or, without -blockdev,
+ * the drive name ("drive-virtio-disk0").
+ *
+ * @return std::string The target device, or `device` unchanged if no disk matches.
+ */
+inline std::string histogramDiskName(const std::string& device, const std::vector<HistogramDisk>& disks) {
+    for (const auto& d : disks) {
+        if (device == d.alias || device == "drive-" + d.alias ||
+            device.find("/" + d.alias + "/") != std::string::npos) {
+            return d.dev;
+        }
+    }
+    return device;
+}
+
+/**
+ * @brief A cumulative latency histogram: `bins` has one more entry than `boundaries`.
+ */
+struct LatencyHistogram {
+    std::vector<uint64_t> boundaries;  // ns
+    std::vector<uint64_t> bins;
+    uint64_t sum_ns = 0;               // total time of the operations counted in `bins`
+
+    bool empty() const { return bins.empty(); }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (uint64_t b : bins) n += b;
+        return n;
+    }
+};
+
+/**
+ * @brief Read, write and flush latency histograms of one disk.
+ */
+struct DiskLatencyHistograms {
+    std::string device;  // qdev id or drive name as query-blockstats reports it, or the target device
+    LatencyHistogram read;
+    LatencyHistogram write;
+    LatencyHistogram flush;
+};
+
+/**
+ * @brief A disk's lifetime operation times when its histograms were armed.
+ *
+ * QEMU's `*_total_time_ns` counters run from the start of the process, while
+ * the bins count from the last `block-latency-histogram-set`; subtracting the
+ * totals as of that moment makes `sum_ns` cover the operations in the bins.
+ */
+struct HistogramBaseline {
+    uint64_t read_ns = 0;
+    uint64_t write_ns = 0;
+    uint64_t flush_ns = 0;
+};
+
+inline std::string blockStatsDevice(const JsonValue& entry) {
+    return entry["qdev"].string.empty() ? entry["device"].string : entry["qdev"].string;
+}
+
+/**
+ * @brief Reads every disk's operation times from the `return` value of `query-blockstats`.
+ *
+ * @return Device (as parseLatencyHistograms() names it) -> baseline.
+ */
+inline std::map<std::string, HistogramBaseline> parseHistogramBaselines(const JsonValue& ret) {
+    std::map<std::string, HistogramBaseline> baselines;
+    for (const auto& entry : ret.array) {
+        const JsonValue& s = entry["stats"];
+        if (s.type != JsonValue::Object) continue;
+        baselines[blockStatsDevice(entry)] = HistogramBaseline{
+            s["rd_total_time_ns"].asUint(), s["wr_total_time_ns"].asUint(), s["flush_total_time_ns"].asUint()};
+    }
+    return baselines;
+}
+
+// A total below its baseline means the counters restarted with QEMU, and the total is all there is
+inline LatencyHistogram parseLatencyHistogram(const JsonValue& info, uint64_t total_ns, uint64_t baseline_ns) {
+    LatencyHistogram h;
+    for (const auto& b : info["boundaries"].array) h.boundaries.push_back(b.asUint());
+    for (const auto& b : info["bins"].array) h.bins.push_back(b.asUint());
+    if (h.bins.size() != h.boundaries.size() + 1) return LatencyHistogram{};
+    h.sum_ns = total_ns >= baseline_ns ? total_ns - baseline_ns : total_ns;
+    return h;
+}
+
+/**
+ * @brief Reads the latency histograms from the `return` value of `query-blockstats`.
+ *
+ * Disks without any histogram configured are omitted. Without a baseline
+ * for a disk, its `sum_ns` is the lifetime total and overstates the bins
+ * unless the histogram was armed when QEMU started.
+ *
+ * @param ret The `return` value.
+ * @param baselines Per device, the totals captured when its histograms were armed.
+ */
+inline std::vector<DiskLatencyHistograms> parseLatencyHistograms(
+    const JsonValue& ret, const std::map<std::string, HistogramBaseline>& baselines = {}) {
+    std::vector<DiskLatencyHistograms> disks;
+    for (const auto& entry : ret.array) {
+        const JsonValue& s = entry["stats"];
+        DiskLatencyHistograms d;
+        d.device = blockStatsDevice(entry);
+        auto it = baselines.find(d.device);
+        HistogramBaseline base = it == baselines.end() ? HistogramBaseline{} : it->second;
+        d.read = parseLatencyHistogram(s["rd_latency_histogram"], s["rd_total_time_ns"].asUint(), base.read_ns);
+        d.write = parseLatencyHistogram(s["wr_latency_histogram"], s["wr_total_time_ns"].asUint(), base.write_ns);
+        d.flush = parseLatencyHistogram(s["flush_latency_histogram"], s["flush_total_time_ns"].asUint(), base.flush_ns);
+        if (!d.read.empty() || !d.write.empty() || !d.flush.empty()) disks.push_back(d);
+    }
+    return disks;
+}
+
+/**
+ * @brief Operations counted between two snapshots of the same histogram.
+ *
+ * If the boundaries changed or a bin went backwards (the histogram was reset,
+ * e.g. by a QEMU restart) `cur` is returned as is.
+ */
+inline LatencyHistogram diffLatencyHistogram(const LatencyHistogram& prev, const LatencyHistogram& cur) {
+    if (prev.boundaries != cur.boundaries || prev.bins.size() != cur.bins.size() || cur.sum_ns < prev.sum_ns) return cur;
+    LatencyHistogram d = cur;
+    for (size_t i = 0; i < cur.bins.size(); i++) {
+        if (cur.bins[i] < prev.bins[i]) return cur;
+        d.bins[i] = cur.bins[i] - prev.bins[i];
+    }
+    d.sum_ns = cur.sum_ns - prev.sum_ns;
+    return d;
+}
+
+/**
+ * @brief Estimates a latency quantile, interpolating linearly within its bin.
+ *
+ * Quantiles falling in the last, unbounded bin are reported as its lower
+ * boundary, so the tail is a lower bound once it outgrows the boundaries.
+ *
+ * @param h Histogram, usually the difference between two snapshots.
+ * @param q Quantile in [0, 1], e.g. 0.99.
+ * @return double Latency in nanoseconds, or a negative value if the histogram is empty.
+ */
+inline double latencyQuantileNs(const LatencyHistogram& h, double q) {
+    uint64_t total = h.count();
+    if (total == 0) return -1.0;
+    double rank = q * static_cast<double>(total);
+    uint64_t below = 0;
+    for (size_t i = 0; i < h.bins.size(); i++) {
+        if (h.bins[i] == 0 || static_cast<double>(below + h.bins[i]) < rank) {
+            below += h.bins[i];
+            continue;
+        }
+        double lower = i == 0 ? 0.0 : static_cast<double>(h.boundaries[i - 1]);
+        if (i == h.boundaries.size()) return lower;
+        double upper = static_cast<double>(h.boundaries[i]);
+        return lower + (upper - lower) * (rank - static_cast<double>(below)) / static_cast<double>(h.bins[i]);
+    }
+    return h.boundaries.empty() ? 0.0 : static_cast<double>(h.boundaries.back());
+}
+
+/**
+ * @brief Formats histograms in the Prometheus text exposition format.
+ *
+ * Emits `augustus_block_latency_seconds` with cumulative `le` buckets and
+ * `_sum`/`_count` per domain, disk and operation, for a node-exporter
+ * textfile collector or an HTTP endpoint to serve.
+ *
+ * @param histograms Per domain, its disks' histograms.
+ */
+inline std::string formatLatencyMetrics(const std::map<std::string, std::vector<DiskLatencyHistograms>>& histograms) {
+    static const char* const name = "augustus_block_latency_seconds";
+    auto seconds = [](uint64_t ns) {
+        std::string s = std::to_string(ns / 1000000000) + ".";
+        std::string frac = std::to_string(ns % 1000000000);
+        s += std::string(9 - frac.size(), '0') + frac;
+        while (s.back() == '0') s.pop_back();
+        if (s.back() == '.') s.pop_back();
+        return s;
+    };
+    auto escape = [](const std::string& v) {
+        std::string out;
+        for (char c : v) {
+            if (c == '\\' || c == '"') out += '\\';
+            if (c == '\n') {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+        return out;
+    };
+
+    std::string out = std::string("# HELP ") + name + " Block request latency per disk, from QEMU latency histograms.\n" +
+                      "# TYPE " + name + " histogram\n";
+    for (const auto& [domain, disks] : histograms) {
+        for (const auto& d : disks) {
+            const std::pair<const char*, const LatencyHistogram*> ops[] = {
+                {"read", &d.read}, {"write", &d.write}, {"flush", &d.flush}};
+            for (const auto& [op, h] : ops) {
+                if (h->empty()) continue;
+                std::string labels = "domain=\"" + escape(domain) + "\",device=\"" + escape(d.device) + "\",op=\"" + op + "\"";
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < h->bins.size(); i++) {
+                    cumulative += h->bins[i];
+                    std::string le = i < h->boundaries.size() ? seconds(h->boundaries[i]) : "+Inf";
+                    out += std::string(name) + "_bucket{" + labels + ",le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+                }
+                out += std::string(name) + "_sum{" + labels + "} " + seconds(h->sum_ns) + "\n";
+                out += std::string(name) + "_count{" + labels + "} " + std::to_string(cumulative) + "\n";
+            }
+        }
+    }
+    return out;
+}
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,190 @@
+// VM leases: TTL deadlines tracked in a hierarchical timer wheel
+#ifndef LEASE_H
+#define LEASE_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xml.h"
+
+/**
+ * @brief Hierarchical timer wheel keyed by name.
+ *
+ * Four levels of 256 slots cover 2^32 ticks. Level `l` holds deadlines less
+ * than 256^(l+1) ticks away, in the slot given by bits [8l, 8l+8) of the
+ * deadline tick. Each time the level below wraps, one slot of the level
+ * above is cascaded into finer levels, so scheduling, cancelling and expiring
+ * a timer are O(1), and advancing costs O(1) per elapsed tick plus the
+ * timers that expire or cascade. Rescheduling a name replaces its timer.
+ *
+ * Time is passed in by the caller (milliseconds on any monotonic or wall
+ * clock), which also allows driving the wheel with virtual time.
+ */
+class TimerWheel {
+    private:
+        static constexpr unsigned slot_bits = 8;
+        static constexpr unsigned slots = 1u << slot_bits;
+        static constexpr unsigned levels = 4;
+
+        struct Timer {
+            std::string name;
+            uint64_t deadline;  // tick
+        };
+        struct Location {
+            std::list<Timer>* slot;
+            std::list<Timer>::iterator it;
+        };
+
+        uint64_t tick_ms;
+        uint64_t current = 0;  // last processed tick
+        bool started = false;
+        std::array<std::array<std::list<Timer>, slots>, levels> wheel;
+        std::list<Timer> due;  // deadlines already reached when scheduled or cascaded
+        std::unordered_map<std::string, Location> index;
+
+        std::list<Timer>* slotFor(uint64_t deadline) {
+            if (deadline <= current) return &due;
+            uint64_t delta = deadline - current;
+            for (unsigned l = 0; l < levels; l++) {
+                if (delta < (1ULL << (slot_bits * (l + 1)))) return &wheel[l][(deadline >> (slot_bits * l)) & (slots - 1)];
+            }
+            // Beyond the wheel's range: park in the top level and re-place when it cascades
+            uint64_t parked = current + (1ULL << (slot_bits * levels)) - 1;
+            return &wheel[levels - 1][(parked >> (slot_bits * (levels - 1))) & (slots - 1)];
+        }
+
+        void place(std::list<Timer>& from, std::list<Timer>::iterator it) {
+            std::list<Timer>* to = slotFor(it->deadline);
+            to->splice(to->end(), from, it);
+            index[it->name] = Location{to, it};
+        }
+
+        void cascade(unsigned level) {
+            std::list<Timer>& slot = wheel[level][(current >> (slot_bits * level)) & (slots - 1)];
+            while (!slot.empty()) place(slot, slot.begin());
+        }
+
+        void start(uint64_t now_ms) {
+            if (started) return;
+            current = now_ms / tick_ms;
+            started = true;
+        }
+
+    public:
+        explicit TimerWheel(uint64_t tick_ms = 1000) : tick_ms(tick_ms ? tick_ms : 1) {}
+
+        /**
+         * @brief Sets (or moves) the timer for `name` to fire at `deadline_ms`.
+         */
+        void schedule(const std::string& name, uint64_t deadline_ms, uint64_t now_ms) {
+            start(now_ms);
+            cancel(name);
+            std::list<Timer> staging;
+            staging.push_back(Timer{name, (deadline_ms + tick_ms - 1) / tick_ms});
+            place(staging, staging.begin());
+        }
+
+        /**
+         * @return true if a timer was removed.
+         */
+        bool cancel(const std::string& name) {
+            auto it = index.find(name);
+            if (it == index.end()) return false;
+            it->second.slot->erase(it->second.it);
+            index.erase(it);
+            return true;
+        }
+
+        /**
+         * @brief Advances to `now_ms` and returns the names whose deadline passed, earliest first.
+         */
+        std::vector<std::string> advance(uint64_t now_ms) {
+            start(now_ms);
+            std::vector<std::string> expired;
+            auto take = [&](std::list<Timer>& slot) {
+                for (auto& t : slot) {
+                    expired.push_back(t.name);
+                    index.erase(t.name);
+                }
+                slot.clear();
+            };
+            take(due);
+            uint64_t target = now_ms / tick_ms;
+            while (current < target) {
+                if (index.empty()) {
+                    current = target;  // nothing to fire or cascade on the way
+                    break;
+                }
+                current++;
+                // Cascade from the highest level whose lower levels all wrapped this tick
+                unsigned top = 0;
+                while (top + 1 < levels && ((current >> (slot_bits * (top + 1))) << (slot_bits * (top + 1))) == current) top++;
+                for (unsigned l = top; l >= 1; l--) cascade(l);
+                take(due);
+                take(wheel[0][current & (slots - 1)]);
+            }
+            return expired;
+        }
+
+        bool contains(const std::string& name) const { return index.count(name) > 0; }
+        size_t size() const { return index.size(); }
+};
+
+/**
+ * @brief A VM's lease: it is torn down unless renewed before `expires_ms`.
+ */
+struct Lease {
+    std::string vm;
+    uint64_t expires_ms = 0;  // Unix epoch milliseconds
+    uint64_t ttl_ms = 0;      // extension granted by each renewal
+    std::string uuid;         // domain the lease was taken on, since names can be reused; not persisted
+    unsigned failed_teardowns = 0;  // teardown attempts that failed since expiry; not persisted
+};
+
+// Leases are stored in domain metadata under this namespace so they survive manager restarts
+static const char* const lease_metadata_uri = "urn:augustus:lease";
+static const char* const lease_metadata_key = "augustus";
+
+inline uint64_t leaseClockMs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief Delay before retrying the teardown of an expired VM after `failed` failed attempts.
+ *
+ * Doubles from one second up to a minute, so a VM whose teardown keeps failing
+ * is retried for as long as it exists without hammering libvirt.
+ */
+inline uint64_t leaseRetryDelayMs(unsigned failed) {
+    const uint64_t base_ms = 1000, max_ms = 60000;
+    unsigned doublings = std::min(failed ? failed - 1 : 0u, 6u);
+    return std::min(max_ms, base_ms << doublings);
+}
+
+inline std::string buildLeaseMetadata(const Lease& lease) {
+    return "<lease expires='" + std::to_string(lease.expires_ms) + "' ttl='" + std::to_string(lease.ttl_ms) + "'/>";
+}
+
+/**
+ * @brief Reads a lease from the metadata element written by buildLeaseMetadata().
+ *
+ * @return true if the element carries an expiry, false otherwise.
+ */
+inline bool parseLeaseMetadata(const std::string& metadata, Lease& lease) {
+    std::string element = xmlElement(metadata, "lease");
+    std::string expires = xmlAttr(element, "expires");
+    if (expires.empty()) return false;
+    lease.expires_ms = std::strtoull(expires.c_str(), nullptr, 10);
+    lease.ttl_ms = std::strtoull(xmlAttr(element, "ttl").c_str(), nullptr, 10);
+    return true;
+}
+
+#endif // LEASE_H
@@ -0,0 +1,361 @@
+// Streaming per-tenant resource metering from domain stats samples
+#ifndef METERING_H
+#define METERING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <libvirt/libvirt.h>
+
+#include "xml.h"
+
+/**
+ * @brief One stats sample of a running domain, as consumed by the metering pipeline.
+ *
+ * `instance` changes whenever the domain is (re)started (the libvirt domain
+ * id), which tells a restart apart from a counter that merely stood still.
+ */
+struct MeterSample {
+    std::string vm;
+    std::string tenant;
+    int instance = 0;
+    uint64_t timestamp_ms = 0;
+    uint64_t cpu_ns = 0;       // cumulative, since the domain started
+    uint64_t memory_kib = 0;   // current allocation
+    uint64_t rx_bytes = 0;     // cumulative over all interfaces
+    uint64_t tx_bytes = 0;
+};
+
+/**
+ * @brief Usage accumulated over one bucket.
+ */
+struct TenantUsage {
+    uint64_t cpu_ns = 0;
+    uint64_t memory_kib_ms = 0;  // memory integrated over time
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+
+    double cpuSeconds() const { return cpu_ns / 1e9; }
+    double gbHours() const { return memory_kib_ms / (1024.0 * 1024.0) / 3600000.0; }
+    uint64_t networkBytes() const { return rx_bytes + tx_bytes; }
+};
+
+/**
+ * @brief A tenant's usage during `[start_ms, start_ms + interval_ms)`.
+ */
+struct MeterBucket {
+    std::string tenant;
+    uint64_t start_ms = 0;
+    uint64_t interval_ms = 0;
+    TenantUsage usage;
+};
+
+// Tenants are stored in domain metadata under this namespace
+static const char* const tenant_metadata_uri = "urn:augustus:tenant";
+static const char* const tenant_metadata_key = "augustus";
+
+inline std::string buildTenantMetadata(const std::string& tenant) {
+    return "<tenant name='" + xmlEscape(tenant) + "'/>";
+}
+
+inline std::string parseTenantMetadata(const std::string& metadata) {
+    return xmlAttr(xmlElement(metadata, "tenant"), "name");
+}
+
+/**
+ * @brief Extracts the metered counters from a domain stats record.
+ *
+ * Expects `VIR_DOMAIN_STATS_CPU_TOTAL`, `VIR_DOMAIN_STATS_BALLOON` and
+ * `VIR_DOMAIN_STATS_INTERFACE` fields; the caller fills in the name, tenant,
+ * instance and timestamp.
+ */
+inline MeterSample parseMeterSample(const virTypedParameter* params, int nparams) {
+    MeterSample sample;
+    uint64_t balloon = 0, maximum = 0;
+    for (int i = 0; i < nparams; i++) {
+        const char* field = params[i].field;
+        uint64_t value;
+        switch (params[i].type) {
+            case VIR_TYPED_PARAM_ULLONG: value = params[i].value.ul; break;
+            case VIR_TYPED_PARAM_LLONG:  value = static_cast<uint64_t>(params[i].value.l); break;
+            case VIR_TYPED_PARAM_UINT:   value = params[i].value.ui; break;
+            case VIR_TYPED_PARAM_INT:    value = static_cast<uint64_t>(params[i].value.i); break;
+            default: continue;
+        }
+        if (std::strcmp(field, "cpu.time") == 0) {
+            sample.cpu_ns = value;
+        } else if (std::strcmp(field, "balloon.current") == 0) {
+            balloon = value;
+        } else if (std::strcmp(field, "balloon.maximum") == 0) {
+            maximum = value;
+        } else if (std::strncmp(field, "net.", 4) == 0) {
+            // net.<n>.rx.bytes, net.<n>.tx.bytes
+            size_t len = std::strlen(field);
+            if (len > 9 && std::strcmp(field + len - 9, ".rx.bytes") == 0) sample.rx_bytes += value;
+            else if (len > 9 && std::strcmp(field + len - 9, ".tx.bytes") == 0) sample.tx_bytes += value;
+        }
+    }
+    sample.memory_kib = balloon ? balloon : maximum;
+    return sample;
+}
+
+/**
+ * @brief Turns stats samples into per-tenant usage in fixed-interval buckets.
+ *
+ * Each sample is compared with the previous one of the same domain only, so
+ * processing costs O(1) per sample regardless of history. Cumulative counters
+ * that go backwards, or a changed instance, mean the domain restarted: the
+ * new counter value is usage since the restart. Memory is integrated over
+ * the time between samples, capped at `max_gap_ms` across restarts since the
+ * domain was down for part of the gap. Usage between two samples is spread
+ * over the buckets the gap covers in proportion to time. The first sample of
+ * a domain only sets its baseline.
+ */
+class MeteringPipeline {
+    private:
+        struct LastSample {
+            int instance = 0;
+            uint64_t timestamp_ms = 0;
+            uint64_t cpu_ns = 0;
+            uint64_t rx_bytes = 0;
+            uint64_t tx_bytes = 0;
+        };
+
+        uint64_t interval_ms;
+        uint64_t max_gap_ms;
+        std::unordered_map<std::string, LastSample> last;                     // domain -> previous sample
+        std::map<std::pair<uint64_t, std::string>, TenantUsage> open_buckets; // (start, tenant) -> usage
+        uint64_t samples = 0;
+
+        static uint64_t counterDelta(uint64_t prev, uint64_t cur, bool restarted) {
+            return restarted || cur < prev ? cur : cur - prev;
+        }
+
+        static uint64_t share(uint64_t value, uint64_t part, uint64_t whole) {
+            return whole ? static_cast<uint64_t>(static_cast<unsigned __int128>(value) * part / whole) : value;
+        }
+
+    public:
+        explicit MeteringPipeline(uint64_t interval_ms = 3600000, uint64_t max_gap_ms = 300000)
+            : interval_ms(interval_ms ? interval_ms : 1), max_gap_ms(max_gap_ms) {}
+
+        /**
+         * @brief Accounts one sample.
+         */
+        void consume(const MeterSample& s) {
+            samples++;
+            auto it = last.find(s.vm);
+            if (it == last.end()) {
+                last[s.vm] = LastSample{s.instance, s.timestamp_ms, s.cpu_ns, s.rx_bytes, s.tx_bytes};
+                return;
+            }
+            LastSample& prev = it->second;
+            if (s.timestamp_ms <= prev.timestamp_ms) return;  // duplicate or reordered sample
+
+            bool restarted = s.instance != prev.instance;
+            TenantUsage delta;
+            delta.cpu_ns = counterDelta(prev.cpu_ns, s.cpu_ns, restarted);
+            delta.rx_bytes = counterDelta(prev.rx_bytes, s.rx_bytes, restarted);
+            delta.tx_bytes = counterDelta(prev.tx_bytes, s.tx_bytes, restarted);
+            uint64_t begin = prev.timestamp_ms;
+            if (restarted || s.cpu_ns < prev.cpu_ns) begin = std::max(begin, s.timestamp_ms - std::min(s.timestamp_ms, max_gap_ms));
+            delta.memory_kib_ms = s.memory_kib * (s.timestamp_ms - begin);
+
+            // Spread over the buckets between the two samples
+            uint64_t span = s.timestamp_ms - prev.timestamp_ms;
+            uint64_t mem_span = s.timestamp_ms - begin;
+            for (uint64_t t = prev.timestamp_ms; t < s.timestamp_ms;) {
+                uint64_t start = t / interval_ms * interval_ms;
+                uint64_t end = std::min(start + interval_ms, s.timestamp_ms);
+                TenantUsage& u = open_buckets[{start, s.tenant}];
+                u.cpu_ns += share(delta.cpu_ns, end - t, span);
+                u.rx_bytes += share(delta.rx_bytes, end - t, span);
+                u.tx_bytes += share(delta.tx_bytes, end - t, span);
+                if (end > begin) u.memory_kib_ms += share(delta.memory_kib_ms, end - std::max(t, begin), mem_span);
+                t = end;
+            }
+            prev = LastSample{s.instance, s.timestamp_ms, s.cpu_ns, s.rx_bytes, s.tx_bytes};
+        }
+
+        /**
+         * @brief Removes and returns the buckets that ended at or before `now_ms`.
+         *
+         * Domains not sampled for `idle_ms` are forgotten, so a domain that comes
+         * back later starts from a fresh baseline.
+         */
+        std::vector<MeterBucket> closeBuckets(uint64_t now_ms, uint64_t idle_ms = 86400000) {
+            std::vector<MeterBucket> closed;
+            for (auto it = open_buckets.begin(); it != open_buckets.end();) {
+                if (it->first.first + interval_ms > now_ms) break;  // ordered by start
+                closed.push_back(MeterBucket{it->first.second, it->first.first, interval_ms, it->second});
+                it = open_buckets.erase(it);
+            }
+            for (auto it = last.begin(); it != last.end();) {
+                it = it->second.timestamp_ms + idle_ms < now_ms ? last.erase(it) : std::next(it);
+            }
+            return closed;
+        }
+
+        size_t trackedDomains() const { return last.size(); }
+        uint64_t samplesConsumed() const { return samples; }
+        const std::map<std::pair<uint64_t, std::string>, TenantUsage>& openBuckets() const { return open_buckets; }
+};
+
+inline uint64_t meterChecksum(const std::string& data) {
+    uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Parses usage log records, stopping at the first torn or corrupt one.
+ *
+ * @param data Log contents, starting at a record boundary.
+ * @param buckets Receives the parsed buckets; may be null to only validate.
+ * @return size_t Length of the valid prefix of `data`.
+ */
+inline size_t parseMeterLog(const std::string& data, std::vector<MeterBucket>* buckets) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t eol = data.find('\n', pos);
+        if (eol == std::string::npos || eol < pos + 2 || data.compare(pos, 2, "U ") != 0) break;
+        std::string header = data.substr(pos + 2, eol - pos - 2);
+        size_t sum_at = header.rfind(' ');
+        if (sum_at == std::string::npos) break;
+        std::string fields = header.substr(0, sum_at);
+        MeterBucket b;
+        size_t tenant_len = 0;
+        std::istringstream in(fields);
+        if (!(in >> b.start_ms >> b.interval_ms >> b.usage.cpu_ns >> b.usage.memory_kib_ms >> b.usage.rx_bytes >>
+              b.usage.tx_bytes >> tenant_len)) break;
+        if (tenant_len >= data.size() - eol - 1 || data[eol + 1 + tenant_len] != '\n') break;
+        b.tenant = data.substr(eol + 1, tenant_len);
+        if (std::to_string(meterChecksum(fields + b.tenant)) != header.substr(sum_at + 1)) break;
+        if (buckets) buckets->push_back(std::move(b));
+        pos = eol + 1 + tenant_len + 1;
+    }
+    return pos;
+}
+
+/**
+ * @brief Finds where the valid records of a usage log end, reading only its tail when possible.
+ *
+ * Records are located from the last `window` bytes: the first record boundary
+ * there that parses is followed to the end of the valid records. Only if the
+ * window holds no complete record is the whole log read.
+ *
+ * @return true if the log could be read, false otherwise.
+ */
+inline bool meterLogValidEnd(int fd, size_t size, size_t& valid, size_t window = 1 << 20) {
+    auto readAt = [fd](size_t offset, size_t len, std::string& out) {
+        out.resize(len);
+        size_t got = 0;
+        while (got < len) {
+            ssize_t n = ::pread(fd, &out[got], len - got, static_cast<off_t>(offset + got));
+            if (n <= 0) return false;
+            got += static_cast<size_t>(n);
+        }
+        return true;
+    };
+    std::string data;
+    size_t from = size > window ? size - window : 0;
+    if (!readAt(from, size - from, data)) return false;
+    for (size_t i = 0; from > 0 && i + 1 < data.size(); i++) {
+        if (data[i] != '\n' || data[i + 1] != 'U') continue;
+        size_t len = parseMeterLog(data.substr(i + 1), nullptr);
+        if (len == 0) continue;
+        valid = from + i + 1 + len;
+        return true;
+    }
+    if (from > 0 && !readAt(0, size, data)) return false;
+    valid = parseMeterLog(data, nullptr);
+    return true;
+}
+
+/**
+ * @brief Appends closed buckets to a usage log and syncs it.
+ *
+ * Record layout, one per tenant and bucket: a header line
+ * `U <start_ms> <interval_ms> <cpu_ns> <memory_kib_ms> <rx> <tx> <tenant_len> <sum>`
+ * followed by the tenant name and a newline; `sum` is an FNV-1a hash of the
+ * header fields and tenant, so a torn tail is detected. A torn tail left by
+ * an earlier crash is truncated before appending, so new records never sit
+ * behind it where loadMeterBuckets() would not reach them.
+ */
+inline bool appendMeterBuckets(const std::string& path, const std::vector<MeterBucket>& buckets) {
+    if (buckets.empty()) return true;
+    std::string data;
+    for (const auto& b : buckets) {
+        std::ostringstream fields;
+        fields << b.start_ms << ' ' << b.interval_ms << ' ' << b.usage.cpu_ns << ' ' << b.usage.memory_kib_ms << ' '
+               << b.usage.rx_bytes << ' ' << b.usage.tx_bytes << ' ' << b.tenant.size();
+        data += "U " + fields.str() + ' ' + std::to_string(meterChecksum(fields.str() + b.tenant)) + '\n' + b.tenant + '\n';
+    }
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        std::cerr << "Failed to open usage log '" << path << "'\n";
+        return false;
+    }
+    off_t size = ::lseek(fd, 0, SEEK_END);
+    size_t valid = 0;
+    bool ok = size >= 0 && meterLogValidEnd(fd, static_cast<size_t>(size), valid);
+    if (ok && valid < static_cast<size_t>(size)) {
+        std::cerr << "Discarding " << static_cast<size_t>(size) - valid << " bytes of torn usage log tail\n";
+        ok = ftruncate(fd, static_cast<off_t>(valid)) == 0;
+    }
+    size_t off = 0;
+    while (ok && off < data.size()) {
+        ssize_t n = ::pwrite(fd, data.data() + off, data.size() - off, static_cast<off_t>(valid + off));
+        if (n < 0) ok = false;
+        else off += static_cast<size_t>(n);
+    }
+    ok = ok && fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok) std::cerr << "Failed to write usage log '" << path << "'\n";
+    return ok;
+}
+
+/**
+ * @brief Reads a usage log written by appendMeterBuckets(), truncating a torn or corrupt tail.
+ *
+ * @return true if the log was read, false if it could not be opened.
+ */
+inline bool loadMeterBuckets(const std::string& path, std::vector<MeterBucket>& buckets) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    bool writable = fd >= 0;
+    if (!writable) fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to open usage log '" << path << "'\n";
+        return false;
+    }
+    std::string data;
+    char buf[65536];
+    ssize_t n;
+    while ((n = ::pread(fd, buf, sizeof(buf), static_cast<off_t>(data.size()))) > 0) {
+        data.append(buf, static_cast<size_t>(n));
+    }
+
+    size_t valid = parseMeterLog(data, &buckets);
+    if (valid < data.size()) {
+        std::cerr << "Discarding " << data.size() - valid << " bytes of torn usage log tail\n";
+        if (writable && ftruncate(fd, static_cast<off_t>(valid)) < 0) {
+            std::cerr << "Failed to truncate usage log '" << path << "'\n";
+        }
+    }
+    ::close(fd);
+    return true;
+}
+
+#endif // METERING_H
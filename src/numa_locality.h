@@ -0,0 +1,221 @@
+// NUMA memory locality of running guests and node consolidation planning
+#ifndef NUMA_LOCALITY_H
+#define NUMA_LOCALITY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "xml.h"
+
+/**
+ * @brief Where a guest's memory lives, summed from its QEMU process's numa_maps.
+ *
+ * The home node is the node holding the most memory; everything on other
+ * nodes counts as remote, since moving it home is the cheapest way to make
+ * the guest node-local.
+ */
+struct NumaUsage {
+    std::map<int, uint64_t> node_kib;
+    uint64_t total_kib = 0;
+    int home_node = -1;
+    uint64_t remote_kib = 0;
+    double remote_fraction = 0.0;
+};
+
+/**
+ * @brief Parses the contents of `/proc/<pid>/numa_maps`.
+ *
+ * Each mapping lists its resident pages per node as `N<node>=<pages>` in units
+ * of `kernelpagesize_kB` (4 KiB unless the mapping is backed by huge pages).
+ */
+inline NumaUsage parseNumaMaps(const std::string& content) {
+    NumaUsage usage;
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string field;
+        uint64_t page_kib = 4;
+        std::map<int, uint64_t> pages;
+        while (fields >> field) {
+            if (field.size() > 1 && field[0] == 'N' && field.find('=') != std::string::npos) {
+                size_t eq = field.find('=');
+                pages[std::atoi(field.substr(1, eq - 1).c_str())] += std::strtoull(field.c_str() + eq + 1, nullptr, 10);
+            } else if (field.rfind("kernelpagesize_kB=", 0) == 0) {
+                page_kib = std::strtoull(field.c_str() + 18, nullptr, 10);
+            }
+        }
+        for (const auto& [node, n] : pages) usage.node_kib[node] += n * page_kib;
+    }
+    uint64_t home_kib = 0;
+    for (const auto& [node, kib] : usage.node_kib) {
+        usage.total_kib += kib;
+        if (usage.home_node < 0 || kib > home_kib) {
+            usage.home_node = node;
+            home_kib = kib;
+        }
+    }
+    usage.remote_kib = usage.total_kib - home_kib;
+    usage.remote_fraction = usage.total_kib ? static_cast<double>(usage.remote_kib) / usage.total_kib : 0.0;
+    return usage;
+}
+
+/**
+ * @brief Reads a process's NUMA usage from `<proc_root>/<pid>/numa_maps`.
+ *
+ * @return true if the file could be read, false otherwise.
+ */
+inline bool readNumaMaps(int pid, NumaUsage& usage, const std::string& proc_root = "/proc") {
+    std::ifstream in(proc_root + "/" + std::to_string(pid) + "/numa_maps");
+    if (!in) return false;
+    std::stringstream content;
+    content << in.rdbuf();
+    usage = parseNumaMaps(content.str());
+    return true;
+}
+
+/**
+ * @brief Reads the QEMU process id libvirt records for a running domain.
+ *
+ * @return int The pid, or -1 if the pid file is missing or malformed.
+ */
+inline int readQemuPid(const std::string& name, const std::string& run_dir = "/run/libvirt/qemu") {
+    std::ifstream in(run_dir + "/" + name + ".pid");
+    int pid = -1;
+    if (!(in >> pid) || pid <= 0) return -1;
+    return pid;
+}
+
+/**
+ * @brief A host NUMA node: its CPUs from capabilities and its free memory.
+ */
+struct NumaNode {
+    int id = 0;
+    uint64_t free_kib = 0;
+    std::vector<unsigned> cpus;
+};
+
+/**
+ * @brief Lists the host NUMA nodes and their CPUs from `virConnectGetCapabilities` output.
+ */
+inline std::vector<NumaNode> parseNumaNodes(const std::string& caps) {
+    std::vector<NumaNode> nodes;
+    std::string cells = xmlElement(xmlElement(xmlElement(caps, "host"), "topology"), "cells");
+    for (const auto& cell : xmlElements(cells, "cell")) {
+        NumaNode node;
+        node.id = std::atoi(xmlAttr(cell, "id").c_str());
+        for (const auto& cpu : xmlElements(xmlElement(cell, "cpus"), "cpu")) {
+            node.cpus.push_back(static_cast<unsigned>(std::strtoul(xmlAttr(cpu, "id").c_str(), nullptr, 10)));
+        }
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+/**
+ * @brief Builds the CPU map pinning a guest to a node's CPUs, leaving out reserved cores.
+ *
+ * @param node Target node.
+ * @param host_cpus Number of host CPUs (sizes the map).
+ * @param reserved Cores the guest must not run on, e.g. isolated and realtime cores.
+ * @return std::vector<unsigned char> The map, or an empty vector if no CPU of the node is usable.
+ */
+inline std::vector<unsigned char> numaNodeCpuMap(const NumaNode& node, unsigned host_cpus,
+                                                 const std::set<unsigned>& reserved) {
+    std::vector<unsigned char> cpumap((host_cpus + 7) / 8, 0);
+    bool any = false;
+    for (unsigned cpu : node.cpus) {
+        if (cpu >= host_cpus || reserved.count(cpu)) continue;
+        cpumap[cpu / 8] |= static_cast<unsigned char>(1 << (cpu % 8));
+        any = true;
+    }
+    if (!any) cpumap.clear();
+    return cpumap;
+}
+
+/**
+ * @brief Thresholds for NUMA rebalancing.
+ *
+ * `budget_kib` caps the memory migrated per pass: page migration runs at
+ * memory-bandwidth speed and competes with the guests for it, so each pass
+ * moves at most about what the host can copy in the rebalance interval
+ * without hurting neighbours.
+ */
+struct NumaLocalityPolicy {
+    double min_remote_fraction = 0.1;      // leave guests that are mostly local alone
+    uint64_t min_remote_kib = 64 * 1024;   // and guests with little remote memory
+    uint64_t budget_kib = 4ULL << 20;      // memory migrated per pass
+    size_t max_moves = 8;                  // guests moved per pass
+};
+
+/**
+ * @brief Moving one guest's memory and vCPUs onto a single node.
+ */
+struct NumaMove {
+    std::string vm;
+    int target_node = -1;
+    uint64_t move_kib = 0;          // memory that has to migrate
+    double remote_fraction = 0.0;   // before the move
+};
+
+/**
+ * @brief Chooses which guests to make node-local this pass.
+ *
+ * Guests are taken worst first (highest remote fraction). Each goes to the
+ * node that needs the least memory migrated among the nodes with room for the
+ * memory still to arrive, usually its home node. Guests whose move does not
+ * fit the remaining budget are skipped in favour of smaller ones.
+ *
+ * @param usage Per-guest NUMA usage.
+ * @param nodes Host nodes with current free memory.
+ * @param policy Thresholds and budget.
+ * @return std::vector<NumaMove> Moves in the order to apply them.
+ */
+inline std::vector<NumaMove> planNumaRebalance(const std::map<std::string, NumaUsage>& usage,
+                                               std::vector<NumaNode> nodes,
+                                               const NumaLocalityPolicy& policy = NumaLocalityPolicy{}) {
+    std::vector<std::pair<std::string, const NumaUsage*>> candidates;
+    for (const auto& [name, u] : usage) {
+        if (u.remote_fraction >= policy.min_remote_fraction && u.remote_kib >= policy.min_remote_kib) {
+            candidates.emplace_back(name, &u);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+        if (a.second->remote_fraction != b.second->remote_fraction) {
+            return a.second->remote_fraction > b.second->remote_fraction;
+        }
+        return a.first < b.first;
+    });
+
+    std::vector<NumaMove> moves;
+    uint64_t budget = policy.budget_kib;
+    for (const auto& [name, u] : candidates) {
+        if (moves.size() >= policy.max_moves) break;
+        NumaNode* best = nullptr;
+        uint64_t best_move = 0;
+        for (auto& node : nodes) {
+            auto here = u->node_kib.find(node.id);
+            uint64_t move = u->total_kib - (here == u->node_kib.end() ? 0 : here->second);
+            if (node.free_kib < move || move > budget) continue;
+            if (!best || move < best_move) {
+                best = &node;
+                best_move = move;
+            }
+        }
+        if (!best) continue;
+        // Memory freed on the other nodes is not credited until the next pass
+        best->free_kib -= best_move;
+        budget -= best_move;
+        moves.push_back(NumaMove{name, best->id, best_move, u->remote_fraction});
+    }
+    return moves;
+}
+
+#endif // NUMA_LOCALITY_H
@@ -0,0 +1,132 @@
+// Hardware perf event sampling for VMManager
+#ifndef PERF_H
+#define PERF_H
+
+#include <libvirt/libvirt.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Perf events enabled by default: instruction/cycle counts for IPC, cache
+// references/misses for miss rate, and the memory-bandwidth monitors where
+// the host supports them.
+static const std::vector<std::string> default_perf_events = {
+    VIR_PERF_PARAM_INSTRUCTIONS,
+    VIR_PERF_PARAM_CPU_CYCLES,
+    VIR_PERF_PARAM_CACHE_REFERENCES,
+    VIR_PERF_PARAM_CACHE_MISSES,
+    VIR_PERF_PARAM_MBMT,
+    VIR_PERF_PARAM_MBML,
+};
+
+/**
+ * @brief Raw perf counter values for one domain, keyed by libvirt event name
+ * (e.g. "cache_misses", "instructions").
+ */
+struct PerfSample {
+    std::map<std::string, uint64_t> counters;
+
+    bool has(const std::string& event) const { return counters.count(event) != 0; }
+    uint64_t get(const std::string& event) const {
+        auto it = counters.find(event);
+        return it == counters.end() ? 0 : it->second;
+    }
+};
+
+/**
+ * @brief Metrics derived from two consecutive perf samples of a domain.
+ *
+ * Counter-based metrics are computed over the delta between samples; the
+ * bandwidth monitors are already reported by libvirt as rates. A metric whose
+ * inputs were not collected is left at zero with its `has_*` flag cleared.
+ */
+struct PerfMetrics {
+    uint64_t instructions = 0;      // delta since previous sample
+    uint64_t cpu_cycles = 0;        // delta since previous sample
+    uint64_t cache_references = 0;  // delta since previous sample
+    uint64_t cache_misses = 0;      // delta since previous sample
+    double ipc = 0.0;               // instructions per cycle
+    double cache_miss_rate = 0.0;   // misses / references
+    double mpki = 0.0;              // cache misses per thousand instructions
+    uint64_t mem_bandwidth_total = 0;  // bytes/s (mbmt)
+    uint64_t mem_bandwidth_local = 0;  // bytes/s (mbml)
+    bool has_ipc = false;
+    bool has_miss_rate = false;
+    bool has_mem_bandwidth = false;
+};
+
+/**
+ * @brief Extracts perf counters from a bulk-stats parameter list.
+ *
+ * Only `perf.<event>` fields are considered; everything else in the record is
+ * ignored so the same record can carry other stats groups.
+ *
+ * @param params Typed parameters of a `virDomainStatsRecord`.
+ * @param nparams Number of entries in `params`.
+ * @return PerfSample Counters found in the record (possibly empty).
+ */
+inline PerfSample parsePerfStats(const virTypedParameter* params, int nparams) {
+    static const std::string prefix = "perf.";
+    PerfSample sample;
+    for (int i = 0; i < nparams; i++) {
+        std::string field(params[i].field);
+        if (field.compare(0, prefix.size(), prefix) != 0) continue;
+
+        uint64_t value;
+        switch (params[i].type) {
+            case VIR_TYPED_PARAM_ULLONG: value = params[i].value.ul; break;
+            case VIR_TYPED_PARAM_LLONG:  value = static_cast<uint64_t>(params[i].value.l); break;
+            case VIR_TYPED_PARAM_UINT:   value = params[i].value.ui; break;
+            case VIR_TYPED_PARAM_INT:    value = static_cast<uint64_t>(params[i].value.i); break;
+            default: continue;
+        }
+        sample.counters[field.substr(prefix.size())] = value;
+    }
+    return sample;
+}
+
+/**
+ * @brief Computes IPC, miss-rate and bandwidth metrics from two samples.
+ *
+ * A counter that went backwards (perf events re-enabled or the domain
+ * restarted) is treated as reset, so its current value is used as the delta.
+ *
+ * @param prev Previous sample, or `nullptr` to use totals since enablement.
+ * @param cur Current sample.
+ * @return PerfMetrics Derived metrics for the interval.
+ */
+inline PerfMetrics computePerfMetrics(const PerfSample* prev, const PerfSample& cur) {
+    auto delta = [&](const std::string& event) -> uint64_t {
+        uint64_t now = cur.get(event);
+        if (!prev || !prev->has(event)) return now;
+        uint64_t before = prev->get(event);
+        return now >= before ? now - before : now;
+    };
+
+    PerfMetrics m;
+    m.instructions = delta(VIR_PERF_PARAM_INSTRUCTIONS);
+    m.cpu_cycles = delta(VIR_PERF_PARAM_CPU_CYCLES);
+    m.cache_references = delta(VIR_PERF_PARAM_CACHE_REFERENCES);
+    m.cache_misses = delta(VIR_PERF_PARAM_CACHE_MISSES);
+
+    if (cur.has(VIR_PERF_PARAM_INSTRUCTIONS) && cur.has(VIR_PERF_PARAM_CPU_CYCLES) && m.cpu_cycles > 0) {
+        m.ipc = static_cast<double>(m.instructions) / m.cpu_cycles;
+        m.has_ipc = true;
+    }
+    if (cur.has(VIR_PERF_PARAM_CACHE_MISSES) && cur.has(VIR_PERF_PARAM_CACHE_REFERENCES) && m.cache_references > 0) {
+        m.cache_miss_rate = static_cast<double>(m.cache_misses) / m.cache_references;
+        m.has_miss_rate = true;
+    }
+    if (cur.has(VIR_PERF_PARAM_CACHE_MISSES) && m.instructions > 0) {
+        m.mpki = 1000.0 * m.cache_misses / m.instructions;
+    }
+    if (cur.has(VIR_PERF_PARAM_MBMT) || cur.has(VIR_PERF_PARAM_MBML)) {
+        m.mem_bandwidth_total = cur.get(VIR_PERF_PARAM_MBMT);
+        m.mem_bandwidth_local = cur.get(VIR_PERF_PARAM_MBML);
+        m.has_mem_bandwidth = true;
+    }
+    return m;
+}
+
+#endif // PERF_H
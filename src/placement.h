@@ -0,0 +1,363 @@
+// Affinity/anti-affinity placement over the fleet model
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fleet.h"
+#include "placement_index.h"
+#include "reservation.h"
+
+enum class AffinityType {
+    Affinity,      // members share a topology domain
+    AntiAffinity,  // members spread across topology domains
+};
+
+/**
+ * @brief A placement constraint over the VMs labelled `label_key=label_value`.
+ *
+ * The topology key selects what "together" means: the same host, rack or
+ * zone. Anti-affinity allows up to `max_per_domain` members per domain.
+ * Non-required rules only rank hosts that satisfy every required rule.
+ */
+struct AffinityRule {
+    std::string name;
+    std::string label_key;
+    std::string label_value;
+    AffinityType type = AffinityType::AntiAffinity;
+    std::string topology_key = "host";  // "host", "rack" or "zone"
+    unsigned max_per_domain = 1;
+    bool required = true;
+};
+
+/**
+ * @brief Returns a host's value for a topology key ("" if unknown).
+ */
+inline const std::string& topologyDomain(const FleetHost& host, const std::string& key) {
+    static const std::string none;
+    if (key == "host") return host.uri;
+    if (key == "rack") return host.rack;
+    if (key == "zone") return host.zone;
+    return none;
+}
+
+/**
+ * @brief A VM's record in the fleet model while it is being re-placed.
+ *
+ * The rule counts include the VM at its current host, so checks for its new
+ * host discount it there, whichever topology key a rule uses.
+ */
+struct PlacedVM {
+    const FleetVM* vm = nullptr;
+    const FleetHost* host = nullptr;
+};
+
+/**
+ * @brief Places VMs on fleet hosts subject to affinity rules.
+ *
+ * Each rule keeps a count of its members per topology domain, and rules are
+ * indexed by label, so checking a candidate host costs one hash lookup per
+ * rule that applies to the VM, independent of how many VMs are placed.
+ * Required affinity with members already placed restricts the candidates to
+ * the hosts of the domains holding them. VMs no rule applies to are placed
+ * through the capacity index without visiting hosts at all. Every VM is
+ * confined to one host NUMA cell. With a reservation book, hosts must also
+ * have the VM's capacity free under every future reservation, and placed VMs
+ * are admitted in the book.
+ */
+class PlacementScheduler {
+    private:
+        std::vector<AffinityRule> rules;
+        std::unordered_map<std::string, std::vector<size_t>> rules_by_label;  // "key=value" -> rules
+        std::vector<std::unordered_map<std::string, unsigned>> occupancy;     // per rule: domain -> members
+        std::vector<unsigned> members;                                        // per rule
+        PlacementIndex index;
+        ReservationBook* book = nullptr;
+        // topology key -> domain -> hosts
+        std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::string>>> hosts_by_domain;
+
+        void count(const FleetVM& vm, const FleetHost& host, int delta) {
+            for (size_t r : rulesFor(vm)) {
+                const std::string& domain = topologyDomain(host, rules[r].topology_key);
+                unsigned& n = occupancy[r][domain];
+                n = delta > 0 ? n + 1 : (n ? n - 1 : 0);
+                members[r] = delta > 0 ? members[r] + 1 : (members[r] ? members[r] - 1 : 0);
+            }
+        }
+
+    public:
+        /**
+         * @brief Whether the re-placed VM's current record is counted in rule `r`.
+         */
+        bool counted(size_t r, const PlacedVM& current) const {
+            if (!current.vm || !current.host) return false;
+            auto it = current.vm->labels.find(rules[r].label_key);
+            return it != current.vm->labels.end() && it->second == rules[r].label_value;
+        }
+
+        /**
+         * @brief Members of rule `r` in `domain`, not counting the VM being re-placed.
+         */
+        unsigned othersIn(size_t r, const std::string& domain, const PlacedVM& current) const {
+            auto it = occupancy[r].find(domain);
+            unsigned n = it == occupancy[r].end() ? 0 : it->second;
+            if (n > 0 && counted(r, current) && topologyDomain(*current.host, rules[r].topology_key) == domain) n--;
+            return n;
+        }
+
+        /**
+         * @brief Members of rule `r` anywhere, not counting the VM being re-placed.
+         */
+        unsigned othersTotal(size_t r, const PlacedVM& current) const {
+            return members[r] - (members[r] > 0 && counted(r, current) ? 1 : 0);
+        }
+
+        /**
+         * @brief Adds a rule; call rebuild() afterwards to count existing members.
+         *
+         * @return true if the rule is valid and its name unused, false otherwise.
+         */
+        bool addRule(const AffinityRule& rule, std::string& error) {
+            if (rule.topology_key != "host" && rule.topology_key != "rack" && rule.topology_key != "zone") {
+                error = "unknown topology key '" + rule.topology_key + "'";
+                return false;
+            }
+            if (rule.label_key.empty()) {
+                error = "rule '" + rule.name + "' has no label selector";
+                return false;
+            }
+            for (const auto& r : rules) {
+                if (r.name == rule.name) {
+                    error = "rule '" + rule.name + "' already exists";
+                    return false;
+                }
+            }
+            rules_by_label[rule.label_key + "=" + rule.label_value].push_back(rules.size());
+            rules.push_back(rule);
+            occupancy.emplace_back();
+            members.push_back(0);
+            return true;
+        }
+
+        /**
+         * @brief Recounts rule members and topology domains from the fleet model.
+         *
+         * Needed after adding rules or hosts, or after the model changed outside
+         * place()/remove().
+         */
+        void rebuild(const FleetModel& fleet) {
+            for (auto& o : occupancy) o.clear();
+            std::fill(members.begin(), members.end(), 0);
+            hosts_by_domain.clear();
+            for (const auto& [uri, host] : fleet.getHosts()) {
+                for (const char* key : {"host", "rack", "zone"}) {
+                    hosts_by_domain[key][topologyDomain(host, key)].push_back(uri);
+                }
+            }
+            for (const auto& [name, vm] : fleet.getVMs()) count(vm, *fleet.host(vm.host), +1);
+            index.build(fleet);
+        }
+
+        /**
+         * @brief Returns the indexes of the rules a VM is a member of.
+         */
+        std::vector<size_t> rulesFor(const FleetVM& vm) const {
+            std::vector<size_t> result;
+            for (const auto& [key, value] : vm.labels) {
+                auto it = rules_by_label.find(key + "=" + value);
+                if (it != rules_by_label.end()) result.insert(result.end(), it->second.begin(), it->second.end());
+            }
+            return result;
+        }
+
+        /**
+         * @brief Checks the required rules for a VM on a candidate host.
+         *
+         * @param applicable Rules for the VM's new labels, from rulesFor().
+         * @param current The VM's current record if it is already placed.
+         * @param why If given, set to the first violated rule's name.
+         */
+        bool allowed(const FleetHost& host, const std::vector<size_t>& applicable, const PlacedVM& current = {},
+                     std::string* why = nullptr) const {
+            for (size_t r : applicable) {
+                const AffinityRule& rule = rules[r];
+                if (!rule.required) continue;
+                unsigned here = othersIn(r, topologyDomain(host, rule.topology_key), current);
+                bool ok = rule.type == AffinityType::AntiAffinity ? here < rule.max_per_domain
+                                                                   : here > 0 || othersTotal(r, current) == 0;
+                if (!ok) {
+                    if (why) *why = rule.name;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief Scores a host by the preferred (non-required) rules; higher is better.
+         */
+        double preference(const FleetHost& host, const std::vector<size_t>& applicable,
+                          const PlacedVM& current = {}) const {
+            double score = 0.0;
+            for (size_t r : applicable) {
+                const AffinityRule& rule = rules[r];
+                if (rule.required) continue;
+                unsigned here = othersIn(r, topologyDomain(host, rule.topology_key), current);
+                score += rule.type == AffinityType::Affinity ? (here > 0 ? 1.0 : 0.0) : -static_cast<double>(here);
+            }
+            return score;
+        }
+
+        /**
+         * @brief Chooses a host for a VM and records it in the fleet model.
+         *
+         * Among hosts with a cell that fits the VM and that satisfy every required
+         * rule, the host with the best preference score wins, ties going to the
+         * tightest fit. With a reservation book (see useReservations()) the VM is
+         * admitted in it; a VM claiming a reservation can only go to the
+         * reservation's host.
+         *
+         * @param fleet Fleet model; the VM is added (or moved) on success.
+         * @param vm VM to place; its `host` is ignored.
+         * @param error Set to the reason when no host qualifies.
+         * @param reservation Reservation the VM claims capacity from; empty for none.
+         * @param now_ms Admission time for the reservation book; 0 = now.
+         * @return std::string Chosen host URI, or an empty string on failure.
+         */
+        std::string place(FleetModel& fleet, FleetVM vm, std::string& error, const std::string& reservation = "",
+                          uint64_t now_ms = 0) {
+            std::vector<size_t> applicable = rulesFor(vm);
+            PlacedVM current;
+            if ((current.vm = fleet.vm(vm.name))) current.host = fleet.host(current.vm->host);
+
+            // Required affinity with other placed members: only their domains qualify
+            const std::vector<std::string>* only = nullptr;
+            std::vector<std::string> narrowed;
+            for (size_t r : applicable) {
+                const AffinityRule& rule = rules[r];
+                if (!rule.required || rule.type != AffinityType::Affinity || othersTotal(r, current) == 0) continue;
+                narrowed.clear();
+                for (const auto& entry : occupancy[r]) {
+                    const std::string& domain = entry.first;
+                    if (othersIn(r, domain, current) == 0) continue;
+                    const auto& in = hosts_by_domain[rule.topology_key][domain];
+                    narrowed.insert(narrowed.end(), in.begin(), in.end());
+                }
+                only = &narrowed;
+                break;
+            }
+
+            std::vector<std::string> reserved_host;
+            if (!reservation.empty()) {
+                std::optional<Reservation> r = book ? book->reservation(reservation) : std::nullopt;
+                if (!r) {
+                    error = "no reservation '" + reservation + "' for VM '" + vm.name + "'";
+                    return "";
+                }
+                if (only && std::find(only->begin(), only->end(), r->host) == only->end()) {
+                    error = "VM '" + vm.name + "' must join its affinity group away from reserved host " + r->host;
+                    return "";
+                }
+                reserved_host.push_back(r->host);
+                only = &reserved_host;
+            }
+            // A re-placed VM must not count against its own capacity; re-adopted where it was if nothing fits
+            if (now_ms == 0) now_ms = reservationClockMs();
+            std::string admitted_on = book ? book->admittedHost(vm.name) : "";
+            if (!admitted_on.empty()) book->releaseVM(vm.name);
+            auto unplaced = [&] {
+                if (!admitted_on.empty() && current.vm) {
+                    book->adoptVM(vm.name, admitted_on, current.vm->memory_kib, current.vm->vcpus, now_ms);
+                }
+                return std::string();
+            };
+
+            std::optional<CellRef> best;
+            double best_score = 0.0;
+            uint64_t best_left = 0;
+            size_t with_capacity = 0, unreserved = 0;
+            std::string violated;
+            auto consider = [&](const FleetHost& h) {
+                if (!h.schedulable || !h.fits(vm.memory_kib, vm.vcpus)) return;
+                std::optional<CellRef> cell = index.bestFitOnHost(h.uri, vm.memory_kib, vm.vcpus);
+                if (!cell) return;
+                with_capacity++;
+                // admitVM() checks a claimed reservation's host itself
+                std::string why;
+                if (book && reservation.empty() &&
+                    !book->fits(h.uri, vm.memory_kib, vm.vcpus, now_ms, reservation_forever, why)) return;
+                unreserved++;
+                if (!allowed(h, applicable, current, &violated)) return;
+                double score = preference(h, applicable, current);
+                uint64_t left = h.freeMemory();
+                if (!best || score > best_score || (score == best_score && left < best_left)) {
+                    best = cell;
+                    best_score = score;
+                    best_left = left;
+                }
+            };
+            if (only) {
+                for (const auto& uri : *only) {
+                    if (const FleetHost* h = fleet.host(uri)) consider(*h);
+                }
+            } else if (applicable.empty() && !book) {
+                best = index.bestFit(vm.memory_kib, vm.vcpus);
+            } else {
+                for (const auto& [uri, h] : fleet.getHosts()) consider(h);
+            }
+
+            if (!best) {
+                if (with_capacity == 0) {
+                    error = "no host has capacity for VM '" + vm.name + "'";
+                } else if (unreserved == 0) {
+                    error = "no host has capacity for VM '" + vm.name + "' outside its reservations";
+                } else {
+                    error = "VM '" + vm.name + "' violates rule '" + violated + "' on every host";
+                }
+                return unplaced();
+            }
+            if (book && !book->admitVM(vm.name, best->host, vm.memory_kib, vm.vcpus, now_ms, error, reservation)) {
+                return unplaced();
+            }
+            if (const FleetVM* old = fleet.vm(vm.name)) {
+                count(*old, *fleet.host(old->host), -1);
+                index.releaseVM(*old);
+            }
+            index.reserve(*best, vm.memory_kib, vm.vcpus);
+            vm.host = best->host;
+            vm.cell = best->cell;
+            fleet.upsertVM(vm);
+            count(vm, *fleet.host(vm.host), +1);
+            return vm.host;
+        }
+
+        /**
+         * @brief Removes a VM from the fleet model and the rule counts.
+         */
+        void remove(FleetModel& fleet, const std::string& name) {
+            const FleetVM* vm = fleet.vm(name);
+            if (!vm) return;
+            count(*vm, *fleet.host(vm->host), -1);
+            index.releaseVM(*vm);
+            fleet.removeVM(name);
+            if (book) book->releaseVM(name);
+        }
+
+        /**
+         * @brief Checks placements against a reservation book and admits placed VMs in it.
+         *
+         * The book must know the fleet's hosts (see ReservationBook::syncFleet()).
+         * Pass nullptr to place on capacity and rules alone again.
+         */
+        void useReservations(ReservationBook* reservations) { book = reservations; }
+
+        const std::vector<AffinityRule>& getRules() const { return rules; }
+        const PlacementIndex& capacityIndex() const { return index; }
+};
+
+#endif // PLACEMENT_H
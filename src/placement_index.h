@@ -0,0 +1,265 @@
+// Logarithmic-time capacity index over host NUMA cells
+#ifndef PLACEMENT_INDEX_H
+#define PLACEMENT_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "fleet.h"
+
+/**
+ * @brief A NUMA cell of a fleet host, as returned by PlacementIndex queries.
+ */
+struct CellRef {
+    std::string host;
+    int cell = 0;
+};
+
+/**
+ * @brief Free capacity of every host NUMA cell, indexed for placement queries.
+ *
+ * Cells are bucketed by free vCPUs (capped at `max_vcpus`), and a segment
+ * tree over the buckets keeps, per node, the cells of its buckets ordered by
+ * free memory. A query for (memory, vCPUs) visits the O(log V) nodes
+ * covering the buckets with enough vCPUs and does one ordered-set lookup in
+ * each, so best-fit and spread queries cost O(log V * log n) for n cells,
+ * and so does updating a cell after a placement or release.
+ */
+class PlacementIndex {
+    private:
+        struct Cell {
+            std::string host;
+            int id = 0;
+            uint64_t free_mem = 0;
+            unsigned free_vcpus = 0;
+            bool live = false;
+        };
+        using Entry = std::pair<uint64_t, uint32_t>;  // (free memory, cell index)
+
+        unsigned width;                              // bucket count, a power of two
+        std::vector<std::set<Entry>> tree;           // 1-based segment tree, leaves at [width, 2*width)
+        std::vector<Cell> cells;
+        std::vector<uint32_t> free_slots;
+        std::unordered_map<std::string, std::vector<uint32_t>> cells_by_host;
+        std::unordered_map<std::string, CellRef> inferred;  // VM of unknown cell -> cell build() charged
+
+        unsigned bucket(unsigned vcpus) const { return std::min(vcpus, width - 1); }
+
+        void link(uint32_t idx) {
+            const Cell& c = cells[idx];
+            for (unsigned node = bucket(c.free_vcpus) + width; node; node /= 2) tree[node].emplace(c.free_mem, idx);
+        }
+
+        void unlink(uint32_t idx) {
+            const Cell& c = cells[idx];
+            for (unsigned node = bucket(c.free_vcpus) + width; node; node /= 2) tree[node].erase({c.free_mem, idx});
+        }
+
+        // Segment tree nodes covering buckets [bucket(vcpus), width)
+        std::vector<unsigned> cover(unsigned vcpus) const {
+            std::vector<unsigned> nodes;
+            unsigned l = bucket(vcpus) + width, r = 2 * width;
+            for (; l < r; l /= 2, r /= 2) {
+                if (l & 1) nodes.push_back(l++);
+                if (r & 1) nodes.push_back(--r);
+            }
+            return nodes;
+        }
+
+        std::optional<uint32_t> find(const std::string& host, int cell) const {
+            auto it = cells_by_host.find(host);
+            if (it == cells_by_host.end()) return std::nullopt;
+            for (uint32_t idx : it->second) {
+                if (cells[idx].id == cell) return idx;
+            }
+            return std::nullopt;
+        }
+
+        CellRef ref(uint32_t idx) const { return CellRef{cells[idx].host, cells[idx].id}; }
+
+    public:
+        /**
+         * @param max_vcpus Largest per-cell vCPU count distinguished by the index;
+         * cells with more free vCPUs share the top bucket.
+         */
+        explicit PlacementIndex(unsigned max_vcpus = 1024) {
+            width = 1;
+            while (width < max_vcpus + 1) width *= 2;
+            tree.resize(2 * width);
+        }
+
+        /**
+         * @brief Rebuilds the index from a fleet model.
+         *
+         * VMs with a known cell are charged to it; others are charged to the
+         * host's cell with the most free memory, which is remembered so
+         * releaseVM() returns the capacity to the same cell.
+         */
+        void build(const FleetModel& fleet) {
+            for (auto& node : tree) node.clear();
+            cells.clear();
+            free_slots.clear();
+            cells_by_host.clear();
+            inferred.clear();
+            for (const auto& [uri, host] : fleet.getHosts()) {
+                if (!host.schedulable) continue;
+                std::vector<FleetCell> caps = host.cells;
+                if (caps.empty()) caps.push_back(FleetCell{host.memory_kib, host.cpus});
+                std::vector<std::pair<uint64_t, unsigned>> free;
+                for (const auto& c : caps) free.emplace_back(c.memory_kib, c.cpus);
+                auto charge = [&free](size_t i, const FleetVM& vm) {
+                    free[i].first -= std::min(free[i].first, vm.memory_kib);
+                    free[i].second -= std::min(free[i].second, vm.vcpus);
+                };
+                for (const auto& name : fleet.vmsOn(uri)) {
+                    const FleetVM& vm = *fleet.vm(name);
+                    if (vm.cell >= 0 && static_cast<size_t>(vm.cell) < free.size()) {
+                        charge(vm.cell, vm);
+                    } else {
+                        size_t most = std::max_element(free.begin(), free.end()) - free.begin();
+                        charge(most, vm);
+                        inferred[name] = CellRef{uri, static_cast<int>(most)};
+                    }
+                }
+                for (size_t i = 0; i < free.size(); i++) {
+                    setCell(uri, static_cast<int>(i), free[i].first, free[i].second);
+                }
+            }
+        }
+
+        /**
+         * @brief Adds a cell or replaces its free capacity.
+         */
+        void setCell(const std::string& host, int cell, uint64_t free_mem, unsigned free_vcpus) {
+            std::optional<uint32_t> idx = find(host, cell);
+            if (idx) {
+                unlink(*idx);
+            } else {
+                if (free_slots.empty()) {
+                    idx = static_cast<uint32_t>(cells.size());
+                    cells.emplace_back();
+                } else {
+                    idx = free_slots.back();
+                    free_slots.pop_back();
+                }
+                cells[*idx] = Cell{host, cell, 0, 0, true};
+                cells_by_host[host].push_back(*idx);
+            }
+            cells[*idx].free_mem = free_mem;
+            cells[*idx].free_vcpus = free_vcpus;
+            link(*idx);
+        }
+
+        void removeHost(const std::string& host) {
+            auto it = cells_by_host.find(host);
+            if (it == cells_by_host.end()) return;
+            for (uint32_t idx : it->second) {
+                unlink(idx);
+                cells[idx].live = false;
+                free_slots.push_back(idx);
+            }
+            cells_by_host.erase(it);
+        }
+
+        /**
+         * @brief Returns the cell with the least free memory that fits the request.
+         */
+        std::optional<CellRef> bestFit(uint64_t mem, unsigned vcpus) const {
+            std::optional<Entry> best;
+            for (unsigned node : cover(vcpus)) {
+                for (auto it = tree[node].lower_bound({mem, 0}); it != tree[node].end(); ++it) {
+                    if (best && *it >= *best) break;
+                    // Only the shared top bucket can hold cells with too few vCPUs
+                    if (cells[it->second].free_vcpus >= vcpus) {
+                        best = *it;
+                        break;
+                    }
+                }
+            }
+            if (!best) return std::nullopt;
+            return ref(best->second);
+        }
+
+        /**
+         * @brief Returns the cell with the most free memory that fits the request.
+         */
+        std::optional<CellRef> spread(uint64_t mem, unsigned vcpus) const {
+            std::optional<Entry> best;
+            for (unsigned node : cover(vcpus)) {
+                for (auto it = tree[node].rbegin(); it != tree[node].rend() && it->first >= mem; ++it) {
+                    if (best && *it <= *best) break;
+                    if (cells[it->second].free_vcpus >= vcpus) {
+                        best = *it;
+                        break;
+                    }
+                }
+            }
+            if (!best) return std::nullopt;
+            return ref(best->second);
+        }
+
+        /**
+         * @brief Returns the tightest-fitting cell on one host.
+         */
+        std::optional<CellRef> bestFitOnHost(const std::string& host, uint64_t mem, unsigned vcpus) const {
+            auto it = cells_by_host.find(host);
+            if (it == cells_by_host.end()) return std::nullopt;
+            std::optional<uint32_t> best;
+            for (uint32_t idx : it->second) {
+                const Cell& c = cells[idx];
+                if (c.free_mem < mem || c.free_vcpus < vcpus) continue;
+                if (!best || c.free_mem < cells[*best].free_mem) best = idx;
+            }
+            if (!best) return std::nullopt;
+            return ref(*best);
+        }
+
+        /**
+         * @brief Takes capacity from a cell after a placement.
+         *
+         * @return true if the cell exists and had the capacity, false otherwise.
+         */
+        bool reserve(const CellRef& where, uint64_t mem, unsigned vcpus) {
+            std::optional<uint32_t> idx = find(where.host, where.cell);
+            if (!idx || cells[*idx].free_mem < mem || cells[*idx].free_vcpus < vcpus) return false;
+            const Cell& c = cells[*idx];
+            setCell(where.host, where.cell, c.free_mem - mem, c.free_vcpus - vcpus);
+            return true;
+        }
+
+        /**
+         * @brief Returns capacity to a cell after a VM left it.
+         */
+        void release(const CellRef& where, uint64_t mem, unsigned vcpus) {
+            std::optional<uint32_t> idx = find(where.host, where.cell);
+            if (!idx) return;
+            const Cell& c = cells[*idx];
+            setCell(where.host, where.cell, c.free_mem + mem, c.free_vcpus + vcpus);
+        }
+
+        /**
+         * @brief Returns a VM's capacity to the cell it is charged to.
+         *
+         * That is `vm.cell`, or for a VM of unknown cell the cell build() chose.
+         */
+        void releaseVM(const FleetVM& vm) {
+            CellRef where{vm.host, vm.cell};
+            if (vm.cell < 0) {
+                auto it = inferred.find(vm.name);
+                if (it == inferred.end()) return;
+                where = it->second;
+                inferred.erase(it);
+            }
+            release(where, vm.memory_kib, vm.vcpus);
+        }
+
+        size_t size() const { return cells.size() - free_slots.size(); }
+};
+
+#endif // PLACEMENT_INDEX_H
@@ -0,0 +1,384 @@
+// Direct QMP client: pipelined queries to many QEMU monitors from one thread
+#ifndef QMP_H
+#define QMP_H
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "iothread.h"
+#include "json.h"
+
+/**
+ * @brief Cumulative I/O counters of one block device, from `query-blockstats`.
+ */
+struct QmpBlockStats {
+    std::string device;  // drive id, or the guest device's qdev path with -blockdev
+    uint64_t rd_bytes = 0;
+    uint64_t wr_bytes = 0;
+    uint64_t rd_operations = 0;
+    uint64_t wr_operations = 0;
+    uint64_t flush_operations = 0;
+    uint64_t rd_total_time_ns = 0;
+    uint64_t wr_total_time_ns = 0;
+    uint64_t flush_total_time_ns = 0;
+};
+
+/**
+ * @brief Reads the `return` value of `query-blockstats`.
+ */
+inline std::vector<QmpBlockStats> parseQmpBlockStats(const JsonValue& ret) {
+    std::vector<QmpBlockStats> devices;
+    for (const auto& entry : ret.array) {
+        const JsonValue& s = entry["stats"];
+        if (s.type != JsonValue::Object) continue;
+        QmpBlockStats b;
+        b.device = entry["device"].string.empty() ? entry["qdev"].string : entry["device"].string;
+        b.rd_bytes = s["rd_bytes"].asUint();
+        b.wr_bytes = s["wr_bytes"].asUint();
+        b.rd_operations = s["rd_operations"].asUint();
+        b.wr_operations = s["wr_operations"].asUint();
+        b.flush_operations = s["flush_operations"].asUint();
+        b.rd_total_time_ns = s["rd_total_time_ns"].asUint();
+        b.wr_total_time_ns = s["wr_total_time_ns"].asUint();
+        b.flush_total_time_ns = s["flush_total_time_ns"].asUint();
+        devices.push_back(b);
+    }
+    return devices;
+}
+
+/**
+ * @brief Sums block stats into the sample the IOThread polling controller uses.
+ */
+inline BlockLatencySample qmpBlockLatencySample(const std::vector<QmpBlockStats>& devices) {
+    BlockLatencySample sample;
+    for (const auto& b : devices) {
+        sample.requests += b.rd_operations + b.wr_operations + b.flush_operations;
+        sample.time_ns += b.rd_total_time_ns + b.wr_total_time_ns + b.flush_total_time_ns;
+    }
+    return sample;
+}
+
+/**
+ * @brief Reads the `return` value of `query-stats` for target "vcpu".
+ *
+ * Scalar statistics (e.g. "exits", "halt_poll_success_ns") are summed over
+ * vCPUs; histograms are skipped.
+ */
+inline std::map<std::string, uint64_t> parseQmpVcpuStats(const JsonValue& ret) {
+    std::map<std::string, uint64_t> totals;
+    for (const auto& provider : ret.array) {
+        for (const auto& stat : provider["stats"].array) {
+            const JsonValue& value = stat["value"];
+            if (value.type == JsonValue::Number) totals[stat["name"].string] += value.asUint();
+        }
+    }
+    return totals;
+}
+
+/**
+ * @brief A QMP command: `execute` with optional `arguments` given as a JSON object.
+ */
+struct QmpCommand {
+    std::string execute;
+    std::string arguments;
+};
+
+/**
+ * @brief The outcome of one command sent to one monitor.
+ */
+struct QmpReply {
+    std::string domain;
+    size_t command = 0;  // index into the commands passed to QmpMux::query()
+    bool ok = false;
+    JsonValue value;     // the command's "return"
+    std::string error;   // QMP error description, or why no reply arrived
+    bool answered = false;  // the monitor responded, with a return or an error
+};
+
+/**
+ * @brief Encodes a command as a QMP request, tagged with `id` unless it is empty.
+ */
+inline std::string qmpCommandJson(const QmpCommand& cmd, const std::string& id = "") {
+    std::string line = "{\"execute\":" + jsonQuote(cmd.execute);
+    if (!cmd.arguments.empty()) line += ",\"arguments\":" + cmd.arguments;
+    if (!id.empty()) line += ",\"id\":" + id;
+    return line + "}";
+}
+
+/**
+ * @brief Fills a reply from a parsed QMP response, taking over its "return" value.
+ *
+ * @return true if `msg` is a response ("return" or "error"), false for greetings and events.
+ */
+inline bool readQmpReply(JsonValue& msg, QmpReply& reply) {
+    if (msg.has("return")) {
+        reply.ok = reply.answered = true;
+        reply.value = std::move(msg.object["return"]);
+        return true;
+    }
+    if (msg.has("error")) {
+        reply.answered = true;
+        reply.error = msg["error"]["desc"].string;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Queries many QEMU monitor sockets at once from the calling thread.
+ *
+ * Each domain needs a QMP socket of its own (e.g. a second `-qmp
+ * unix:<path>,server=on,wait=off` added through `<qemu:commandline>`): QEMU
+ * serves one client per monitor, and libvirt holds the one it created.
+ *
+ * Connections are non-blocking and stay open between queries. A query writes
+ * every command to every monitor up front, tagged with an `id`, then collects
+ * the replies as they arrive through one epoll set, so a round costs about one
+ * monitor's latency however many domains and commands it covers. Replies that
+ * miss the timeout are reported as such and ignored if they turn up later.
+ */
+class QmpMux {
+    private:
+        struct Conn {
+            std::string name;
+            std::string path;
+            int fd = -1;
+            std::string in;
+            std::string out;
+            std::map<uint64_t, size_t> pending;  // request id -> slot in the query's replies
+        };
+
+        int epfd = -1;
+        std::unordered_map<std::string, Conn> conns;
+        uint64_t next_id = 1;  // 0 tags qmp_capabilities
+
+        static std::string encode(const QmpCommand& cmd, uint64_t id) {
+            return qmpCommandJson(cmd, std::to_string(id)) + "\r\n";
+        }
+
+        bool open(Conn& c) {
+            sockaddr_un addr{};
+            if (c.path.size() >= sizeof(addr.sun_path)) return false;
+            c.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (c.fd < 0) return false;
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, c.path.c_str(), sizeof(addr.sun_path) - 1);
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT;
+            ev.data.ptr = &c;
+            if (::connect(c.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+                epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev) < 0) {
+                close(c.fd);
+                c.fd = -1;
+                return false;
+            }
+            c.in.clear();
+            // The greeting needs no answer before negotiating, so this goes out with the first query
+            c.out = encode(QmpCommand{"qmp_capabilities", ""}, 0);
+            return true;
+        }
+
+        void drop(Conn& c, std::vector<QmpReply>& replies, const std::string& why, size_t& outstanding) {
+            for (const auto& [id, slot] : c.pending) {
+                replies[slot].error = why;
+                outstanding--;
+            }
+            c.pending.clear();
+            if (c.fd >= 0) close(c.fd);
+            c.fd = -1;
+            c.out.clear();
+        }
+
+        bool flush(Conn& c) {
+            while (!c.out.empty()) {
+                ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (n <= 0) return false;
+                c.out.erase(0, static_cast<size_t>(n));
+            }
+            epoll_event ev{};
+            ev.events = c.out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+            ev.data.ptr = &c;
+            return epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev) == 0;
+        }
+
+        // Replies that arrived before a hang-up still count, so the buffer is parsed before reporting it
+        bool receive(Conn& c, std::vector<QmpReply>& replies, size_t& outstanding) {
+            char buf[16384];
+            bool connected = true;
+            while (true) {
+                ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (n <= 0) {
+                    connected = false;
+                    break;
+                }
+                c.in.append(buf, static_cast<size_t>(n));
+            }
+            size_t start = 0, nl;
+            while ((nl = c.in.find('\n', start)) != std::string::npos) {
+                JsonValue msg;
+                bool parsed = parseJson(c.in.substr(start, nl - start), msg);
+                start = nl + 1;
+                // Greeting and events carry no id; replies to timed-out requests are no longer pending
+                if (!parsed || !msg.has("id")) continue;
+                auto it = c.pending.find(msg["id"].asUint());
+                if (it == c.pending.end() || !readQmpReply(msg, replies[it->second])) continue;
+                c.pending.erase(it);
+                outstanding--;
+            }
+            c.in.erase(0, start);
+            return connected;
+        }
+
+        std::vector<QmpReply> run(const std::vector<Conn*>& targets, const std::vector<QmpCommand>& commands,
+                                  int timeout_ms) {
+            std::vector<QmpReply> replies;
+            size_t outstanding = 0;
+            for (Conn* target : targets) {
+                Conn& c = *target;
+                size_t first = replies.size();
+                for (size_t i = 0; i < commands.size(); i++) {
+                    QmpReply r;
+                    r.domain = c.name;
+                    r.command = i;
+                    replies.push_back(std::move(r));
+                }
+                bool reused = c.fd >= 0;
+                if (epfd < 0 || (!reused && !open(c))) {
+                    for (size_t i = first; i < replies.size(); i++) replies[i].error = "cannot connect to " + c.path;
+                    continue;
+                }
+                std::string batch;
+                for (size_t i = 0; i < commands.size(); i++) {
+                    c.pending[next_id] = first + i;
+                    batch += encode(commands[i], next_id++);
+                    outstanding++;
+                }
+                c.out += batch;
+                bool sent = flush(c);
+                if (!sent && reused) {
+                    // Hung up since the last query (e.g. QEMU restarted): reconnect once and resend
+                    close(c.fd);
+                    c.fd = -1;
+                    if (open(c)) {
+                        c.out += batch;
+                        sent = flush(c);
+                    }
+                }
+                if (!sent) drop(c, replies, "monitor closed", outstanding);
+            }
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            epoll_event events[64];
+            while (outstanding > 0) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0) break;
+                int n = epoll_wait(epfd, events, 64, static_cast<int>(left.count()));
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0) break;
+                for (int i = 0; i < n; i++) {
+                    Conn& c = *static_cast<Conn*>(events[i].data.ptr);
+                    if (c.fd < 0) continue;
+                    bool alive = true;
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) alive = receive(c, replies, outstanding);
+                    if (alive && (events[i].events & EPOLLOUT)) alive = flush(c);
+                    if (!alive) drop(c, replies, "monitor closed", outstanding);
+                }
+            }
+            for (auto& [name, c] : conns) {
+                for (const auto& [id, slot] : c.pending) replies[slot].error = "timed out";
+                c.pending.clear();
+            }
+            return replies;
+        }
+
+    public:
+        QmpMux() : epfd(epoll_create1(EPOLL_CLOEXEC)) {}
+        QmpMux(const QmpMux&) = delete;
+        QmpMux& operator=(const QmpMux&) = delete;
+
+        ~QmpMux() {
+            for (auto& [name, c] : conns) {
+                if (c.fd >= 0) close(c.fd);
+            }
+            if (epfd >= 0) close(epfd);
+        }
+
+        /**
+         * @brief Adds a domain's monitor socket; it is connected on the next query.
+         */
+        void add(const std::string& name, const std::string& socket_path) {
+            Conn& c = conns[name];
+            if (c.path == socket_path) return;
+            if (c.fd >= 0) close(c.fd);
+            c = Conn{};
+            c.name = name;
+            c.path = socket_path;
+        }
+
+        void remove(const std::string& name) {
+            auto it = conns.find(name);
+            if (it == conns.end()) return;
+            if (it->second.fd >= 0) close(it->second.fd);
+            conns.erase(it);
+        }
+
+        bool contains(const std::string& name) const { return conns.count(name) > 0; }
+
+        std::vector<std::string> domains() const {
+            std::vector<std::string> names;
+            for (const auto& [name, c] : conns) names.push_back(name);
+            return names;
+        }
+
+        size_t size() const { return conns.size(); }
+
+        /**
+         * @brief Sends `commands` to every monitor and waits for the replies.
+         *
+         * Monitors that are not connected are (re)connected first, as are those
+         * found to have hung up since the last query. A monitor that hangs up
+         * while commands are in flight fails them and is reconnected on the next
+         * query; replies it sent before hanging up still count.
+         *
+         * @param commands Commands to run on each monitor, in order.
+         * @param timeout_ms How long to wait for all replies.
+         * @return std::vector<QmpReply> One reply per monitor and command.
+         */
+        std::vector<QmpReply> query(const std::vector<QmpCommand>& commands, int timeout_ms = 500) {
+            std::vector<Conn*> targets;
+            for (auto& [name, c] : conns) targets.push_back(&c);
+            return run(targets, commands, timeout_ms);
+        }
+
+        /**
+         * @brief Sends `commands` to one domain's monitor only, e.g. to configure that domain.
+         *
+         * @return std::vector<QmpReply> One reply per command; none if the domain was never added.
+         */
+        std::vector<QmpReply> query(const std::string& name, const std::vector<QmpCommand>& commands,
+                                    int timeout_ms = 500) {
+            auto it = conns.find(name);
+            if (it == conns.end()) return {};
+            return run({&it->second}, commands, timeout_ms);
+        }
+
+        std::vector<QmpReply> query(const QmpCommand& command, int timeout_ms = 500) {
+            return query(std::vector<QmpCommand>{command}, timeout_ms);
+        }
+};
+
+#endif // QMP_H
@@ -0,0 +1,311 @@
+// Cache and memory-bandwidth allocation (Intel RDT / resctrl) admission
+#ifndef RDT_H
+#define RDT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "spec.h"
+#include "xml.h"
+
+/**
+ * @brief Allocation budget of one host cache bank (from `<host><cache><bank>`).
+ *
+ * With CDP enabled the bank exposes separate "code" and "data" controls, each
+ * with the bank's full capacity, so usage is tracked per control type.
+ */
+struct CacheBankBudget {
+    unsigned id = 0;
+    unsigned level = 0;
+    uint64_t size_kib = 0;
+    uint64_t granularity_kib = 0;
+    uint64_t min_kib = 0;
+    unsigned max_allocs = 0;                      // resctrl groups, including the default group
+    std::map<std::string, uint64_t> allocated_kib; // control type -> reserved KiB
+    unsigned groups = 0;
+};
+
+/**
+ * @brief Memory-bandwidth budget of one host NUMA node (from `<host><memory_bandwidth>`).
+ */
+struct BandwidthNodeBudget {
+    unsigned id = 0;
+    unsigned granularity = 0;  // percent
+    unsigned min = 0;          // percent
+    unsigned max_allocs = 0;
+    unsigned allocated = 0;    // percent reserved
+    unsigned groups = 0;
+};
+
+/**
+ * @brief Parses `<cachetune>` and `<memorytune>` groups out of domain XML.
+ */
+inline void parseResctrl(const std::string& domain_xml, std::vector<CacheTuneSpec>& cachetune,
+                         std::vector<MemoryTuneSpec>& memorytune) {
+    for (const auto& group : xmlElements(domain_xml, "cachetune")) {
+        CacheTuneSpec ct;
+        ct.vcpus = xmlAttr(group, "vcpus");
+        for (const auto& cache : xmlElements(group, "cache")) {
+            CacheAllocation a;
+            a.id = static_cast<unsigned>(std::stoul("0" + xmlAttr(cache, "id")));
+            a.level = static_cast<unsigned>(std::stoul("0" + xmlAttr(cache, "level")));
+            a.type = xmlAttr(cache, "type");
+            a.size_kib = xmlToKiB(std::stoull("0" + xmlAttr(cache, "size")), xmlAttr(cache, "unit"));
+            ct.caches.push_back(a);
+        }
+        cachetune.push_back(ct);
+    }
+    for (const auto& group : xmlElements(domain_xml, "memorytune")) {
+        MemoryTuneSpec mt;
+        mt.vcpus = xmlAttr(group, "vcpus");
+        for (const auto& node : xmlElements(group, "node")) {
+            MemoryBandwidthAllocation a;
+            a.node = static_cast<unsigned>(std::stoul("0" + xmlAttr(node, "id")));
+            a.bandwidth = static_cast<unsigned>(std::stoul("0" + xmlAttr(node, "bandwidth")));
+            mt.nodes.push_back(a);
+        }
+        memorytune.push_back(mt);
+    }
+}
+
+/**
+ * @brief Tracks host cache-way and memory-bandwidth budgets and admits guest allocations.
+ *
+ * A request is admitted only if every cache allocation is granularity-aligned,
+ * at least the bank minimum and fits in what is left of its bank (one
+ * granularity unit always stays with the host's default group), every
+ * bandwidth share fits within 100% of its node, and no resource runs out of
+ * resctrl groups.
+ */
+class RdtBudget {
+    private:
+        std::map<std::pair<unsigned, unsigned>, CacheBankBudget> banks;  // (level, id) -> budget
+        std::map<unsigned, BandwidthNodeBudget> nodes;
+        std::map<std::string, std::pair<std::vector<CacheTuneSpec>, std::vector<MemoryTuneSpec>>> holdings;
+
+        static unsigned toUnsigned(const std::string& s) {
+            return s.empty() ? 0 : static_cast<unsigned>(std::stoul(s));
+        }
+
+        // Applies (sign = +1) or reverts (sign = -1) a set of allocations
+        void apply(const std::vector<CacheTuneSpec>& cachetune, const std::vector<MemoryTuneSpec>& memorytune,
+                   int sign) {
+            for (const auto& group : cachetune) {
+                std::set<std::pair<unsigned, unsigned>> touched;
+                for (const auto& c : group.caches) {
+                    auto it = banks.find({c.level, c.id});
+                    if (it == banks.end()) continue;
+                    uint64_t& used = it->second.allocated_kib[c.type];
+                    used = sign > 0 ? used + c.size_kib : used - std::min(used, c.size_kib);
+                    touched.insert(it->first);
+                }
+                for (const auto& key : touched) {
+                    unsigned& g = banks[key].groups;
+                    g = sign > 0 ? g + 1 : (g ? g - 1 : 0);
+                }
+            }
+            for (const auto& group : memorytune) {
+                std::set<unsigned> touched;
+                for (const auto& n : group.nodes) {
+                    auto it = nodes.find(n.node);
+                    if (it == nodes.end()) continue;
+                    unsigned& used = it->second.allocated;
+                    used = sign > 0 ? used + n.bandwidth : used - std::min(used, n.bandwidth);
+                    touched.insert(n.node);
+                }
+                for (unsigned id : touched) {
+                    unsigned& g = nodes[id].groups;
+                    g = sign > 0 ? g + 1 : (g ? g - 1 : 0);
+                }
+            }
+        }
+
+    public:
+        /**
+         * @brief Loads cache banks and bandwidth nodes from host capabilities XML.
+         *
+         * Existing reservations are kept and re-applied to the new budgets.
+         *
+         * @param caps_xml Output of `virConnectGetCapabilities`.
+         * @return true if the host reports any allocatable cache or bandwidth, false otherwise.
+         */
+        bool loadCapabilities(const std::string& caps_xml) {
+            banks.clear();
+            nodes.clear();
+            std::string host = xmlElement(caps_xml, "host");
+
+            for (const auto& bank : xmlElements(xmlElement(host, "cache"), "bank")) {
+                std::vector<std::string> controls = xmlElements(bank, "control");
+                if (controls.empty()) continue;  // monitoring only, no allocation
+                CacheBankBudget b;
+                b.id = toUnsigned(xmlAttr(bank, "id"));
+                b.level = toUnsigned(xmlAttr(bank, "level"));
+                b.size_kib = xmlToKiB(std::stoull("0" + xmlAttr(bank, "size")), xmlAttr(bank, "unit"));
+                const std::string& ctl = controls.front();
+                b.granularity_kib = xmlToKiB(std::stoull("0" + xmlAttr(ctl, "granularity")), xmlAttr(ctl, "unit"));
+                std::string min = xmlAttr(ctl, "min");
+                b.min_kib = min.empty() ? b.granularity_kib : xmlToKiB(std::stoull(min), xmlAttr(ctl, "unit"));
+                b.max_allocs = toUnsigned(xmlAttr(ctl, "maxAllocs"));
+                for (const auto& c : controls) b.allocated_kib[xmlAttr(c, "type")] = 0;
+                banks[{b.level, b.id}] = b;
+            }
+
+            for (const auto& node : xmlElements(xmlElement(host, "memory_bandwidth"), "node")) {
+                std::string ctl = xmlElement(node, "control");
+                if (ctl.empty()) continue;
+                BandwidthNodeBudget n;
+                n.id = toUnsigned(xmlAttr(node, "id"));
+                n.granularity = toUnsigned(xmlAttr(ctl, "granularity"));
+                n.min = toUnsigned(xmlAttr(ctl, "min"));
+                n.max_allocs = toUnsigned(xmlAttr(ctl, "maxAllocs"));
+                nodes[n.id] = n;
+            }
+
+            for (const auto& [name, held] : holdings) apply(held.first, held.second, +1);
+            return !banks.empty() || !nodes.empty();
+        }
+
+        /**
+         * @brief Checks whether a spec's allocations fit in the remaining budget.
+         *
+         * @param spec Spec with `cachetune`/`memorytune` groups.
+         * @param error Set to a description of the first violation.
+         * @return true if the allocations fit, false otherwise.
+         */
+        bool fits(const VMSpec& spec, std::string& error) const {
+            std::map<std::pair<unsigned, unsigned>, std::map<std::string, uint64_t>> cache_demand;
+            std::map<std::pair<unsigned, unsigned>, unsigned> cache_groups;
+            for (const auto& group : spec.cachetune) {
+                std::set<std::pair<unsigned, unsigned>> touched;
+                for (const auto& c : group.caches) {
+                    auto it = banks.find({c.level, c.id});
+                    std::string where = "L" + std::to_string(c.level) + " cache " + std::to_string(c.id);
+                    if (it == banks.end()) {
+                        error = where + " does not support allocation";
+                        return false;
+                    }
+                    const CacheBankBudget& b = it->second;
+                    if (!b.allocated_kib.count(c.type)) {
+                        error = where + " has no '" + c.type + "' control" +
+                                (c.type == "both" ? " (CDP enabled: use 'code' and 'data')" : "");
+                        return false;
+                    }
+                    if (b.granularity_kib && c.size_kib % b.granularity_kib != 0) {
+                        error = where + ": size " + std::to_string(c.size_kib) + "KiB is not a multiple of " +
+                                std::to_string(b.granularity_kib) + "KiB";
+                        return false;
+                    }
+                    if (c.size_kib < b.min_kib) {
+                        error = where + ": size " + std::to_string(c.size_kib) + "KiB is below the minimum " +
+                                std::to_string(b.min_kib) + "KiB";
+                        return false;
+                    }
+                    cache_demand[it->first][c.type] += c.size_kib;
+                    touched.insert(it->first);
+                }
+                for (const auto& key : touched) cache_groups[key]++;
+            }
+            for (const auto& [key, by_type] : cache_demand) {
+                const CacheBankBudget& b = banks.at(key);
+                std::string where = "L" + std::to_string(b.level) + " cache " + std::to_string(b.id);
+                for (const auto& [type, kib] : by_type) {
+                    uint64_t usable = b.size_kib > b.granularity_kib ? b.size_kib - b.granularity_kib : 0;
+                    uint64_t used = b.allocated_kib.at(type);
+                    if (used + kib > usable) {
+                        error = where + ": " + std::to_string(kib) + "KiB requested but only " +
+                                std::to_string(usable - std::min(usable, used)) + "KiB of '" + type + "' left";
+                        return false;
+                    }
+                }
+                if (b.max_allocs && b.groups + cache_groups[key] > b.max_allocs - 1) {
+                    error = where + ": no free allocation groups (" + std::to_string(b.max_allocs - 1) + " in use)";
+                    return false;
+                }
+            }
+
+            std::map<unsigned, unsigned> bw_demand, bw_groups;
+            for (const auto& group : spec.memorytune) {
+                std::set<unsigned> touched;
+                for (const auto& n : group.nodes) {
+                    auto it = nodes.find(n.node);
+                    std::string where = "memory bandwidth node " + std::to_string(n.node);
+                    if (it == nodes.end()) {
+                        error = where + " does not support allocation";
+                        return false;
+                    }
+                    const BandwidthNodeBudget& b = it->second;
+                    if (n.bandwidth > 100 || n.bandwidth < b.min ||
+                        (b.granularity && n.bandwidth % b.granularity != 0)) {
+                        error = where + ": bandwidth " + std::to_string(n.bandwidth) + "% must be a multiple of " +
+                                std::to_string(b.granularity) + "% between " + std::to_string(b.min) + "% and 100%";
+                        return false;
+                    }
+                    bw_demand[n.node] += n.bandwidth;
+                    touched.insert(n.node);
+                }
+                for (unsigned id : touched) bw_groups[id]++;
+            }
+            for (const auto& [id, pct] : bw_demand) {
+                const BandwidthNodeBudget& b = nodes.at(id);
+                std::string where = "memory bandwidth node " + std::to_string(id);
+                if (b.allocated + pct > 100) {
+                    error = where + ": " + std::to_string(pct) + "% requested but only " +
+                            std::to_string(100 - b.allocated) + "% left";
+                    return false;
+                }
+                if (b.max_allocs && b.groups + bw_groups[id] > b.max_allocs - 1) {
+                    error = where + ": no free allocation groups (" + std::to_string(b.max_allocs - 1) + " in use)";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief Reserves a spec's allocations for `name` if they fit.
+         *
+         * Re-admitting a name first releases its previous reservation.
+         *
+         * @return true if admitted, false otherwise (with `error` set).
+         */
+        bool admit(const std::string& name, const VMSpec& spec, std::string& error) {
+            auto previous = holdings.find(name);
+            if (previous != holdings.end()) {
+                auto held = previous->second;
+                release(name);
+                if (!fits(spec, error)) {
+                    apply(held.first, held.second, +1);
+                    holdings[name] = held;
+                    return false;
+                }
+            } else if (!fits(spec, error)) {
+                return false;
+            }
+            if (spec.cachetune.empty() && spec.memorytune.empty()) return true;
+            apply(spec.cachetune, spec.memorytune, +1);
+            holdings[name] = {spec.cachetune, spec.memorytune};
+            return true;
+        }
+
+        /**
+         * @brief Returns a domain's reservation to the budget.
+         */
+        void release(const std::string& name) {
+            auto it = holdings.find(name);
+            if (it == holdings.end()) return;
+            apply(it->second.first, it->second.second, -1);
+            holdings.erase(it);
+        }
+
+        bool holds(const std::string& name) const { return holdings.count(name) != 0; }
+
+        const std::map<std::pair<unsigned, unsigned>, CacheBankBudget>& cacheBanks() const { return banks; }
+        const std::map<unsigned, BandwidthNodeBudget>& bandwidthNodes() const { return nodes; }
+};
+
+#endif // RDT_H
@@ -0,0 +1,300 @@
+// Guest readiness detection from console output and guest agent events
+#ifndef READINESS_H
+#define READINESS_H
+
+#include <libvirt/libvirt.h>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Aho-Corasick automaton matching many byte patterns in one pass.
+ *
+ * The automaton is compiled to a full transition table, so streaming input
+ * costs one table lookup per byte regardless of the number of patterns.
+ * Matching state is a single integer, letting one automaton serve any number
+ * of concurrent streams.
+ */
+class PatternMatcher {
+    private:
+        std::vector<std::array<int32_t, 256>> next;
+        std::vector<int32_t> output;  // lowest pattern index ending at each state, or -1
+        std::vector<std::string> patterns;
+
+    public:
+        PatternMatcher() { build({}); }
+        explicit PatternMatcher(const std::vector<std::string>& pats) { build(pats); }
+
+        /**
+         * @brief Compiles the automaton for a new pattern set. Empty patterns are ignored.
+         */
+        void build(const std::vector<std::string>& pats) {
+            patterns = pats;
+            next.assign(1, {});
+            next[0].fill(-1);
+            output.assign(1, -1);
+
+            for (size_t p = 0; p < patterns.size(); p++) {
+                if (patterns[p].empty()) continue;
+                int32_t state = 0;
+                for (unsigned char c : patterns[p]) {
+                    if (next[state][c] < 0) {
+                        next[state][c] = static_cast<int32_t>(next.size());
+                        next.emplace_back();
+                        next.back().fill(-1);
+                        output.push_back(-1);
+                    }
+                    state = next[state][c];
+                }
+                if (output[state] < 0) output[state] = static_cast<int32_t>(p);
+            }
+
+            // Breadth-first pass: resolve failure links into direct transitions
+            std::vector<int32_t> fail(next.size(), 0);
+            std::deque<int32_t> queue;
+            for (int c = 0; c < 256; c++) {
+                if (next[0][c] < 0) {
+                    next[0][c] = 0;
+                } else {
+                    queue.push_back(next[0][c]);
+                }
+            }
+            while (!queue.empty()) {
+                int32_t state = queue.front();
+                queue.pop_front();
+                int32_t inherited = output[fail[state]];
+                if (inherited >= 0 && (output[state] < 0 || inherited < output[state])) output[state] = inherited;
+                for (int c = 0; c < 256; c++) {
+                    int32_t child = next[state][c];
+                    if (child < 0) {
+                        next[state][c] = next[fail[state]][c];
+                    } else {
+                        fail[child] = next[fail[state]][c];
+                        queue.push_back(child);
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Advances a stream's matching state over `len` bytes.
+         *
+         * @param state Per-stream state, 0 for a fresh stream; updated in place.
+         * @return int Index of the first pattern completed in this chunk, or -1.
+         */
+        int feed(int32_t& state, const char* data, size_t len) const {
+            for (size_t i = 0; i < len; i++) {
+                state = next[state][static_cast<unsigned char>(data[i])];
+                if (output[state] >= 0) return output[state];
+            }
+            return -1;
+        }
+
+        const std::vector<std::string>& getPatterns() const { return patterns; }
+};
+
+// Which signals must be observed before a guest counts as ready
+enum class ReadinessMode {
+    Console,  // a readiness pattern appeared on the serial console
+    Agent,    // the guest agent connected
+    Either,
+    Both,
+};
+
+/**
+ * @brief Tracks readiness of booting guests.
+ *
+ * Console bytes (from libvirt streams or a test feeding them directly) and
+ * guest agent connect events are folded into per-VM state; waiters block in
+ * waitReady() until the configured signals have been seen.
+ */
+class ReadinessMonitor {
+    private:
+        struct Guest {
+            int32_t match_state = 0;
+            bool console_matched = false;
+            bool agent_connected = false;
+            bool ready = false;
+            std::string matched_pattern;
+            std::chrono::steady_clock::time_point watched_at;
+            std::chrono::steady_clock::time_point ready_at;
+        };
+
+        PatternMatcher matcher;
+        ReadinessMode mode;
+        mutable std::mutex mutex;
+        std::condition_variable ready_cv;
+        std::unordered_map<std::string, Guest> guests;
+
+        bool satisfied(const Guest& g) const {
+            switch (mode) {
+                case ReadinessMode::Console: return g.console_matched;
+                case ReadinessMode::Agent: return g.agent_connected;
+                case ReadinessMode::Either: return g.console_matched || g.agent_connected;
+                case ReadinessMode::Both: return g.console_matched && g.agent_connected;
+            }
+            return false;
+        }
+
+        void update(Guest& g) {
+            if (g.ready || !satisfied(g)) return;
+            g.ready = true;
+            g.ready_at = std::chrono::steady_clock::now();
+            ready_cv.notify_all();
+        }
+
+    public:
+        explicit ReadinessMonitor(const std::vector<std::string>& patterns = {"login:"},
+                                  ReadinessMode mode = ReadinessMode::Console)
+            : matcher(patterns), mode(mode) {}
+
+        /**
+         * @brief Replaces the readiness patterns and mode.
+         *
+         * Guests already watched restart console matching from scratch, since their
+         * matching state indexes the old automaton.
+         */
+        void configure(const std::vector<std::string>& patterns, ReadinessMode new_mode) {
+            std::lock_guard<std::mutex> lock(mutex);
+            matcher.build(patterns);
+            mode = new_mode;
+            for (auto& [name, g] : guests) g.match_state = 0;
+        }
+
+        ReadinessMode getMode() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return mode;
+        }
+
+        /**
+         * @brief Starts tracking a guest, resetting any previous readiness state.
+         */
+        void watch(const std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            Guest g;
+            g.watched_at = std::chrono::steady_clock::now();
+            guests[name] = g;
+        }
+
+        void forget(const std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            guests.erase(name);
+        }
+
+        /**
+         * @brief Feeds console output for a guest.
+         *
+         * @return true once no more console data is needed (pattern seen, guest ready
+         * or not watched), false otherwise.
+         */
+        bool feed(const std::string& name, const char* data, size_t len) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = guests.find(name);
+            if (it == guests.end()) return true;
+            Guest& g = it->second;
+            if (!g.console_matched) {
+                int match = matcher.feed(g.match_state, data, len);
+                if (match >= 0) {
+                    g.console_matched = true;
+                    g.matched_pattern = matcher.getPatterns()[match];
+                }
+            }
+            update(g);
+            return g.ready || g.console_matched;
+        }
+
+        /**
+         * @brief Records that the guest agent of `name` connected.
+         */
+        void agentConnected(const std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = guests.find(name);
+            if (it == guests.end()) return;
+            it->second.agent_connected = true;
+            update(it->second);
+        }
+
+        bool isReady(const std::string& name) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = guests.find(name);
+            return it != guests.end() && it->second.ready;
+        }
+
+        /**
+         * @brief Blocks until the guest is ready or `timeout` elapses.
+         *
+         * @return true if the guest became ready, false on timeout or if it is not watched.
+         */
+        bool waitReady(const std::string& name, std::chrono::milliseconds timeout) {
+            std::unique_lock<std::mutex> lock(mutex);
+            return ready_cv.wait_for(lock, timeout, [&] {
+                auto it = guests.find(name);
+                return it == guests.end() || it->second.ready;
+            }) && guests.count(name) && guests[name].ready;
+        }
+
+        /**
+         * @brief Time from watch() to readiness, or a negative duration if not ready.
+         */
+        std::chrono::milliseconds timeToReady(const std::string& name) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = guests.find(name);
+            if (it == guests.end() || !it->second.ready) return std::chrono::milliseconds(-1);
+            return std::chrono::duration_cast<std::chrono::milliseconds>(it->second.ready_at - it->second.watched_at);
+        }
+
+        std::string matchedPattern(const std::string& name) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = guests.find(name);
+            return it == guests.end() ? "" : it->second.matched_pattern;
+        }
+};
+
+/**
+ * @brief Per-console context passed to the libvirt stream callback.
+ */
+struct ConsoleWatch {
+    ReadinessMonitor* monitor;
+    std::string name;
+    virStreamPtr stream;
+};
+
+/**
+ * @brief Non-blocking console stream callback, run on the libvirt event loop thread.
+ *
+ * Drains whatever is readable into the monitor and tears the stream down once
+ * the console is no longer needed (pattern seen, hangup or error).
+ */
+inline void consoleStreamCallback(virStreamPtr stream, int events, void* opaque) {
+    auto* watch = static_cast<ConsoleWatch*>(opaque);
+    bool done = (events & (VIR_STREAM_EVENT_ERROR | VIR_STREAM_EVENT_HANGUP)) != 0;
+
+    char buf[4096];
+    while (!done) {
+        int n = virStreamRecv(stream, buf, sizeof(buf));
+        if (n == -2) break;  // would block
+        if (n <= 0) {
+            done = true;
+            break;
+        }
+        done = watch->monitor->feed(watch->name, buf, static_cast<size_t>(n));
+    }
+
+    if (done) {
+        virStreamEventRemoveCallback(stream);  // frees `watch` via the registered free callback
+        virStreamAbort(stream);
+        virStreamFree(stream);
+    }
+}
+
+inline void freeConsoleWatch(void* opaque) {
+    delete static_cast<ConsoleWatch*>(opaque);
+}
+
+#endif // READINESS_H
@@ -0,0 +1,168 @@
+// Realtime vCPU scheduling and exclusive core admission
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cpuset.h"
+#include "spec.h"
+#include "xml.h"
+
+/**
+ * @brief Recovers the realtime settings of an existing domain from its XML.
+ *
+ * @return std::optional<RealtimeSpec> Set if the domain has a realtime `<vcpusched>`.
+ */
+inline std::optional<RealtimeSpec> parseRealtime(const std::string& domain_xml) {
+    std::string cputune = xmlElement(domain_xml, "cputune");
+    std::string sched = xmlElement(cputune, "vcpusched");
+    std::string scheduler = xmlAttr(sched, "scheduler");
+    if (scheduler != "fifo" && scheduler != "rr") return std::nullopt;
+
+    RealtimeSpec rt;
+    rt.scheduler = scheduler;
+    std::string priority = xmlAttr(sched, "priority");
+    rt.priority = priority.empty() ? 1 : std::stoi(priority);
+    for (const auto& pin : xmlElements(cputune, "vcpupin")) {
+        for (unsigned c : parseCpuset(xmlAttr(pin, "cpuset"))) rt.cores.push_back(c);
+    }
+    for (unsigned c : parseCpuset(xmlAttr(xmlElement(cputune, "emulatorpin"), "cpuset"))) {
+        rt.emulator_cores.push_back(c);
+    }
+    rt.lock_memory = !xmlElement(xmlElement(domain_xml, "memoryBacking"), "locked").empty();
+    return rt;
+}
+
+/**
+ * @brief Reads the host's isolated CPUs (`isolcpus=`) from sysfs.
+ */
+inline std::set<unsigned> readIsolatedCpus(const std::string& path = "/sys/devices/system/cpu/isolated") {
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line)) return {};
+    return parseCpuset(line);
+}
+
+/**
+ * @brief Hands out host cores to realtime guests exclusively.
+ *
+ * A core runs the vCPU of at most one realtime guest and never also hosts an
+ * emulator thread; emulator threads may share housekeeping cores. When the
+ * set of isolated cores is known, vCPU cores must come from it.
+ */
+class RealtimeAdmission {
+    private:
+        std::set<unsigned> isolated;
+        std::map<unsigned, std::string> vcpu_owner;         // core -> domain
+        std::map<unsigned, std::set<std::string>> emulator_users;  // core -> domains
+
+    public:
+        void setIsolated(const std::set<unsigned>& cpus) { isolated = cpus; }
+        const std::set<unsigned>& isolatedCpus() const { return isolated; }
+
+        /**
+         * @brief Checks a realtime spec against the cores already handed out.
+         *
+         * @param name Domain the spec is for (its own holdings are ignored).
+         * @param spec Spec with `realtime` set.
+         * @param error Set to the reason on rejection.
+         * @return true if the spec can be admitted, false otherwise.
+         */
+        bool fits(const std::string& name, const VMSpec& spec, std::string& error) const {
+            if (!spec.realtime) return true;
+            const RealtimeSpec& rt = *spec.realtime;
+            if (rt.cores.size() != static_cast<size_t>(spec.vcpus)) {
+                error = std::to_string(spec.vcpus) + " vCPUs need " + std::to_string(spec.vcpus) +
+                        " dedicated cores, " + std::to_string(rt.cores.size()) + " given";
+                return false;
+            }
+            if (rt.scheduler != "fifo" && rt.scheduler != "rr") {
+                error = "scheduler must be 'fifo' or 'rr'";
+                return false;
+            }
+            if (rt.priority < 1 || rt.priority > 99) {
+                error = "priority " + std::to_string(rt.priority) + " outside 1-99";
+                return false;
+            }
+            if (rt.emulator_cores.empty()) {
+                error = "emulator thread needs its own cores";
+                return false;
+            }
+
+            std::set<unsigned> cores;
+            for (unsigned c : rt.cores) {
+                if (!cores.insert(c).second) {
+                    error = "core " + std::to_string(c) + " assigned to two vCPUs";
+                    return false;
+                }
+                if (!isolated.empty() && !isolated.count(c)) {
+                    error = "core " + std::to_string(c) + " is not isolated";
+                    return false;
+                }
+                auto owner = vcpu_owner.find(c);
+                if (owner != vcpu_owner.end() && owner->second != name) {
+                    error = "core " + std::to_string(c) + " already runs vCPUs of '" + owner->second + "'";
+                    return false;
+                }
+                auto users = emulator_users.find(c);
+                if (users != emulator_users.end() && !(users->second.size() == 1 && users->second.count(name))) {
+                    error = "core " + std::to_string(c) + " runs emulator threads of '" + *users->second.begin() + "'";
+                    return false;
+                }
+            }
+            for (unsigned c : rt.emulator_cores) {
+                if (cores.count(c)) {
+                    error = "emulator core " + std::to_string(c) + " overlaps the vCPU cores";
+                    return false;
+                }
+                auto owner = vcpu_owner.find(c);
+                if (owner != vcpu_owner.end() && owner->second != name) {
+                    error = "emulator core " + std::to_string(c) + " runs vCPUs of '" + owner->second + "'";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief Reserves a spec's cores if they fit.
+         *
+         * @return true if admitted (or the spec is not realtime), false otherwise.
+         */
+        bool admit(const std::string& name, const VMSpec& spec, std::string& error) {
+            if (!fits(name, spec, error)) return false;
+            if (!spec.realtime) return true;
+            release(name);
+            for (unsigned c : spec.realtime->cores) vcpu_owner[c] = name;
+            for (unsigned c : spec.realtime->emulator_cores) emulator_users[c].insert(name);
+            return true;
+        }
+
+        void release(const std::string& name) {
+            for (auto it = vcpu_owner.begin(); it != vcpu_owner.end();) {
+                it = it->second == name ? vcpu_owner.erase(it) : std::next(it);
+            }
+            for (auto it = emulator_users.begin(); it != emulator_users.end();) {
+                it->second.erase(name);
+                it = it->second.empty() ? emulator_users.erase(it) : std::next(it);
+            }
+        }
+
+        const std::map<unsigned, std::string>& vcpuCores() const { return vcpu_owner; }
+
+        /**
+         * @brief Cores other domains must not be pinned to: isolated ones and realtime vCPU cores.
+         */
+        std::set<unsigned> reservedCores() const {
+            std::set<unsigned> result = isolated;
+            for (const auto& [core, owner] : vcpu_owner) result.insert(core);
+            return result;
+        }
+};
+
+#endif // REALTIME_H
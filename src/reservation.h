@@ -0,0 +1,521 @@
+// Time-windowed capacity reservations with per-host timelines
+#ifndef RESERVATION_H
+#define RESERVATION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "fleet.h"
+
+static constexpr uint64_t reservation_forever = std::numeric_limits<uint64_t>::max();
+
+// Reservation windows are wall-clock milliseconds since the epoch
+inline uint64_t reservationClockMs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief Committed capacity of one host over time.
+ *
+ * Every interval `[start, end)` of usage becomes +amount at `start` and
+ * -amount at `end`. Those changes live in a treap ordered by time whose nodes
+ * also keep their subtree's total change and its largest prefix sum, so the
+ * peak usage over any window is the total before the window plus the largest
+ * prefix inside it: O(log n) for n change points, and the same for adding or
+ * removing an interval. Memory and vCPUs are tracked side by side; since the
+ * two limits are independent, their peaks may fall at different times.
+ */
+class CapacityTimeline {
+    private:
+        struct Node {
+            uint64_t time = 0;
+            int64_t mem = 0, cpu = 0;          // change at `time`
+            int64_t sum_mem = 0, sum_cpu = 0;  // subtree total
+            int64_t max_mem = 0, max_cpu = 0;  // largest subtree prefix sum, empty prefix included
+            uint32_t priority = 0;
+            int left = -1, right = -1;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<int> free_nodes;
+        int root = -1;
+        uint32_t seed = 2463534242u;
+
+        uint32_t nextPriority() {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return seed;
+        }
+
+        void pull(int n) {
+            Node& x = nodes[n];
+            int64_t lsum_mem = 0, lsum_cpu = 0, lmax_mem = 0, lmax_cpu = 0, rmax_mem = 0, rmax_cpu = 0;
+            x.sum_mem = x.mem;
+            x.sum_cpu = x.cpu;
+            if (x.left >= 0) {
+                const Node& l = nodes[x.left];
+                lsum_mem = l.sum_mem;
+                lsum_cpu = l.sum_cpu;
+                lmax_mem = l.max_mem;
+                lmax_cpu = l.max_cpu;
+                x.sum_mem += l.sum_mem;
+                x.sum_cpu += l.sum_cpu;
+            }
+            if (x.right >= 0) {
+                const Node& r = nodes[x.right];
+                rmax_mem = r.max_mem;
+                rmax_cpu = r.max_cpu;
+                x.sum_mem += r.sum_mem;
+                x.sum_cpu += r.sum_cpu;
+            }
+            x.max_mem = std::max(lmax_mem, lsum_mem + x.mem + rmax_mem);
+            x.max_cpu = std::max(lmax_cpu, lsum_cpu + x.cpu + rmax_cpu);
+        }
+
+        // Splits `n` into keys < `key` and keys >= `key`
+        void split(int n, uint64_t key, int& l, int& r) {
+            if (n < 0) {
+                l = r = -1;
+                return;
+            }
+            if (nodes[n].time < key) {
+                split(nodes[n].right, key, nodes[n].right, r);
+                l = n;
+            } else {
+                split(nodes[n].left, key, l, nodes[n].left);
+                r = n;
+            }
+            pull(n);
+        }
+
+        int merge(int l, int r) {
+            if (l < 0) return r;
+            if (r < 0) return l;
+            if (nodes[l].priority > nodes[r].priority) {
+                nodes[l].right = merge(nodes[l].right, r);
+                pull(l);
+                return l;
+            }
+            nodes[r].left = merge(l, nodes[r].left);
+            pull(r);
+            return r;
+        }
+
+        void change(uint64_t time, int64_t mem, int64_t cpu) {
+            int before, rest, at, after;
+            split(root, time, before, rest);
+            split(rest, time + 1, at, after);
+            if (at < 0) {
+                if (free_nodes.empty()) {
+                    at = static_cast<int>(nodes.size());
+                    nodes.emplace_back();
+                } else {
+                    at = free_nodes.back();
+                    free_nodes.pop_back();
+                }
+                nodes[at] = Node{};
+                nodes[at].time = time;
+                nodes[at].priority = nextPriority();
+            }
+            nodes[at].mem += mem;
+            nodes[at].cpu += cpu;
+            if (nodes[at].mem == 0 && nodes[at].cpu == 0) {
+                free_nodes.push_back(at);
+                at = -1;
+            } else {
+                pull(at);
+            }
+            root = merge(merge(before, at), after);
+        }
+
+    public:
+        /**
+         * @brief Adds (or, with negative amounts, removes) usage over `[start, end)`.
+         *
+         * `end` = reservation_forever leaves the usage open-ended.
+         */
+        void add(uint64_t start, uint64_t end, int64_t mem, int64_t cpu) {
+            if (start >= end) return;
+            change(start, mem, cpu);
+            if (end != reservation_forever) change(end, -mem, -cpu);
+        }
+
+        /**
+         * @brief Returns the peak (memory, vCPU) usage over `[start, end)`.
+         */
+        std::pair<int64_t, int64_t> peak(uint64_t start, uint64_t end) {
+            // Usage at `start` includes the change at `start`; later changes only matter if they raise it
+            int before, rest, at, inside, after;
+            split(root, start, before, rest);
+            split(rest, start + 1, at, rest);
+            split(rest, end, inside, after);
+            int64_t mem = 0, cpu = 0, rise_mem = 0, rise_cpu = 0;
+            for (int n : {before, at}) {
+                if (n < 0) continue;
+                mem += nodes[n].sum_mem;
+                cpu += nodes[n].sum_cpu;
+            }
+            if (inside >= 0) {
+                rise_mem = nodes[inside].max_mem;
+                rise_cpu = nodes[inside].max_cpu;
+            }
+            root = merge(merge(merge(before, at), inside), after);
+            return {mem + rise_mem, cpu + rise_cpu};
+        }
+
+        size_t changePoints() const { return nodes.size() - free_nodes.size(); }
+};
+
+/**
+ * @brief Capacity promised to an owner on one host for a time window.
+ */
+struct Reservation {
+    std::string id;
+    std::string owner;   // team or tenant the capacity is held for
+    std::string host;    // set by reserveInPool() when reserving against a pool
+    uint64_t memory_kib = 0;
+    unsigned vcpus = 0;
+    uint64_t start_ms = 0;
+    uint64_t end_ms = reservation_forever;
+};
+
+/**
+ * @brief Admission control for VMs and future reservations across hosts.
+ *
+ * Running VMs hold capacity from their admission onwards; reservations hold
+ * it for their window. A new VM or reservation is admitted only if, at every
+ * moment of its window, it fits next to everything already committed on the
+ * host. A VM created for a reservation's owner can claim part of the
+ * reservation instead, and then needs new capacity only from the
+ * reservation's end.
+ *
+ * A book is shared by the managers and schedulers of a fleet; every public
+ * member is safe to call from several threads.
+ */
+class ReservationBook {
+    private:
+        struct HostCapacity {
+            uint64_t memory_kib = 0;
+            unsigned vcpus = 0;
+            CapacityTimeline timeline;
+        };
+        struct AdmittedVM {
+            std::string host;
+            uint64_t memory_kib = 0;
+            unsigned vcpus = 0;
+            uint64_t since_ms = 0;     // start of its own interval in the timeline
+            std::string reservation;   // claimed reservation, if any
+        };
+
+        std::map<std::string, HostCapacity> hosts;
+        std::unordered_map<std::string, Reservation> reservations;
+        std::unordered_map<std::string, AdmittedVM> vms;
+        std::unordered_map<std::string, std::pair<uint64_t, unsigned>> claimed;  // reservation -> (memory, vCPUs)
+        mutable std::mutex mutex;
+
+        bool fitsOn(HostCapacity& h, uint64_t mem, unsigned vcpus, uint64_t start, uint64_t end, std::string& error) {
+            auto [peak_mem, peak_cpu] = h.timeline.peak(start, end);
+            if (peak_mem + static_cast<int64_t>(mem) > static_cast<int64_t>(h.memory_kib)) {
+                error = "needs " + std::to_string(mem) + " KiB but only " +
+                        std::to_string(std::max<int64_t>(0, h.memory_kib - peak_mem)) + " KiB is free at the peak";
+                return false;
+            }
+            if (peak_cpu + vcpus > static_cast<int64_t>(h.vcpus)) {
+                error = "needs " + std::to_string(vcpus) + " vCPUs but only " +
+                        std::to_string(std::max<int64_t>(0, h.vcpus - peak_cpu)) + " are free at the peak";
+                return false;
+            }
+            return true;
+        }
+
+        bool reserveLocked(const Reservation& r, std::string& error) {
+            if (r.id.empty() || reservations.count(r.id)) {
+                error = "reservation id '" + r.id + "' is empty or already used";
+                return false;
+            }
+            if (r.start_ms >= r.end_ms) {
+                error = "reservation '" + r.id + "' has an empty window";
+                return false;
+            }
+            auto it = hosts.find(r.host);
+            if (it == hosts.end()) {
+                error = "unknown host " + r.host;
+                return false;
+            }
+            if (!fitsOn(it->second, r.memory_kib, r.vcpus, r.start_ms, r.end_ms, error)) {
+                error = "reservation '" + r.id + "' on " + r.host + " " + error;
+                return false;
+            }
+            it->second.timeline.add(r.start_ms, r.end_ms, r.memory_kib, r.vcpus);
+            reservations[r.id] = r;
+            return true;
+        }
+
+        void adopt(const std::string& vm, const std::string& host, uint64_t memory_kib, unsigned vcpus,
+                   uint64_t now_ms) {
+            hosts[host].timeline.add(now_ms, reservation_forever, memory_kib, vcpus);
+            vms[vm] = AdmittedVM{host, memory_kib, vcpus, now_ms, ""};
+        }
+
+        void release(const std::string& vm) {
+            auto it = vms.find(vm);
+            if (it == vms.end()) return;
+            const AdmittedVM& a = it->second;
+            hosts[a.host].timeline.add(a.since_ms, reservation_forever, -static_cast<int64_t>(a.memory_kib),
+                                       -static_cast<int64_t>(a.vcpus));
+            auto c = claimed.find(a.reservation);
+            if (c != claimed.end()) {
+                c->second.first -= a.memory_kib;
+                c->second.second -= a.vcpus;
+                if (c->second.first == 0 && c->second.second == 0) claimed.erase(c);
+            }
+            vms.erase(it);
+        }
+
+    public:
+        /**
+         * @brief Adds a host or updates its capacity.
+         */
+        void setHost(const std::string& uri, uint64_t memory_kib, unsigned vcpus) {
+            std::lock_guard<std::mutex> lock(mutex);
+            HostCapacity& h = hosts[uri];
+            h.memory_kib = memory_kib;
+            h.vcpus = vcpus;
+        }
+
+        /**
+         * @brief Checks whether `mem`/`vcpus` fit on a host throughout `[start_ms, end_ms)`.
+         */
+        bool fits(const std::string& host, uint64_t mem, unsigned vcpus, uint64_t start_ms, uint64_t end_ms,
+                  std::string& error) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = hosts.find(host);
+            if (it == hosts.end()) {
+                error = "unknown host " + host;
+                return false;
+            }
+            return fitsOn(it->second, mem, vcpus, start_ms, end_ms, error);
+        }
+
+        /**
+         * @brief Records a reservation on its host if it fits for its whole window.
+         */
+        bool reserve(const Reservation& r, std::string& error) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return reserveLocked(r, error);
+        }
+
+        /**
+         * @brief Reserves on the pool host that is left with the least free memory at its peak.
+         *
+         * @return std::string The chosen host, or an empty string if no host in the pool fits.
+         */
+        std::string reserveInPool(Reservation r, const std::vector<std::string>& pool, std::string& error) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string best;
+            int64_t best_left = 0;
+            for (const auto& uri : pool) {
+                auto it = hosts.find(uri);
+                if (it == hosts.end()) continue;
+                std::string why;
+                if (!fitsOn(it->second, r.memory_kib, r.vcpus, r.start_ms, r.end_ms, why)) continue;
+                int64_t left = static_cast<int64_t>(it->second.memory_kib) - it->second.timeline.peak(r.start_ms, r.end_ms).first;
+                if (best.empty() || left < best_left) {
+                    best = uri;
+                    best_left = left;
+                }
+            }
+            if (best.empty()) {
+                error = "no host in the pool can hold reservation '" + r.id + "'";
+                return "";
+            }
+            r.host = best;
+            return reserveLocked(r, error) ? best : "";
+        }
+
+        /**
+         * @brief Cancels a reservation; refused while VMs still claim it.
+         */
+        bool cancel(const std::string& id, std::string& error) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = reservations.find(id);
+            if (it == reservations.end()) {
+                error = "no reservation '" + id + "'";
+                return false;
+            }
+            if (claimed.count(id)) {
+                error = "reservation '" + id + "' is claimed by running VMs";
+                return false;
+            }
+            const Reservation& r = it->second;
+            hosts[r.host].timeline.add(r.start_ms, r.end_ms, -static_cast<int64_t>(r.memory_kib), -static_cast<int64_t>(r.vcpus));
+            reservations.erase(it);
+            return true;
+        }
+
+        /**
+         * @brief Admits a VM that starts now and runs indefinitely.
+         *
+         * Without a reservation the VM must fit from `now_ms` on, including
+         * under every future reservation on the host. With one, it must belong to
+         * the reservation's host and window and fit in its unclaimed part, and
+         * only needs new capacity from the reservation's end.
+         */
+        bool admitVM(const std::string& vm, const std::string& host, uint64_t memory_kib, unsigned vcpus,
+                     uint64_t now_ms, std::string& error, const std::string& reservation = "") {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (vms.count(vm)) {
+                error = "VM '" + vm + "' is already admitted";
+                return false;
+            }
+            auto h = hosts.find(host);
+            if (h == hosts.end()) {
+                error = "unknown host " + host;
+                return false;
+            }
+            uint64_t since = now_ms;
+            if (!reservation.empty()) {
+                auto r = reservations.find(reservation);
+                if (r == reservations.end() || r->second.host != host || now_ms < r->second.start_ms ||
+                    now_ms >= r->second.end_ms) {
+                    error = "reservation '" + reservation + "' is not active on " + host;
+                    return false;
+                }
+                auto c = claimed.find(reservation);
+                std::pair<uint64_t, unsigned> used = c == claimed.end() ? std::pair<uint64_t, unsigned>{0, 0} : c->second;
+                if (used.first + memory_kib > r->second.memory_kib || used.second + vcpus > r->second.vcpus) {
+                    error = "VM '" + vm + "' exceeds the unclaimed part of reservation '" + reservation + "'";
+                    return false;
+                }
+                since = r->second.end_ms;
+            }
+            if (since != reservation_forever && !fitsOn(h->second, memory_kib, vcpus, since, reservation_forever, error)) {
+                error = "VM '" + vm + "' on " + host + " " + error;
+                return false;
+            }
+            h->second.timeline.add(since, reservation_forever, memory_kib, vcpus);
+            if (!reservation.empty()) {
+                claimed[reservation].first += memory_kib;
+                claimed[reservation].second += vcpus;
+            }
+            vms[vm] = AdmittedVM{host, memory_kib, vcpus, since, reservation};
+            return true;
+        }
+
+        /**
+         * @brief Returns a VM's capacity after it was undefined or migrated away.
+         */
+        void releaseVM(const std::string& vm) {
+            std::lock_guard<std::mutex> lock(mutex);
+            release(vm);
+        }
+
+        /**
+         * @brief Records a VM that already runs on `host`, whether or not it fits.
+         *
+         * For VMs that arrived by migration or were found running: any claim on
+         * a reservation elsewhere is dropped, and the VM holds capacity on its
+         * new host from `now_ms` on.
+         */
+        void adoptVM(const std::string& vm, const std::string& host, uint64_t memory_kib, unsigned vcpus,
+                     uint64_t now_ms) {
+            std::lock_guard<std::mutex> lock(mutex);
+            release(vm);
+            adopt(vm, host, memory_kib, vcpus, now_ms);
+        }
+
+        /**
+         * @brief Moves an admitted VM to another host from `now_ms` on; no-op for VMs not in the book.
+         */
+        void moveVM(const std::string& vm, const std::string& host, uint64_t now_ms) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = vms.find(vm);
+            if (it == vms.end()) return;
+            AdmittedVM a = it->second;
+            release(vm);
+            adopt(vm, host, a.memory_kib, a.vcpus, now_ms);
+        }
+
+        /**
+         * @brief Returns the host a VM was admitted on, or an empty string.
+         */
+        std::string admittedHost(const std::string& vm) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = vms.find(vm);
+            return it == vms.end() ? "" : it->second.host;
+        }
+
+        /**
+         * @brief Drops reservations that ended by `now_ms`.
+         *
+         * @return size_t Number of reservations dropped.
+         */
+        size_t expire(uint64_t now_ms) {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t dropped = 0;
+            for (auto it = reservations.begin(); it != reservations.end();) {
+                const Reservation& r = it->second;
+                if (r.end_ms > now_ms) {
+                    ++it;
+                    continue;
+                }
+                // Claiming VMs already hold their own capacity from the end on
+                hosts[r.host].timeline.add(r.start_ms, r.end_ms, -static_cast<int64_t>(r.memory_kib),
+                                           -static_cast<int64_t>(r.vcpus));
+                for (auto& [name, a] : vms) {
+                    if (a.reservation == r.id) a.reservation.clear();
+                }
+                claimed.erase(r.id);
+                it = reservations.erase(it);
+                dropped++;
+            }
+            return dropped;
+        }
+
+        /**
+         * @brief Registers a fleet's hosts and running VMs, admitting the VMs unconditionally.
+         *
+         * VMs that already run are a fact, not a request: they are recorded even
+         * when they overlap reservations, which then show up as overcommitted
+         * in fits().
+         */
+        void syncFleet(const FleetModel& fleet, uint64_t now_ms) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& [uri, host] : fleet.getHosts()) {
+                hosts[uri].memory_kib = host.memory_kib;
+                hosts[uri].vcpus = host.cpus;
+            }
+            for (const auto& [name, vm] : fleet.getVMs()) {
+                if (!vms.count(name)) adopt(name, vm.host, vm.memory_kib, vm.vcpus, now_ms);
+            }
+        }
+
+        std::optional<Reservation> reservation(const std::string& id) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = reservations.find(id);
+            if (it == reservations.end()) return std::nullopt;
+            return it->second;
+        }
+
+        std::vector<Reservation> getReservations(const std::string& host = "") const {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<Reservation> result;
+            for (const auto& [id, r] : reservations) {
+                if (host.empty() || r.host == host) result.push_back(r);
+            }
+            return result;
+        }
+};
+
+#endif // RESERVATION_H
@@ -0,0 +1,228 @@
+// libvirt error classification and retry with backoff
+#ifndef RETRY_H
+#define RETRY_H
+
+#include <libvirt/virterror.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+enum class ErrorClass {
+    Retryable,     // transient: lock contention, timeouts, RPC hiccups
+    NonRetryable,  // the same call will fail again (bad XML, missing domain, denied)
+};
+
+/**
+ * @brief A libvirt error captured from the thread-local last-error slot.
+ */
+struct LibvirtError {
+    int code = VIR_ERR_OK;
+    int domain = VIR_FROM_NONE;
+    std::string message;
+};
+
+/**
+ * @brief Captures the calling thread's last libvirt error.
+ */
+inline LibvirtError lastLibvirtError() {
+    LibvirtError err;
+    virErrorPtr e = virGetLastError();
+    if (e) {
+        err.code = e->code;
+        err.domain = e->domain;
+        err.message = e->message ? e->message : "";
+    }
+    return err;
+}
+
+/**
+ * @brief Decides whether retrying a failed call can succeed.
+ *
+ * Besides codes that are transient by definition, a few messages are matched
+ * because libvirt reports lock contention ("cannot acquire state change lock",
+ * "domain is locked") under generic codes on some drivers and versions.
+ * A closed connection (VIR_ERR_NO_CONNECT) is not retryable: every call on the
+ * same handle fails until the caller reconnects.
+ */
+inline ErrorClass classifyError(const LibvirtError& err) {
+    switch (err.code) {
+        case VIR_ERR_OPERATION_TIMEOUT:
+        case VIR_ERR_RPC:
+        case VIR_ERR_AGENT_UNRESPONSIVE:
+        case VIR_ERR_RESOURCE_BUSY:
+            return ErrorClass::Retryable;
+        default:
+            break;
+    }
+    static const char* transient_messages[] = {
+        "cannot acquire state change lock",
+        "domain is locked",
+        "Timed out during operation",
+        "Resource temporarily unavailable",
+    };
+    for (const char* m : transient_messages) {
+        if (err.message.find(m) != std::string::npos) return ErrorClass::Retryable;
+    }
+    return ErrorClass::NonRetryable;
+}
+
+/**
+ * @brief Per-operation retry policy: capped exponential backoff with full jitter.
+ *
+ * Attempt n (0-based) sleeps a uniform random time in
+ * [0, min(max_delay, base_delay * multiplier^n)] before the next try.
+ */
+struct RetryPolicy {
+    int max_attempts = 4;  // total attempts including the first; 1 disables retries
+    std::chrono::milliseconds base_delay{100};
+    std::chrono::milliseconds max_delay{5000};
+    double multiplier = 2.0;
+};
+
+/**
+ * @brief Token bucket limiting retries to a fraction of recent requests.
+ *
+ * Every request deposits `ratio` tokens (capped at `max_tokens`); every retry
+ * withdraws one. When a dependency is failing wholesale, retries stop once the
+ * bucket is empty instead of multiplying load by max_attempts.
+ */
+class RetryBudget {
+    private:
+        std::mutex mutex;
+        double tokens;
+        double ratio;
+        double max_tokens;
+
+    public:
+        explicit RetryBudget(double ratio = 0.2, double initial_tokens = 10.0, double max_tokens = 100.0)
+            : tokens(initial_tokens), ratio(ratio), max_tokens(max_tokens) {}
+
+        void onRequest() {
+            std::lock_guard<std::mutex> lock(mutex);
+            tokens = std::min(max_tokens, tokens + ratio);
+        }
+
+        bool tryRetry() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tokens < 1.0) return false;
+            tokens -= 1.0;
+            return true;
+        }
+
+        double available() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return tokens;
+        }
+};
+
+struct RetryStats {
+    uint64_t calls = 0;
+    uint64_t attempts = 0;
+    uint64_t retries = 0;
+    uint64_t non_retryable = 0;     // calls that failed with a non-retryable error
+    uint64_t exhausted = 0;         // calls that ran out of attempts
+    uint64_t budget_denied = 0;     // retries skipped because the budget was empty
+    uint64_t applied = 0;           // calls found to have taken effect despite a failed attempt
+};
+
+/**
+ * @brief Runs libvirt calls under retry policies sharing one retry budget.
+ *
+ * The error source and sleep function are injectable so a simulated backend
+ * can feed error codes and virtual time.
+ */
+class RetryExecutor {
+    private:
+        RetryBudget budget;
+        std::mutex mutex;
+        std::mt19937_64 rng{std::random_device{}()};
+        RetryStats counters;
+
+        std::chrono::milliseconds backoff(const RetryPolicy& policy, int attempt) {
+            double cap = static_cast<double>(policy.base_delay.count());
+            for (int i = 0; i < attempt; i++) cap *= policy.multiplier;
+            cap = std::min(cap, static_cast<double>(policy.max_delay.count()));
+            std::lock_guard<std::mutex> lock(mutex);
+            std::uniform_real_distribution<double> dist(0.0, cap);
+            return std::chrono::milliseconds(static_cast<int64_t>(dist(rng)));
+        }
+
+        void count(uint64_t RetryStats::*field) {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.*field += 1;
+        }
+
+    public:
+        std::function<LibvirtError()> last_error = lastLibvirtError;
+        std::function<void(std::chrono::milliseconds)> sleep = [](std::chrono::milliseconds d) {
+            std::this_thread::sleep_for(d);
+        };
+
+        explicit RetryExecutor(double budget_ratio = 0.2) : budget(budget_ratio) {}
+
+        /**
+         * @brief Runs `attempt` until it succeeds, fails non-retryably, or the policy
+         * or retry budget is exhausted.
+         *
+         * A non-idempotent call (e.g. starting a domain) that timed out may still
+         * have taken effect, so repeating it would fail ("domain is already
+         * running"). For such calls pass `applied`: it is checked before every
+         * retry, and after a non-retryable failure that follows a retried one,
+         * and a true result ends the call successfully.
+         *
+         * @param what Operation description used in log messages.
+         * @param policy Retry policy for this operation.
+         * @param attempt Callable returning true on success.
+         * @param error Set to the error of the last failed attempt.
+         * @param applied Optional check whether the operation has taken effect.
+         * @return true if an attempt succeeded, false otherwise.
+         */
+        bool run(const std::string& what, const RetryPolicy& policy, const std::function<bool()>& attempt,
+                 LibvirtError* error = nullptr, const std::function<bool()>& applied = nullptr) {
+            count(&RetryStats::calls);
+            budget.onRequest();
+            for (int n = 0;; n++) {
+                count(&RetryStats::attempts);
+                if (attempt()) return true;
+
+                LibvirtError err = last_error();
+                if (error) *error = err;
+                bool retryable = classifyError(err) == ErrorClass::Retryable;
+                if ((retryable || n > 0) && applied && applied()) {
+                    count(&RetryStats::applied);
+                    return true;
+                }
+                if (!retryable) {
+                    count(&RetryStats::non_retryable);
+                    return false;
+                }
+                if (n + 1 >= policy.max_attempts) {
+                    count(&RetryStats::exhausted);
+                    return false;
+                }
+                if (!budget.tryRetry()) {
+                    count(&RetryStats::budget_denied);
+                    std::cerr << "Retry budget exhausted, not retrying " << what << "\n";
+                    return false;
+                }
+                count(&RetryStats::retries);
+                std::chrono::milliseconds delay = backoff(policy, n);
+                std::cerr << "Transient failure in " << what << " (" << err.message << "), retrying in "
+                          << delay.count() << "ms\n";
+                sleep(delay);
+            }
+        }
+
+        RetryStats stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return counters;
+        }
+};
+
+#endif // RETRY_H
@@ -0,0 +1,560 @@
+// Sharded control plane: hosts spread over Augustus processes by consistent hashing
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "vm.h"
+
+/**
+ * @brief 64-bit hash for ring positions (FNV-1a followed by a splitmix64 finalizer).
+ */
+inline uint64_t ringHash(const std::string& key) {
+    uint64_t h = 1469598103934665603ULL;  // FNV-1a
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+/**
+ * @brief Consistent-hash ring assigning keys (host URIs) to shards.
+ *
+ * Each shard owns `vnodes` points on the ring, and a key belongs to the shard
+ * of the first point at or after its hash. When a shard joins or leaves only
+ * the keys between its points and their predecessors move, about 1/N of them,
+ * and the virtual nodes keep the shares even.
+ */
+class HashRing {
+    private:
+        unsigned vnodes;
+        std::map<uint64_t, std::string> ring;
+        std::set<std::string> members;
+
+    public:
+        explicit HashRing(unsigned vnodes = 128) : vnodes(vnodes) {}
+
+        void addShard(const std::string& shard) {
+            if (!members.insert(shard).second) return;
+            for (unsigned i = 0; i < vnodes; i++) ring.emplace(ringHash(shard + "#" + std::to_string(i)), shard);
+        }
+
+        void removeShard(const std::string& shard) {
+            if (!members.erase(shard)) return;
+            for (auto it = ring.begin(); it != ring.end();) {
+                it = it->second == shard ? ring.erase(it) : std::next(it);
+            }
+        }
+
+        /**
+         * @brief Returns the shard owning a key, or an empty string if the ring is empty.
+         */
+        std::string owner(const std::string& key) const {
+            if (ring.empty()) return "";
+            auto it = ring.lower_bound(ringHash(key));
+            return it == ring.end() ? ring.begin()->second : it->second;
+        }
+
+        const std::set<std::string>& shards() const { return members; }
+};
+
+/**
+ * @brief A control-plane request addressed to the shard owning `host`.
+ */
+struct ShardRequest {
+    std::string op;                 // start, shutdown, destroy, undefine, state, config-root
+    std::string host;               // libvirt URI of the host
+    std::vector<std::string> args;  // e.g. domain name
+    bool forwarded = false;         // set by the forwarding shard; never forwarded again
+};
+
+struct ShardResponse {
+    bool ok = false;
+    std::string payload;  // result on success, error message otherwise
+};
+
+// Wire format: one line per message, tab-separated fields, with '\\', '\t'
+// and '\n' escaped inside fields.
+inline std::string shardEscape(const std::string& field) {
+    std::string out;
+    for (char c : field) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '\t') out += "\\t";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+inline std::vector<std::string> shardSplit(const std::string& line) {
+    std::vector<std::string> fields(1);
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '\t') {
+            fields.emplace_back();
+        } else if (c == '\\' && i + 1 < line.size()) {
+            char n = line[++i];
+            fields.back() += n == 't' ? '\t' : n == 'n' ? '\n' : n;
+        } else {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+inline std::string encodeShardRequest(const ShardRequest& req) {
+    std::string line = std::string(req.forwarded ? "F" : "C") + "\t" + shardEscape(req.op) + "\t" +
+                       shardEscape(req.host);
+    for (const auto& a : req.args) line += "\t" + shardEscape(a);
+    return line + "\n";
+}
+
+inline bool decodeShardRequest(const std::string& line, ShardRequest& req) {
+    std::vector<std::string> f = shardSplit(line);
+    if (f.size() < 3 || (f[0] != "F" && f[0] != "C")) return false;
+    req.forwarded = f[0] == "F";
+    req.op = f[1];
+    req.host = f[2];
+    req.args.assign(f.begin() + 3, f.end());
+    return true;
+}
+
+inline std::string encodeShardResponse(const ShardResponse& resp) {
+    return std::string(resp.ok ? "OK" : "ERR") + "\t" + shardEscape(resp.payload) + "\n";
+}
+
+/**
+ * @brief Reads one '\n'-terminated line from a socket.
+ *
+ * @return true if a full line was read before EOF, error or timeout.
+ */
+inline bool readShardLine(int fd, std::string& buffer, std::string& line, int timeout_ms) {
+    while (true) {
+        size_t nl = buffer.find('\n');
+        if (nl != std::string::npos) {
+            line = buffer.substr(0, nl);
+            buffer.erase(0, nl + 1);
+            return true;
+        }
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) <= 0) return false;
+        char chunk[4096];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+}
+
+inline bool writeAll(int fd, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Sends a request to the shard listening on a unix socket and waits for the reply.
+ */
+inline ShardResponse sendShardRequest(const std::string& socket_path, const ShardRequest& req,
+                                      int timeout_ms = 30000) {
+    ShardResponse resp;
+    sockaddr_un addr{};
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        resp.payload = "socket path too long: " + socket_path;
+        return resp;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        resp.payload = std::string("socket: ") + strerror(errno);
+        return resp;
+    }
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    std::string buffer, line;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        resp.payload = "cannot reach shard at " + socket_path + ": " + strerror(errno);
+    } else if (!writeAll(fd, encodeShardRequest(req)) || !readShardLine(fd, buffer, line, timeout_ms)) {
+        resp.payload = "no reply from shard at " + socket_path;
+    } else {
+        std::vector<std::string> f = shardSplit(line);
+        resp.ok = f[0] == "OK";
+        resp.payload = f.size() > 1 ? f[1] : "";
+    }
+    close(fd);
+    return resp;
+}
+
+/**
+ * @brief Serves shard requests on a unix socket, one thread per client connection.
+ *
+ * Threads of disconnected clients are joined by the acceptor, so a server
+ * taking short-lived connections keeps one thread per open connection.
+ */
+class ShardServer {
+    private:
+        int listen_fd = -1;
+        std::string path;
+        std::atomic<bool> running{false};
+        std::thread acceptor;
+        std::mutex clients_mutex;
+        std::map<uint64_t, std::thread> clients;  // connection number -> serving thread
+        std::vector<uint64_t> finished;           // connections whose thread has returned
+        uint64_t next_client = 0;
+        std::function<ShardResponse(const ShardRequest&)> handler;
+
+        void serveClient(uint64_t n, int fd) {
+            std::string buffer, line;
+            while (running && readShardLine(fd, buffer, line, 500) ) {
+                ShardRequest req;
+                ShardResponse resp;
+                if (decodeShardRequest(line, req)) resp = handler(req);
+                else resp.payload = "malformed request";
+                if (!writeAll(fd, encodeShardResponse(resp))) break;
+            }
+            close(fd);
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            finished.push_back(n);
+        }
+
+        void reapClients() {
+            std::vector<std::thread> done;
+            {
+                std::lock_guard<std::mutex> lock(clients_mutex);
+                for (uint64_t n : finished) {
+                    auto it = clients.find(n);
+                    done.push_back(std::move(it->second));
+                    clients.erase(it);
+                }
+                finished.clear();
+            }
+            for (auto& t : done) t.join();
+        }
+
+    public:
+        ~ShardServer() { stop(); }
+
+        bool start(const std::string& socket_path, std::function<ShardResponse(const ShardRequest&)> fn) {
+            sockaddr_un addr{};
+            if (socket_path.size() >= sizeof(addr.sun_path)) {
+                std::cerr << "Shard socket path too long: " << socket_path << "\n";
+                return false;
+            }
+            listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listen_fd < 0) {
+                std::cerr << "Failed to create shard socket: " << strerror(errno) << "\n";
+                return false;
+            }
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+            unlink(socket_path.c_str());
+            if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd, 64) < 0) {
+                std::cerr << "Failed to listen on " << socket_path << ": " << strerror(errno) << "\n";
+                close(listen_fd);
+                listen_fd = -1;
+                return false;
+            }
+            path = socket_path;
+            handler = std::move(fn);
+            running = true;
+            acceptor = std::thread([this] {
+                while (running) {
+                    reapClients();
+                    pollfd pfd{listen_fd, POLLIN, 0};
+                    if (poll(&pfd, 1, 200) <= 0) continue;
+                    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (fd < 0) continue;
+                    std::lock_guard<std::mutex> lock(clients_mutex);
+                    uint64_t n = next_client++;
+                    clients.emplace(n, std::thread([this, n, fd] { serveClient(n, fd); }));
+                }
+            });
+            return true;
+        }
+
+        void stop() {
+            if (!running.exchange(false)) return;
+            if (acceptor.joinable()) acceptor.join();
+            std::map<uint64_t, std::thread> done;
+            {
+                std::lock_guard<std::mutex> lock(clients_mutex);
+                done.swap(clients);
+                finished.clear();
+            }
+            for (auto& [n, t] : done) t.join();
+            close(listen_fd);
+            unlink(path.c_str());
+            listen_fd = -1;
+        }
+
+        /**
+         * @brief Number of client threads not yet joined.
+         */
+        size_t clientThreads() {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            return clients.size();
+        }
+};
+
+/**
+ * @brief Hosts gained and lost by a shard after a membership change.
+ */
+struct ShardRebalance {
+    std::vector<std::string> acquired;
+    std::vector<std::string> released;
+};
+
+/**
+ * @brief One Augustus process in a sharded control plane.
+ *
+ * Every shard is configured with the same host list and member table (shard
+ * id -> unix socket path), so all shards compute the same ring and agree on
+ * owners without coordination. A shard holds a VMManager connection only for
+ * the hosts it owns and forwards other requests to the owning shard. A
+ * forwarded request that reaches a shard which does not own the host (the
+ * two disagree during a membership change) fails instead of bouncing.
+ */
+class ShardNode {
+    private:
+        /**
+         * @brief Connection to an owned host; requests to one host run one at a time.
+         */
+        struct HostConnection {
+            std::mutex mutex;
+            std::unique_ptr<VMManager> manager;
+        };
+
+        std::string id;
+        DomainType domain_type;
+        mutable std::shared_mutex topology_mutex;  // guards ring, members and hosts
+        HashRing ring;
+        std::map<std::string, std::string> members;  // shard id -> socket path
+        std::set<std::string> hosts;
+        std::mutex managers_mutex;  // guards the map only, never held across libvirt calls
+        std::map<std::string, std::shared_ptr<HostConnection>> managers;  // owned host -> connection
+        std::mutex rebalance_mutex;
+        ShardServer server;
+
+        ShardResponse handleLocal(const ShardRequest& req) {
+            ShardResponse resp;
+            std::shared_ptr<HostConnection> connection;
+            {
+                std::lock_guard<std::mutex> lock(managers_mutex);
+                auto it = managers.find(req.host);
+                if (it != managers.end()) connection = it->second;
+            }
+            if (!connection) {
+                resp.payload = "shard '" + id + "' has no connection to " + req.host;
+                return resp;
+            }
+            // A released host's connection stays open until its last request returns
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            VMManager& manager = *connection->manager;
+
+            if (req.op == "config-root") {
+                resp.ok = true;
+                resp.payload = digestHex(manager.configTree().root());
+                return resp;
+            }
+            if (req.args.empty()) {
+                resp.payload = "operation '" + req.op + "' needs a domain name";
+                return resp;
+            }
+            virDomainPtr dom = manager.lookupVM(req.args[0]);
+            if (!dom) {
+                resp.payload = "no domain '" + req.args[0] + "' on " + req.host;
+                return resp;
+            }
+            if (req.op == "start") {
+                resp.ok = manager.startVM(dom);
+            } else if (req.op == "shutdown") {
+                resp.ok = manager.stopVM(dom);
+            } else if (req.op == "destroy") {
+                resp.ok = manager.destroyVM(dom);
+            } else if (req.op == "undefine") {
+                resp.ok = manager.undefineVM(dom);
+            } else if (req.op == "state") {
+                int state = 0, reason = 0;
+                resp.ok = virDomainGetState(dom, &state, &reason, 0) == 0;
+                resp.payload = std::to_string(state);
+            } else {
+                resp.payload = "unknown operation '" + req.op + "'";
+            }
+            if (!resp.ok && resp.payload.empty()) resp.payload = req.op + " failed for '" + req.args[0] + "'";
+            virDomainFree(dom);
+            return resp;
+        }
+
+    public:
+        ShardNode(const std::string& shard_id, DomainType domain_type, unsigned vnodes = 128)
+            : id(shard_id), domain_type(domain_type), ring(vnodes) {}
+
+        ~ShardNode() { server.stop(); }
+
+        /**
+         * @brief Sets the fleet's host URIs (the same list on every shard).
+         *
+         * @return ShardRebalance Hosts this shard connected to or let go of.
+         */
+        ShardRebalance setHosts(const std::set<std::string>& uris) {
+            {
+                std::unique_lock<std::shared_mutex> lock(topology_mutex);
+                hosts = uris;
+            }
+            return rebalance();
+        }
+
+        /**
+         * @brief Sets the shard membership (the same table on every shard).
+         *
+         * @param shards Shard id -> unix socket path; must include this shard.
+         * @return ShardRebalance Hosts this shard connected to or let go of.
+         */
+        ShardRebalance setMembers(const std::map<std::string, std::string>& shards) {
+            {
+                std::unique_lock<std::shared_mutex> lock(topology_mutex);
+                for (const auto& s : std::set<std::string>(ring.shards())) {
+                    if (!shards.count(s)) ring.removeShard(s);
+                }
+                for (const auto& [s, path] : shards) ring.addShard(s);
+                members = shards;
+            }
+            return rebalance();
+        }
+
+        /**
+         * @brief Opens connections to newly owned hosts and closes released ones.
+         *
+         * Requests keep being served while new hosts are connected.
+         */
+        ShardRebalance rebalance() {
+            ShardRebalance result;
+            std::lock_guard<std::mutex> serial(rebalance_mutex);
+            std::set<std::string> owned;
+            {
+                std::shared_lock<std::shared_mutex> lock(topology_mutex);
+                for (const auto& uri : hosts) {
+                    if (ring.owner(uri) == id) owned.insert(uri);
+                }
+            }
+            std::vector<std::string> wanted;
+            {
+                std::lock_guard<std::mutex> lock(managers_mutex);
+                for (auto it = managers.begin(); it != managers.end();) {
+                    if (owned.count(it->first)) {
+                        ++it;
+                        continue;
+                    }
+                    result.released.push_back(it->first);
+                    it = managers.erase(it);
+                }
+                for (const auto& uri : owned) {
+                    if (!managers.count(uri)) wanted.push_back(uri);
+                }
+            }
+            for (const auto& uri : wanted) {
+                auto connection = std::make_shared<HostConnection>();
+                connection->manager = std::make_unique<VMManager>(domain_type);
+                if (!connection->manager->connect(uri)) {
+                    std::cerr << "Shard '" << id << "' cannot connect to owned host " << uri << "\n";
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(managers_mutex);
+                managers[uri] = std::move(connection);
+                result.acquired.push_back(uri);
+            }
+            std::lock_guard<std::mutex> lock(managers_mutex);
+            std::cout << "Shard '" << id << "' owns " << managers.size() << " hosts (+" << result.acquired.size()
+                      << " -" << result.released.size() << ")\n";
+            return result;
+        }
+
+        /**
+         * @brief Starts serving requests on this shard's socket from the member table.
+         */
+        bool serve() {
+            std::string socket_path;
+            {
+                std::shared_lock<std::shared_mutex> lock(topology_mutex);
+                auto it = members.find(id);
+                if (it != members.end()) socket_path = it->second;
+            }
+            if (socket_path.empty()) {
+                std::cerr << "Shard '" << id << "' is not in the member table\n";
+                return false;
+            }
+            return server.start(socket_path, [this](const ShardRequest& req) { return route(req); });
+        }
+
+        std::string ownerOf(const std::string& host) const {
+            std::shared_lock<std::shared_mutex> lock(topology_mutex);
+            return ring.owner(host);
+        }
+
+        /**
+         * @brief Runs a request locally if this shard owns the host, otherwise forwards it.
+         */
+        ShardResponse route(const ShardRequest& req) {
+            std::string owner, socket_path;
+            {
+                std::shared_lock<std::shared_mutex> lock(topology_mutex);
+                owner = ring.owner(req.host);
+                auto it = members.find(owner);
+                if (it != members.end()) socket_path = it->second;
+            }
+            if (owner == id) return handleLocal(req);
+            ShardResponse resp;
+            if (req.forwarded || owner.empty()) {
+                resp.payload = "shard '" + id + "' does not own " + req.host;
+                return resp;
+            }
+            if (socket_path.empty()) {
+                resp.payload = "no socket for shard '" + owner + "'";
+                return resp;
+            }
+            ShardRequest fwd = req;
+            fwd.forwarded = true;
+            return sendShardRequest(socket_path, fwd);
+        }
+
+        /**
+         * @brief Hosts this shard currently holds connections for.
+         */
+        std::vector<std::string> ownedHosts() {
+            std::lock_guard<std::mutex> lock(managers_mutex);
+            std::vector<std::string> result;
+            for (const auto& [uri, connection] : managers) result.push_back(uri);
+            return result;
+        }
+
+        /**
+         * @brief Number of client threads of this shard's server not yet joined.
+         */
+        size_t serverThreads() { return server.clientThreads(); }
+};
+
+#endif // SHARD_H
@@ -0,0 +1,364 @@
+// VM specifications and domain XML generation
+#ifndef SPEC_H
+#define SPEC_H
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cpuset.h"
+#include "feature_profile.h"
+#include "xml.h"
+
+enum DomainType {
+    QEMU = 0,
+    KVM = 1,
+    LXC = 2,
+    // Add other domain types here
+};
+
+static const std::map<DomainType, std::string> domain_type_strings = {
+    {QEMU, "qemu"},
+    {KVM, "kvm"},
+    {LXC, "lxc"},
+};
+
+/**
+ * @brief A virtio-mem device providing hot-(un)pluggable memory in `block_mib` units.
+ *
+ * `max_mib` is the device size (the most memory that can ever be plugged) and
+ * `requested_mib` how much is plugged at boot.
+ */
+struct VirtioMemSpec {
+    uint64_t max_mib = 0;
+    uint64_t block_mib = 2;
+    uint64_t requested_mib = 0;
+    int node = 0;  // guest NUMA node the memory is plugged into
+    int slots = 16;
+};
+
+/**
+ * @brief System container settings for LXC domains.
+ *
+ * The container runs `init` inside `root_dir`; its vCPU count becomes a CFS
+ * quota and its memory a cgroup hard limit.
+ */
+struct LxcSpec {
+    std::string root_dir;
+    std::string init = "/sbin/init";
+    std::vector<std::string> init_args;
+    int cpu_shares = 1024;  // relative CPU weight against other containers
+};
+
+/**
+ * @brief QEMU adaptive polling window of an IOThread.
+ *
+ * The iothread busy-polls for up to `max_ns` before sleeping; QEMU grows and
+ * shrinks the window between 0 and `max_ns` by the `grow`/`shrink` factors
+ * (0 selects QEMU's defaults). `max_ns` = 0 disables polling.
+ */
+struct IOThreadPolling {
+    uint64_t max_ns = 0;
+    unsigned grow = 0;
+    unsigned shrink = 0;
+
+    bool operator==(const IOThreadPolling&) const = default;
+};
+
+/**
+ * @brief An IOThread defined with the domain, optionally with a fixed polling window.
+ */
+struct IOThreadSpec {
+    unsigned id = 1;
+    std::optional<IOThreadPolling> polling;
+};
+
+/**
+ * @brief Realtime scheduling for latency-critical guests.
+ *
+ * vCPU `i` is pinned to `cores[i]` and scheduled with SCHED_FIFO/SCHED_RR at
+ * `priority`; the emulator thread runs on `emulator_cores`, away from the
+ * vCPUs, and guest memory is locked so it is never swapped or migrated.
+ */
+struct RealtimeSpec {
+    std::vector<unsigned> cores;           // host core per vCPU, preferably isolated
+    std::vector<unsigned> emulator_cores;  // housekeeping cores for QEMU's own threads
+    std::string scheduler = "fifo";        // "fifo" or "rr"
+    int priority = 1;                      // 1-99
+    bool lock_memory = true;
+};
+
+/**
+ * @brief A slice of one host cache bank reserved for a set of vCPUs.
+ */
+struct CacheAllocation {
+    unsigned id = 0;             // cache bank id from host capabilities
+    unsigned level = 3;
+    std::string type = "both";   // "both", or "code"/"data" with CDP enabled
+    uint64_t size_kib = 0;
+};
+
+/**
+ * @brief A `<cachetune>` group: cache allocations shared by the listed vCPUs.
+ */
+struct CacheTuneSpec {
+    std::string vcpus;  // vCPU list, e.g. "0-3"
+    std::vector<CacheAllocation> caches;
+};
+
+/**
+ * @brief A memory-bandwidth share (percent) on one host NUMA node.
+ */
+struct MemoryBandwidthAllocation {
+    unsigned node = 0;
+    unsigned bandwidth = 100;
+};
+
+/**
+ * @brief A `<memorytune>` group: bandwidth limits shared by the listed vCPUs.
+ */
+struct MemoryTuneSpec {
+    std::string vcpus;
+    std::vector<MemoryBandwidthAllocation> nodes;
+};
+
+/**
+ * @brief Everything needed to define a domain.
+ *
+ * `memory` is the boot memory; memory devices such as virtio-mem add to it.
+ */
+struct VMSpec {
+    std::string name;
+    int memory = 0;  // MiB
+    int vcpus = 1;
+    std::optional<DomainType> type;  // overrides the manager's domain type
+    std::optional<VirtioMemSpec> virtio_mem;
+    std::optional<LxcSpec> lxc;
+    std::vector<CacheTuneSpec> cachetune;
+    std::vector<MemoryTuneSpec> memorytune;
+    std::vector<IOThreadSpec> iothreads;
+    unsigned disk_iothread = 0;  // IOThread serving the disk's virtqueue; 0 = QEMU main loop
+    std::optional<RealtimeSpec> realtime;
+    std::string profile;         // feature profile name ("linux", "windows", ...); empty = generic
+    std::string machine;         // machine type ("q35", "pc-i440fx-8.2", ...); empty = hypervisor default
+    std::vector<std::string> cpu_features;  // host CPU features the guest requires
+    std::string reservation;     // capacity reservation the VM claims (see ReservationBook); empty = none
+};
+
+/**
+ * @brief Builds the `<cachetune>` and `<memorytune>` elements for a spec's cputune block.
+ */
+inline std::string buildResctrlXML(const VMSpec& spec) {
+    std::string xml;
+    for (const auto& group : spec.cachetune) {
+        xml += "    <cachetune vcpus='" + xmlEscape(group.vcpus) + "'>";
+        for (const auto& c : group.caches) {
+            xml += "      <cache id='" + std::to_string(c.id) + "' level='" + std::to_string(c.level) +
+                   "' type='" + xmlEscape(c.type) + "' size='" + std::to_string(c.size_kib) + "' unit='KiB'/>";
+        }
+        xml += "    </cachetune>";
+    }
+    for (const auto& group : spec.memorytune) {
+        xml += "    <memorytune vcpus='" + xmlEscape(group.vcpus) + "'>";
+        for (const auto& n : group.nodes) {
+            xml += "      <node id='" + std::to_string(n.node) + "' bandwidth='" + std::to_string(n.bandwidth) + "'/>";
+        }
+        xml += "    </memorytune>";
+    }
+    return xml;
+}
+
+/**
+ * @brief Builds the `<cputune>` pinning and scheduler entries of a realtime spec.
+ *
+ * Each vCPU is pinned to its own core and given the realtime scheduler; the
+ * emulator thread is kept off the vCPU cores.
+ */
+inline std::string buildRealtimeCputuneXML(const RealtimeSpec& rt) {
+    std::string xml;
+    for (size_t v = 0; v < rt.cores.size(); v++) {
+        xml += "    <vcpupin vcpu='" + std::to_string(v) + "' cpuset='" + std::to_string(rt.cores[v]) + "'/>";
+    }
+    if (!rt.emulator_cores.empty()) {
+        std::set<unsigned> emulator(rt.emulator_cores.begin(), rt.emulator_cores.end());
+        xml += "    <emulatorpin cpuset='" + formatCpuset(emulator) + "'/>";
+    }
+    if (!rt.cores.empty()) {
+        xml += "    <vcpusched vcpus='0-" + std::to_string(rt.cores.size() - 1) + "' scheduler='" +
+               xmlEscape(rt.scheduler) + "' priority='" + std::to_string(rt.priority) + "'/>";
+    }
+    return xml;
+}
+
+/**
+ * @brief Builds the `<iothreads>` count and `<iothreadids>` elements for a spec.
+ */
+inline std::string buildIOThreadsXML(const VMSpec& spec) {
+    if (spec.iothreads.empty()) return "";
+    std::string xml = "  <iothreads>" + std::to_string(spec.iothreads.size()) + "</iothreads>"
+                      "  <iothreadids>";
+    for (const auto& t : spec.iothreads) {
+        xml += "    <iothread id='" + std::to_string(t.id) + "'";
+        if (!t.polling) {
+            xml += "/>";
+            continue;
+        }
+        xml += "><poll max='" + std::to_string(t.polling->max_ns) + "' grow='" + std::to_string(t.polling->grow) +
+               "' shrink='" + std::to_string(t.polling->shrink) + "'/></iothread>";
+    }
+    return xml + "  </iothreadids>";
+}
+
+/**
+ * @brief Builds the libvirt domain XML for a spec.
+ *
+ * @param spec VM specification.
+ * @param type Domain type string (e.g. "kvm", "qemu").
+ * @param emulator Path to the QEMU binary.
+ * @param disk_path Path to the VM's disk image.
+ * @param features Feature profile to emit; defaults to the spec's named profile.
+ * @return std::string Domain XML suitable for `virDomainDefineXML`.
+ */
+inline std::string buildDomainXML(const VMSpec& spec, const std::string& type,
+                                  const std::string& emulator, const std::string& disk_path,
+                                  const FeatureProfile* features = nullptr) {
+    std::string memory = std::to_string(spec.memory);
+    const FeatureProfile& profile = features ? *features : findFeatureProfile(spec.profile);
+
+    std::string max_memory;
+    std::string cputune;
+    std::string cpu;
+    std::string memory_devices;
+    std::string resctrl = buildResctrlXML(spec);
+    std::string disk_iothread;
+    if (spec.disk_iothread) disk_iothread = " iothread='" + std::to_string(spec.disk_iothread) + "'";
+    std::string pinning = spec.realtime ? buildRealtimeCputuneXML(*spec.realtime) : "";
+    if (!pinning.empty() || !resctrl.empty()) {
+        cputune = "  <cputune>" + pinning + resctrl + "  </cputune>";
+    }
+    std::string memory_backing;
+    if (spec.realtime && spec.realtime->lock_memory) {
+        // QEMU needs a memlock limit covering guest RAM plus its own allocations
+        const int qemu_overhead_mib = 256;
+        int limit = spec.memory + qemu_overhead_mib + (spec.virtio_mem ? static_cast<int>(spec.virtio_mem->max_mib) : 0);
+        memory_backing =
+            "  <memoryBacking>    <locked/>  </memoryBacking>"
+            "  <memtune>    <hard_limit unit='MiB'>" + std::to_string(limit) + "</hard_limit>  </memtune>";
+    }
+
+    if (spec.virtio_mem) {
+        const VirtioMemSpec& vmem = *spec.virtio_mem;
+        // Memory devices need a maxMemory ceiling and a guest NUMA topology to plug into
+        max_memory =
+            "  <maxMemory slots='" + std::to_string(vmem.slots) + "' unit='MiB'>" +
+            std::to_string(spec.memory + vmem.max_mib) + "</maxMemory>";
+        cpu =
+            "    <numa>"
+            "      <cell id='0' cpus='0-" + std::to_string(spec.vcpus - 1) + "' memory='" + memory + "' unit='MiB'/>"
+            "    </numa>";
+        memory_devices =
+            "    <memory model='virtio-mem'>"
+            "      <target>"
+            "        <size unit='MiB'>" + std::to_string(vmem.max_mib) + "</size>"
+            "        <node>" + std::to_string(vmem.node) + "</node>"
+            "        <block unit='MiB'>" + std::to_string(vmem.block_mib) + "</block>"
+            "        <requested unit='MiB'>" + std::to_string(vmem.requested_mib) + "</requested>"
+            "      </target>"
+            "    </memory>";
+    }
+
+    if (!spec.cpu_features.empty()) {
+        std::string required;
+        for (const auto& f : spec.cpu_features) required += "    <feature policy='require' name='" + xmlEscape(f) + "'/>";
+        cpu = "  <cpu mode='host-model'>" + required + cpu + "  </cpu>";
+    } else if (!cpu.empty()) {
+        cpu = "  <cpu>" + cpu + "  </cpu>";
+    }
+    std::string machine;
+    if (!spec.machine.empty()) machine = " machine='" + xmlEscape(spec.machine) + "'";
+
+    return
+    "<domain type='" + type + "'>"
+    "  <name>" + xmlEscape(spec.name) + "</name>" +
+    max_memory +
+    "  <memory unit='MiB'>" + memory + "</memory>" +
+    memory_backing +
+    "  <vcpu>" + std::to_string(spec.vcpus) + "</vcpu>" +
+    buildIOThreadsXML(spec) +
+    "  <os>"
+    "    <type arch='x86_64'" + machine + ">hvm</type>"
+    "    <boot dev='hd'/>"
+    "  </os>" +
+    buildFeaturesXML(profile) +
+    buildClockXML(profile) +
+    cputune +
+    cpu +
+    "  <devices>"
+    "    <emulator>" + xmlEscape(emulator) + "</emulator>"
+    "    <disk type='file' device='disk'>"
+    "      <driver name='qemu' type='qcow2'" + disk_iothread + "/>"
+    "      <source file='" + xmlEscape(disk_path) + "'/>"
+    "      <target dev='vda' bus='virtio'/>"
+    "    </disk>"
+    "    <interface type='network'>"
+    "      <source network='default'/>"
+    "      <model type='virtio'/>"
+    "    </interface>" +
+    memory_devices +
+    "    <console type='pty'/>"
+    "    <graphics type='vnc' port='-1'/>"
+    "  </devices>"
+    "</domain>";
+}
+
+/**
+ * @brief Builds the libvirt domain XML for an LXC system container.
+ *
+ * @param spec VM specification with `lxc` set.
+ * @return std::string Domain XML suitable for `virDomainDefineXML` on an LXC connection.
+ */
+inline std::string buildLXCDomainXML(const VMSpec& spec) {
+    LxcSpec lxc = spec.lxc.value_or(LxcSpec{});
+    std::string memory = std::to_string(spec.memory);
+    const int period_us = 100000;
+
+    std::string init_args;
+    for (const auto& arg : lxc.init_args) {
+        init_args += "    <initarg>" + xmlEscape(arg) + "</initarg>";
+    }
+
+    return
+    "<domain type='lxc'>"
+    "  <name>" + xmlEscape(spec.name) + "</name>"
+    "  <memory unit='MiB'>" + memory + "</memory>"
+    "  <vcpu>" + std::to_string(spec.vcpus) + "</vcpu>"
+    "  <os>"
+    "    <type>exe</type>"
+    "    <init>" + xmlEscape(lxc.init) + "</init>" +
+    init_args +
+    "  </os>"
+    "  <cputune>"
+    "    <shares>" + std::to_string(lxc.cpu_shares) + "</shares>"
+    "    <period>" + std::to_string(period_us) + "</period>"
+    "    <quota>" + std::to_string(static_cast<long long>(period_us) * spec.vcpus) + "</quota>"
+    "  </cputune>"
+    "  <memtune>"
+    "    <hard_limit unit='MiB'>" + memory + "</hard_limit>"
+    "  </memtune>"
+    "  <devices>"
+    "    <filesystem type='mount'>"
+    "      <source dir='" + xmlEscape(lxc.root_dir) + "'/>"
+    "      <target dir='/'/>"
+    "    </filesystem>"
+    "    <interface type='network'>"
+    "      <source network='default'/>"
+    "    </interface>"
+    "    <console type='pty'/>"
+    "  </devices>"
+    "</domain>";
+}
+
+#endif // SPEC_H
@@ -0,0 +1,237 @@
+// Thin-provisioned disk watermarks driven by block threshold and I/O error events
+#ifndef THIN_H
+#define THIN_H
+
+#include <libvirt/libvirt.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xml.h"
+
+/**
+ * @brief When and how far thin volumes are grown.
+ *
+ * A disk's threshold is armed at `watermark` of its volume's physical size;
+ * when the guest writes past it the volume grows by `extend_fraction` (at
+ * least `min_extend_bytes`), up to `max_capacity_bytes`.
+ */
+struct ThinPolicy {
+    double watermark = 0.8;
+    double extend_fraction = 0.25;
+    uint64_t min_extend_bytes = 1ULL << 30;
+    uint64_t max_capacity_bytes = 0;  // 0 = no limit
+};
+
+/**
+ * @brief A disk of a domain whose image lives on a thin volume.
+ */
+struct ThinDisk {
+    std::string dev;   // target device, e.g. "vda"
+    std::string path;  // source block device
+};
+
+/**
+ * @brief Lists the disks of a domain that are qcow2 images on block volumes.
+ *
+ * Only these are thin: the image can address more than the volume holds, and
+ * the volume has to grow before the guest's writes reach its end. File-backed
+ * images grow on their own and are bounded by the filesystem instead.
+ */
+inline std::vector<ThinDisk> parseThinDisks(const std::string& domain_xml) {
+    std::vector<ThinDisk> disks;
+    for (const auto& disk : xmlElements(domain_xml, "disk")) {
+        if (xmlAttr(disk, "type") != "block" || xmlAttr(disk, "device") != "disk") continue;
+        if (xmlAttr(xmlElement(disk, "driver"), "type") != "qcow2") continue;
+        std::string path = xmlAttr(xmlElement(disk, "source"), "dev");
+        std::string dev = xmlAttr(xmlElement(disk, "target"), "dev");
+        if (!path.empty() && !dev.empty()) disks.push_back(ThinDisk{dev, path});
+    }
+    return disks;
+}
+
+/**
+ * @brief Byte offset at which to arm a disk's threshold.
+ */
+inline uint64_t thinThreshold(uint64_t physical, const ThinPolicy& policy) {
+    return static_cast<uint64_t>(static_cast<double>(physical) * policy.watermark);
+}
+
+/**
+ * @brief New size for a volume that crossed its watermark.
+ *
+ * @return uint64_t The grown size, or 0 if the volume is already at the maximum.
+ */
+inline uint64_t thinExtension(uint64_t physical, const ThinPolicy& policy) {
+    uint64_t step = std::max<uint64_t>(static_cast<uint64_t>(static_cast<double>(physical) * policy.extend_fraction),
+                                       policy.min_extend_bytes);
+    uint64_t grown = physical + step;
+    if (policy.max_capacity_bytes) grown = std::min(grown, policy.max_capacity_bytes);
+    return grown > physical ? grown : 0;
+}
+
+/**
+ * @brief A threshold crossing or an I/O error reported by libvirt.
+ */
+struct ThinEvent {
+    enum Kind { Threshold, IOError } kind = Threshold;
+    std::string domain;
+    std::string dev;     // target device or alias
+    std::string path;    // source path
+    std::string reason;  // I/O errors: "enospc", ...
+};
+
+/**
+ * @brief Hands events from libvirt's event loop to a worker thread.
+ *
+ * Reacting to an event takes several RPCs (volume lookup, resize, re-arming,
+ * resume), which must not stall the event loop that delivers every other
+ * callback.
+ */
+class ThinEventQueue {
+    private:
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<ThinEvent> pending;
+        std::function<void(const ThinEvent&)> handler;
+        std::thread worker;
+        bool running = false;
+
+    public:
+        ~ThinEventQueue() { stop(); }
+
+        void start(std::function<void(const ThinEvent&)> fn) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (running) return;
+            handler = std::move(fn);
+            running = true;
+            worker = std::thread([this] {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (true) {
+                    cv.wait(lock, [this] { return !running || !pending.empty(); });
+                    if (!running) break;
+                    ThinEvent e = std::move(pending.front());
+                    pending.pop_front();
+                    lock.unlock();
+                    handler(e);
+                    lock.lock();
+                }
+            });
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!running) return;
+                running = false;
+            }
+            cv.notify_one();
+            worker.join();
+        }
+
+        void push(ThinEvent e) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(e));
+            cv.notify_one();
+        }
+};
+
+/**
+ * @brief Reads the error recorded for each disk of a domain (`VIR_DOMAIN_DISK_ERROR_*`).
+ */
+inline std::vector<int> libvirtDiskErrors(virDomainPtr vm) {
+    std::vector<int> codes;
+    int n = virDomainGetDiskErrors(vm, nullptr, 0, 0);
+    if (n <= 0) return codes;
+    std::vector<virDomainDiskError> errors(n);
+    n = virDomainGetDiskErrors(vm, errors.data(), static_cast<unsigned>(n), 0);
+    for (int i = 0; i < n; i++) {
+        codes.push_back(errors[i].error);
+        free(errors[i].disk);
+    }
+    return codes;
+}
+
+/**
+ * @brief Domains paused because a thin volume ran out of space, and their resumption.
+ *
+ * A pause on an I/O error counts only when libvirt's disk errors confirm
+ * ENOSPC: after EIO or a permission error, growing the volume cures nothing
+ * and resuming only replays the failing write. The libvirt calls are members
+ * so tests can script them.
+ */
+class NoSpacePauses {
+    private:
+        std::mutex mutex;
+        std::set<std::string> tracked;
+
+    public:
+        std::function<bool(virDomainPtr, int&, int&)> get_state = [](virDomainPtr vm, int& state, int& reason) {
+            return virDomainGetState(vm, &state, &reason, 0) == 0;
+        };
+        std::function<std::vector<int>(virDomainPtr)> disk_errors = libvirtDiskErrors;
+        std::function<bool(virDomainPtr)> resume = [](virDomainPtr vm) { return virDomainResume(vm) == 0; };
+
+        /**
+         * @brief Checks that a domain is paused on an I/O error and that a disk reports no space.
+         */
+        bool confirm(virDomainPtr vm) {
+            int state, reason;
+            if (!get_state(vm, state, reason) || state != VIR_DOMAIN_PAUSED || reason != VIR_DOMAIN_PAUSED_IOERROR) {
+                return false;
+            }
+            std::vector<int> errors = disk_errors(vm);
+            return std::find(errors.begin(), errors.end(), VIR_DOMAIN_DISK_ERROR_NO_SPACE) != errors.end();
+        }
+
+        void track(const std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            tracked.insert(name);
+        }
+
+        void forget(const std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            tracked.erase(name);
+        }
+
+        bool isTracked(const std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return tracked.count(name) > 0;
+        }
+
+        std::vector<std::string> names() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return std::vector<std::string>(tracked.begin(), tracked.end());
+        }
+
+        /**
+         * @brief Resumes a tracked domain if its pause is confirmed as ENOSPC, and stops tracking it.
+         *
+         * Domains no longer paused (resumed by hand, shut down) or paused for
+         * another I/O error are only forgotten; the domain stays tracked only if
+         * the resume itself failed.
+         *
+         * @return true if the domain was resumed.
+         */
+        bool resumeIfNoSpace(virDomainPtr vm, const std::string& name) {
+            bool confirmed = confirm(vm);
+            if (confirmed && !resume(vm)) {
+                std::cerr << "Failed to resume VM '" << name << "'\n";
+                return false;
+            }
+            forget(name);
+            if (confirmed) std::cout << "VM '" << name << "' resumed after its disk was extended\n";
+            return confirmed;
+        }
+};
+
+#endif // THIN_H
@@ -0,0 +1,259 @@
+// Offline validation of VM specs against cached hypervisor capabilities
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "spec.h"
+#include "xml.h"
+
+/**
+ * @brief A machine type offered by the emulator, from host capabilities.
+ */
+struct MachineType {
+    std::string name;
+    std::string canonical;  // for aliases such as "q35"; empty otherwise
+    unsigned max_cpus = 0;
+};
+
+/**
+ * @brief What one hypervisor (emulator + virt type) on one host accepts.
+ *
+ * Built once from `virConnectGetCapabilities`, `virConnectGetDomainCapabilities`,
+ * `virNodeGetInfo` and the expanded host-model CPU, then reused to check
+ * specs without further RPCs.
+ */
+struct HypervisorLimits {
+    std::set<std::string> domain_types;  // virt types the emulator supports for the guest arch
+    std::vector<MachineType> machines;
+    std::string default_machine;         // machine the domain capabilities describe
+    unsigned max_vcpus = 0;              // of the default machine; 0 = unknown
+    unsigned host_cpus = 0;
+    std::set<std::string> cpu_features;  // features of the host-model CPU
+    std::set<std::string> cpu_disabled;  // features host-model explicitly lacks
+    bool cpu_features_expanded = false;  // cpu_features is the full list, not only additions to the model
+
+    const MachineType* machine(const std::string& name) const {
+        for (const auto& m : machines) {
+            if (m.name == name || (!m.canonical.empty() && m.canonical == name)) return &m;
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * @brief One reason a spec would be rejected.
+ */
+struct SpecError {
+    std::string field;
+    std::string message;
+};
+
+struct ValidationStats {
+    uint64_t checked = 0;
+    uint64_t rejected = 0;  // specs refused before any define RPC
+};
+
+/**
+ * @brief Returns the names of the `<feature>` elements of a CPU definition with the given policy.
+ */
+inline std::set<std::string> parseCpuFeatures(const std::string& cpu_xml, const std::string& policy = "require") {
+    std::set<std::string> result;
+    for (const auto& f : xmlElements(cpu_xml, "feature")) {
+        std::string p = xmlAttr(f, "policy");
+        if (p.empty() || p == policy) result.insert(xmlAttr(f, "name"));
+    }
+    return result;
+}
+
+/**
+ * @brief Returns the domain capabilities' host-model CPU as a `<cpu>` definition.
+ *
+ * Suitable as input for `virConnectBaselineHypervisorCPU` to expand it to the
+ * model's full feature list. Empty if host-model is unsupported.
+ */
+inline std::string hostModelCpuXML(const std::string& domcaps) {
+    for (const auto& mode : xmlElements(xmlElement(domcaps, "cpu"), "mode")) {
+        if (xmlAttr(mode, "name") != "host-model" || xmlAttr(mode, "supported") != "yes") continue;
+        std::string xml = "<cpu mode='custom' match='exact'>";
+        xml += "<model>" + xmlEscape(xmlChildText(mode, "model")) + "</model>";
+        std::string vendor = xmlChildText(mode, "vendor");
+        if (!vendor.empty()) xml += "<vendor>" + xmlEscape(vendor) + "</vendor>";
+        for (const auto& f : xmlElements(mode, "feature")) xml += f;
+        return xml + "</cpu>";
+    }
+    return "";
+}
+
+/**
+ * @brief Returns the emulator the host capabilities name for x86_64 HVM guests of a virt type.
+ *
+ * A `<domain>` may name its own emulator; otherwise the arch's applies. The
+ * path is the one on the host the capabilities came from, which for a remote
+ * connection need not exist locally.
+ *
+ * @return std::string Emulator path, or an empty string if no such guest is offered.
+ */
+inline std::string capabilitiesEmulator(const std::string& caps, const std::string& virttype) {
+    for (const auto& guest : xmlElements(caps, "guest")) {
+        if (xmlChildText(guest, "os_type") != "hvm") continue;
+        std::string arch = xmlElement(guest, "arch");
+        if (xmlAttr(arch, "name") != "x86_64") continue;
+        for (const auto& d : xmlElements(arch, "domain")) {
+            if (xmlAttr(d, "type") != virttype) continue;
+            std::string emulator = xmlChildText(d, "emulator");
+            if (!emulator.empty()) return emulator;
+            std::string shared = arch;
+            xmlRemoveElements(shared, "domain");
+            return xmlChildText(shared, "emulator");
+        }
+    }
+    return "";
+}
+
+/**
+ * @brief Collects hypervisor limits for the x86_64 HVM guests the spec builder emits.
+ *
+ * @param caps Output of `virConnectGetCapabilities`.
+ * @param domcaps Output of `virConnectGetDomainCapabilities` for the default machine.
+ * @param virttype Domain type being validated ("kvm", "qemu").
+ * @param expanded_cpu Host-model CPU expanded by `virConnectBaselineHypervisorCPU`, or empty.
+ */
+inline HypervisorLimits parseHypervisorLimits(const std::string& caps, const std::string& domcaps,
+                                              const std::string& virttype, const std::string& expanded_cpu = "") {
+    HypervisorLimits limits;
+    auto addMachines = [&limits](const std::string& xml) {
+        for (const auto& m : xmlElements(xml, "machine")) {
+            unsigned max_cpus = static_cast<unsigned>(std::strtoul(xmlAttr(m, "maxCpus").c_str(), nullptr, 10));
+            limits.machines.push_back(MachineType{xmlText(m), xmlAttr(m, "canonical"), max_cpus});
+        }
+    };
+    for (const auto& guest : xmlElements(caps, "guest")) {
+        if (xmlChildText(guest, "os_type") != "hvm") continue;
+        std::string arch = xmlElement(guest, "arch");
+        if (xmlAttr(arch, "name") != "x86_64") continue;
+        for (const auto& d : xmlElements(arch, "domain")) {
+            std::string type = xmlAttr(d, "type");
+            limits.domain_types.insert(type);
+            if (type != virttype) continue;
+            addMachines(d);  // older libvirt lists machines per domain type
+        }
+        std::string shared = arch;
+        xmlRemoveElements(shared, "domain");
+        addMachines(shared);
+    }
+
+    limits.default_machine = xmlChildText(domcaps, "machine");
+    limits.max_vcpus = static_cast<unsigned>(std::strtoul(xmlAttr(xmlElement(domcaps, "vcpu"), "max").c_str(), nullptr, 10));
+    for (const auto& mode : xmlElements(xmlElement(domcaps, "cpu"), "mode")) {
+        if (xmlAttr(mode, "name") != "host-model" || xmlAttr(mode, "supported") != "yes") continue;
+        limits.cpu_features = parseCpuFeatures(mode, "require");
+        limits.cpu_disabled = parseCpuFeatures(mode, "disable");
+    }
+    if (!expanded_cpu.empty()) {
+        limits.cpu_features = parseCpuFeatures(expanded_cpu, "require");
+        limits.cpu_features_expanded = true;
+    }
+    return limits;
+}
+
+/**
+ * @brief Checks a spec against hypervisor limits without contacting libvirt.
+ *
+ * Catches what `virDomainDefineXML` or `virDomainCreate` would otherwise
+ * reject after a round trip: unknown machine types, vCPU counts above the
+ * machine limit, CPU features the host lacks, undeclared IOThreads and
+ * inconsistent virtio-mem sizes and pins to
+ * host CPUs that do not exist. Specs with an unknown `limits` field (zero
+ * or empty) skip the corresponding check. Guest memory above the host's is
+ * not an error: libvirt defines and starts overcommitted guests.
+ *
+ * @param spec Spec to check.
+ * @param virttype Domain type the spec would be defined with.
+ * @param limits Limits of the target hypervisor; pass nullptr to run only the spec-internal checks.
+ * @return std::vector<SpecError> Every problem found; empty if the spec is valid.
+ */
+inline std::vector<SpecError> validateVMSpec(const VMSpec& spec, const std::string& virttype,
+                                             const HypervisorLimits* limits) {
+    std::vector<SpecError> errors;
+    auto fail = [&errors](const std::string& field, const std::string& message) {
+        errors.push_back(SpecError{field, message});
+    };
+
+    if (spec.name.empty()) fail("name", "must not be empty");
+    if (spec.name.find('/') != std::string::npos) fail("name", "must not contain '/'");
+    if (spec.memory <= 0) fail("memory", "must be positive, got " + std::to_string(spec.memory) + " MiB");
+    if (spec.vcpus < 1) fail("vcpus", "must be at least 1, got " + std::to_string(spec.vcpus));
+
+    std::set<unsigned> iothread_ids;
+    for (const auto& t : spec.iothreads) {
+        if (t.id == 0) fail("iothreads", "IOThread ids start at 1");
+        else if (!iothread_ids.insert(t.id).second) fail("iothreads", "duplicate IOThread id " + std::to_string(t.id));
+    }
+    if (spec.disk_iothread && !iothread_ids.count(spec.disk_iothread)) {
+        fail("disk_iothread", "IOThread " + std::to_string(spec.disk_iothread) + " is not declared in iothreads");
+    }
+
+    if (spec.virtio_mem) {
+        const VirtioMemSpec& v = *spec.virtio_mem;
+        if (v.block_mib < 2 || (v.block_mib & (v.block_mib - 1))) {
+            fail("virtio_mem.block_mib", "must be a power of two of at least 2 MiB, got " + std::to_string(v.block_mib));
+        } else {
+            if (v.max_mib == 0 || v.max_mib % v.block_mib) {
+                fail("virtio_mem.max_mib", "must be a positive multiple of the " + std::to_string(v.block_mib) + " MiB block size");
+            }
+            if (v.requested_mib % v.block_mib) {
+                fail("virtio_mem.requested_mib", "must be a multiple of the " + std::to_string(v.block_mib) + " MiB block size");
+            }
+        }
+        if (v.requested_mib > v.max_mib) {
+            fail("virtio_mem.requested_mib", std::to_string(v.requested_mib) + " MiB exceeds max_mib " + std::to_string(v.max_mib));
+        }
+        if (v.node != 0) fail("virtio_mem.node", "the generated guest topology has only NUMA node 0");
+    }
+
+    if (!limits) return errors;
+
+    if (!limits->domain_types.empty() && !limits->domain_types.count(virttype)) {
+        fail("type", "domain type '" + virttype + "' is not supported by the emulator");
+    }
+
+    unsigned max_vcpus = limits->max_vcpus;
+    std::string machine = spec.machine.empty() ? limits->default_machine : spec.machine;
+    if (!spec.machine.empty() && !limits->machines.empty()) {
+        const MachineType* m = limits->machine(spec.machine);
+        if (!m) {
+            fail("machine", "machine type '" + spec.machine + "' is not offered by the emulator");
+        } else if (m->max_cpus) {
+            max_vcpus = m->max_cpus;
+        }
+    }
+    if (max_vcpus && spec.vcpus > static_cast<int>(max_vcpus)) {
+        fail("vcpus", std::to_string(spec.vcpus) + " exceeds the limit of " + std::to_string(max_vcpus) +
+                      " for machine type '" + machine + "'");
+    }
+
+    if (spec.realtime && limits->host_cpus) {
+        for (unsigned c : spec.realtime->cores) {
+            if (c >= limits->host_cpus) fail("realtime.cores", "host has no CPU " + std::to_string(c));
+        }
+        for (unsigned c : spec.realtime->emulator_cores) {
+            if (c >= limits->host_cpus) fail("realtime.emulator_cores", "host has no CPU " + std::to_string(c));
+        }
+    }
+
+    for (const auto& f : spec.cpu_features) {
+        if (limits->cpu_disabled.count(f) ||
+            (limits->cpu_features_expanded && !limits->cpu_features.count(f))) {
+            fail("cpu_features", "host CPU lacks feature '" + f + "'");
+        }
+    }
+    return errors;
+}
+
+#endif // VALIDATE_H
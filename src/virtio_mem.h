@@ -0,0 +1,109 @@
+// virtio-mem device state and memory elasticity policy
+#ifndef VIRTIO_MEM_H
+#define VIRTIO_MEM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "xml.h"
+
+/**
+ * @brief Sizes of a virtio-mem device as reported in live domain XML, in KiB.
+ */
+struct VirtioMemState {
+    uint64_t size_kib = 0;       // device maximum
+    uint64_t block_kib = 0;      // plug granularity
+    uint64_t requested_kib = 0;  // what the host asked the guest to plug
+    uint64_t current_kib = 0;    // what the guest has actually plugged
+};
+
+/**
+ * @brief Tuning knobs for the virtio-mem controller.
+ *
+ * The controller acts only when the guest's free memory ratio leaves the
+ * [grow_below, shrink_above] band, then resizes towards `target_free`.
+ */
+struct ElasticityPolicy {
+    double target_free = 0.25;
+    double grow_below = 0.10;
+    double shrink_above = 0.45;
+    uint64_t max_step_kib = 1024 * 1024;  // largest single resize (1 GiB)
+};
+
+/**
+ * @brief Converts an element's value and `unit` attribute to KiB.
+ */
+inline uint64_t xmlSizeKiB(const std::string& element) {
+    std::string text = xmlText(element);
+    if (text.empty()) return 0;
+    return xmlToKiB(std::stoull(text), xmlAttr(element, "unit"));
+}
+
+/**
+ * @brief Returns the first `<memory model='virtio-mem'>` device in domain XML, or an empty string.
+ */
+inline std::string findVirtioMemDevice(const std::string& domain_xml) {
+    size_t begin, end, from = 0;
+    while (xmlFindElement(domain_xml, "memory", from, begin, end)) {
+        std::string element = domain_xml.substr(begin, end - begin);
+        if (xmlAttr(element, "model") == "virtio-mem") return element;
+        from = end;
+    }
+    return "";
+}
+
+/**
+ * @brief Parses the target sizes of a virtio-mem device element.
+ */
+inline VirtioMemState parseVirtioMem(const std::string& device) {
+    VirtioMemState state;
+    std::string target = xmlElement(device, "target");
+    state.size_kib = xmlSizeKiB(xmlElement(target, "size"));
+    state.block_kib = xmlSizeKiB(xmlElement(target, "block"));
+    state.requested_kib = xmlSizeKiB(xmlElement(target, "requested"));
+    state.current_kib = xmlSizeKiB(xmlElement(target, "current"));
+    return state;
+}
+
+/**
+ * @brief Returns a copy of the device element with its requested size replaced.
+ */
+inline std::string setVirtioMemRequested(const std::string& device, uint64_t requested_kib) {
+    std::string out = device;
+    xmlReplaceElement(out, "requested", "<requested unit='KiB'>" + std::to_string(requested_kib) + "</requested>");
+    return out;
+}
+
+/**
+ * @brief Decides the requested virtio-mem size for a guest's current memory demand.
+ *
+ * @param dev Current device state.
+ * @param guest_total_kib Memory visible to the guest (boot memory plus plugged blocks).
+ * @param guest_available_kib Memory the guest reports as available for new work.
+ * @param policy Controller thresholds.
+ * @return uint64_t New requested size in KiB, block-aligned and within the device
+ * size; equal to `dev.requested_kib` when no change is needed.
+ */
+inline uint64_t decideVirtioMemRequest(const VirtioMemState& dev, uint64_t guest_total_kib,
+                                       uint64_t guest_available_kib, const ElasticityPolicy& policy) {
+    if (guest_total_kib == 0 || dev.block_kib == 0) return dev.requested_kib;
+    double free_ratio = static_cast<double>(guest_available_kib) / guest_total_kib;
+    if (free_ratio >= policy.grow_below && free_ratio <= policy.shrink_above) return dev.requested_kib;
+
+    uint64_t used = guest_total_kib > guest_available_kib ? guest_total_kib - guest_available_kib : 0;
+    double wanted_total = used / (1.0 - policy.target_free);
+    int64_t delta = static_cast<int64_t>(wanted_total) - static_cast<int64_t>(guest_total_kib);
+    int64_t max_step = static_cast<int64_t>(policy.max_step_kib);
+    delta = std::clamp(delta, -max_step, max_step);
+
+    int64_t block = static_cast<int64_t>(dev.block_kib);
+    int64_t target = static_cast<int64_t>(dev.requested_kib) + delta;
+    // Round away from the current size so a triggered resize always moves at least one block
+    if (delta > 0) target = (target + block - 1) / block * block;
+    else target = target / block * block;
+    target = std::clamp<int64_t>(target, 0, static_cast<int64_t>(dev.size_kib / dev.block_kib * dev.block_kib));
+    return static_cast<uint64_t>(target);
+}
+
+#endif // VIRTIO_MEM_H
@@ -3,25 +3,69 @@
 #define VM_H
 
 #include <libvirt/libvirt.h>
+#include <libvirt/libvirt-qemu.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <cstdlib>
+#include <spawn.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 
+#include "clone.h"
+#include "digest.h"
+#include "events.h"
+#include "fleet.h"
+#include "iothread.h"
+#include "journal.h"
+#include "latency_histogram.h"
+#include "lease.h"
+#include "metering.h"
+#include "numa_locality.h"
+#include "perf.h"
+#include "qmp.h"
+#include "rdt.h"
+#include "readiness.h"
+#include "realtime.h"
+#include "reservation.h"
+#include "retry.h"
+#include "spec.h"
+#include "thin.h"
+#include "validate.h"
+#include "virtio_mem.h"
+#include "xml.h"
+
 #define MB_SIZE 1024
 
-enum DomainType {
-    QEMU = 0,
-    KVM = 1,
-    // Add other domain types here
+// Consolidation migrations: live, driven by the source daemon, persisted at the
+// destination and undefined at the source
+static const unsigned long consolidation_migrate_flags =
+    VIR_MIGRATE_LIVE | VIR_MIGRATE_PEER2PEER | VIR_MIGRATE_PERSIST_DEST | VIR_MIGRATE_UNDEFINE_SOURCE;
+
+// How recoverFromJournal() resolves operations that were in flight at a crash
+enum class RecoveryPolicy {
+    Replay,    // finish the interrupted operation
+    RollBack,  // undo whatever part of it took effect
 };
 
-static const std::map<DomainType, std::string> domain_type_strings = {
-    {QEMU, "qemu"},
-    {KVM, "kvm"},
+struct RecoveryReport {
+    size_t in_flight = 0;     // operations found open in the journal
+    size_t already_done = 0;  // operations whose effect was already in place
+    size_t replayed = 0;
+    size_t rolled_back = 0;
+    size_t failed = 0;
+    double elapsed_ms = 0.0;
 };
 
 // Can use different virtualization providers (QEMU, KVM, etc.)
@@ -29,6 +73,125 @@ class VMManager {
     private:
         DomainType domain_type; // qemu, kvm, etc.
         virConnectPtr conn;
+        std::map<std::string, PerfSample> perf_samples; // last perf sample per domain name
+        std::map<std::string, BlockLatencySample> block_samples; // last block sample per domain name
+        HostCpuSample host_cpu_sample;
+        std::string host_caps;                            // host capabilities XML, fetched once per connection
+        std::map<std::string, std::string> emulator_cache; // virttype -> emulator named by host capabilities
+        std::map<std::string, std::string> domcaps_cache; // "emulator|virttype" -> domain capabilities XML
+        std::map<std::string, HypervisorLimits> limits_cache; // virttype -> parsed limits
+        ValidationStats validation_counters;
+        std::mutex config_tree_mutex;
+        ConfigMerkle config_tree;                 // digests of defined domains' persistent configs
+        std::set<std::string> config_dirty;       // domains with events or config writes since their digest was taken
+        bool config_tree_loaded = false;
+        std::unique_ptr<OperationJournal> journal;       // null unless openJournal() was called
+        EventCoalescer events;
+        int lifecycle_callback_id = -1;
+        std::vector<int> config_callback_ids;     // device, tunable and metadata events that mark configs dirty
+        mutable std::mutex state_cache_mutex;
+        std::unordered_map<std::string, int> state_cache; // domain name -> VIR_DOMAIN_* state, fed by events
+        ReadinessMonitor readiness;
+        RetryExecutor retry;
+        std::map<std::string, RetryPolicy> retry_policies; // operation -> policy; default policy otherwise
+        RdtBudget rdt;
+        bool rdt_loaded = false;
+        RealtimeAdmission rt_cores;
+        bool rt_loaded = false;
+        ReservationBook* reservation_book = nullptr;  // shared across the fleet; null unless useReservations()
+        std::string reservation_host;                 // this host's URI in the book
+        std::mutex lease_mutex;
+        TimerWheel lease_wheel;
+        std::unordered_map<std::string, Lease> leases;  // domain name -> lease
+        std::mutex tenant_mutex;
+        std::unordered_map<std::string, std::string> tenant_cache;  // domain UUID -> tenant from metadata
+        std::string proc_root = "/proc";
+        std::string qemu_run_dir = "/run/libvirt/qemu"; // where libvirt keeps <domain>.pid files
+        int agent_callback_id = -1;
+        ThinPolicy thin_policy;
+        ThinEventQueue thin_events;
+        int threshold_callback_id = -1;
+        int io_error_callback_id = -1;
+        NoSpacePauses enospc_paused;  // domains paused on ENOSPC awaiting space
+        std::function<bool(virDomainPtr, const ThinDisk&)> thin_relocator;
+        std::mutex qmp_mutex;
+        QmpMux qmp;
+        std::string qmp_socket_dir;  // empty: stats queries go through libvirt only
+        std::mutex histogram_mutex;
+        std::map<std::string, LatencyHistogramConfig> histogram_configs;  // domain -> boundaries to keep applied
+        std::map<std::string, std::vector<HistogramDisk>> histogram_disks; // domain -> disks as of the last apply
+        std::map<std::string, std::map<std::string, HistogramBaseline>> histogram_baselines; // domain -> device -> totals when armed
+
+        static void blockThresholdCallback(virConnectPtr, virDomainPtr dom, const char* dev, const char* path,
+                                           unsigned long long, unsigned long long, void* opaque) {
+            ThinEvent e;
+            e.kind = ThinEvent::Threshold;
+            e.domain = virDomainGetName(dom);
+            e.dev = dev ? dev : "";
+            e.path = path ? path : "";
+            static_cast<ThinEventQueue*>(opaque)->push(std::move(e));
+        }
+
+        static void ioErrorReasonCallback(virConnectPtr, virDomainPtr dom, const char* src_path, const char* dev_alias,
+                                          int, const char* reason, void* opaque) {
+            ThinEvent e;
+            e.kind = ThinEvent::IOError;
+            e.domain = virDomainGetName(dom);
+            e.dev = dev_alias ? dev_alias : "";
+            e.path = src_path ? src_path : "";
+            e.reason = reason ? reason : "";
+            static_cast<ThinEventQueue*>(opaque)->push(std::move(e));
+        }
+
+        static void agentLifecycleCallback(virConnectPtr, virDomainPtr dom, int state, int, void* opaque) {
+            if (state == VIR_CONNECT_DOMAIN_EVENT_AGENT_LIFECYCLE_STATE_CONNECTED) {
+                static_cast<ReadinessMonitor*>(opaque)->agentConnected(virDomainGetName(dom));
+            }
+        }
+
+        static int lifecycleCallback(virConnectPtr, virDomainPtr dom, int event, int detail, void* opaque) {
+            DomainEvent e;
+            e.domain = virDomainGetName(dom);
+            e.event = event;
+            e.detail = detail;
+            e.received = std::chrono::steady_clock::now();
+            static_cast<EventCoalescer*>(opaque)->push(std::move(e));
+            return 0;
+        }
+
+        void markConfigDirty(const std::string& name) {
+            std::lock_guard<std::mutex> lock(config_tree_mutex);
+            config_dirty.insert(name);
+        }
+
+        static void deviceChangeCallback(virConnectPtr, virDomainPtr dom, const char*, void* opaque) {
+            static_cast<VMManager*>(opaque)->markConfigDirty(virDomainGetName(dom));
+        }
+
+        static void tunableCallback(virConnectPtr, virDomainPtr dom, virTypedParameterPtr, int, void* opaque) {
+            static_cast<VMManager*>(opaque)->markConfigDirty(virDomainGetName(dom));
+        }
+
+        static void metadataChangeCallback(virConnectPtr, virDomainPtr dom, int, const char*, void* opaque) {
+            static_cast<VMManager*>(opaque)->markConfigDirty(virDomainGetName(dom));
+        }
+
+        void applyEventBatch(const std::vector<DomainEvent>& batch) {
+            {
+                std::lock_guard<std::mutex> lock(config_tree_mutex);
+                for (const auto& e : batch) config_dirty.insert(e.domain);
+            }
+            std::lock_guard<std::mutex> lock(state_cache_mutex);
+            for (const auto& e : batch) {
+                if (e.event == VIR_DOMAIN_EVENT_UNDEFINED) {
+                    state_cache.erase(e.domain);
+                } else if (e.event == VIR_DOMAIN_EVENT_DEFINED) {
+                    state_cache.emplace(e.domain, VIR_DOMAIN_SHUTOFF);
+                } else if (eventToState(e.event) >= 0) {
+                    state_cache[e.domain] = eventToState(e.event);
+                }
+            }
+        }
         /**
          * @brief Convert a libvirt domain state code to a human-readable string.
          *
@@ -40,19 +203,629 @@ class VMManager {
          * `"Shutdown"`, `"Shutoff"`, `"Crashed"`, or `"Unknown"` if the state is unrecognized.
          */
         std::string escapeXML(const std::string& str) const {
-            std::string result;
-            result.reserve(str.size());
-            for (char c : str) {
-                switch (c) {
-                    case '<':  result += "&lt;";   break;
-                    case '>':  result += "&gt;";   break;
-                    case '&':  result += "&amp;";  break;
-                    case '\'': result += "&apos;"; break;
-                    case '"':  result += "&quot;"; break;
-                    default:   result += c;        break;
+            return xmlEscape(str);
+        }
+
+        /**
+         * @brief Records the intent of an operation when a journal is open.
+         *
+         * @param op Set to the id to pass to journalEnd(), 0 without a journal.
+         * @return false if a journal is open but the intent could not be made
+         * durable, in which case the operation must not be performed.
+         */
+        bool journalBegin(uint64_t& op, JournalOp kind, const std::string& name, const std::string& payload = "") {
+            op = journal ? journal->begin(kind, name, payload) : 0;
+            if (journal && op == 0) {
+                std::cerr << "Failed to journal " << journal_op_strings.at(kind) << " of VM '" << name << "'\n";
+                return false;
+            }
+            return true;
+        }
+
+        void journalEnd(uint64_t id, bool ok) {
+            if (journal) journal->complete(id, ok);
+        }
+
+        /**
+         * @brief Resolves one interrupted operation against the domain's current state.
+         *
+         * @return 0 if nothing had to be done, 1 if an action was applied, -1 on failure.
+         */
+        int recoverEntry(const JournalEntry& e, RecoveryPolicy policy) {
+            virDomainPtr dom = virDomainLookupByName(conn, e.domain.c_str());
+            bool exists = dom != nullptr;
+            bool active = exists && virDomainIsActive(dom) == 1;
+            int rc = 0;
+            auto apply = [&rc](bool ok) { rc = ok ? 1 : -1; };
+
+            if (policy == RecoveryPolicy::Replay) {
+                switch (e.op) {
+                    case JournalOp::Create:
+                        if (!exists) {
+                            virDomainPtr defined = virDomainDefineXML(conn, e.payload.c_str());
+                            apply(defined != nullptr);
+                            if (defined) virDomainFree(defined);
+                        }
+                        break;
+                    case JournalOp::Start:
+                        if (!exists) rc = -1;
+                        else if (!active) apply(virDomainCreate(dom) == 0);
+                        break;
+                    case JournalOp::Stop:
+                        if (active) apply(virDomainShutdown(dom) == 0);
+                        break;
+                    case JournalOp::Destroy:
+                        if (active) apply(virDomainDestroy(dom) == 0);
+                        break;
+                    case JournalOp::Undefine:
+                        if (exists) apply(virDomainUndefine(dom) == 0);
+                        break;
+                    case JournalOp::Restore: {
+                        std::string save_path, dxml;
+                        if (exists) break;
+                        if (!unpackJournalPayload(e.payload, save_path, dxml)) rc = -1;
+                        else apply(virDomainRestoreFlags(conn, save_path.c_str(), dxml.c_str(),
+                                                         VIR_DOMAIN_SAVE_RUNNING) == 0);
+                        break;
+                    }
+                    case JournalOp::Update: {
+                        std::string prev_xml, new_xml;
+                        if (!exists) break;
+                        if (!unpackJournalPayload(e.payload, prev_xml, new_xml)) {
+                            rc = -1;
+                            break;
+                        }
+                        virDomainPtr defined = virDomainDefineXML(conn, new_xml.c_str());
+                        apply(defined != nullptr);
+                        if (defined) virDomainFree(defined);
+                        break;
+                    }
+                    case JournalOp::Migrate:
+                        if (active) apply(virDomainMigrateToURI(dom, e.payload.c_str(), consolidation_migrate_flags,
+                                                                nullptr, 0) == 0);
+                        if (!exists || rc == 1) releaseMigrated(e.domain);
+                        break;
+                }
+            } else {
+                switch (e.op) {
+                    case JournalOp::Create:
+                        if (exists) apply((!active || virDomainDestroy(dom) == 0) && virDomainUndefine(dom) == 0);
+                        break;
+                    case JournalOp::Start:
+                        if (active) apply(virDomainDestroy(dom) == 0);
+                        break;
+                    case JournalOp::Stop:
+                    case JournalOp::Destroy:
+                        if (exists && !active) apply(virDomainCreate(dom) == 0);
+                        break;
+                    case JournalOp::Undefine:
+                        if (!exists && !e.payload.empty()) {
+                            virDomainPtr defined = virDomainDefineXML(conn, e.payload.c_str());
+                            apply(defined != nullptr);
+                            if (defined) virDomainFree(defined);
+                        }
+                        break;
+                    case JournalOp::Restore:
+                        // Clones are transient: destroying one removes it
+                        if (active) apply(virDomainDestroy(dom) == 0);
+                        break;
+                    case JournalOp::Update: {
+                        // Put the previous persistent config back; the domain itself is kept
+                        std::string prev_xml, new_xml;
+                        if (!exists) break;
+                        if (!unpackJournalPayload(e.payload, prev_xml, new_xml)) {
+                            rc = -1;
+                            break;
+                        }
+                        virDomainPtr defined = virDomainDefineXML(conn, prev_xml.c_str());
+                        apply(defined != nullptr);
+                        if (defined) virDomainFree(defined);
+                        break;
+                    }
+                    case JournalOp::Migrate:
+                        // A domain still here never left; one that is gone already runs
+                        // at the destination and cannot be pulled back from this side
+                        if (!exists) releaseMigrated(e.domain);
+                        break;
                 }
             }
-            return result;
+            if (dom) virDomainFree(dom);
+            return rc;
+        }
+
+        /**
+         * @brief Creates a qcow2 overlay backed by `base` (of format `base_format`) using qemu-img.
+         *
+         * @return true if qemu-img exited successfully, false otherwise.
+         */
+        bool createOverlay(const std::string& base, const std::string& base_format,
+                           const std::string& overlay) const {
+            std::vector<std::string> args = {"qemu-img", "create", "-q", "-f", "qcow2",
+                                             "-F", base_format, "-b", base, overlay};
+            std::vector<char*> argv;
+            for (auto& a : args) argv.push_back(a.data());
+            argv.push_back(nullptr);
+
+            pid_t pid;
+            if (posix_spawnp(&pid, "qemu-img", nullptr, nullptr, argv.data(), environ) != 0) {
+                std::cerr << "Failed to run qemu-img\n";
+                return false;
+            }
+            int status = 0;
+            if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                std::cerr << "Failed to create overlay '" << overlay << "'\n";
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Registers a domain definition, journaling and retrying the call.
+         *
+         * @return virDomainPtr Pointer to the defined domain on success, `nullptr` on failure.
+         */
+        virDomainPtr defineDomain(const std::string& name, const std::string& xml) {
+            uint64_t op;
+            if (!journalBegin(op, JournalOp::Create, name, xml)) return nullptr;
+            virDomainPtr dom = nullptr;
+            LibvirtError err;
+            retry.run("define of VM '" + name + "'", retryPolicy("define"), [&] {
+                dom = virDomainDefineXML(conn, xml.c_str());
+                return dom != nullptr;
+            }, &err);
+            journalEnd(op, dom != nullptr);
+            if (!dom) {
+                std::cerr << "Failed to define domain: " << err.message << "\n";
+                return nullptr;
+            }
+            
+            std::cout << "VM '" << name << "' defined successfully\n";
+            return dom;
+        }
+
+        /**
+         * @brief Replaces the persistent config of an existing domain, journaling the
+         * previous XML so recovery can roll the update back.
+         *
+         * @param vm Domain handle.
+         * @param prev_xml Current inactive XML of the domain.
+         * @param xml New inactive XML.
+         * @return true if the config was replaced, false otherwise.
+         */
+        bool redefineDomain(virDomainPtr vm, const std::string& prev_xml, const std::string& xml) {
+            std::string name = virDomainGetName(vm);
+            uint64_t op;
+            if (!journalBegin(op, JournalOp::Update, name, packJournalPayload(prev_xml, xml))) return false;
+            virDomainPtr dom = nullptr;
+            LibvirtError err;
+            retry.run("config update of VM '" + name + "'", retryPolicy("define"), [&] {
+                dom = virDomainDefineXML(conn, xml.c_str());
+                return dom != nullptr;
+            }, &err);
+            journalEnd(op, dom != nullptr);
+            if (!dom) {
+                std::cerr << "Failed to update config of VM '" << name << "': " << err.message << "\n";
+                return false;
+            }
+            virDomainFree(dom);
+            return true;
+        }
+
+        /**
+         * @brief Loads cache/bandwidth budgets from host capabilities and accounts for
+         * allocations of domains that already exist.
+         */
+        bool loadRdtBudget() {
+            char* caps = virConnectGetCapabilities(conn);
+            if (!caps) {
+                std::cerr << "Failed to get host capabilities\n";
+                return false;
+            }
+            rdt.loadCapabilities(caps);
+            free(caps);
+
+            forEachDomainXML([this](const std::string& name, const std::string& xml) {
+                VMSpec existing;
+                existing.name = name;
+                parseResctrl(xml, existing.cachetune, existing.memorytune);
+                std::string error;
+                if (!rdt.admit(existing.name, existing, error)) {
+                    std::cerr << "Warning: VM '" << name << "' exceeds cache/bandwidth budget: " << error << "\n";
+                }
+            });
+            rdt_loaded = true;
+            return true;
+        }
+
+        /**
+         * @brief Loads the host's isolated cores and the cores held by existing realtime domains.
+         */
+        void loadRealtimeCores() {
+            rt_cores.setIsolated(readIsolatedCpus());
+            if (rt_cores.isolatedCpus().empty()) {
+                std::cerr << "Warning: no isolated host CPUs (isolcpus=); realtime vCPUs will share cores with host tasks\n";
+            }
+            forEachDomainXML([this](const std::string& name, const std::string& xml) {
+                std::optional<RealtimeSpec> rt = parseRealtime(xml);
+                if (!rt) return;
+                VMSpec existing;
+                existing.name = name;
+                existing.vcpus = static_cast<int>(rt->cores.size());
+                existing.realtime = rt;
+                std::string error;
+                if (!rt_cores.admit(name, existing, error)) {
+                    std::cerr << "Warning: realtime VM '" << name << "' conflicts with another: " << error << "\n";
+                }
+            });
+            rt_loaded = true;
+        }
+
+        /**
+         * @brief Admits a new VM's memory and vCPUs in the reservation book, if there is one.
+         *
+         * A scheduler sharing the book may already have admitted the VM for this
+         * host; `admitted` tells whether this call did, and so whether a failed
+         * define must release it.
+         */
+        bool admitCapacity(const VMSpec& spec, bool& admitted) {
+            admitted = false;
+            if (!reservation_book) return true;
+            std::string held = reservation_book->admittedHost(spec.name);
+            if (held == reservation_host) return true;
+            if (!held.empty()) {
+                std::cerr << "Cannot admit VM '" << spec.name << "': it was admitted on " << held << "\n";
+                return false;
+            }
+            uint64_t memory_kib = (static_cast<uint64_t>(spec.memory) + (spec.virtio_mem ? spec.virtio_mem->max_mib : 0)) * 1024;
+            std::string error;
+            if (!reservation_book->admitVM(spec.name, reservation_host, memory_kib, static_cast<unsigned>(spec.vcpus),
+                                           reservationClockMs(), error, spec.reservation)) {
+                std::cerr << "Cannot admit VM '" << spec.name << "': " << error << "\n";
+                return false;
+            }
+            admitted = true;
+            return true;
+        }
+
+        // Returns a VM's capacity to the book unless it was already moved to another host there
+        void releaseCapacity(const std::string& name) {
+            if (reservation_book && reservation_book->admittedHost(name) == reservation_host) {
+                reservation_book->releaseVM(name);
+            }
+        }
+
+        /**
+         * @brief Calls `fn` with the name and persistent XML of every defined domain.
+         */
+        void forEachDomainXML(const std::function<void(const std::string&, const std::string&)>& fn) {
+            virDomainPtr *domains;
+            int num = virConnectListAllDomains(conn, &domains, 0);
+            for (int i = 0; i < num; i++) {
+                char* xml = virDomainGetXMLDesc(domains[i], VIR_DOMAIN_XML_INACTIVE);
+                if (xml) {
+                    fn(virDomainGetName(domains[i]), xml);
+                    free(xml);
+                }
+                virDomainFree(domains[i]);
+            }
+            if (num >= 0) free(domains);
+        }
+
+        bool readHostCpu(HostCpuSample& sample) {
+            int nparams = 0;
+            if (virNodeGetCPUStats(conn, VIR_NODE_CPU_STATS_ALL_CPUS, nullptr, &nparams, 0) < 0 || nparams == 0) {
+                std::cerr << "Failed to get host CPU stats\n";
+                return false;
+            }
+            std::vector<virNodeCPUStats> params(nparams);
+            if (virNodeGetCPUStats(conn, VIR_NODE_CPU_STATS_ALL_CPUS, params.data(), &nparams, 0) < 0) {
+                std::cerr << "Failed to get host CPU stats\n";
+                return false;
+            }
+            sample = HostCpuSample{};
+            for (int i = 0; i < nparams; i++) {
+                std::string field = params[i].field;
+                if (field == "utilization") continue;
+                if (field == "idle" || field == "iowait") sample.idle_ns += params[i].value;
+                sample.total_ns += params[i].value;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Returns domain capabilities for an emulator and virt type, fetched once per pair.
+         *
+         * @return std::string Capabilities XML, or an empty string on failure.
+         */
+        std::string getDomainCapabilities(const std::string& emulator, const std::string& virttype) {
+            std::string key = emulator + "|" + virttype;
+            auto it = domcaps_cache.find(key);
+            if (it != domcaps_cache.end()) return it->second;
+            char* caps = virConnectGetDomainCapabilities(conn, emulator.c_str(), nullptr, nullptr,
+                                                         virttype.c_str(), 0);
+            if (!caps) {
+                std::cerr << "Failed to get domain capabilities for " << virttype << " (" << emulator << ")\n";
+                return "";
+            }
+            std::string xml = caps;
+            free(caps);
+            domcaps_cache[key] = xml;
+            return xml;
+        }
+
+        /**
+         * @brief Returns the host capabilities XML, fetched once per connection.
+         *
+         * @return std::string Capabilities XML, or an empty string on failure.
+         */
+        const std::string& getCapabilities() {
+            if (!host_caps.empty()) return host_caps;
+            char* caps = virConnectGetCapabilities(conn);
+            if (!caps) {
+                std::cerr << "Failed to get host capabilities\n";
+                return host_caps;
+            }
+            host_caps = caps;
+            free(caps);
+            return host_caps;
+        }
+
+        /**
+         * @brief Returns the emulator the connected host offers for a virt type, looked up once.
+         *
+         * @return std::string Emulator path on the connected host, or an empty string if none.
+         */
+        std::string emulatorPath(const std::string& virttype) {
+            auto it = emulator_cache.find(virttype);
+            if (it != emulator_cache.end()) return it->second;
+            const std::string& caps = getCapabilities();
+            if (caps.empty()) return "";
+            return emulator_cache[virttype] = capabilitiesEmulator(caps, virttype);
+        }
+
+        /**
+         * @brief Returns the limits specs are validated against, gathered once per virt type.
+         *
+         * @return const HypervisorLimits* The cached limits, or `nullptr` if capabilities are unavailable.
+         */
+        const HypervisorLimits* hypervisorLimits(const std::string& virttype) {
+            auto it = limits_cache.find(virttype);
+            if (it != limits_cache.end()) return &it->second;
+
+            std::string emulator = emulatorPath(virttype);
+            std::string domcaps = emulator.empty() ? "" : getDomainCapabilities(emulator, virttype);
+            if (domcaps.empty()) {
+                std::cerr << "Failed to get capabilities for " << virttype << "\n";
+                return nullptr;
+            }
+
+            // Expand host-model to its full feature list so required features can be checked by name
+            std::string expanded;
+            std::string host_cpu = hostModelCpuXML(domcaps);
+            if (!host_cpu.empty()) {
+                const char* cpus[] = {host_cpu.c_str()};
+                char* cpu = virConnectBaselineHypervisorCPU(conn, emulator.c_str(), "x86_64", nullptr, virttype.c_str(),
+                                                            cpus, 1, VIR_CONNECT_BASELINE_CPU_EXPAND_FEATURES);
+                if (cpu) {
+                    expanded = cpu;
+                    free(cpu);
+                }
+            }
+
+            HypervisorLimits limits = parseHypervisorLimits(host_caps, domcaps, virttype, expanded);
+            virNodeInfo node;
+            if (virNodeGetInfo(conn, &node) == 0) {
+                limits.host_cpus = node.cpus;
+            }
+            return &(limits_cache[virttype] = std::move(limits));
+        }
+
+        bool writeLease(virDomainPtr vm, const Lease& lease) {
+            unsigned flags = VIR_DOMAIN_AFFECT_CONFIG | (virDomainIsActive(vm) == 1 ? VIR_DOMAIN_AFFECT_LIVE : 0);
+            if (virDomainSetMetadata(vm, VIR_DOMAIN_METADATA_ELEMENT, buildLeaseMetadata(lease).c_str(),
+                                     lease_metadata_key, lease_metadata_uri, flags) < 0) {
+                std::cerr << "Failed to write lease of VM '" << lease.vm << "'\n";
+                return false;
+            }
+            markConfigDirty(lease.vm);
+            return true;
+        }
+
+        static std::string domainUUID(virDomainPtr vm) {
+            char uuid[VIR_UUID_STRING_BUFLEN];
+            return virDomainGetUUIDString(vm, uuid) == 0 ? uuid : "";
+        }
+
+        /**
+         * @brief Reads a domain's lease from its metadata.
+         *
+         * @param error If non-null, set to true when the metadata could not be read,
+         * as opposed to the domain holding no lease.
+         */
+        bool readLease(virDomainPtr vm, Lease& lease, bool* error = nullptr) {
+            char* metadata = virDomainGetMetadata(vm, VIR_DOMAIN_METADATA_ELEMENT, lease_metadata_uri,
+                                                  VIR_DOMAIN_AFFECT_CONFIG);
+            if (error) *error = !metadata && lastLibvirtError().code != VIR_ERR_NO_DOMAIN_METADATA;
+            lease.vm = virDomainGetName(vm);
+            lease.uuid = domainUUID(vm);
+            bool found = metadata && parseLeaseMetadata(metadata, lease);
+            free(metadata);
+            return found;
+        }
+
+        void forgetLease(const std::string& name) {
+            std::lock_guard<std::mutex> lock(lease_mutex);
+            leases.erase(name);
+            lease_wheel.cancel(name);
+        }
+
+        /**
+         * @brief Reschedules the teardown of an expired lease with backoff.
+         *
+         * Does nothing if the lease was renewed, replaced or forgotten meanwhile.
+         */
+        void retryExpiredLease(const Lease& expired, uint64_t now_ms) {
+            std::lock_guard<std::mutex> lock(lease_mutex);
+            auto it = leases.find(expired.vm);
+            if (it == leases.end() || it->second.uuid != expired.uuid || it->second.expires_ms != expired.expires_ms) return;
+            uint64_t delay = leaseRetryDelayMs(++it->second.failed_teardowns);
+            lease_wheel.schedule(expired.vm, now_ms + delay, now_ms);
+            std::cerr << "Failed to tear down VM '" << expired.vm << "' after its lease expired, retrying in "
+                      << delay << "ms\n";
+        }
+
+        /**
+         * @brief Forgets an expired lease whose domain is gone or holds no lease, unless it was renewed meanwhile.
+         */
+        void dropExpiredLease(const Lease& expired) {
+            std::lock_guard<std::mutex> lock(lease_mutex);
+            auto it = leases.find(expired.vm);
+            if (it == leases.end() || it->second.uuid != expired.uuid || it->second.expires_ms != expired.expires_ms) return;
+            leases.erase(it);
+            lease_wheel.cancel(expired.vm);
+        }
+
+        bool armThinDisk(virDomainPtr vm, const ThinDisk& disk, uint64_t physical) {
+            if (virDomainSetBlockThreshold(vm, disk.dev.c_str(), thinThreshold(physical, thin_policy), 0) < 0) {
+                std::cerr << "Failed to set block threshold on disk '" << disk.dev << "' of VM '"
+                          << virDomainGetName(vm) << "'\n";
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * Grows the volume under a disk whose writes passed its watermark, or
+         * hands the disk to the relocator when the volume cannot grow, then
+         * re-arms the threshold. A disk already below its watermark (grown by an
+         * earlier event for the same crossing) is only re-armed.
+         */
+        bool extendThinDisk(virDomainPtr vm, const ThinDisk& disk) {
+            const char* name = virDomainGetName(vm);
+            virDomainBlockInfo info;
+            if (virDomainGetBlockInfo(vm, disk.dev.c_str(), &info, 0) < 0) {
+                std::cerr << "Failed to get block info of disk '" << disk.dev << "' of VM '" << name << "'\n";
+                return false;
+            }
+            if (info.allocation < thinThreshold(info.physical, thin_policy)) return armThinDisk(vm, disk, info.physical);
+
+            uint64_t grown = thinExtension(info.physical, thin_policy);
+            virStorageVolPtr vol = grown ? virStorageVolLookupByPath(conn, disk.path.c_str()) : nullptr;
+            bool ok = vol && virStorageVolResize(vol, grown, 0) == 0;
+            if (vol) virStorageVolFree(vol);
+            if (ok) {
+                std::cout << "Disk '" << disk.dev << "' of VM '" << name << "' grown to " << (grown >> 20) << " MiB\n";
+                return armThinDisk(vm, disk, grown);
+            }
+            if (thin_relocator && thin_relocator(vm, disk)) {
+                std::cout << "Disk '" << disk.dev << "' of VM '" << name << "' relocated\n";
+                if (virDomainGetBlockInfo(vm, disk.dev.c_str(), &info, 0) < 0) return false;
+                return armThinDisk(vm, disk, info.physical);
+            }
+            std::cerr << "Failed to extend disk '" << disk.dev << "' of VM '" << name << "'"
+                      << (grown ? "" : ": volume at maximum size") << "\n";
+            return false;
+        }
+
+        void handleThinEvent(const ThinEvent& e) {
+            if (e.kind == ThinEvent::IOError && e.reason != "enospc") return;
+            virDomainPtr vm = virDomainLookupByName(conn, e.domain.c_str());
+            if (!vm) return;
+            if (e.kind == ThinEvent::IOError) enospc_paused.track(e.domain);
+            char* xml = virDomainGetXMLDesc(vm, 0);
+            std::vector<ThinDisk> disks = xml ? parseThinDisks(xml) : std::vector<ThinDisk>{};
+            free(xml);
+            // Threshold events name backing images as "vda[<index>]"; I/O errors name the alias, so match the path first
+            std::string dev = e.dev.substr(0, e.dev.find('['));
+            auto disk = std::find_if(disks.begin(), disks.end(), [&](const ThinDisk& d) {
+                return d.path == e.path || d.dev == dev;
+            });
+            if (disk != disks.end() && extendThinDisk(vm, *disk) && enospc_paused.isTracked(e.domain)) {
+                enospc_paused.resumeIfNoSpace(vm, e.domain);
+            }
+            virDomainFree(vm);
+        }
+
+        // Direct monitor socket of a domain, or "" if it has none; qmp_mutex must be held
+        std::string qmpSocketPath(const std::string& name) const {
+            if (qmp_socket_dir.empty()) return "";
+            struct stat st;
+            std::string path = qmp_socket_dir + "/" + name + ".qmp";
+            return stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) ? path : "";
+        }
+
+        /**
+         * Runs commands in order on one domain's monitor: over its direct QMP
+         * socket if it has one, through virDomainQemuMonitorCommand() otherwise
+         * or if the socket does not answer.
+         */
+        std::vector<QmpReply> runOnMonitor(virDomainPtr vm, const std::vector<QmpCommand>& commands,
+                                           int timeout_ms = 500) {
+            std::string name = virDomainGetName(vm);
+            {
+                std::lock_guard<std::mutex> lock(qmp_mutex);
+                std::string path = qmpSocketPath(name);
+                if (!path.empty()) {
+                    qmp.add(name, path);
+                    std::vector<QmpReply> replies = qmp.query(name, commands, timeout_ms);
+                    bool answered = std::all_of(replies.begin(), replies.end(), [](const QmpReply& r) { return r.answered; });
+                    if (answered) return replies;
+                }
+            }
+            std::vector<QmpReply> replies(commands.size());
+            for (size_t i = 0; i < commands.size(); i++) {
+                QmpReply& reply = replies[i];
+                reply.domain = name;
+                reply.command = i;
+                char* response = nullptr;
+                JsonValue msg;
+                if (virDomainQemuMonitorCommand(vm, qmpCommandJson(commands[i]).c_str(), &response, 0) < 0 || !response ||
+                    !parseJson(response, msg) || !readQmpReply(msg, reply)) {
+                    reply.error = "monitor command failed";
+                }
+                free(response);
+            }
+            return replies;
+        }
+
+        bool applyLatencyHistograms(virDomainPtr vm, const LatencyHistogramConfig& config) {
+            std::string name = virDomainGetName(vm);
+            char* xml = virDomainGetXMLDesc(vm, 0);
+            if (!xml) {
+                std::cerr << "Failed to get XML of VM '" << name << "'\n";
+                return false;
+            }
+            std::vector<HistogramDisk> disks = parseHistogramDisks(xml);
+            free(xml);
+            // The monitor runs these in order, so the trailing query sees the totals as of the reset bins
+            std::vector<QmpCommand> commands;
+            for (const auto& disk : disks) {
+                commands.push_back(QmpCommand{"block-latency-histogram-set", buildLatencyHistogramArguments(disk.alias, config)});
+            }
+            commands.push_back(QmpCommand{"query-blockstats", ""});
+            std::vector<QmpReply> replies = runOnMonitor(vm, commands);
+            bool ok = true;
+            for (size_t i = 0; i < disks.size(); i++) {
+                if (replies[i].ok) continue;
+                std::cerr << "Failed to set latency histogram on disk '" << disks[i].dev << "' of VM '" << name << "'"
+                          << (replies[i].error.empty() ? "" : ": " + replies[i].error) << "\n";
+                ok = false;
+            }
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            histogram_disks[name] = disks;
+            if (replies.back().ok) {
+                histogram_baselines[name] = parseHistogramBaselines(replies.back().value);
+            } else {
+                std::cerr << "Warning: no baseline for the latency histograms of VM '" << name
+                          << "'; their sums include time from before they were set\n";
+                histogram_baselines.erase(name);
+            }
+            return ok;
+        }
+
+        RetryPolicy retryPolicy(const std::string& op) const {
+            auto it = retry_policies.find(op);
+            return it == retry_policies.end() ? RetryPolicy{} : it->second;
         }
 
         std::string getStateString(unsigned char state) const {
@@ -113,6 +886,20 @@ class VMManager {
             return ""; // Not found
         }
 
+        /**
+         * @brief Deregisters every domain event callback registered on the current connection.
+         */
+        void deregisterCallbacks() {
+            if (!conn) return;
+            if (lifecycle_callback_id >= 0) virConnectDomainEventDeregisterAny(conn, lifecycle_callback_id);
+            for (int id : config_callback_ids) virConnectDomainEventDeregisterAny(conn, id);
+            if (agent_callback_id >= 0) virConnectDomainEventDeregisterAny(conn, agent_callback_id);
+            if (threshold_callback_id >= 0) virConnectDomainEventDeregisterAny(conn, threshold_callback_id);
+            if (io_error_callback_id >= 0) virConnectDomainEventDeregisterAny(conn, io_error_callback_id);
+            lifecycle_callback_id = agent_callback_id = threshold_callback_id = io_error_callback_id = -1;
+            config_callback_ids.clear();
+        }
+
     public:
         /**
         * @brief Constructs a VMManager and initializes the libvirt connection handle.
@@ -126,14 +913,53 @@ class VMManager {
         *
         * Closes the libvirt connection held by this VMManager instance if one exists.
         */
-        ~VMManager() { if (conn) virConnectClose(conn); }
+        ~VMManager() {
+            deregisterCallbacks();
+            events.stop();
+            thin_events.stop();
+            if (conn) virConnectClose(conn);
+        }
+
+        /**
+         * @brief Starts the libvirt event loop thread.
+         *
+         * Must be called before connect() for watchEvents() to receive anything.
+         *
+         * @return true if the event loop is running, false otherwise.
+         */
+        static bool startEventLoop() {
+            if (!LibvirtEventLoop::instance().start()) {
+                std::cerr << "Failed to register libvirt event loop\n";
+                return false;
+            }
+            return true;
+        }
         /**
          * @brief Establishes a connection to a libvirt daemon at the specified URI.
          *
+         * A previous connection is closed first, with its event callbacks and the
+         * host capabilities, domain states and config digests cached from it.
+         *
          * @param uri Connection URI for libvirt (for example, "qemu:///system").
          * @return true if the connection was opened successfully, false otherwise.
          */
         bool connect(const std::string& uri) {
+            if (conn) {
+                // Callbacks and cached host data belong to the previous connection
+                deregisterCallbacks();
+                virConnectClose(conn);
+                conn = nullptr;
+                host_caps.clear();
+                emulator_cache.clear();
+                domcaps_cache.clear();
+                limits_cache.clear();
+                {
+                    std::lock_guard<std::mutex> lock(state_cache_mutex);
+                    state_cache.clear();
+                }
+                std::lock_guard<std::mutex> lock(config_tree_mutex);
+                config_tree_loaded = false;
+            }
             conn = virConnectOpen(uri.c_str());
             if (!conn) {
                 std::cerr << "\nFailed to connect to libvirt (URI: " << uri << ")" << std::endl;
@@ -158,8 +984,49 @@ class VMManager {
          * @return virDomainPtr Pointer to the defined domain on success, `nullptr` on failure.
          */
         virDomainPtr createVM(const std::string& name, int memory, int vcpus) {
-            // Find QEMU binary path
-            std::string qemu_path = findQEMUPath();
+            VMSpec spec;
+            spec.name = name;
+            spec.memory = memory;
+            spec.vcpus = vcpus;
+            return createVM(spec);
+        }
+
+        /**
+         * @brief Defines a domain from a full VM specification.
+         *
+         * Creates and registers a domain definition (but does not start the domain). The spec's
+         * name is used as the domain name and as the base filename for the VM disk image.
+         * Specs with an LXC type become system containers rooted at `spec.lxc->root_dir`;
+         * those need a manager connected to an LXC driver (e.g. "lxc:///system").
+         *
+         * @param spec VM specification.
+         * @return virDomainPtr Pointer to the defined domain on success, `nullptr` on failure.
+         */
+        virDomainPtr createVM(const VMSpec& spec) {
+            const std::string& name = spec.name;
+            DomainType type = spec.type.value_or(domain_type);
+            std::vector<SpecError> errors;
+            if (!validateSpec(spec, errors)) {
+                for (const auto& e : errors) {
+                    std::cerr << "Invalid spec for VM '" << name << "': " << e.field << ": " << e.message << "\n";
+                }
+                return nullptr;
+            }
+            if (type == LXC) {
+                if (!spec.lxc || spec.lxc->root_dir.empty()) {
+                    std::cerr << "Error: LXC domain '" << name << "' needs a root filesystem directory\n";
+                    return nullptr;
+                }
+                bool admitted;
+                if (!admitCapacity(spec, admitted)) return nullptr;
+                virDomainPtr dom = defineDomain(name, buildLXCDomainXML(spec));
+                if (!dom && admitted) reservation_book->releaseVM(name);
+                return dom;
+            }
+
+            // Emulator on the connected host; searched for locally only if its capabilities name none
+            std::string qemu_path = emulatorPath(domain_type_strings.at(type));
+            if (qemu_path.empty()) qemu_path = findQEMUPath();
             if (qemu_path.empty()) {
                 std::cerr << "Error: QEMU binary not found. Please install QEMU:" << std::endl;
                 std::cerr << "  macOS: brew install qemu" << std::endl;
@@ -185,55 +1052,78 @@ class VMManager {
                 disk_path = "/var/lib/libvirt/images/" + name + ".qcow2";
             }
             
-            // Minimal VM XML configuration
-            std::string xml = 
-            "<domain type='" + domain_type_strings.at(domain_type) + "'>"
-            "  <name>" + escapeXML(name) + "</name>"
-            "  <memory unit='MiB'>" + std::to_string(memory) + "</memory>"
-            "  <vcpu>" + std::to_string(vcpus) + "</vcpu>"
-            "  <os>"
-            "    <type arch='x86_64'>hvm</type>"
-            "    <boot dev='hd'/>"
-            "  </os>"
-            "  <features>"
-            "    <acpi/>"
-            "    <apic/>"
-            "  </features>"
-            "  <devices>"
-            "    <emulator>" + escapeXML(qemu_path) + "</emulator>"
-            "    <disk type='file' device='disk'>"
-            "      <driver name='qemu' type='qcow2'/>"
-            "      <source file='" + escapeXML(disk_path) + "'/>"
-            "      <target dev='vda' bus='virtio'/>"
-            "    </disk>"
-            "    <interface type='network'>"
-            "      <source network='default'/>"
-            "      <model type='virtio'/>"
-            "    </interface>"
-            "    <console type='pty'/>"
-            "    <graphics type='vnc' port='-1'/>"
-            "  </devices>"
-            "</domain>";
-
-            virDomainPtr dom = virDomainDefineXML(conn, xml.c_str());
-            if (!dom) {
-                std::cerr << "Failed to define domain\n";
-                return nullptr;
+            bool resctrl = !spec.cachetune.empty() || !spec.memorytune.empty();
+            if (resctrl) {
+                if (!rdt_loaded && !loadRdtBudget()) return nullptr;
+                std::string error;
+                if (!rdt.admit(name, spec, error)) {
+                    std::cerr << "Cannot admit cache/bandwidth allocation for VM '" << name << "': " << error << "\n";
+                    return nullptr;
+                }
             }
-            
-            std::cout << "VM '" << name << "' defined successfully\n";
-            return dom;
-        }
+
+            if (spec.realtime) {
+                if (!rt_loaded) loadRealtimeCores();
+                std::string error;
+                if (!rt_cores.admit(name, spec, error)) {
+                    std::cerr << "Cannot admit realtime VM '" << name << "': " << error << "\n";
+                    if (resctrl) rdt.release(name);
+                    return nullptr;
+                }
+            }
+
+            bool admitted;
+            if (!admitCapacity(spec, admitted)) {
+                if (resctrl) rdt.release(name);
+                if (spec.realtime) rt_cores.release(name);
+                return nullptr;
+            }
+
+            FeatureProfile features = findFeatureProfile(spec.profile);
+            if (!spec.profile.empty()) {
+                if (!feature_profiles.count(spec.profile)) {
+                    std::cerr << "Warning: unknown feature profile '" << spec.profile << "', using generic\n";
+                }
+                std::string domcaps = getDomainCapabilities(qemu_path, domain_type_strings.at(type));
+                if (!domcaps.empty()) {
+                    std::vector<std::string> dropped;
+                    features = filterFeatureProfile(features, domcaps, dropped);
+                    for (const auto& f : dropped) {
+                        std::cerr << "Warning: feature '" << f << "' unsupported by the hypervisor, not enabled for VM '"
+                                  << name << "'\n";
+                    }
+                }
+            }
+
+            std::string xml = buildDomainXML(spec, domain_type_strings.at(type), qemu_path, disk_path, &features);
+
+            virDomainPtr dom = defineDomain(name, xml);
+            if (!dom) {
+                if (resctrl) rdt.release(name);
+                if (spec.realtime) rt_cores.release(name);
+                if (admitted) reservation_book->releaseVM(name);
+            }
+            return dom;
+        }
 
         /**
          * @brief Starts the given libvirt domain.
          *
          * @param vm Domain handle to start.
+         * @param flags virDomainCreateFlags, e.g. VIR_DOMAIN_START_PAUSED.
          * @return true if the domain was started successfully, false otherwise.
          */
-        bool startVM(virDomainPtr vm) {
-            if (virDomainCreate(vm) < 0) {
-                std::cerr << "Failed to start domain\n";
+        bool startVM(virDomainPtr vm, unsigned flags = 0) {
+            std::string name = virDomainGetName(vm);
+            uint64_t op;
+            if (!journalBegin(op, JournalOp::Start, name)) return false;
+            LibvirtError err;
+            bool ok = retry.run("start of VM '" + name + "'", retryPolicy("start"),
+                                [&] { return virDomainCreateWithFlags(vm, flags) == 0; }, &err,
+                                [&] { return virDomainIsActive(vm) == 1; });
+            journalEnd(op, ok);
+            if (!ok) {
+                std::cerr << "Failed to start domain: " << err.message << "\n";
                 return false;
             }
             std::cout << "VM started successfully\n";
@@ -247,8 +1137,16 @@ class VMManager {
          * @return `true` if the VM was stopped successfully, `false` otherwise.
          */
         bool stopVM(virDomainPtr vm) {
-            if (virDomainShutdown(vm) < 0) {
-                std::cerr << "Failed to stop domain\n";
+            std::string name = virDomainGetName(vm);
+            uint64_t op;
+            if (!journalBegin(op, JournalOp::Stop, name)) return false;
+            LibvirtError err;
+            bool ok = retry.run("shutdown of VM '" + name + "'", retryPolicy("shutdown"),
+                                [&] { return virDomainShutdown(vm) == 0; }, &err,
+                                [&] { return virDomainIsActive(vm) == 0; });
+            journalEnd(op, ok);
+            if (!ok) {
+                std::cerr << "Failed to stop domain: " << err.message << "\n";
                 return false;
             }
             std::cout << "VM '" << virDomainGetName(vm) << "' stopped successfully\n";
@@ -263,8 +1161,15 @@ class VMManager {
          */
         bool destroyVM(virDomainPtr vm) {
             std::string name = virDomainGetName(vm);
-            if (virDomainDestroy(vm) < 0) {
-                std::cerr << "Failed to destroy VM '" << name << "'\n";
+            uint64_t op;
+            if (!journalBegin(op, JournalOp::Destroy, name)) return false;
+            LibvirtError err;
+            bool ok = retry.run("destroy of VM '" + name + "'", retryPolicy("destroy"),
+                                [&] { return virDomainDestroy(vm) == 0; }, &err,
+                                [&] { return virDomainIsActive(vm) == 0; });
+            journalEnd(op, ok);
+            if (!ok) {
+                std::cerr << "Failed to destroy VM '" << name << "': " << err.message << "\n";
                 return false;
             }
             std::cout << "VM '" << name << "' destroyed successfully\n";
@@ -279,10 +1184,34 @@ class VMManager {
          */
         bool undefineVM(virDomainPtr vm) {
             std::string name = virDomainGetName(vm);
-            if (virDomainUndefine(vm) < 0) {
-                std::cerr << "Failed to undefine VM '" << name << "'\n";
+            uint64_t op = 0;
+            if (journal) {
+                // Keep the definition so recovery can roll the undefine back
+                char* xml = virDomainGetXMLDesc(vm, VIR_DOMAIN_XML_INACTIVE);
+                std::string payload = xml ? xml : "";
+                free(xml);
+                if (!journalBegin(op, JournalOp::Undefine, name, payload)) return false;
+            }
+            LibvirtError err;
+            bool ok = retry.run("undefine of VM '" + name + "'", retryPolicy("undefine"),
+                                [&] { return virDomainUndefine(vm) == 0; }, &err, [&] {
+                                    // Gone entirely if it was shut off, transient if it was running
+                                    int persistent = virDomainIsPersistent(vm);
+                                    return persistent == 0 || (persistent < 0 && lastLibvirtError().code == VIR_ERR_NO_DOMAIN);
+                                });
+            journalEnd(op, ok);
+            if (!ok) {
+                std::cerr << "Failed to undefine VM '" << name << "': " << err.message << "\n";
                 return false;
             }
+            rdt.release(name);
+            rt_cores.release(name);
+            releaseCapacity(name);
+            forgetLease(name);
+            {
+                std::lock_guard<std::mutex> lock(tenant_mutex);
+                tenant_cache.erase(domainUUID(vm));
+            }
             std::cout << "VM '" << name << "' undefined successfully\n";
             return true;
         }
@@ -296,9 +1225,14 @@ class VMManager {
          * Caller is responsible for freeing the returned domain handle with `virDomainFree`.
          */
         virDomainPtr lookupVM(const std::string& name) {
-            virDomainPtr vm = virDomainLookupByName(conn, name.c_str());
+            virDomainPtr vm = nullptr;
+            LibvirtError err;
+            retry.run("lookup of VM '" + name + "'", retryPolicy("lookup"), [&] {
+                vm = virDomainLookupByName(conn, name.c_str());
+                return vm != nullptr;
+            }, &err);
             if (!vm) {
-                std::cerr << "VM '" << name << "' not found\n";
+                std::cerr << "VM '" << name << "' not found: " << err.message << "\n";
                 return nullptr;
             }
             std::cout << "VM '" << name << "' found\n";
@@ -352,6 +1286,1800 @@ class VMManager {
                 std::cerr << "Failed to get VM state\n";
             }
         }
+
+        /**
+         * @brief Returns the host cache and memory-bandwidth budgets.
+         *
+         * Budgets are loaded from capabilities on first use; call refreshRdtBudget()
+         * to load them eagerly or after host changes.
+         */
+        const RdtBudget& rdtBudget() const {
+            return rdt;
+        }
+
+        bool refreshRdtBudget() {
+            return loadRdtBudget();
+        }
+
+        /**
+         * @brief Overrides the retry policy of one operation.
+         *
+         * @param op Operation name: "define", "start", "shutdown", "destroy", "undefine" or "lookup".
+         * @param policy Policy to use; `max_attempts = 1` disables retries for the operation.
+         */
+        void setRetryPolicy(const std::string& op, const RetryPolicy& policy) {
+            retry_policies[op] = policy;
+        }
+
+        /**
+         * @brief Checks a spec against this host's hypervisor before defining it.
+         *
+         * Capabilities, host limits and the expanded host CPU are fetched once per
+         * virt type, for the emulator the host's capabilities name; after that
+         * validation makes no RPCs, so invalid specs in a batch fail in-process
+         * instead of at `virDomainDefineXML` or `virDomainCreate`. A spec cannot
+         * pass unchecked: if the capabilities are unavailable it is rejected.
+         * createVM() runs this check itself.
+         *
+         * @param spec Spec to check.
+         * @param errors Set to every problem found.
+         * @return true if the spec is valid, false otherwise.
+         */
+        bool validateSpec(const VMSpec& spec, std::vector<SpecError>& errors) {
+            DomainType type = spec.type.value_or(domain_type);
+            const std::string& virttype = domain_type_strings.at(type);
+            const HypervisorLimits* limits = nullptr;
+            if (type != LXC) limits = hypervisorLimits(virttype);
+            errors = validateVMSpec(spec, virttype, limits);
+            if (type != LXC && !limits) {
+                errors.push_back(SpecError{"type", "capabilities of the " + virttype + " hypervisor are unavailable"});
+            }
+            validation_counters.checked++;
+            if (!errors.empty()) validation_counters.rejected++;
+            return errors.empty();
+        }
+
+        /**
+         * @brief Returns how many specs were validated and how many were rejected before any define RPC.
+         */
+        ValidationStats validationStats() const {
+            return validation_counters;
+        }
+
+        /**
+         * @brief Returns retry counters (attempts, retries, budget denials) across all operations.
+         */
+        RetryStats retryStats() {
+            return retry.stats();
+        }
+
+        /**
+         * @brief Opens the write-ahead operation journal.
+         *
+         * Once open, every create/start/stop/destroy/undefine records its intent
+         * durably before calling libvirt and its completion afterwards, and fails
+         * without calling libvirt if the intent cannot be written. The journal
+         * compacts itself once it outgrows its checkpoint size. Call
+         * recoverFromJournal() next to resolve operations left open by a crash.
+         *
+         * @param path Path of the journal file.
+         * @return true if the journal was opened successfully, false otherwise.
+         */
+        bool openJournal(const std::string& path) {
+            auto j = std::make_unique<OperationJournal>();
+            if (!j->open(path)) return false;
+            journal = std::move(j);
+            std::cout << "Operation journal opened (" << journal->inFlight().size()
+                      << " operations in flight)\n";
+            return true;
+        }
+
+        /**
+         * @brief Resolves operations that were in flight when the process last stopped.
+         *
+         * Only the journaled in-flight operations are inspected, so recovery cost is
+         * proportional to the interrupted batch rather than to the number of domains.
+         * Each operation is checked against the domain's current state and either
+         * finished or undone according to `policy`; the journal is then compacted
+         * down to the operations that could not be resolved.
+         *
+         * @param policy Whether to replay or roll back interrupted operations.
+         * @return RecoveryReport Counts of resolved operations and elapsed time.
+         */
+        RecoveryReport recoverFromJournal(RecoveryPolicy policy = RecoveryPolicy::Replay) {
+            RecoveryReport report;
+            if (!journal) return report;
+            auto started = std::chrono::steady_clock::now();
+
+            std::vector<JournalEntry> entries = journal->inFlight();
+            report.in_flight = entries.size();
+            for (const auto& e : entries) {
+                int rc = recoverEntry(e, policy);
+                if (rc < 0) {
+                    std::cerr << "Failed to recover " << journal_op_strings.at(e.op)
+                              << " of VM '" << e.domain << "'\n";
+                    report.failed++;
+                    continue;
+                }
+                if (rc == 0) report.already_done++;
+                else if (policy == RecoveryPolicy::Replay) report.replayed++;
+                else report.rolled_back++;
+                journal->complete(e.id, true);
+            }
+            journal->sync();
+            journal->checkpoint();
+
+            report.elapsed_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - started).count();
+            std::cout << "Recovered " << report.in_flight - report.failed << "/" << report.in_flight
+                      << " in-flight operations in " << report.elapsed_ms << " ms\n";
+            return report;
+        }
+
+        /**
+         * @brief Returns journal overhead counters (records per sync, commit latency).
+         */
+        JournalStats journalStats() const {
+            return journal ? journal->stats() : JournalStats{};
+        }
+
+        /**
+         * @brief Subscribes to domain lifecycle events on the current connection.
+         *
+         * Events are coalesced per domain over `window` and dispatched in batches
+         * to the internal state cache and to handlers added with subscribeEvents().
+         * Requires startEventLoop() to have been called before connect().
+         *
+         * @param window Coalescing window.
+         * @return true if the subscription was registered, false otherwise.
+         */
+        bool watchEvents(std::chrono::milliseconds window = std::chrono::milliseconds(50)) {
+            if (lifecycle_callback_id >= 0) return true;
+            lifecycle_callback_id = virConnectDomainEventRegisterAny(
+                conn, nullptr, VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                VIR_DOMAIN_EVENT_CALLBACK(lifecycleCallback), &events, nullptr);
+            if (lifecycle_callback_id < 0) {
+                std::cerr << "Failed to register domain event callback\n";
+                return false;
+            }
+            // Live device and tunable changes, and metadata edits, change a domain's
+            // config without a lifecycle event
+            const std::pair<int, virConnectDomainEventGenericCallback> config_events[] = {
+                {VIR_DOMAIN_EVENT_ID_DEVICE_ADDED, VIR_DOMAIN_EVENT_CALLBACK(deviceChangeCallback)},
+                {VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED, VIR_DOMAIN_EVENT_CALLBACK(deviceChangeCallback)},
+                {VIR_DOMAIN_EVENT_ID_TUNABLE, VIR_DOMAIN_EVENT_CALLBACK(tunableCallback)},
+                {VIR_DOMAIN_EVENT_ID_METADATA_CHANGE, VIR_DOMAIN_EVENT_CALLBACK(metadataChangeCallback)},
+            };
+            for (const auto& [id, callback] : config_events) {
+                int callback_id = virConnectDomainEventRegisterAny(conn, nullptr, id, callback, this, nullptr);
+                if (callback_id < 0) {
+                    std::cerr << "Failed to register domain event callback\n";
+                    for (int registered : config_callback_ids) virConnectDomainEventDeregisterAny(conn, registered);
+                    config_callback_ids.clear();
+                    virConnectDomainEventDeregisterAny(conn, lifecycle_callback_id);
+                    lifecycle_callback_id = -1;
+                    return false;
+                }
+                config_callback_ids.push_back(callback_id);
+            }
+            events.setWindow(window);
+            events.subscribe([this](const std::vector<DomainEvent>& batch) { applyEventBatch(batch); });
+            events.start();
+            return true;
+        }
+
+        /**
+         * @brief Adds a handler that receives coalesced event batches.
+         */
+        void subscribeEvents(EventBatchHandler handler) {
+            events.subscribe(std::move(handler));
+        }
+
+        /**
+         * @brief Returns the last state reported by events for a domain.
+         *
+         * @return int A `VIR_DOMAIN_*` state, or -1 if no event has been seen for the domain.
+         */
+        int cachedState(const std::string& name) const {
+            std::lock_guard<std::mutex> lock(state_cache_mutex);
+            auto it = state_cache.find(name);
+            return it == state_cache.end() ? -1 : it->second;
+        }
+
+        EventStats eventStats() {
+            return events.stats();
+        }
+
+        /**
+         * @brief Turns a booted VM into a clone template by saving its memory state.
+         *
+         * The VM's first network interface is hot-unplugged before saving so that
+         * each clone can be given its own NIC (and MAC) after restore; a MAC
+         * rewritten in the restore XML would not reach the guest, whose virtio-net
+         * state is part of the saved memory. After this call the template domain
+         * is stopped and undefined (its XML lives on in the save image), and its
+         * disk becomes the read-only base of every clone.
+         *
+         * @param vm Running domain to save.
+         * @param save_path Path to write the memory image to.
+         * @param tpl Filled in with the template description on success.
+         * @return true if the template was created successfully, false otherwise.
+         */
+        bool createCloneTemplate(virDomainPtr vm, const std::string& save_path, CloneTemplate& tpl) {
+            tpl = CloneTemplate{};
+            tpl.name = virDomainGetName(vm);
+            tpl.save_path = save_path;
+
+            char* live = virDomainGetXMLDesc(vm, 0);
+            if (!live) {
+                std::cerr << "Failed to read XML of VM '" << tpl.name << "'\n";
+                return false;
+            }
+            std::string live_xml(live);
+            free(live);
+            for (const auto& disk : xmlElements(live_xml, "disk")) {
+                if (xmlAttr(disk, "device") == "disk") {
+                    tpl.base_disk = xmlAttr(xmlElement(disk, "source"), "file");
+                    std::string format = xmlAttr(xmlElement(disk, "driver"), "type");
+                    if (!format.empty()) tpl.base_format = format;
+                    break;
+                }
+            }
+            if (tpl.base_disk.empty()) {
+                std::cerr << "VM '" << tpl.name << "' has no file-backed disk to clone\n";
+                return false;
+            }
+
+            tpl.uuid = xmlChildText(live_xml, "uuid");
+            tpl.interface = xmlElement(live_xml, "interface");
+            if (!tpl.interface.empty()) {
+                if (virDomainDetachDeviceFlags(vm, tpl.interface.c_str(), VIR_DOMAIN_AFFECT_LIVE) < 0) {
+                    std::cerr << "Failed to detach interface from VM '" << tpl.name << "'\n";
+                    return false;
+                }
+                // Detach completes asynchronously once the guest releases the device;
+                // other NICs stay, so look for this one by MAC (or alias)
+                std::string mac = xmlAttr(xmlElement(tpl.interface, "mac"), "address");
+                std::string alias = xmlAttr(xmlElement(tpl.interface, "alias"), "name");
+                auto present = [&](const std::string& xml) {
+                    for (const auto& iface : xmlElements(xml, "interface")) {
+                        if (!mac.empty() && xmlAttr(xmlElement(iface, "mac"), "address") == mac) return true;
+                        if (mac.empty() && xmlAttr(xmlElement(iface, "alias"), "name") == alias) return true;
+                    }
+                    return false;
+                };
+                bool detached = false;
+                for (int i = 0; i < 100 && !detached; i++) {
+                    char* cur = virDomainGetXMLDesc(vm, 0);
+                    detached = cur && !present(cur);
+                    free(cur);
+                    if (!detached) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                if (!detached) {
+                    std::cerr << "Timed out waiting for interface detach on VM '" << tpl.name << "'\n";
+                    return false;
+                }
+            }
+
+            if (virDomainSave(vm, save_path.c_str()) < 0) {
+                std::cerr << "Failed to save VM '" << tpl.name << "' to '" << save_path << "'\n";
+                return false;
+            }
+            char* saved = virDomainSaveImageGetXMLDesc(conn, save_path.c_str(), 0);
+            if (!saved) {
+                std::cerr << "Failed to read save image XML '" << save_path << "'\n";
+                return false;
+            }
+            tpl.xml = saved;
+            free(saved);
+
+            // Clones carry the template's UUID, which its inactive definition would still claim
+            if (virDomainIsPersistent(vm) == 1 && !undefineVM(vm)) return false;
+
+            std::cout << "Clone template '" << tpl.name << "' saved to '" << save_path << "'\n";
+            return true;
+        }
+
+        /**
+         * @brief Restores a running clone from a template's memory image.
+         *
+         * The clone gets a fresh name and qcow2 overlay (next to the template's
+         * disk) through the restore XML, then a NIC with a fresh MAC is hot-plugged.
+         * It keeps the template's UUID, since libvirt refuses to change it on
+         * restore; as libvirt also keys domains by UUID, one clone of a template
+         * can run per host at a time.
+         *
+         * @param tpl Template created by createCloneTemplate().
+         * @param clone_name Name of the new domain.
+         * @return virDomainPtr Pointer to the running clone on success, `nullptr` on failure.
+         */
+        virDomainPtr restoreClone(const CloneTemplate& tpl, const std::string& clone_name) {
+            if (!tpl.uuid.empty()) {
+                virDomainPtr holder = virDomainLookupByUUIDString(conn, tpl.uuid.c_str());
+                if (holder) {
+                    std::cerr << "Failed to restore clone '" << clone_name << "': VM '" << virDomainGetName(holder)
+                              << "' already uses UUID " << tpl.uuid << " of template '" << tpl.name << "'\n";
+                    virDomainFree(holder);
+                    return nullptr;
+                }
+            }
+            CloneIdentity id;
+            id.name = clone_name;
+            id.mac = generateMAC();
+            size_t slash = tpl.base_disk.rfind('/');
+            std::string dir = slash == std::string::npos ? "." : tpl.base_disk.substr(0, slash);
+            id.disk_path = dir + "/" + clone_name + ".qcow2";
+
+            if (!createOverlay(tpl.base_disk, tpl.base_format, id.disk_path)) return nullptr;
+
+            std::string dxml = rewriteCloneXML(tpl.xml, id);
+            uint64_t op;
+            if (!journalBegin(op, JournalOp::Restore, clone_name, packJournalPayload(tpl.save_path, dxml))) {
+                unlink(id.disk_path.c_str());
+                return nullptr;
+            }
+            bool restored = virDomainRestoreFlags(conn, tpl.save_path.c_str(), dxml.c_str(),
+                                                  VIR_DOMAIN_SAVE_RUNNING) == 0;
+            journalEnd(op, restored);
+            if (!restored) {
+                std::cerr << "Failed to restore clone '" << clone_name << "'\n";
+                unlink(id.disk_path.c_str());
+                return nullptr;
+            }
+            virDomainPtr dom = virDomainLookupByName(conn, clone_name.c_str());
+            if (!dom) {
+                std::cerr << "Restored clone '" << clone_name << "' not found\n";
+                return nullptr;
+            }
+
+            if (!tpl.interface.empty()) {
+                std::string iface = cloneInterfaceXML(tpl.interface, id.mac);
+                if (virDomainAttachDeviceFlags(dom, iface.c_str(), VIR_DOMAIN_AFFECT_LIVE) < 0) {
+                    std::cerr << "Failed to attach interface to clone '" << clone_name << "'\n";
+                }
+            }
+            return dom;
+        }
+
+        /**
+         * @brief Restores `count` clones named `<prefix>-<n>`, one per host, and reports clone throughput.
+         *
+         * Clones share the template's UUID, so a host runs at most one of them:
+         * the clones fan out over the first `count` hosts of `managers`, restoring
+         * in parallel. The template's save image and disk must be reachable at the
+         * same paths on every host (shared storage).
+         *
+         * @param tpl Template created by createCloneTemplate().
+         * @param prefix Name prefix for the clones.
+         * @param count Number of clones to restore; fails up front if it exceeds the number of hosts.
+         * @param managers Connected managers keyed by host.
+         * @param clones If non-null, receives the handles of the restored clones
+         * (caller frees them with `virDomainFree`); otherwise they are freed here.
+         * @return CloneReport Number restored and elapsed time.
+         */
+        static CloneReport restoreClones(const CloneTemplate& tpl, const std::string& prefix, size_t count,
+                                         const std::map<std::string, VMManager*>& managers,
+                                         std::vector<virDomainPtr>* clones = nullptr) {
+            CloneReport report;
+            report.requested = count;
+            if (count > managers.size()) {
+                std::cerr << "Failed to restore " << count << " clones of template '" << tpl.name << "': only "
+                          << managers.size() << " hosts, and clones sharing its UUID run one per host\n";
+                return report;
+            }
+            std::vector<VMManager*> hosts;
+            for (const auto& [host, manager] : managers) {
+                if (hosts.size() == count) break;
+                hosts.push_back(manager);
+            }
+
+            auto started = std::chrono::steady_clock::now();
+            std::vector<virDomainPtr> restored(count, nullptr);
+            std::vector<std::thread> workers;
+            for (size_t i = 0; i < count; i++) {
+                workers.emplace_back([&, i] { restored[i] = hosts[i]->restoreClone(tpl, prefix + "-" + std::to_string(i)); });
+            }
+            for (auto& w : workers) w.join();
+            report.elapsed_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - started).count();
+
+            for (virDomainPtr dom : restored) {
+                if (!dom) continue;
+                report.restored++;
+                if (clones) clones->push_back(dom);
+                else virDomainFree(dom);
+            }
+            std::cout << "Restored " << report.restored << "/" << count << " clones ("
+                      << report.clonesPerSecond() << " clones/s)\n";
+            return report;
+        }
+
+        /**
+         * @brief Reads the state of a domain's virtio-mem device.
+         *
+         * @param vm Domain to inspect.
+         * @param state Filled in with the device sizes on success.
+         * @return true if the domain has a virtio-mem device, false otherwise.
+         */
+        bool getVirtioMemState(virDomainPtr vm, VirtioMemState& state) {
+            char* xml = virDomainGetXMLDesc(vm, 0);
+            if (!xml) {
+                std::cerr << "Failed to read XML of VM '" << virDomainGetName(vm) << "'\n";
+                return false;
+            }
+            std::string device = findVirtioMemDevice(xml);
+            free(xml);
+            if (device.empty()) return false;
+            state = parseVirtioMem(device);
+            return true;
+        }
+
+        /**
+         * @brief Changes how much virtio-mem memory the guest is asked to plug.
+         *
+         * The size is rounded down to the device's block size and capped at the
+         * device maximum. The guest plugs or unplugs blocks asynchronously; the
+         * device's `current` size converges to the request.
+         *
+         * @param vm Running domain with a virtio-mem device.
+         * @param requested_kib New requested size in KiB.
+         * @return true if the request was applied, false otherwise.
+         */
+        bool resizeVirtioMem(virDomainPtr vm, uint64_t requested_kib) {
+            const char* name = virDomainGetName(vm);
+            char* xml = virDomainGetXMLDesc(vm, 0);
+            if (!xml) {
+                std::cerr << "Failed to read XML of VM '" << name << "'\n";
+                return false;
+            }
+            std::string device = findVirtioMemDevice(xml);
+            free(xml);
+            if (device.empty()) {
+                std::cerr << "VM '" << name << "' has no virtio-mem device\n";
+                return false;
+            }
+
+            VirtioMemState state = parseVirtioMem(device);
+            if (state.block_kib) requested_kib = requested_kib / state.block_kib * state.block_kib;
+            requested_kib = std::min(requested_kib, state.size_kib);
+
+            std::string updated = setVirtioMemRequested(device, requested_kib);
+            if (virDomainUpdateDeviceFlags(vm, updated.c_str(), VIR_DOMAIN_AFFECT_LIVE) < 0) {
+                std::cerr << "Failed to resize virtio-mem of VM '" << name << "'\n";
+                return false;
+            }
+            std::cout << "VM '" << name << "' virtio-mem requested size set to "
+                      << requested_kib / MB_SIZE << "MB\n";
+            return true;
+        }
+
+        /**
+         * @brief Runs one controller step: resizes virtio-mem to match guest memory demand.
+         *
+         * Demand comes from the guest's balloon statistics (needs the virtio balloon
+         * driver with stats enabled in the guest).
+         *
+         * @param vm Running domain with a virtio-mem device.
+         * @param policy Controller thresholds.
+         * @return true if the plugged size was changed, false if unchanged or on failure.
+         */
+        bool balanceVirtioMem(virDomainPtr vm, const ElasticityPolicy& policy = ElasticityPolicy{}) {
+            VirtioMemState state;
+            if (!getVirtioMemState(vm, state)) return false;
+
+            virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+            int n = virDomainMemoryStats(vm, stats, VIR_DOMAIN_MEMORY_STAT_NR, 0);
+            if (n < 0) {
+                std::cerr << "Failed to get memory stats of VM '" << virDomainGetName(vm) << "'\n";
+                return false;
+            }
+            uint64_t total = 0, usable = 0;
+            for (int i = 0; i < n; i++) {
+                if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_AVAILABLE) total = stats[i].val;
+                if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_USABLE) usable = stats[i].val;
+            }
+
+            uint64_t target = decideVirtioMemRequest(state, total, usable, policy);
+            if (target == state.requested_kib) return false;
+            return resizeVirtioMem(vm, target);
+        }
+
+        /**
+         * @brief Sets the console patterns and signals that mark a guest as ready.
+         *
+         * @param patterns Byte strings any of which marks the console as ready
+         * (e.g. "login:", a cloud-init completion line).
+         * @param mode Which of console and guest agent signals are required.
+         */
+        void configureReadiness(const std::vector<std::string>& patterns, ReadinessMode mode) {
+            readiness.configure(patterns, mode);
+        }
+
+        /**
+         * @brief Starts watching a running domain's readiness signals.
+         *
+         * Opens the serial console as a non-blocking stream serviced on the libvirt
+         * event loop thread and/or listens for the guest agent connecting, depending
+         * on the readiness mode. Requires startEventLoop() to have been called before
+         * connect().
+         *
+         * @param vm Running domain to watch.
+         * @return true if the required signal sources were attached, false otherwise.
+         */
+        bool watchReadiness(virDomainPtr vm) {
+            std::string name = virDomainGetName(vm);
+            ReadinessMode mode = readiness.getMode();
+            readiness.watch(name);
+
+            if (mode != ReadinessMode::Console && agent_callback_id < 0) {
+                agent_callback_id = virConnectDomainEventRegisterAny(
+                    conn, nullptr, VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE,
+                    VIR_DOMAIN_EVENT_CALLBACK(agentLifecycleCallback), &readiness, nullptr);
+                if (agent_callback_id < 0) {
+                    std::cerr << "Failed to register guest agent event callback\n";
+                    return false;
+                }
+            }
+            if (mode == ReadinessMode::Agent) return true;
+
+            virStreamPtr stream = virStreamNew(conn, VIR_STREAM_NONBLOCK);
+            if (!stream) {
+                std::cerr << "Failed to create console stream for VM '" << name << "'\n";
+                return false;
+            }
+            if (virDomainOpenConsole(vm, nullptr, stream, VIR_DOMAIN_CONSOLE_FORCE) < 0) {
+                std::cerr << "Failed to open console of VM '" << name << "'\n";
+                virStreamFree(stream);
+                return false;
+            }
+            auto* watch = new ConsoleWatch{&readiness, name, stream};
+            if (virStreamEventAddCallback(stream, VIR_STREAM_EVENT_READABLE | VIR_STREAM_EVENT_ERROR |
+                                          VIR_STREAM_EVENT_HANGUP, consoleStreamCallback, watch,
+                                          freeConsoleWatch) < 0) {
+                std::cerr << "Failed to watch console of VM '" << name << "'\n";
+                delete watch;
+                virStreamAbort(stream);
+                virStreamFree(stream);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Starts a domain and blocks until its guest reports ready.
+         *
+         * The domain is started paused and only resumed once the console and agent
+         * are watched, so no output from early boot is missed.
+         *
+         * @param vm Domain handle to start.
+         * @param timeout Longest time to wait for readiness.
+         * @return true if the domain started and became ready in time, false otherwise.
+         */
+        bool startVMAndWait(virDomainPtr vm, std::chrono::milliseconds timeout) {
+            if (!startVM(vm, VIR_DOMAIN_START_PAUSED)) return false;
+            std::string name = virDomainGetName(vm);
+            if (!watchReadiness(vm)) {
+                readiness.forget(name);
+                virDomainDestroy(vm);
+                return false;
+            }
+            if (virDomainResume(vm) < 0) {
+                std::cerr << "Failed to resume VM '" << name << "' after attaching readiness watches\n";
+                readiness.forget(name);
+                virDomainDestroy(vm);
+                return false;
+            }
+            if (!readiness.waitReady(name, timeout)) {
+                std::cerr << "VM '" << name << "' not ready after " << timeout.count() << "ms\n";
+                readiness.forget(name);
+                return false;
+            }
+            std::cout << "VM '" << name << "' ready after " << readiness.timeToReady(name).count() << "ms\n";
+            readiness.forget(name);
+            return true;
+        }
+
+        /**
+         * @brief Whether a guest being waited on by startVMAndWait() has become ready.
+         */
+        bool isReady(const std::string& name) const {
+            return readiness.isReady(name);
+        }
+
+        /**
+         * @brief Adds an IOThread to a domain, live if it is running and to its persistent config.
+         *
+         * @param vm Domain handle.
+         * @param id IOThread id (must not be in use).
+         * @return true if the IOThread was added, false otherwise.
+         */
+        bool addIOThread(virDomainPtr vm, unsigned id) {
+            unsigned flags = VIR_DOMAIN_AFFECT_CONFIG;
+            if (virDomainIsActive(vm) == 1) flags |= VIR_DOMAIN_AFFECT_LIVE;
+            if (virDomainAddIOThread(vm, id, flags) < 0) {
+                std::cerr << "Failed to add IOThread " << id << " to VM '" << virDomainGetName(vm) << "'\n";
+                return false;
+            }
+            markConfigDirty(virDomainGetName(vm));
+            std::cout << "IOThread " << id << " added to VM '" << virDomainGetName(vm) << "'\n";
+            return true;
+        }
+
+        /**
+         * @brief Removes an IOThread that no disk is assigned to.
+         *
+         * @param vm Domain handle.
+         * @param id IOThread id.
+         * @return true if the IOThread was removed, false otherwise.
+         */
+        bool removeIOThread(virDomainPtr vm, unsigned id) {
+            unsigned flags = VIR_DOMAIN_AFFECT_CONFIG;
+            if (virDomainIsActive(vm) == 1) flags |= VIR_DOMAIN_AFFECT_LIVE;
+            if (virDomainDelIOThread(vm, id, flags) < 0) {
+                std::cerr << "Failed to remove IOThread " << id << " from VM '" << virDomainGetName(vm) << "'\n";
+                return false;
+            }
+            markConfigDirty(virDomainGetName(vm));
+            std::cout << "IOThread " << id << " removed from VM '" << virDomainGetName(vm) << "'\n";
+            return true;
+        }
+
+        /**
+         * @brief Sets the adaptive polling window of a running domain's IOThread.
+         *
+         * @param vm Running domain.
+         * @param id IOThread id.
+         * @param polling New polling settings; `max_ns` = 0 disables polling.
+         * @return true if the settings were applied, false otherwise.
+         */
+        bool setIOThreadPolling(virDomainPtr vm, unsigned id, const IOThreadPolling& polling) {
+            virTypedParameterPtr params = nullptr;
+            int nparams = 0, maxparams = 0;
+            if (virTypedParamsAddULLong(&params, &nparams, &maxparams, VIR_DOMAIN_IOTHREAD_POLL_MAX_NS,
+                                        polling.max_ns) < 0 ||
+                virTypedParamsAddUInt(&params, &nparams, &maxparams, VIR_DOMAIN_IOTHREAD_POLL_GROW,
+                                      polling.grow) < 0 ||
+                virTypedParamsAddUInt(&params, &nparams, &maxparams, VIR_DOMAIN_IOTHREAD_POLL_SHRINK,
+                                      polling.shrink) < 0) {
+                virTypedParamsFree(params, nparams);
+                return false;
+            }
+            int rc = virDomainSetIOThreadParams(vm, id, params, nparams, VIR_DOMAIN_AFFECT_LIVE);
+            virTypedParamsFree(params, nparams);
+            if (rc < 0) {
+                std::cerr << "Failed to set polling of IOThread " << id << " of VM '" << virDomainGetName(vm) << "'\n";
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Assigns a disk's virtqueue to an IOThread (0 moves it back to the main loop).
+         *
+         * QEMU cannot move a disk between threads while it runs, so the change is
+         * made to the persistent config and takes effect on the next boot.
+         *
+         * @param vm Domain handle.
+         * @param target_dev Disk target (e.g. "vda").
+         * @param iothread IOThread id, which must exist in the persistent config.
+         * @return true if the config was updated, false otherwise.
+         */
+        bool assignDiskIOThread(virDomainPtr vm, const std::string& target_dev, unsigned iothread) {
+            std::string name = virDomainGetName(vm);
+            char* raw = virDomainGetXMLDesc(vm, VIR_DOMAIN_XML_INACTIVE);
+            if (!raw) {
+                std::cerr << "Failed to read XML of VM '" << name << "'\n";
+                return false;
+            }
+            const std::string prev_xml = raw;
+            std::string xml = prev_xml;
+            free(raw);
+
+            size_t begin, end, from = 0;
+            bool found = false;
+            while (!found && xmlFindElement(xml, "disk", from, begin, end)) {
+                std::string disk = xml.substr(begin, end - begin);
+                from = end;
+                if (xmlAttr(xmlElement(disk, "target"), "dev") != target_dev) continue;
+                size_t driver_begin, driver_end;
+                if (!xmlFindElement(xml, "driver", begin, driver_begin, driver_end) || driver_end > end) break;
+                if (iothread) {
+                    xmlSetAttr(xml, driver_begin, "iothread", std::to_string(iothread));
+                } else {
+                    std::string driver = xml.substr(driver_begin, driver_end - driver_begin);
+                    std::string attr = " iothread='" + xmlAttr(driver, "iothread") + "'";
+                    size_t pos = driver.find(attr);
+                    if (pos != std::string::npos) xml.erase(driver_begin + pos, attr.size());
+                }
+                found = true;
+            }
+            if (!found) {
+                std::cerr << "VM '" << name << "' has no disk '" << target_dev << "' with a driver element\n";
+                return false;
+            }
+
+            if (!redefineDomain(vm, prev_xml, xml)) return false;
+            std::cout << "Disk '" << target_dev << "' of VM '" << name << "' assigned to IOThread " << iothread
+                      << " (effective on next boot)\n";
+            return true;
+        }
+
+        /**
+         * @brief Runs one polling controller step over all active domains.
+         *
+         * Block latency is measured between consecutive calls, so the first call
+         * only records a baseline; call this periodically (e.g. every few seconds).
+         *
+         * @param policy Controller thresholds.
+         * @return int Number of IOThreads whose polling window was changed, or -1 on failure.
+         */
+        int balanceIOThreadPolling(const PollingPolicy& policy = PollingPolicy{}) {
+            HostCpuSample cpu;
+            if (!readHostCpu(cpu)) return -1;
+            double host_idle = computeHostIdle(host_cpu_sample.total_ns ? &host_cpu_sample : nullptr, cpu);
+            host_cpu_sample = cpu;
+
+            virDomainStatsRecordPtr *records = nullptr;
+            int num = virConnectGetAllDomainStats(conn, VIR_DOMAIN_STATS_BLOCK | VIR_DOMAIN_STATS_IOTHREAD, &records,
+                                                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE);
+            if (num < 0) {
+                std::cerr << "Failed to collect block stats\n";
+                return -1;
+            }
+
+            int changed = 0;
+            for (int i = 0; i < num; i++) {
+                BlockLatencySample sample = parseBlockLatencyStats(records[i]->params, records[i]->nparams);
+                std::string name = virDomainGetName(records[i]->dom);
+                auto prev = block_samples.find(name);
+                if (prev != block_samples.end()) {
+                    double latency = computeBlockLatencyUs(prev->second, sample);
+                    for (const auto& [id, polling] : sample.iothreads) {
+                        IOThreadPolling next = decideIOThreadPolling(polling, latency, host_idle, policy);
+                        if (next == polling || !setIOThreadPolling(records[i]->dom, id, next)) continue;
+                        std::cout << "VM '" << name << "' IOThread " << id << " poll-max-ns " << polling.max_ns
+                                  << " -> " << next.max_ns << "\n";
+                        changed++;
+                    }
+                }
+                block_samples[name] = sample;
+            }
+            virDomainStatsRecordListFree(records);
+            return changed;
+        }
+
+        /**
+         * @brief Records this connection's host and its active VMs in a fleet model.
+         *
+         * Call once per connection (one VMManager per host) to build a fleet-wide
+         * model; calling again refreshes the host's entries.
+         *
+         * @param fleet Model to update.
+         * @param vcpu_overcommit vCPUs offered per host CPU.
+         * @return true if the host was recorded, false otherwise.
+         */
+        bool snapshotFleet(FleetModel& fleet, double vcpu_overcommit = 1.0) {
+            char* uri = virConnectGetURI(conn);
+            if (!uri) {
+                std::cerr << "Failed to get connection URI\n";
+                return false;
+            }
+            FleetHost host;
+            host.uri = uri;
+            free(uri);
+            virNodeInfo node;
+            if (virNodeGetInfo(conn, &node) < 0) {
+                std::cerr << "Failed to get node info\n";
+                return false;
+            }
+            host.memory_kib = node.memory;
+            host.cpus = static_cast<unsigned>(node.cpus * vcpu_overcommit);
+            fleet.removeHost(host.uri);
+            fleet.upsertHost(host);
+
+            std::set<std::string> pinned;
+            for (const auto& [core, owner] : rt_cores.vcpuCores()) pinned.insert(owner);
+
+            virDomainPtr *domains;
+            int num = virConnectListAllDomains(conn, &domains, VIR_CONNECT_LIST_DOMAINS_ACTIVE);
+            for (int i = 0; i < num; i++) {
+                virDomainInfo info;
+                if (virDomainGetInfo(domains[i], &info) == 0) {
+                    FleetVM vm;
+                    vm.name = virDomainGetName(domains[i]);
+                    vm.host = host.uri;
+                    vm.memory_kib = info.maxMem;
+                    vm.vcpus = info.nrVirtCpu;
+                    vm.movable = !pinned.count(vm.name);
+                    fleet.upsertVM(vm);
+                }
+                virDomainFree(domains[i]);
+            }
+            if (num >= 0) free(domains);
+            return num >= 0;
+        }
+
+        /**
+         * @brief Admits VMs created through this manager in a reservation book shared across the fleet.
+         *
+         * Registers this host's capacity in the book and adopts the VMs already
+         * running here, as snapshotFleet() sees them. From then on createVM()
+         * refuses VMs that do not fit under the host's reservations (or in the
+         * reservation named by `VMSpec::reservation`), and undefining or
+         * migrating a VM returns its capacity. Call again to adopt VMs that
+         * arrived by other means.
+         *
+         * @param book Reservation book, or nullptr to stop admitting.
+         * @param vcpu_overcommit vCPUs offered per host CPU.
+         * @return true if the host was registered, false otherwise.
+         */
+        bool useReservations(ReservationBook* book, double vcpu_overcommit = 1.0) {
+            if (!book) {
+                reservation_book = nullptr;
+                return true;
+            }
+            FleetModel here;
+            if (!snapshotFleet(here, vcpu_overcommit)) return false;
+            book->syncFleet(here, reservationClockMs());
+            reservation_host = here.getHosts().begin()->first;
+            reservation_book = book;
+            return true;
+        }
+
+        /**
+         * @brief Live-migrates a domain off this host, journaled with its destination.
+         *
+         * The domain is persisted at the destination and undefined here. Safe to run
+         * concurrently for different domains: admission state is left to
+         * releaseMigrated(), which the caller runs once the migration is done.
+         *
+         * @param name Domain to migrate.
+         * @param dest_uri Connection URI of the destination host.
+         * @return true if the domain was migrated, false otherwise.
+         */
+        bool migrateOut(const std::string& name, const std::string& dest_uri) {
+            virDomainPtr dom = virDomainLookupByName(conn, name.c_str());
+            if (!dom) {
+                std::cerr << "Failed to find VM '" << name << "' for migration\n";
+                return false;
+            }
+            uint64_t op;
+            if (!journalBegin(op, JournalOp::Migrate, name, dest_uri)) {
+                virDomainFree(dom);
+                return false;
+            }
+            bool ok = virDomainMigrateToURI(dom, dest_uri.c_str(), consolidation_migrate_flags, nullptr, 0) == 0;
+            journalEnd(op, ok);
+            virDomainFree(dom);
+            if (!ok) std::cerr << "Failed to migrate VM '" << name << "' to " << dest_uri << "\n";
+            return ok;
+        }
+
+        /**
+         * @brief Releases the cache, bandwidth and core reservations, the admitted capacity and the lease of a
+         * domain that left this host.
+         *
+         * The lease travels in the domain's metadata; the destination's loadLeases() picks it up.
+         */
+        void releaseMigrated(const std::string& name) {
+            rdt.release(name);
+            rt_cores.release(name);
+            releaseCapacity(name);
+            forgetLease(name);
+        }
+
+        /**
+         * @brief Runs a consolidation plan across the fleet.
+         *
+         * Waves run one after another with a barrier between them, whichever hosts
+         * their migrations leave, and at most `plan.max_concurrent` migrations run
+         * at once fleet-wide. Each migration is run by the manager of its source
+         * host (see migrateOut()).
+         *
+         * @param plan Plan from planConsolidation().
+         * @param managers Connection URI (as recorded by snapshotFleet()) -> manager of that host.
+         * @param fleet If given, updated with each successful migration.
+         * @return size_t Number of VMs migrated.
+         */
+        static size_t executeConsolidation(const ConsolidationPlan& plan,
+                                           const std::map<std::string, VMManager*>& managers,
+                                           FleetModel* fleet = nullptr) {
+            size_t migrated = 0;
+            for (const auto& wave : plan.waves) {
+                std::vector<char> ok(wave.size(), 0);
+                std::atomic<size_t> next{0};
+                auto worker = [&] {
+                    for (size_t i; (i = next.fetch_add(1)) < wave.size();) {
+                        auto source = managers.find(wave[i].from);
+                        if (source == managers.end()) {
+                            std::cerr << "No manager for host " << wave[i].from << ", skipping VM '" << wave[i].vm
+                                      << "'\n";
+                            continue;
+                        }
+                        ok[i] = source->second->migrateOut(wave[i].vm, wave[i].to);
+                    }
+                };
+                std::vector<std::thread> workers;
+                size_t width = std::min<size_t>(wave.size(), std::max(1u, plan.max_concurrent));
+                for (size_t t = 0; t < width; t++) workers.emplace_back(worker);
+                for (auto& w : workers) w.join();
+
+                for (size_t i = 0; i < wave.size(); i++) {
+                    if (!ok[i]) continue;
+                    migrated++;
+                    VMManager* source = managers.at(wave[i].from);
+                    if (source->reservation_book) {
+                        source->reservation_book->moveVM(wave[i].vm, wave[i].to, reservationClockMs());
+                    }
+                    source->releaseMigrated(wave[i].vm);
+                    if (fleet) fleet->moveVM(wave[i].vm, wave[i].to);
+                }
+            }
+            std::cout << "Migrated " << migrated << " of " << plan.migrations.size() << " VMs\n";
+            return migrated;
+        }
+
+        /**
+         * @brief Digest of a domain's canonical persistent config.
+         *
+         * @param vm Domain handle.
+         * @param digest Set to the digest on success.
+         * @return true on success, false if the XML could not be read.
+         */
+        bool configDigest(virDomainPtr vm, Digest& digest) {
+            char* xml = virDomainGetXMLDesc(vm, VIR_DOMAIN_XML_INACTIVE);
+            if (!xml) {
+                std::cerr << "Failed to read XML of VM '" << virDomainGetName(vm) << "'\n";
+                return false;
+            }
+            digest = digestDomainXML(xml);
+            free(xml);
+            return true;
+        }
+
+        /**
+         * @brief Returns the Merkle tree of this host's domain configs.
+         *
+         * The first call digests every defined domain. While events are watched
+         * (watchEvents()), later calls only re-digest domains that had lifecycle,
+         * device, tunable or metadata events since, or whose config this manager
+         * changed; otherwise every domain is re-digested each time.
+         */
+        ConfigMerkle configTree() {
+            std::set<std::string> dirty;
+            bool full;
+            {
+                std::lock_guard<std::mutex> lock(config_tree_mutex);
+                full = !config_tree_loaded || lifecycle_callback_id < 0;
+                dirty.swap(config_dirty);
+            }
+
+            if (full) {
+                ConfigMerkle tree(config_tree.bucketCount());
+                forEachDomainXML([&tree](const std::string& name, const std::string& xml) {
+                    tree.set(name, digestDomainXML(xml));
+                });
+                std::lock_guard<std::mutex> lock(config_tree_mutex);
+                config_tree = tree;
+                config_tree_loaded = true;
+                return config_tree;
+            }
+
+            std::map<std::string, std::optional<Digest>> updates;
+            for (const auto& name : dirty) {
+                virDomainPtr dom = virDomainLookupByName(conn, name.c_str());
+                Digest digest;
+                if (dom && configDigest(dom, digest)) updates[name] = digest;
+                else updates[name] = std::nullopt;
+                if (dom) virDomainFree(dom);
+            }
+            std::lock_guard<std::mutex> lock(config_tree_mutex);
+            for (const auto& [name, digest] : updates) {
+                if (digest) config_tree.set(name, *digest);
+                else config_tree.remove(name);
+            }
+            return config_tree;
+        }
+
+        /**
+         * @brief Compares this host's domain configs against desired state.
+         *
+         * @param desired Tree of desired digests (digestDomainXML() of each intended
+         * config), built with the same bucket count as configTree().
+         * @return DriftReport Missing, unexpected and changed domains; clean if the
+         * roots match.
+         */
+        DriftReport auditConfigs(const ConfigMerkle& desired) {
+            DriftReport report = desired.diff(configTree());
+            if (report.clean()) return report;
+            std::cout << "Config drift: " << report.missing.size() << " missing, " << report.unexpected.size()
+                      << " unexpected, " << report.changed.size() << " changed\n";
+            return report;
+        }
+
+        /**
+         * @brief Gives a domain a lease that expires `ttl_ms` from now unless renewed.
+         *
+         * The lease is written to the domain's metadata (persistent config, and the
+         * live domain when running) so a restarted manager picks it up in loadLeases().
+         *
+         * @param vm Domain handle.
+         * @param ttl_ms Lease duration; each renewLease() extends the lease by this much.
+         * @param now_ms Current time in Unix epoch milliseconds.
+         * @return true if the lease was recorded, false otherwise.
+         */
+        bool setLease(virDomainPtr vm, uint64_t ttl_ms, uint64_t now_ms = leaseClockMs()) {
+            Lease lease{virDomainGetName(vm), now_ms + ttl_ms, ttl_ms, domainUUID(vm)};
+            if (!writeLease(vm, lease)) return false;
+            std::lock_guard<std::mutex> lock(lease_mutex);
+            leases[lease.vm] = lease;
+            lease_wheel.schedule(lease.vm, lease.expires_ms, now_ms);
+            return true;
+        }
+
+        /**
+         * @brief Heartbeat: extends a domain's lease by its TTL from now.
+         *
+         * @return true if the domain has a lease and it was extended, false otherwise.
+         */
+        bool renewLease(const std::string& name, uint64_t now_ms = leaseClockMs()) {
+            Lease lease;
+            {
+                std::lock_guard<std::mutex> lock(lease_mutex);
+                auto it = leases.find(name);
+                if (it == leases.end()) {
+                    std::cerr << "VM '" << name << "' has no lease to renew\n";
+                    return false;
+                }
+                it->second.expires_ms = now_ms + it->second.ttl_ms;
+                it->second.failed_teardowns = 0;
+                lease = it->second;
+                lease_wheel.schedule(name, lease.expires_ms, now_ms);
+            }
+            virDomainPtr vm = virDomainLookupByName(conn, name.c_str());
+            if (!vm) return true;  // expiry will find it gone
+            if (!lease.uuid.empty() && domainUUID(vm) != lease.uuid) {
+                std::cerr << "VM '" << name << "' was redefined since its lease was taken, not renewed\n";
+                virDomainFree(vm);
+                forgetLease(name);
+                return false;
+            }
+            bool ok = writeLease(vm, lease);
+            virDomainFree(vm);
+            return ok;
+        }
+
+        /**
+         * @brief Removes a domain's lease so it never expires.
+         */
+        bool clearLease(virDomainPtr vm) {
+            std::string name = virDomainGetName(vm);
+            unsigned flags = VIR_DOMAIN_AFFECT_CONFIG | (virDomainIsActive(vm) == 1 ? VIR_DOMAIN_AFFECT_LIVE : 0);
+            if (virDomainSetMetadata(vm, VIR_DOMAIN_METADATA_ELEMENT, nullptr, nullptr, lease_metadata_uri, flags) < 0) {
+                std::cerr << "Failed to clear lease of VM '" << name << "'\n";
+                return false;
+            }
+            markConfigDirty(name);
+            forgetLease(name);
+            return true;
+        }
+
+        /**
+         * @brief Rebuilds the lease table from the metadata of all defined domains.
+         *
+         * @return int Number of leases found, or -1 on failure.
+         */
+        int loadLeases(uint64_t now_ms = leaseClockMs()) {
+            virDomainPtr *domains;
+            int num = virConnectListAllDomains(conn, &domains, 0);
+            if (num < 0) {
+                std::cerr << "Failed to list domains\n";
+                return -1;
+            }
+            int found = 0;
+            std::lock_guard<std::mutex> lock(lease_mutex);
+            for (int i = 0; i < num; i++) {
+                Lease lease;
+                if (readLease(domains[i], lease)) {
+                    leases[lease.vm] = lease;
+                    lease_wheel.schedule(lease.vm, lease.expires_ms, now_ms);
+                    found++;
+                }
+                virDomainFree(domains[i]);
+            }
+            free(domains);
+            return found;
+        }
+
+        /**
+         * @brief Tears down every domain whose lease expired by `now_ms`.
+         *
+         * Expired domains are destroyed if running and then undefined. Before
+         * teardown the domain's UUID and lease metadata are checked again, so a
+         * domain that reuses the name, or whose lease another manager renewed,
+         * is left alone. A lease is only forgotten once its domain is undefined
+         * or found gone; if the lookup, the metadata read or the teardown fails,
+         * the teardown is retried with backoff (see leaseRetryDelayMs()). Call
+         * periodically (e.g. every second); each call only touches the timer wheel
+         * slots that elapsed since the previous one.
+         *
+         * @return std::vector<std::string> Names of the domains torn down.
+         */
+        std::vector<std::string> expireLeases(uint64_t now_ms = leaseClockMs()) {
+            std::vector<Lease> expired;
+            {
+                std::lock_guard<std::mutex> lock(lease_mutex);
+                for (const auto& name : lease_wheel.advance(now_ms)) {
+                    auto it = leases.find(name);
+                    // A renewal racing the wheel moves the deadline; trust the table
+                    if (it == leases.end()) continue;
+                    if (it->second.expires_ms > now_ms) {
+                        lease_wheel.schedule(name, it->second.expires_ms, now_ms);
+                        continue;
+                    }
+                    expired.push_back(it->second);
+                }
+            }
+            std::vector<std::string> removed;
+            for (const auto& lease : expired) {
+                const std::string& name = lease.vm;
+                virDomainPtr vm = virDomainLookupByName(conn, name.c_str());
+                if (!vm) {
+                    if (lastLibvirtError().code == VIR_ERR_NO_DOMAIN) dropExpiredLease(lease);
+                    else retryExpiredLease(lease, now_ms);
+                    continue;
+                }
+                Lease current;
+                bool error = false;
+                if (!readLease(vm, current, &error)) {
+                    if (error) {
+                        retryExpiredLease(lease, now_ms);
+                    } else {
+                        std::cerr << "Warning: VM '" << name << "' no longer holds a lease, not torn down\n";
+                        dropExpiredLease(lease);
+                    }
+                    virDomainFree(vm);
+                    continue;
+                }
+                bool replaced = !lease.uuid.empty() && current.uuid != lease.uuid;
+                if (replaced || current.expires_ms > now_ms) {
+                    // Renewed elsewhere, or a new domain took the name with a lease of its own
+                    if (replaced) std::cerr << "Warning: VM '" << name << "' was redefined, tracking its own lease\n";
+                    std::lock_guard<std::mutex> lock(lease_mutex);
+                    leases[name] = current;
+                    lease_wheel.schedule(name, current.expires_ms, now_ms);
+                    virDomainFree(vm);
+                    continue;
+                }
+                std::cout << "Lease of VM '" << name << "' expired\n";
+                // undefineVM() forgets the lease once the domain is gone
+                bool ok = (virDomainIsActive(vm) != 1 || destroyVM(vm)) && undefineVM(vm);
+                virDomainFree(vm);
+                if (ok) removed.push_back(name);
+                else retryExpiredLease(lease, now_ms);
+            }
+            return removed;
+        }
+
+        /**
+         * @brief Returns the current leases.
+         */
+        std::vector<Lease> getLeases() {
+            std::lock_guard<std::mutex> lock(lease_mutex);
+            std::vector<Lease> result;
+            for (const auto& [name, lease] : leases) result.push_back(lease);
+            return result;
+        }
+
+        /**
+         * @brief Assigns a domain to a tenant for metering, stored in the domain's metadata.
+         */
+        bool setTenant(virDomainPtr vm, const std::string& tenant) {
+            std::string name = virDomainGetName(vm);
+            unsigned flags = VIR_DOMAIN_AFFECT_CONFIG | (virDomainIsActive(vm) == 1 ? VIR_DOMAIN_AFFECT_LIVE : 0);
+            if (virDomainSetMetadata(vm, VIR_DOMAIN_METADATA_ELEMENT, buildTenantMetadata(tenant).c_str(),
+                                     tenant_metadata_key, tenant_metadata_uri, flags) < 0) {
+                std::cerr << "Failed to set tenant of VM '" << name << "'\n";
+                return false;
+            }
+            markConfigDirty(name);
+            std::lock_guard<std::mutex> lock(tenant_mutex);
+            tenant_cache[domainUUID(vm)] = tenant;
+            return true;
+        }
+
+        /**
+         * @brief Feeds one stats sample of every running domain into a metering pipeline.
+         *
+         * Uses a single bulk stats call; a domain's tenant is read from its metadata
+         * the first time it is seen and cached by UUID while it keeps running, so
+         * a domain redefined under the same name is looked up again. Domains without a
+         * tenant are metered as "default". Call at the metering sample rate, then
+         * periodically persist `pipeline.closeBuckets()` with appendMeterBuckets().
+         *
+         * @param pipeline Pipeline to feed.
+         * @param now_ms Sample timestamp in Unix epoch milliseconds.
+         * @return int Number of samples consumed, or -1 on failure.
+         */
+        int collectMetering(MeteringPipeline& pipeline, uint64_t now_ms = leaseClockMs()) {
+            virDomainStatsRecordPtr *records = nullptr;
+            int num = virConnectGetAllDomainStats(conn,
+                                                  VIR_DOMAIN_STATS_CPU_TOTAL | VIR_DOMAIN_STATS_BALLOON |
+                                                  VIR_DOMAIN_STATS_INTERFACE,
+                                                  &records, VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE);
+            if (num < 0) {
+                std::cerr << "Failed to collect metering stats\n";
+                return -1;
+            }
+            std::unordered_map<std::string, std::string> running;  // the cache keeps only running domains
+            for (int i = 0; i < num; i++) {
+                MeterSample sample = parseMeterSample(records[i]->params, records[i]->nparams);
+                sample.vm = virDomainGetName(records[i]->dom);
+                sample.instance = virDomainGetID(records[i]->dom);
+                sample.timestamp_ms = now_ms;
+                std::string uuid = domainUUID(records[i]->dom);
+                std::optional<std::string> cached;
+                {
+                    std::lock_guard<std::mutex> lock(tenant_mutex);
+                    auto it = tenant_cache.find(uuid);
+                    if (it != tenant_cache.end()) cached = it->second;
+                }
+                if (cached) {
+                    sample.tenant = *cached;
+                } else {
+                    char* metadata = virDomainGetMetadata(records[i]->dom, VIR_DOMAIN_METADATA_ELEMENT,
+                                                          tenant_metadata_uri, VIR_DOMAIN_AFFECT_LIVE);
+                    std::string name = metadata ? parseTenantMetadata(metadata) : "";
+                    free(metadata);
+                    sample.tenant = name.empty() ? "default" : name;
+                }
+                running[uuid] = sample.tenant;
+                pipeline.consume(sample);
+            }
+            virDomainStatsRecordListFree(records);
+            std::lock_guard<std::mutex> lock(tenant_mutex);
+            // Tenants set while the stats were read are newer than what was sampled
+            for (auto& [uuid, tenant] : running) {
+                auto it = tenant_cache.find(uuid);
+                if (it != tenant_cache.end()) tenant = it->second;
+            }
+            tenant_cache.swap(running);
+            return num;
+        }
+
+        /**
+         * @brief Sets where NUMA usage is read from (defaults: "/proc" and "/run/libvirt/qemu").
+         *
+         * Session connections keep pid files under `$XDG_RUNTIME_DIR/libvirt/qemu/run`.
+         */
+        void setNumaPaths(const std::string& proc, const std::string& run_dir) {
+            proc_root = proc;
+            qemu_run_dir = run_dir;
+        }
+
+        /**
+         * @brief Reads how a running domain's memory is spread over host NUMA nodes.
+         *
+         * The QEMU pid file and numa_maps are read from this machine's filesystem,
+         * so this fails on a remote connection.
+         *
+         * @param vm Running domain.
+         * @param usage Set to the per-node memory of the domain's QEMU process.
+         * @return true if the usage was read, false otherwise.
+         */
+        bool getNumaUsage(virDomainPtr vm, NumaUsage& usage) {
+            std::string name = virDomainGetName(vm);
+            if (virConnectIsRemote(conn) != 0) {
+                std::cerr << "Failed to read NUMA usage of VM '" << name << "': the connection is not local\n";
+                return false;
+            }
+            int pid = readQemuPid(name, qemu_run_dir);
+            if (pid < 0) {
+                std::cerr << "Failed to find the QEMU process of VM '" << name << "'\n";
+                return false;
+            }
+            if (!readNumaMaps(pid, usage, proc_root)) {
+                std::cerr << "Failed to read NUMA maps of VM '" << name << "' (pid " << pid << ")\n";
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Confines a running domain's memory and vCPUs to one host NUMA node.
+         *
+         * Narrowing the live nodeset makes the kernel migrate the domain's pages
+         * to the node; vCPUs and the emulator thread are then pinned to its CPUs,
+         * except isolated cores and cores running realtime vCPUs. The domain's
+         * memory mode must allow live nodeset changes (strict).
+         *
+         * @param vm Running domain.
+         * @param node Target node, with its CPUs.
+         * @param host_cpus Number of host CPUs (sizes the CPU maps).
+         * @return true if memory and CPUs were moved, false otherwise.
+         */
+        bool moveToNumaNode(virDomainPtr vm, const NumaNode& node, unsigned host_cpus) {
+            std::string name = virDomainGetName(vm);
+            if (!rt_loaded) loadRealtimeCores();
+            std::vector<unsigned char> cpumap = numaNodeCpuMap(node, host_cpus, rt_cores.reservedCores());
+            if (cpumap.empty()) {
+                std::cerr << "Failed to move VM '" << name << "': NUMA node " << node.id
+                          << " has no CPUs outside isolated and realtime cores\n";
+                return false;
+            }
+            virTypedParameterPtr params = nullptr;
+            int nparams = 0, maxparams = 0;
+            if (virTypedParamsAddString(&params, &nparams, &maxparams, VIR_DOMAIN_NUMA_NODESET,
+                                        std::to_string(node.id).c_str()) < 0) {
+                virTypedParamsFree(params, nparams);
+                return false;
+            }
+            int rc = virDomainSetNumaParameters(vm, params, nparams, VIR_DOMAIN_AFFECT_LIVE);
+            virTypedParamsFree(params, nparams);
+            if (rc < 0) {
+                std::cerr << "Failed to move memory of VM '" << name << "' to NUMA node " << node.id << "\n";
+                return false;
+            }
+
+            virDomainInfo info;
+            if (virDomainGetInfo(vm, &info) < 0) {
+                std::cerr << "Failed to get info for VM '" << name << "'\n";
+                return false;
+            }
+            int maplen = static_cast<int>(cpumap.size());
+            for (unsigned v = 0; v < info.nrVirtCpu; v++) {
+                if (virDomainPinVcpuFlags(vm, v, cpumap.data(), maplen, VIR_DOMAIN_AFFECT_LIVE) < 0) {
+                    std::cerr << "Failed to pin vCPU " << v << " of VM '" << name << "' to NUMA node " << node.id << "\n";
+                    return false;
+                }
+            }
+            if (virDomainPinEmulator(vm, cpumap.data(), maplen, VIR_DOMAIN_AFFECT_LIVE) < 0) {
+                std::cerr << "Failed to pin emulator of VM '" << name << "' to NUMA node " << node.id << "\n";
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Makes the running domains with the most remote memory node-local.
+         *
+         * Reads each domain's numa_maps, plans moves worst offenders first within
+         * the policy's migration budget, and applies them. Realtime domains keep
+         * their exclusive pinning and are never moved, and nodes whose CPUs are
+         * all isolated or held by realtime vCPUs are never targets. Needs a local
+         * connection. Call periodically; each pass migrates at most `policy.budget_kib`.
+         *
+         * @param policy Thresholds and per-pass budget.
+         * @return std::vector<NumaMove> Moves that were applied.
+         */
+        std::vector<NumaMove> rebalanceNuma(const NumaLocalityPolicy& policy = NumaLocalityPolicy{}) {
+            if (virConnectIsRemote(conn) != 0) {
+                std::cerr << "Failed to rebalance NUMA nodes: the connection is not local\n";
+                return {};
+            }
+            char* caps = virConnectGetCapabilities(conn);
+            if (!caps) {
+                std::cerr << "Failed to get host capabilities\n";
+                return {};
+            }
+            std::vector<NumaNode> nodes = parseNumaNodes(caps);
+            free(caps);
+            if (nodes.size() < 2) return {};
+
+            int max_id = 0;
+            for (const auto& n : nodes) max_id = std::max(max_id, n.id);
+            std::vector<unsigned long long> free_bytes(max_id + 1, 0);
+            if (virNodeGetCellsFreeMemory(conn, free_bytes.data(), 0, max_id + 1) < 0) {
+                std::cerr << "Failed to get free memory per NUMA node\n";
+                return {};
+            }
+            unsigned host_cpus = 0;
+            for (auto& n : nodes) {
+                n.free_kib = free_bytes[n.id] / 1024;
+                for (unsigned cpu : n.cpus) host_cpus = std::max(host_cpus, cpu + 1);
+            }
+            if (!rt_loaded) loadRealtimeCores();
+            std::set<unsigned> reserved = rt_cores.reservedCores();
+            nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [&](const NumaNode& n) {
+                return numaNodeCpuMap(n, host_cpus, reserved).empty();
+            }), nodes.end());
+            if (nodes.empty()) return {};
+
+            std::map<std::string, NumaUsage> usage;
+            std::map<std::string, virDomainPtr> running;
+            virDomainPtr *domains;
+            int num = virConnectListAllDomains(conn, &domains, VIR_CONNECT_LIST_DOMAINS_ACTIVE);
+            for (int i = 0; i < num; i++) {
+                std::string name = virDomainGetName(domains[i]);
+                char* xml = virDomainGetXMLDesc(domains[i], 0);
+                bool realtime = xml && parseRealtime(xml);
+                free(xml);
+                NumaUsage u;
+                if (!realtime && getNumaUsage(domains[i], u)) {
+                    usage[name] = u;
+                    running[name] = domains[i];
+                } else {
+                    virDomainFree(domains[i]);
+                }
+            }
+            if (num >= 0) free(domains);
+
+            std::vector<NumaMove> applied;
+            for (const auto& move : planNumaRebalance(usage, nodes, policy)) {
+                auto node = std::find_if(nodes.begin(), nodes.end(), [&](const NumaNode& n) { return n.id == move.target_node; });
+                if (!moveToNumaNode(running[move.vm], *node, host_cpus)) continue;
+                std::cout << "VM '" << move.vm << "' moved to NUMA node " << move.target_node << " ("
+                          << static_cast<int>(move.remote_fraction * 100) << "% remote, " << move.move_kib / 1024
+                          << " MiB migrated)\n";
+                applied.push_back(move);
+            }
+            for (auto& [name, dom] : running) virDomainFree(dom);
+            return applied;
+        }
+
+        /**
+         * @brief Enables direct QMP stats queries for domains that expose a socket.
+         *
+         * Domains with a QMP socket at `<dir>/<name>.qmp` are queried over it,
+         * bypassing libvirtd; others, and those whose socket fails, are queried
+         * through virDomainQemuMonitorCommand(). An empty `dir` sends every
+         * query through libvirt.
+         */
+        void setQmpSocketDir(const std::string& dir) {
+            std::lock_guard<std::mutex> lock(qmp_mutex);
+            qmp_socket_dir = dir;
+        }
+
+        /**
+         * @brief Runs a QMP query on every active domain.
+         *
+         * Domains with a direct socket are queried together, pipelined on one
+         * thread; the rest fall back to libvirt one by one.
+         *
+         * @param command Query to run, e.g. {"query-blockstats", ""}.
+         * @param timeout_ms How long to wait for direct replies before falling back.
+         * @return std::map<std::string, QmpReply> Reply per domain name.
+         */
+        std::map<std::string, QmpReply> queryQmp(const QmpCommand& command, int timeout_ms = 500) {
+            std::map<std::string, QmpReply> result;
+            std::map<std::string, virDomainPtr> running;
+            virDomainPtr *domains;
+            int num = virConnectListAllDomains(conn, &domains, VIR_CONNECT_LIST_DOMAINS_ACTIVE);
+            if (num < 0) {
+                std::cerr << "Failed to list active VMs\n";
+                return result;
+            }
+            for (int i = 0; i < num; i++) running[virDomainGetName(domains[i])] = domains[i];
+            free(domains);
+
+            std::lock_guard<std::mutex> lock(qmp_mutex);
+            for (const auto& name : qmp.domains()) {
+                if (!running.count(name)) qmp.remove(name);
+            }
+            for (const auto& [name, dom] : running) {
+                std::string path = qmpSocketPath(name);
+                if (!path.empty()) {
+                    qmp.add(name, path);
+                } else {
+                    qmp.remove(name);
+                }
+            }
+            if (qmp.size()) {
+                for (auto& reply : qmp.query(command, timeout_ms)) {
+                    if (reply.ok) result[reply.domain] = std::move(reply);
+                }
+            }
+
+            std::string request = qmpCommandJson(command);
+            for (const auto& [name, dom] : running) {
+                if (!result.count(name)) {
+                    QmpReply& reply = result[name];
+                    reply.domain = name;
+                    char* response = nullptr;
+                    JsonValue msg;
+                    if (virDomainQemuMonitorCommand(dom, request.c_str(), &response, 0) < 0 || !response ||
+                        !parseJson(response, msg) || !readQmpReply(msg, reply)) {
+                        reply.error = "monitor command failed";
+                        std::cerr << "Failed to run " << command.execute << " on VM '" << name << "'\n";
+                    }
+                    free(response);
+                }
+                virDomainFree(dom);
+            }
+            return result;
+        }
+
+        /**
+         * @brief Collects block I/O counters of all active domains over QMP.
+         *
+         * @return Per domain, its devices' counters; domains whose query failed are omitted.
+         */
+        std::map<std::string, std::vector<QmpBlockStats>> collectQmpBlockStats(int timeout_ms = 500) {
+            std::map<std::string, std::vector<QmpBlockStats>> stats;
+            for (const auto& [name, reply] : queryQmp(QmpCommand{"query-blockstats", ""}, timeout_ms)) {
+                if (reply.ok) stats[name] = parseQmpBlockStats(reply.value);
+            }
+            return stats;
+        }
+
+        /**
+         * @brief Collects KVM vCPU statistics of all active domains over QMP (`query-stats`, QEMU 7.1+).
+         *
+         * @return Per domain, each scalar statistic summed over its vCPUs.
+         */
+        std::map<std::string, std::map<std::string, uint64_t>> collectQmpVcpuStats(int timeout_ms = 500) {
+            std::map<std::string, std::map<std::string, uint64_t>> stats;
+            for (const auto& [name, reply] : queryQmp(QmpCommand{"query-stats", "{\"target\":\"vcpu\"}"}, timeout_ms)) {
+                if (reply.ok) stats[name] = parseQmpVcpuStats(reply.value);
+            }
+            return stats;
+        }
+
+        /**
+         * @brief Makes QEMU keep latency histograms for every disk of a running domain.
+         *
+         * Sends `block-latency-histogram-set` over the domain's direct QMP
+         * socket (see setQmpSocketDir()), or else through the monitor
+         * passthrough (libvirt marks the domain tainted by custom monitor
+         * commands), and records each disk's operation times at that moment so
+         * reported sums cover only what the bins count. The configuration is
+         * remembered and re-applied by collectLatencyHistograms() when QEMU
+         * restarts, since histograms do not outlive the process.
+         *
+         * @param vm Running domain.
+         * @param config Bucket boundaries.
+         * @return true if every disk was configured, false otherwise.
+         */
+        bool setLatencyHistograms(virDomainPtr vm, const LatencyHistogramConfig& config = LatencyHistogramConfig{}) {
+            {
+                std::lock_guard<std::mutex> lock(histogram_mutex);
+                histogram_configs[virDomainGetName(vm)] = config;
+            }
+            return applyLatencyHistograms(vm, config);
+        }
+
+        /**
+         * @brief Stops re-applying latency histograms to a domain, e.g. once it is undefined.
+         *
+         * QEMU keeps counting until the domain restarts.
+         */
+        void clearLatencyHistograms(const std::string& name) {
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            histogram_configs.erase(name);
+            histogram_disks.erase(name);
+            histogram_baselines.erase(name);
+        }
+
+        /**
+         * @brief Collects the latency histograms of all active domains.
+         *
+         * Reads `query-blockstats` through queryQmp(), so domains with a direct
+         * QMP socket skip libvirtd. Devices are named by their target ("vda")
+         * for domains configured through setLatencyHistograms(). Configured
+         * domains that report no histograms (restarted since) are configured
+         * again and show up from the next collection. Call periodically and
+         * publish the result with formatLatencyMetrics(), or take quantiles of
+         * the difference between collections with diffLatencyHistogram().
+         *
+         * @param timeout_ms How long to wait for direct QMP replies.
+         * @return Per domain, its disks' cumulative histograms.
+         */
+        std::map<std::string, std::vector<DiskLatencyHistograms>> collectLatencyHistograms(int timeout_ms = 500) {
+            std::map<std::string, std::vector<DiskLatencyHistograms>> result;
+            std::vector<std::pair<std::string, LatencyHistogramConfig>> rearm;
+            auto replies = queryQmp(QmpCommand{"query-blockstats", ""}, timeout_ms);
+            {
+                std::lock_guard<std::mutex> lock(histogram_mutex);
+                for (const auto& [name, reply] : replies) {
+                    if (!reply.ok) continue;
+                    auto baselines = histogram_baselines.find(name);
+                    std::vector<DiskLatencyHistograms> disks =
+                        baselines == histogram_baselines.end() ? parseLatencyHistograms(reply.value)
+                                                               : parseLatencyHistograms(reply.value, baselines->second);
+                    auto config = histogram_configs.find(name);
+                    if (disks.empty() && config != histogram_configs.end()) rearm.emplace_back(name, config->second);
+                    if (disks.empty()) continue;
+                    auto known = histogram_disks.find(name);
+                    if (known != histogram_disks.end()) {
+                        for (auto& d : disks) d.device = histogramDiskName(d.device, known->second);
+                    }
+                    result[name] = std::move(disks);
+                }
+            }
+            for (const auto& [name, config] : rearm) {
+                virDomainPtr vm = virDomainLookupByName(conn, name.c_str());
+                if (!vm) continue;
+                applyLatencyHistograms(vm, config);
+                virDomainFree(vm);
+            }
+            return result;
+        }
+
+        /**
+         * @brief Sets how disks that cannot grow in place are moved to another volume.
+         *
+         * Called from the thin-provisioning worker with the domain and the disk
+         * whose volume is at its maximum size or whose pool is out of space; it
+         * should copy the disk to a larger volume and pivot the domain onto it.
+         * Without a relocator such disks are only reported.
+         */
+        void setThinRelocator(std::function<bool(virDomainPtr, const ThinDisk&)> relocator) {
+            thin_relocator = std::move(relocator);
+        }
+
+        /**
+         * @brief Arms block thresholds on a running domain's thin disks.
+         *
+         * Each qcow2 disk on a block volume gets a threshold at the policy's
+         * watermark of the volume's size; disks already past it are extended.
+         *
+         * @param vm Running domain.
+         * @return int Number of disks armed, or -1 if the domain XML could not be read.
+         */
+        int armBlockThresholds(virDomainPtr vm) {
+            char* xml = virDomainGetXMLDesc(vm, 0);
+            if (!xml) {
+                std::cerr << "Failed to get XML of VM '" << virDomainGetName(vm) << "'\n";
+                return -1;
+            }
+            std::vector<ThinDisk> disks = parseThinDisks(xml);
+            free(xml);
+            int armed = 0;
+            for (const auto& disk : disks) {
+                if (extendThinDisk(vm, disk)) armed++;
+            }
+            return armed;
+        }
+
+        /**
+         * @brief Keeps thin disks of running domains ahead of their guests' writes.
+         *
+         * Registers for block threshold and I/O error events and arms every
+         * active domain's thin disks. When a guest writes past a watermark, its
+         * volume is grown (or the disk relocated) and the threshold re-armed; a
+         * guest paused because a volume ran out of space (as its disk errors
+         * confirm) is resumed once its disk was extended. Events are handled on
+         * a worker thread so the RPCs do not stall the event loop. Requires
+         * startEventLoop() before connect().
+         *
+         * @param policy Watermark and growth policy.
+         * @return true if the events were registered, false otherwise.
+         */
+        bool watchThinProvisioning(const ThinPolicy& policy = ThinPolicy{}) {
+            if (threshold_callback_id >= 0) return true;
+            thin_policy = policy;
+            thin_events.start([this](const ThinEvent& e) { handleThinEvent(e); });
+            threshold_callback_id = virConnectDomainEventRegisterAny(
+                conn, nullptr, VIR_DOMAIN_EVENT_ID_BLOCK_THRESHOLD,
+                VIR_DOMAIN_EVENT_CALLBACK(blockThresholdCallback), &thin_events, nullptr);
+            io_error_callback_id = virConnectDomainEventRegisterAny(
+                conn, nullptr, VIR_DOMAIN_EVENT_ID_IO_ERROR_REASON,
+                VIR_DOMAIN_EVENT_CALLBACK(ioErrorReasonCallback), &thin_events, nullptr);
+            if (threshold_callback_id < 0 || io_error_callback_id < 0) {
+                std::cerr << "Failed to register thin-provisioning event callbacks\n";
+                if (threshold_callback_id >= 0) virConnectDomainEventDeregisterAny(conn, threshold_callback_id);
+                if (io_error_callback_id >= 0) virConnectDomainEventDeregisterAny(conn, io_error_callback_id);
+                threshold_callback_id = io_error_callback_id = -1;
+                thin_events.stop();
+                return false;
+            }
+
+            virDomainPtr *domains;
+            int num = virConnectListAllDomains(conn, &domains, VIR_CONNECT_LIST_DOMAINS_ACTIVE);
+            for (int i = 0; i < num; i++) {
+                // Paused because a disk ran out of space, not on another I/O error: resume it once extended
+                if (enospc_paused.confirm(domains[i])) enospc_paused.track(virDomainGetName(domains[i]));
+                armBlockThresholds(domains[i]);
+                virDomainFree(domains[i]);
+            }
+            if (num >= 0) free(domains);
+            resumeNoSpacePausedVMs();
+            return true;
+        }
+
+        /**
+         * @brief Retries domains paused because a thin volume ran out of space.
+         *
+         * Extends their thin disks again and resumes those whose disks all have
+         * room, e.g. after space was reclaimed in the pool. Call periodically
+         * while watchThinProvisioning() is active.
+         *
+         * @return int Number of domains resumed.
+         */
+        int resumeNoSpacePausedVMs() {
+            int resumed = 0;
+            for (const auto& name : enospc_paused.names()) {
+                virDomainPtr vm = virDomainLookupByName(conn, name.c_str());
+                if (!vm) {
+                    enospc_paused.forget(name);
+                    continue;
+                }
+                char* xml = virDomainGetXMLDesc(vm, 0);
+                std::vector<ThinDisk> disks = xml ? parseThinDisks(xml) : std::vector<ThinDisk>{};
+                free(xml);
+                bool room = true;
+                for (const auto& disk : disks) room = extendThinDisk(vm, disk) && room;
+                if (room && enospc_paused.resumeIfNoSpace(vm, name)) resumed++;
+                virDomainFree(vm);
+            }
+            return resumed;
+        }
+
+        /**
+         * @brief Enables hardware perf events on a running domain.
+         *
+         * Events are enabled one at a time so that counters the host does not
+         * support (e.g. memory-bandwidth monitoring without RDT) are skipped
+         * instead of failing the whole request.
+         *
+         * @param vm Domain to enable perf events on.
+         * @param events libvirt perf event names (`VIR_PERF_PARAM_*`).
+         * @return std::vector<std::string> The events that were enabled.
+         */
+        std::vector<std::string> enablePerfEvents(virDomainPtr vm,
+                                                  const std::vector<std::string>& events = default_perf_events) {
+            std::vector<std::string> enabled;
+            for (const auto& event : events) {
+                virTypedParameterPtr params = nullptr;
+                int nparams = 0, maxparams = 0;
+                if (virTypedParamsAddBoolean(&params, &nparams, &maxparams, event.c_str(), 1) < 0) {
+                    continue;
+                }
+                if (virDomainSetPerfEvents(vm, params, nparams, VIR_DOMAIN_AFFECT_LIVE) == 0) {
+                    enabled.push_back(event);
+                } else {
+                    std::cerr << "Perf event '" << event << "' unavailable for VM '"
+                              << virDomainGetName(vm) << "'\n";
+                }
+                virTypedParamsFree(params, nparams);
+            }
+            std::cout << "Enabled " << enabled.size() << "/" << events.size()
+                      << " perf events for VM '" << virDomainGetName(vm) << "'\n";
+            return enabled;
+        }
+
+        /**
+         * @brief Records a perf sample for a domain and derives metrics against the previous one.
+         *
+         * Used by collectPerfMetrics() for bulk-stats records and callable directly with
+         * synthetic samples when hardware counters are unavailable.
+         *
+         * @param name Domain name.
+         * @param sample Raw perf counters for the domain.
+         * @return PerfMetrics Metrics for the interval since the previous sample.
+         */
+        PerfMetrics recordPerfSample(const std::string& name, const PerfSample& sample) {
+            auto it = perf_samples.find(name);
+            PerfMetrics metrics = computePerfMetrics(it == perf_samples.end() ? nullptr : &it->second, sample);
+            perf_samples[name] = sample;
+            return metrics;
+        }
+
+        /**
+         * @brief Collects perf counters for all active domains via bulk stats.
+         *
+         * @return std::map<std::string, PerfMetrics> Derived metrics keyed by domain name.
+         * Domains without perf events enabled are omitted.
+         */
+        std::map<std::string, PerfMetrics> collectPerfMetrics() {
+            std::map<std::string, PerfMetrics> result;
+            virDomainStatsRecordPtr *records = nullptr;
+            int num = virConnectGetAllDomainStats(conn, VIR_DOMAIN_STATS_PERF, &records,
+                                                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE);
+            if (num < 0) {
+                std::cerr << "Failed to collect perf stats\n";
+                return result;
+            }
+
+            for (int i = 0; i < num; i++) {
+                PerfSample sample = parsePerfStats(records[i]->params, records[i]->nparams);
+                if (sample.counters.empty()) continue;
+                std::string name = virDomainGetName(records[i]->dom);
+                result[name] = recordPerfSample(name, sample);
+            }
+            virDomainStatsRecordListFree(records);
+            return result;
+        }
 };
 
 #endif // VM_H      
\ No newline at end of file
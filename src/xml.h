@@ -0,0 +1,196 @@
+// Minimal string-based helpers for reading and patching libvirt XML
+#ifndef XML_H
+#define XML_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Escapes the five XML special characters in `str`.
+ */
+inline std::string xmlEscape(const std::string& str) {
+    std::string result;
+    result.reserve(str.size());
+    for (char c : str) {
+        switch (c) {
+            case '<':  result += "&lt;";   break;
+            case '>':  result += "&gt;";   break;
+            case '&':  result += "&amp;";  break;
+            case '\'': result += "&apos;"; break;
+            case '"':  result += "&quot;"; break;
+            default:   result += c;        break;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Locates an element in an XML string.
+ *
+ * Finds the first `<tag ...>...</tag>` or `<tag .../>` at or after `from`,
+ * accounting for nested elements with the same tag name.
+ *
+ * @param xml Document to search.
+ * @param tag Element name.
+ * @param from Offset to start searching at.
+ * @param begin Set to the offset of the opening `<`.
+ * @param end Set to the offset one past the closing `>`.
+ * @return true if the element was found, false otherwise.
+ */
+inline bool xmlFindElement(const std::string& xml, const std::string& tag, size_t from,
+                           size_t& begin, size_t& end) {
+    const std::string open = "<" + tag;
+    const std::string close = "</" + tag + ">";
+    auto isTagStart = [&](size_t pos) {
+        size_t after = pos + open.size();
+        if (after >= xml.size()) return false;
+        char c = xml[after];
+        return c == '>' || c == '/' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    };
+
+    size_t pos = xml.find(open, from);
+    while (pos != std::string::npos && !isTagStart(pos)) pos = xml.find(open, pos + 1);
+    if (pos == std::string::npos) return false;
+
+    size_t tag_end = xml.find('>', pos);
+    if (tag_end == std::string::npos) return false;
+    begin = pos;
+    if (xml[tag_end - 1] == '/') {
+        end = tag_end + 1;
+        return true;
+    }
+
+    int depth = 1;
+    size_t cursor = tag_end + 1;
+    while (depth > 0) {
+        size_t next_close = xml.find(close, cursor);
+        if (next_close == std::string::npos) return false;
+        size_t next_open = xml.find(open, cursor);
+        while (next_open != std::string::npos && next_open < next_close && !isTagStart(next_open)) {
+            next_open = xml.find(open, next_open + 1);
+        }
+        if (next_open != std::string::npos && next_open < next_close) {
+            size_t open_end = xml.find('>', next_open);
+            if (open_end == std::string::npos) return false;
+            if (xml[open_end - 1] != '/') depth++;
+            cursor = open_end + 1;
+        } else {
+            depth--;
+            cursor = next_close + close.size();
+        }
+    }
+    end = cursor;
+    return true;
+}
+
+/**
+ * @brief Returns the first `tag` element (including its markup), or an empty string.
+ */
+inline std::string xmlElement(const std::string& xml, const std::string& tag, size_t from = 0) {
+    size_t begin, end;
+    if (!xmlFindElement(xml, tag, from, begin, end)) return "";
+    return xml.substr(begin, end - begin);
+}
+
+/**
+ * @brief Returns every `tag` element in document order (nested matches are not split out).
+ */
+inline std::vector<std::string> xmlElements(const std::string& xml, const std::string& tag) {
+    std::vector<std::string> result;
+    size_t begin, end, from = 0;
+    while (xmlFindElement(xml, tag, from, begin, end)) {
+        result.push_back(xml.substr(begin, end - begin));
+        from = end;
+    }
+    return result;
+}
+
+/**
+ * @brief Returns an attribute of an element's start tag, or an empty string if absent.
+ */
+inline std::string xmlAttr(const std::string& element, const std::string& name) {
+    size_t tag_end = element.find('>');
+    std::string start = element.substr(0, tag_end);
+    for (char quote : {'\'', '"'}) {
+        std::string key = " " + name + "=" + quote;
+        size_t pos = start.find(key);
+        if (pos == std::string::npos) continue;
+        pos += key.size();
+        size_t close = start.find(quote, pos);
+        if (close == std::string::npos) return "";
+        return start.substr(pos, close - pos);
+    }
+    return "";
+}
+
+/**
+ * @brief Returns the text content of an element (everything between its start and end tags).
+ */
+inline std::string xmlText(const std::string& element) {
+    size_t start = element.find('>');
+    size_t end = element.rfind("</");
+    if (start == std::string::npos || end == std::string::npos || end < start) return "";
+    return element.substr(start + 1, end - start - 1);
+}
+
+/**
+ * @brief Returns the text of the first `tag` element in `xml`, or an empty string.
+ */
+inline std::string xmlChildText(const std::string& xml, const std::string& tag) {
+    return xmlText(xmlElement(xml, tag));
+}
+
+/**
+ * @brief Replaces the first `tag` element in `xml` with `replacement`.
+ *
+ * @return true if an element was replaced, false if none was found.
+ */
+inline bool xmlReplaceElement(std::string& xml, const std::string& tag, const std::string& replacement,
+                              size_t from = 0) {
+    size_t begin, end;
+    if (!xmlFindElement(xml, tag, from, begin, end)) return false;
+    xml.replace(begin, end - begin, replacement);
+    return true;
+}
+
+/**
+ * @brief Removes every `tag` element from `xml`.
+ */
+inline void xmlRemoveElements(std::string& xml, const std::string& tag) {
+    while (xmlReplaceElement(xml, tag, "")) {}
+}
+
+/**
+ * @brief Converts a size in a libvirt unit ("KiB", "MiB", "b", ...) to KiB.
+ */
+inline uint64_t xmlToKiB(uint64_t value, const std::string& unit) {
+    if (unit == "b" || unit == "bytes") return value / 1024;
+    if (unit == "M" || unit == "MiB") return value * 1024;
+    if (unit == "G" || unit == "GiB") return value * 1024 * 1024;
+    if (unit == "KB") return value * 1000 / 1024;
+    if (unit == "MB") return value * 1000 * 1000 / 1024;
+    if (unit == "GB") return value * 1000 * 1000 * 1000 / 1024;
+    return value;  // KiB is libvirt's default
+}
+
+/**
+ * @brief Sets (or adds) an attribute on the start tag of the element beginning at `begin`.
+ */
+inline void xmlSetAttr(std::string& xml, size_t begin, const std::string& name, const std::string& value) {
+    size_t tag_end = xml.find('>', begin);
+    if (tag_end == std::string::npos) return;
+    for (char quote : {'\'', '"'}) {
+        std::string key = " " + name + "=" + quote;
+        size_t pos = xml.find(key, begin);
+        if (pos == std::string::npos || pos > tag_end) continue;
+        pos += key.size();
+        size_t close = xml.find(quote, pos);
+        xml.replace(pos, close - pos, xmlEscape(value));
+        return;
+    }
+    size_t insert_at = xml[tag_end - 1] == '/' ? tag_end - 1 : tag_end;
+    xml.insert(insert_at, " " + name + "='" + xmlEscape(value) + "'");
+}
+
+#endif // XML_H
@@ -0,0 +1,39 @@
+// Minimal assertion helpers shared by the unit tests
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+inline int check_failures = 0;
+
+/**
+ * @brief Records a failed expectation without aborting, so one run reports every failure.
+ */
+#define CHECK(cond)                                                                       \
+    do {                                                                                  \
+        if (!(cond)) {                                                                    \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n";  \
+            check_failures++;                                                             \
+        }                                                                                 \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                            \
+    do {                                                                                          \
+        auto check_a_ = (a);                                                                      \
+        auto check_b_ = (b);                                                                      \
+        if (!(check_a_ == check_b_)) {                                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b ") failed: "     \
+                      << check_a_ << " != " << check_b_ << "\n";                                  \
+            check_failures++;                                                                     \
+        }                                                                                         \
+    } while (0)
+
+/**
+ * @brief Exit status for main(): non-zero if any check failed.
+ */
+inline int checkResult() {
+    if (check_failures) std::cerr << check_failures << " check(s) failed\n";
+    return check_failures ? 1 : 0;
+}
+
+#endif // CHECK_H
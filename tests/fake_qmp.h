@@ -0,0 +1,156 @@
+// A QEMU monitor stand-in serving QMP on a Unix socket, shared by the QmpMux test and bench
+#ifndef FAKE_QMP_H
+#define FAKE_QMP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "json.h"
+
+/**
+ * @brief Serves one QMP client at a time, like QEMU, from a thread of its own.
+ *
+ * Every command gets `{"return":{"monitor":<name>,"execute":<command>}}` with
+ * the request's id, preceded by an event the client has to skip, after
+ * `service_time` (QEMU runs commands in its main loop, one at a time), unless
+ * `respond` is set: it is called on the monitor's thread and returns false to
+ * have the command fail. The other behaviours misbehave the way real monitors
+ * do.
+ */
+class FakeQmpMonitor {
+    public:
+        enum Behaviour {
+            Reply,           // answer every command
+            ReplyThenClose,  // answer the first command, then hang up in the same breath
+            Silent,          // negotiate capabilities, then never answer
+            CloseOnCommand,  // hang up on the first command without answering
+            Error,           // answer every command with a QMP error
+        };
+
+        std::atomic<int> connections{0};
+        std::atomic<int> commands{0};
+        std::atomic<int> hang_ups{0};
+        std::chrono::microseconds service_time{0};
+        std::function<bool(const std::string& execute, const JsonValue& arguments, std::string& ret)> respond;
+
+    private:
+        std::string name;
+        std::string path;
+        Behaviour behaviour;
+        int listen_fd = -1;
+        std::atomic<bool> running{true};
+        std::thread thread;
+
+        static bool sendAll(int fd, const std::string& data) {
+            size_t sent = 0;
+            while (sent < data.size()) {
+                ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) return false;
+                sent += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        // Answers the lines of one client; returns when it or the behaviour hangs up
+        void serve(int fd) {
+            connections++;
+            sendAll(fd, "{\"QMP\":{\"version\":{\"qemu\":{\"major\":9}},\"capabilities\":[]}}\r\n");
+            std::string in;
+            char buf[16384];
+            while (running) {
+                pollfd p{fd, POLLIN, 0};
+                if (poll(&p, 1, 50) <= 0) continue;
+                ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+                if (n <= 0) return;
+                in.append(buf, static_cast<size_t>(n));
+                std::string out;
+                size_t start = 0, nl;
+                bool hang_up = false;
+                while ((nl = in.find('\n', start)) != std::string::npos) {
+                    JsonValue msg;
+                    bool parsed = parseJson(in.substr(start, nl - start), msg);
+                    start = nl + 1;
+                    if (!parsed) continue;
+                    std::string id = std::to_string(msg["id"].asUint());
+                    const std::string& execute = msg["execute"].string;
+                    if (execute == "qmp_capabilities") {
+                        out += "{\"return\":{},\"id\":" + id + "}\r\n";
+                        continue;
+                    }
+                    commands++;
+                    if (service_time.count() > 0) std::this_thread::sleep_for(service_time);
+                    if (behaviour == Silent) continue;
+                    if (behaviour == CloseOnCommand) {
+                        hang_up = true;
+                        break;
+                    }
+                    out += "{\"event\":\"RESUME\",\"timestamp\":{\"seconds\":1,\"microseconds\":0}}\r\n";
+                    std::string ret;
+                    if (behaviour == Error || (respond && !respond(execute, msg["arguments"], ret))) {
+                        out += "{\"error\":{\"class\":\"GenericError\",\"desc\":\"no " + execute + " here\"},\"id\":" +
+                               id + "}\r\n";
+                    } else if (respond) {
+                        out += "{\"return\":" + ret + ",\"id\":" + id + "}\r\n";
+                    } else {
+                        out += "{\"return\":{\"monitor\":" + jsonQuote(name) + ",\"execute\":" + jsonQuote(execute) +
+                               "},\"id\":" + id + "}\r\n";
+                    }
+                    if (behaviour == ReplyThenClose) {
+                        hang_up = true;
+                        break;
+                    }
+                }
+                in.erase(0, start);
+                if (!out.empty() && !sendAll(fd, out)) return;
+                if (hang_up) return;
+            }
+        }
+
+    public:
+        FakeQmpMonitor(const std::string& monitor, const std::string& socket_path, Behaviour b = Reply)
+            : name(monitor), path(socket_path), behaviour(b) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            unlink(path.c_str());
+            listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+                listen(listen_fd, 4) < 0) {
+                running = false;
+                return;
+            }
+            thread = std::thread([this] {
+                while (running) {
+                    pollfd p{listen_fd, POLLIN, 0};
+                    if (poll(&p, 1, 50) <= 0) continue;
+                    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (fd < 0) continue;
+                    serve(fd);
+                    close(fd);
+                    hang_ups++;
+                }
+            });
+        }
+
+        FakeQmpMonitor(const FakeQmpMonitor&) = delete;
+        FakeQmpMonitor& operator=(const FakeQmpMonitor&) = delete;
+
+        ~FakeQmpMonitor() {
+            running = false;
+            if (thread.joinable()) thread.join();
+            if (listen_fd >= 0) close(listen_fd);
+            unlink(path.c_str());
+        }
+
+        bool listening() const { return listen_fd >= 0 && thread.joinable(); }
+};
+
+#endif // FAKE_QMP_H
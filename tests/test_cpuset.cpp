@@ -0,0 +1,50 @@
+// Cpuset string parsing and formatting
+#include "cpuset.h"
+
+#include "check.h"
+
+static void testParse() {
+    CHECK(parseCpuset("0-3,8,^2") == std::set<unsigned>({0, 1, 3, 8}));
+    CHECK(parseCpuset("5") == std::set<unsigned>({5}));
+    CHECK(parseCpuset("2-2") == std::set<unsigned>({2}));
+    // sysfs lists end in a newline; empty items are skipped
+    CHECK(parseCpuset("1,3-4\n") == std::set<unsigned>({1, 3, 4}));
+    CHECK(parseCpuset("1,,2") == std::set<unsigned>({1, 2}));
+    CHECK(parseCpuset("").empty());
+    CHECK(parseCpuset("\n").empty());
+    CHECK(parseCpuset("0-8191").size() == 8192u);
+}
+
+static void testMalformed() {
+    // Open, reversed or doubled ranges
+    CHECK(parseCpuset("3-").empty());
+    CHECK(parseCpuset("-3").empty());
+    CHECK(parseCpuset("-").empty());
+    CHECK(parseCpuset("5-3").empty());
+    CHECK(parseCpuset("1-2-3").empty());
+    CHECK(parseCpuset("^").empty());
+    CHECK(parseCpuset("0,^").empty());
+    CHECK(parseCpuset("a").empty());
+    CHECK(parseCpuset("0-3,x").empty());
+    CHECK(parseCpuset("1 2").empty());
+    // Ids past the cpumask limit, including ones that overflow 32 or 64 bits
+    CHECK(parseCpuset("8192").empty());
+    CHECK(parseCpuset("0-4294967295").empty());
+    CHECK(parseCpuset("4294967296").empty());
+    CHECK(parseCpuset("99999999999999999999999").empty());
+}
+
+static void testFormat() {
+    CHECK_EQ(formatCpuset({}), std::string(""));
+    CHECK_EQ(formatCpuset({0, 1, 2, 3, 8, 10, 11}), std::string("0-3,8,10-11"));
+    std::set<unsigned> cpus = parseCpuset("0-3,8,10-11,^1");
+    CHECK_EQ(formatCpuset(cpus), std::string("0,2-3,8,10-11"));
+    CHECK(parseCpuset(formatCpuset(cpus)) == cpus);
+}
+
+int main() {
+    testParse();
+    testMalformed();
+    testFormat();
+    return checkResult();
+}
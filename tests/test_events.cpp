@@ -0,0 +1,131 @@
+// Event coalescing fold rules and batch triggers
+#include "events.h"
+
+#include "check.h"
+
+static DomainEvent event(const std::string& domain, int type) {
+    DomainEvent e;
+    e.domain = domain;
+    e.event = type;
+    e.received = std::chrono::steady_clock::now();
+    return e;
+}
+
+/**
+ * @brief Collects dispatched batches and lets the test wait for them.
+ */
+struct BatchLog {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::vector<DomainEvent>> batches;
+
+    EventBatchHandler handler() {
+        return [this](const std::vector<DomainEvent>& batch) {
+            std::lock_guard<std::mutex> lock(mutex);
+            batches.push_back(batch);
+            cv.notify_all();
+        };
+    }
+
+    bool waitFor(size_t count, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, timeout, [&] { return batches.size() >= count; });
+    }
+};
+
+static std::vector<DomainEvent> coalesce(const std::vector<DomainEvent>& events) {
+    EventCoalescer coalescer;
+    BatchLog log;
+    coalescer.subscribe(log.handler());
+    for (const auto& e : events) coalescer.push(e);
+    coalescer.flush();
+    return log.batches.empty() ? std::vector<DomainEvent>{} : log.batches[0];
+}
+
+static void testFoldRules() {
+    // Run-state transitions collapse into the latest one
+    auto out = coalesce({event("a", VIR_DOMAIN_EVENT_STARTED), event("a", VIR_DOMAIN_EVENT_SUSPENDED),
+                         event("a", VIR_DOMAIN_EVENT_RESUMED)});
+    CHECK_EQ(out.size(), 1u);
+    if (out.size() == 1) {
+        CHECK_EQ(out[0].event, static_cast<int>(VIR_DOMAIN_EVENT_RESUMED));
+        CHECK_EQ(out[0].coalesced, 2u);
+    }
+
+    // DEFINED + DEFINED fold into one
+    out = coalesce({event("a", VIR_DOMAIN_EVENT_DEFINED), event("a", VIR_DOMAIN_EVENT_DEFINED)});
+    CHECK_EQ(out.size(), 1u);
+    if (out.size() == 1) CHECK_EQ(out[0].coalesced, 1u);
+
+    // A crash is never folded away, even by the restart that follows it
+    out = coalesce({event("a", VIR_DOMAIN_EVENT_CRASHED), event("a", VIR_DOMAIN_EVENT_STARTED)});
+    CHECK_EQ(out.size(), 2u);
+    if (out.size() == 2) CHECK_EQ(out[0].event, static_cast<int>(VIR_DOMAIN_EVENT_CRASHED));
+
+    // An undefine is never folded, in either direction
+    out = coalesce({event("a", VIR_DOMAIN_EVENT_UNDEFINED), event("a", VIR_DOMAIN_EVENT_DEFINED)});
+    CHECK_EQ(out.size(), 2u);
+    out = coalesce({event("a", VIR_DOMAIN_EVENT_STOPPED), event("a", VIR_DOMAIN_EVENT_UNDEFINED),
+                    event("a", VIR_DOMAIN_EVENT_STOPPED)});
+    CHECK_EQ(out.size(), 3u);
+
+    // A definition change does not fold into a state transition
+    out = coalesce({event("a", VIR_DOMAIN_EVENT_STARTED), event("a", VIR_DOMAIN_EVENT_DEFINED)});
+    CHECK_EQ(out.size(), 2u);
+
+    // Domains are folded independently and keep arrival order
+    out = coalesce({event("a", VIR_DOMAIN_EVENT_STARTED), event("b", VIR_DOMAIN_EVENT_STARTED),
+                    event("a", VIR_DOMAIN_EVENT_STOPPED), event("c", VIR_DOMAIN_EVENT_DEFINED)});
+    CHECK_EQ(out.size(), 3u);
+    if (out.size() == 3) {
+        CHECK_EQ(out[0].domain, std::string("a"));
+        CHECK_EQ(out[0].event, static_cast<int>(VIR_DOMAIN_EVENT_STOPPED));
+        CHECK_EQ(out[1].domain, std::string("b"));
+        CHECK_EQ(out[2].domain, std::string("c"));
+    }
+}
+
+static void testMaxBatch() {
+    // A window far longer than the test: only the batch size can trigger dispatch
+    EventCoalescer coalescer(std::chrono::milliseconds(60000), 4);
+    BatchLog log;
+    coalescer.subscribe(log.handler());
+    coalescer.start();
+    for (int i = 0; i < 3; i++) coalescer.push(event("vm" + std::to_string(i), VIR_DOMAIN_EVENT_STARTED));
+    // Folded events do not count towards the batch size
+    coalescer.push(event("vm0", VIR_DOMAIN_EVENT_STOPPED));
+    CHECK(!log.waitFor(1, std::chrono::milliseconds(100)));
+    coalescer.push(event("vm3", VIR_DOMAIN_EVENT_STARTED));
+    CHECK(log.waitFor(1, std::chrono::milliseconds(5000)));
+    {
+        std::lock_guard<std::mutex> lock(log.mutex);
+        if (!log.batches.empty()) CHECK_EQ(log.batches[0].size(), 4u);
+    }
+    coalescer.stop();
+
+    EventStats stats = coalescer.stats();
+    CHECK_EQ(stats.received, 5u);
+    CHECK_EQ(stats.coalesced, 1u);
+    CHECK_EQ(stats.dispatched, 4u);
+    CHECK_EQ(stats.batches, 1u);
+}
+
+static void testWindow() {
+    EventCoalescer coalescer(std::chrono::milliseconds(20));
+    BatchLog log;
+    coalescer.subscribe(log.handler());
+    coalescer.start();
+    coalescer.push(event("vm", VIR_DOMAIN_EVENT_STARTED));
+    CHECK(log.waitFor(1, std::chrono::milliseconds(5000)));
+    coalescer.push(event("vm", VIR_DOMAIN_EVENT_STOPPED));
+    CHECK(log.waitFor(2, std::chrono::milliseconds(5000)));
+    coalescer.stop();
+    CHECK_EQ(coalescer.stats().coalesced, 0u);
+}
+
+int main() {
+    testFoldRules();
+    testMaxBatch();
+    testWindow();
+    return checkResult();
+}
@@ -0,0 +1,156 @@
+// Feature profile XML generation and capability filtering
+#include "spec.h"
+
+#include <algorithm>
+
+#include "check.h"
+
+static bool contains(const std::vector<std::string>& v, const std::string& s) {
+    return std::find(v.begin(), v.end(), s) != v.end();
+}
+
+static std::vector<std::string> hypervFeatures(const std::string& features_xml) {
+    std::vector<std::string> names;
+    std::string hyperv = xmlElement(features_xml, "hyperv");
+    size_t pos = hyperv.find('>');
+    while ((pos = hyperv.find('<', pos)) != std::string::npos && hyperv[pos + 1] != '/') {
+        size_t end = hyperv.find_first_of(" />", pos + 1);
+        names.push_back(hyperv.substr(pos + 1, end - pos - 1));
+        pos = end;
+    }
+    return names;
+}
+
+static std::string timerAttr(const std::string& clock_xml, const std::string& timer, const std::string& attr) {
+    for (const auto& t : xmlElements(clock_xml, "timer")) {
+        if (xmlAttr(t, "name") == timer) return xmlAttr(t, attr);
+    }
+    return "<missing>";
+}
+
+static void testGeneric() {
+    const FeatureProfile& p = findFeatureProfile("generic");
+    std::string features = buildFeaturesXML(p);
+    CHECK(!xmlElement(features, "acpi").empty());
+    CHECK(!xmlElement(features, "apic").empty());
+    CHECK(xmlElement(features, "hyperv").empty());
+    CHECK(xmlElement(features, "kvm").empty());
+    CHECK(xmlElement(features, "pmu").empty());
+    CHECK(buildClockXML(p).empty());
+
+    // Unknown and empty names fall back to generic
+    CHECK_EQ(findFeatureProfile("").name, std::string("generic"));
+    CHECK_EQ(findFeatureProfile("plan9").name, std::string("generic"));
+}
+
+static void testLinux() {
+    const FeatureProfile& p = findFeatureProfile("linux");
+    std::string features = buildFeaturesXML(p);
+    CHECK(xmlElement(features, "hyperv").empty());
+    std::string kvm = xmlElement(features, "kvm");
+    CHECK_EQ(xmlAttr(xmlElement(kvm, "poll-control"), "state"), std::string("on"));
+    CHECK_EQ(xmlAttr(xmlElement(kvm, "pv-ipi"), "state"), std::string("on"));
+    CHECK(xmlElement(kvm, "hidden").empty());
+    CHECK_EQ(xmlAttr(xmlElement(features, "pmu"), "state"), std::string("off"));
+
+    std::string clock = buildClockXML(p);
+    CHECK_EQ(xmlAttr(clock, "offset"), std::string("utc"));
+    CHECK_EQ(timerAttr(clock, "kvmclock", "present"), std::string("yes"));
+    CHECK_EQ(timerAttr(clock, "rtc", "tickpolicy"), std::string("catchup"));
+    CHECK_EQ(timerAttr(clock, "pit", "tickpolicy"), std::string("delay"));
+    CHECK_EQ(timerAttr(clock, "hpet", "present"), std::string("no"));
+    CHECK_EQ(timerAttr(clock, "hypervclock", "present"), std::string("<missing>"));
+}
+
+static void testWindows() {
+    for (const char* name : {"windows", "windows-gpu"}) {
+        const FeatureProfile& p = findFeatureProfile(name);
+        std::string features = buildFeaturesXML(p);
+        CHECK_EQ(xmlAttr(xmlElement(features, "hyperv"), "mode"), std::string("custom"));
+
+        // Every enlightenment follows the ones it depends on
+        std::vector<std::string> hv = hypervFeatures(features);
+        CHECK_EQ(hv.size(), p.hyperv.size());
+        auto at = [&](const std::string& f) { return std::find(hv.begin(), hv.end(), f) - hv.begin(); };
+        CHECK(at("vpindex") < at("synic"));
+        CHECK(at("synic") < at("stimer"));
+        CHECK(at("vpindex") < at("tlbflush"));
+        CHECK(at("vpindex") < at("ipi"));
+        CHECK_EQ(xmlAttr(xmlElement(features, "spinlocks"), "retries"), std::string("8191"));
+        CHECK_EQ(xmlAttr(xmlElement(features, "pmu"), "state"), std::string("off"));
+
+        std::string clock = buildClockXML(p);
+        CHECK_EQ(xmlAttr(clock, "offset"), std::string("localtime"));
+        CHECK_EQ(timerAttr(clock, "hypervclock", "present"), std::string("yes"));
+        CHECK_EQ(timerAttr(clock, "kvmclock", "present"), std::string("<missing>"));
+    }
+
+    // Only the GPU profile hides the KVM signature from vendor drivers
+    CHECK(xmlElement(buildFeaturesXML(findFeatureProfile("windows")), "kvm").empty());
+    std::string gpu = xmlElement(buildFeaturesXML(findFeatureProfile("windows-gpu")), "kvm");
+    CHECK_EQ(xmlAttr(xmlElement(gpu, "hidden"), "state"), std::string("on"));
+}
+
+static void testDomainXMLUsesProfile() {
+    VMSpec spec;
+    spec.name = "win";
+    spec.memory = 4096;
+    spec.vcpus = 4;
+    spec.profile = "windows";
+    std::string xml = buildDomainXML(spec, "kvm", "/usr/bin/qemu-system-x86_64", "/var/lib/win.qcow2");
+    CHECK_EQ(xmlElements(xml, "features").size(), 1u);
+    CHECK(!xmlElement(xmlElement(xml, "features"), "hyperv").empty());
+    CHECK_EQ(xmlAttr(xmlElement(xml, "clock"), "offset"), std::string("localtime"));
+}
+
+static const char* kvm_domcaps =
+    "<domainCapabilities><domain>kvm</domain><features>"
+    "<hyperv supported='yes'><enum name='features'>"
+    "<value>relaxed</value><value>vapic</value><value>spinlocks</value><value>runtime</value>"
+    "<value>synic</value><value>stimer</value><value>reset</value><value>frequencies</value>"
+    "<value>tlbflush</value><value>ipi</value>"
+    "</enum></hyperv></features></domainCapabilities>";
+
+static void testFilter() {
+    // vpindex is missing from the host's list: everything built on it goes too
+    std::vector<std::string> dropped;
+    FeatureProfile f = filterFeatureProfile(findFeatureProfile("windows"), kvm_domcaps, dropped);
+    CHECK(!contains(f.hyperv, "vpindex"));
+    CHECK(!contains(f.hyperv, "synic"));
+    CHECK(!contains(f.hyperv, "stimer"));
+    CHECK(!contains(f.hyperv, "tlbflush"));
+    CHECK(!contains(f.hyperv, "ipi"));
+    CHECK(contains(f.hyperv, "relaxed"));
+    CHECK(contains(f.hyperv, "spinlocks"));
+    CHECK(contains(dropped, "hyperv/vpindex"));
+    CHECK(contains(dropped, "hyperv/stimer"));
+    CHECK_EQ(dropped.size(), 5u);
+
+    // TCG: no Hyper-V, no KVM PV features, no paravirtual clocks
+    dropped.clear();
+    std::string tcg = "<domainCapabilities><domain>qemu</domain><features>"
+                      "<hyperv supported='no'/></features></domainCapabilities>";
+    FeatureProfile l = filterFeatureProfile(findFeatureProfile("linux"), tcg, dropped);
+    CHECK(l.kvm.empty());
+    CHECK(contains(dropped, "kvm/poll-control"));
+    CHECK(contains(dropped, "timer/kvmclock"));
+    std::string clock = buildClockXML(l);
+    CHECK_EQ(timerAttr(clock, "kvmclock", "present"), std::string("<missing>"));
+    CHECK_EQ(timerAttr(clock, "rtc", "tickpolicy"), std::string("catchup"));
+
+    dropped.clear();
+    FeatureProfile g = filterFeatureProfile(findFeatureProfile("windows-gpu"), tcg, dropped);
+    CHECK(g.hyperv.empty());
+    CHECK(!g.kvm_hidden);
+    CHECK(contains(dropped, "kvm/hidden"));
+    CHECK(xmlElement(buildFeaturesXML(g), "hyperv").empty());
+}
+
+int main() {
+    testGeneric();
+    testLinux();
+    testWindows();
+    testDomainXMLUsesProfile();
+    testFilter();
+    return checkResult();
+}
@@ -0,0 +1,132 @@
+// IOThread stats parsing and the polling controller driven by a synthetic latency / CPU headroom series
+#include "iothread.h"
+
+#include <cstdio>
+
+#include "check.h"
+
+static virTypedParameter param(const char* field, unsigned long long value) {
+    virTypedParameter p{};
+    std::snprintf(p.field, sizeof(p.field), "%s", field);
+    p.type = VIR_TYPED_PARAM_ULLONG;
+    p.value.ul = value;
+    return p;
+}
+
+static void testParse() {
+    std::vector<virTypedParameter> record = {
+        param("block.count", 2),
+        param("block.0.rd.reqs", 100),
+        param("block.0.rd.times", 1000000),
+        param("block.0.wr.reqs", 50),
+        param("block.0.wr.times", 2000000),
+        param("block.0.wr.bytes", 4096),
+        param("block.1.fl.reqs", 10),
+        param("block.1.fl.times", 500000),
+        param("block.1.allocation", 1 << 30),
+        param("iothread.count", 2),
+        param("iothread.1.poll-max-ns", 32768),
+        param("iothread.1.poll-grow", 2),
+        param("iothread.1.poll-shrink", 4),
+        param("iothread.2.poll-max-ns", 0),
+        param("iothread.x.poll-max-ns", 7),
+    };
+    BlockLatencySample s = parseBlockLatencyStats(record.data(), static_cast<int>(record.size()));
+    CHECK_EQ(s.requests, 160u);
+    CHECK_EQ(s.time_ns, 3500000u);
+    CHECK_EQ(s.iothreads.size(), 2u);
+    CHECK_EQ(s.iothreads[1].max_ns, 32768u);
+    CHECK_EQ(s.iothreads[1].grow, 2u);
+    CHECK_EQ(s.iothreads[1].shrink, 4u);
+    CHECK_EQ(s.iothreads[2].max_ns, 0u);
+
+    // Latency is per completed request over the interval, not since boot
+    BlockLatencySample next = s;
+    next.requests += 40;
+    next.time_ns += 20000000;
+    CHECK_EQ(computeBlockLatencyUs(s, next), 500.0);
+    CHECK(computeBlockLatencyUs(s, s) < 0);
+    CHECK(computeBlockLatencyUs(next, s) < 0);
+
+    HostCpuSample boot{750, 1000};
+    HostCpuSample later{800, 1200};
+    CHECK_EQ(computeHostIdle(nullptr, boot), 0.75);
+    CHECK_EQ(computeHostIdle(&boot, later), 0.25);
+    // A counter that went backwards falls back to the ratio since boot
+    CHECK_EQ(computeHostIdle(&later, boot), 0.75);
+    CHECK_EQ(computeHostIdle(nullptr, HostCpuSample{}), 0.0);
+}
+
+/**
+ * @brief One controller interval: block latency seen by the guest and host idle fraction.
+ */
+struct Interval {
+    double latency_us;  // negative: no I/O
+    double host_idle;
+    uint64_t expect_max_ns;
+};
+
+static void testController() {
+    PollingPolicy policy;
+    // Cumulative counters, advanced each interval the way the stats poll sees them
+    BlockLatencySample block_prev, block;
+    HostCpuSample cpu_prev, cpu;
+    IOThreadPolling polling;
+
+    const std::vector<Interval> series = {
+        {300, 0.60, 4096},    // slow I/O, idle host: start polling
+        {300, 0.60, 8192},
+        {250, 0.50, 16384},
+        {100, 0.50, 16384},   // within the band: hold
+        {-1, 0.50, 16384},    // no I/O: hold
+        {900, 0.60, 32768},
+        {900, 0.60, 65536},
+        {900, 0.60, 131072},
+        {900, 0.60, 256000},  // capped
+        {900, 0.60, 256000},
+        {900, 0.10, 128000},  // host short of CPU: back off even though I/O is slow
+        {900, 0.05, 64000},
+        {10, 0.60, 32000},    // fast I/O: relax
+        {10, 0.60, 16000},
+        {10, 0.60, 8000},
+        {10, 0.60, 0},        // below the smallest window: stop polling
+        {10, 0.60, 0},
+        {300, 0.10, 0},       // a busy host never starts polling
+    };
+    for (size_t i = 0; i < series.size(); i++) {
+        const Interval& interval = series[i];
+        block_prev = block;
+        cpu_prev = cpu;
+        if (interval.latency_us >= 0) {
+            block.requests += 1000;
+            block.time_ns += static_cast<uint64_t>(interval.latency_us * 1000 * 1000);
+        }
+        cpu.total_ns += 1000000000;
+        cpu.idle_ns += static_cast<uint64_t>(interval.host_idle * 1000000000);
+
+        double latency = computeBlockLatencyUs(block_prev, block);
+        double idle = computeHostIdle(&cpu_prev, cpu);
+        IOThreadPolling next = decideIOThreadPolling(polling, latency, idle, policy);
+        if (next.max_ns != interval.expect_max_ns) {
+            std::fprintf(stderr, "interval %zu: poll-max-ns %llu, expected %llu\n", i,
+                         static_cast<unsigned long long>(next.max_ns),
+                         static_cast<unsigned long long>(interval.expect_max_ns));
+        }
+        CHECK_EQ(next.max_ns, interval.expect_max_ns);
+        polling = next;
+    }
+
+    // Grow and shrink factors are left to whatever the iothread was configured with
+    IOThreadPolling tuned{4096, 2, 4};
+    IOThreadPolling next = decideIOThreadPolling(tuned, 500, 0.9, policy);
+    CHECK_EQ(next.max_ns, 8192u);
+    CHECK_EQ(next.grow, 2u);
+    CHECK_EQ(next.shrink, 4u);
+    CHECK(decideIOThreadPolling(tuned, 100, 0.9, policy) == tuned);
+}
+
+int main() {
+    testParse();
+    testController();
+    return checkResult();
+}
@@ -0,0 +1,191 @@
+// Operation journal torn tails, lost completions, failed flushes, group commit and checkpoints
+#include "journal.h"
+
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+#include "check.h"
+
+namespace fs = std::filesystem;
+
+static void appendRaw(const fs::path& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::app | std::ios::binary) << bytes;
+}
+
+static void testTornTail(const fs::path& dir) {
+    fs::path path = dir / "torn.journal";
+    {
+        OperationJournal journal;
+        CHECK(journal.open(path));
+        uint64_t a = journal.begin(JournalOp::Create, "a", "<domain/>");
+        CHECK(journal.begin(JournalOp::Start, "b") != 0);
+        CHECK(journal.begin(JournalOp::Undefine, "c", "<domain>\nmulti-line\n</domain>") != 0);
+        journal.complete(a, true);
+    }
+    uintmax_t clean = fs::file_size(path);
+
+    // A crash mid-write leaves a partial intent: open drops and truncates it
+    appendRaw(path, "I 9 0 1 40 12345\nd<dom");
+    {
+        OperationJournal journal;
+        CHECK(journal.open(path));
+        CHECK_EQ(fs::file_size(path), clean);
+        std::vector<JournalEntry> open = journal.inFlight();
+        CHECK_EQ(open.size(), 2u);
+        if (open.size() == 2) {
+            CHECK_EQ(open[0].domain, std::string("b"));
+            CHECK_EQ(open[1].payload, std::string("<domain>\nmulti-line\n</domain>"));
+        }
+        // Ids continue past the replayed ones, and the new intent lands after the cut
+        CHECK(journal.begin(JournalOp::Stop, "d") > open.back().id);
+    }
+    OperationJournal journal;
+    CHECK(journal.open(path));
+    CHECK_EQ(journal.inFlight().size(), 3u);
+}
+
+static void testLostCompletion(const fs::path& dir) {
+    fs::path path = dir / "lost.journal";
+    fs::path crashed = dir / "lost-crashed.journal";
+    OperationJournal journal;
+    CHECK(journal.open(path));
+    uint64_t op = journal.begin(JournalOp::Destroy, "vm");
+    CHECK(op != 0);
+    journal.complete(op, true);
+
+    // The completion is only buffered: a crash now leaves the intent open
+    fs::copy_file(path, crashed);
+    OperationJournal recovered;
+    CHECK(recovered.open(crashed));
+    std::vector<JournalEntry> open = recovered.inFlight();
+    CHECK_EQ(open.size(), 1u);
+    if (open.size() == 1) {
+        CHECK_EQ(open[0].id, op);
+        CHECK(open[0].op == JournalOp::Destroy);
+    }
+
+    // Once synced, the completion is on disk too
+    CHECK(journal.sync());
+    fs::path synced = dir / "lost-synced.journal";
+    fs::copy_file(path, synced);
+    OperationJournal later;
+    CHECK(later.open(synced));
+    CHECK(later.inFlight().empty());
+}
+
+static void testFailedFlush(const fs::path& dir) {
+    fs::path path = dir / "failed.journal";
+    OperationJournal journal;
+    CHECK(journal.open(path));
+    CHECK(journal.begin(JournalOp::Start, "before") != 0);
+    CHECK(journal.sync());
+    uintmax_t good = fs::file_size(path);
+
+    // Cap the file size so the next intent is written only partly
+    rlimit saved;
+    getrlimit(RLIMIT_FSIZE, &saved);
+    std::signal(SIGXFSZ, SIG_IGN);
+    rlimit capped = saved;
+    capped.rlim_cur = good + 64;
+    setrlimit(RLIMIT_FSIZE, &capped);
+    uint64_t failed = journal.begin(JournalOp::Create, "lost", std::string(4096, 'x'));
+    setrlimit(RLIMIT_FSIZE, &saved);
+    CHECK_EQ(failed, 0u);
+    CHECK_EQ(fs::file_size(path), good);
+
+    // The next flush rewrites the failed batch whole, closed by a failed completion
+    uint64_t after = journal.begin(JournalOp::Stop, "after");
+    CHECK(after != 0);
+    CHECK(journal.sync());
+    uintmax_t size = fs::file_size(path);
+
+    OperationJournal reopened;
+    CHECK(reopened.open(path));
+    CHECK_EQ(fs::file_size(path), size);
+    std::vector<JournalEntry> open = reopened.inFlight();
+    CHECK_EQ(open.size(), 2u);
+    if (open.size() == 2) {
+        CHECK_EQ(open[0].domain, std::string("before"));
+        CHECK_EQ(open[1].domain, std::string("after"));
+    }
+}
+
+static void testGroupCommit(const fs::path& dir) {
+    fs::path path = dir / "group.journal";
+    const int threads = 8, ops = 200;
+    {
+        OperationJournal journal;
+        CHECK(journal.open(path));
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&journal, t] {
+                for (int i = 0; i < ops; i++) {
+                    uint64_t id = journal.begin(JournalOp::Start, "vm" + std::to_string(t));
+                    if (id) journal.complete(id, true);
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+        JournalStats stats = journal.stats();
+        CHECK_EQ(stats.commits, static_cast<uint64_t>(threads * ops));
+        CHECK_EQ(stats.records, static_cast<uint64_t>(2 * threads * ops));
+        // Every intent waited for a sync, but never more than one sync per intent
+        CHECK(stats.syncs <= stats.commits);
+        CHECK(stats.recordsPerSync() >= 2.0);
+    }
+    OperationJournal journal;
+    CHECK(journal.open(path));
+    CHECK(journal.inFlight().empty());
+}
+
+static void testCheckpoint(const fs::path& dir) {
+    fs::path path = dir / "checkpoint.journal";
+    OperationJournal journal;
+    CHECK(journal.open(path));
+    journal.setCheckpointBytes(4096);
+
+    // An operation held open across many compactions survives them
+    uint64_t held = journal.begin(JournalOp::Migrate, "held", "qemu+ssh://dest/system");
+    for (int i = 0; i < 1000; i++) {
+        uint64_t id = journal.begin(JournalOp::Start, "vm" + std::to_string(i), std::string(64, 'p'));
+        journal.complete(id, true);
+    }
+    CHECK(journal.stats().checkpoints > 0);
+    CHECK(journal.size() < 8192);
+    CHECK(fs::file_size(path) < 8192);
+
+    fs::path crashed = dir / "checkpoint-crashed.journal";
+    CHECK(journal.sync());
+    fs::copy_file(path, crashed);
+    {
+        OperationJournal recovered;
+        CHECK(recovered.open(crashed));
+        std::vector<JournalEntry> open = recovered.inFlight();
+        CHECK_EQ(open.size(), 1u);
+        if (open.size() == 1) {
+            CHECK_EQ(open[0].id, held);
+            CHECK_EQ(open[0].payload, std::string("qemu+ssh://dest/system"));
+        }
+    }
+
+    // Once the held operation completes, an explicit checkpoint empties the file
+    journal.complete(held, true);
+    CHECK(journal.checkpoint());
+    CHECK_EQ(fs::file_size(path), 0u);
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("augustus-journal-" + std::to_string(getpid()));
+    fs::create_directories(dir);
+    testTornTail(dir);
+    testLostCompletion(dir);
+    testFailedFlush(dir);
+    testGroupCommit(dir);
+    testCheckpoint(dir);
+    fs::remove_all(dir);
+    return checkResult();
+}
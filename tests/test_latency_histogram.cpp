@@ -0,0 +1,188 @@
+// Latency histograms armed and collected over QMP against a fake QEMU block layer
+#include "latency_histogram.h"
+#include "qmp.h"
+
+#include <mutex>
+
+#include "check.h"
+#include "fake_qmp.h"
+
+/**
+ * @brief The part of QEMU's block layer the histograms come from, for one disk.
+ *
+ * `*_total_time_ns` counts from process start; the bins count from the last
+ * `block-latency-histogram-set`, which also (re)arms them.
+ */
+struct FakeBlockLayer {
+    std::mutex mutex;
+    std::string alias = "virtio-disk0";
+    uint64_t rd_total_ns = 0;
+    std::vector<uint64_t> boundaries;
+    std::vector<uint64_t> bins;  // empty: not armed
+
+    void read(uint64_t ns) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rd_total_ns += ns;
+        if (bins.empty()) return;
+        size_t bin = 0;
+        while (bin < boundaries.size() && ns >= boundaries[bin]) bin++;
+        bins[bin]++;
+    }
+
+    void restart() {
+        std::lock_guard<std::mutex> lock(mutex);
+        rd_total_ns = 0;
+        boundaries.clear();
+        bins.clear();
+    }
+
+    bool respond(const std::string& execute, const JsonValue& args, std::string& ret) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (execute == "block-latency-histogram-set") {
+            if (args["id"].string != alias) return false;
+            boundaries.clear();
+            for (const auto& b : args["boundaries"].array) boundaries.push_back(b.asUint());
+            bins.assign(boundaries.size() + 1, 0);
+            ret = "{}";
+            return true;
+        }
+        if (execute != "query-blockstats") return false;
+        auto list = [](const std::vector<uint64_t>& values) {
+            std::string out = "[";
+            for (size_t i = 0; i < values.size(); i++) out += (i ? "," : "") + std::to_string(values[i]);
+            return out + "]";
+        };
+        ret = "[{\"device\":\"\",\"qdev\":\"/machine/peripheral/" + alias + "/virtio-backend\",\"stats\":{" +
+              "\"rd_total_time_ns\":" + std::to_string(rd_total_ns) + ",\"wr_total_time_ns\":0,\"flush_total_time_ns\":0";
+        if (!bins.empty()) {
+            ret += ",\"rd_latency_histogram\":{\"boundaries\":" + list(boundaries) + ",\"bins\":" + list(bins) + "}";
+        }
+        ret += "}}]";
+        return true;
+    }
+};
+
+// What VMManager::applyLatencyHistograms() sends: one set per disk, then the query taking the baseline
+static bool arm(QmpMux& mux, const std::string& domain, const std::vector<HistogramDisk>& disks,
+                const LatencyHistogramConfig& config, std::map<std::string, HistogramBaseline>& baselines) {
+    std::vector<QmpCommand> commands;
+    for (const auto& d : disks) {
+        commands.push_back(QmpCommand{"block-latency-histogram-set", buildLatencyHistogramArguments(d.alias, config)});
+    }
+    commands.push_back(QmpCommand{"query-blockstats", ""});
+    std::vector<QmpReply> replies = mux.query(domain, commands, 2000);
+    if (replies.size() != commands.size()) return false;
+    for (const auto& r : replies) {
+        if (!r.ok) return false;
+    }
+    baselines = parseHistogramBaselines(replies.back().value);
+    return true;
+}
+
+static std::vector<DiskLatencyHistograms> collect(QmpMux& mux, const std::string& domain,
+                                                  const std::map<std::string, HistogramBaseline>& baselines) {
+    for (auto& r : mux.query(QmpCommand{"query-blockstats", ""}, 2000)) {
+        if (r.domain == domain && r.ok) return parseLatencyHistograms(r.value, baselines);
+    }
+    return {};
+}
+
+static void testSumCoversOnlyBinnedOperations(const std::string& dir) {
+    FakeBlockLayer block;
+    FakeQmpMonitor monitor("vm1", dir + "/vm1.qmp");
+    monitor.respond = [&](const std::string& execute, const JsonValue& args, std::string& ret) {
+        return block.respond(execute, args, ret);
+    };
+    FakeQmpMonitor other("vm2", dir + "/vm2.qmp");
+    QmpMux mux;
+    mux.add("vm1", dir + "/vm1.qmp");
+    mux.add("vm2", dir + "/vm2.qmp");
+    std::vector<HistogramDisk> disks = {{"vda", "virtio-disk0"}};
+
+    // A busy past before the histogram exists
+    for (int i = 0; i < 10; i++) block.read(1000000);
+    LatencyHistogramConfig config;
+    config.boundaries = {50000, 1000000};
+    std::map<std::string, HistogramBaseline> baselines;
+    CHECK(arm(mux, "vm1", disks, config, baselines));
+    CHECK_EQ(other.commands.load(), 0);  // configuring one domain leaves the other monitors alone
+    CHECK(mux.query("unknown", {QmpCommand{"query-blockstats", ""}}).empty());
+
+    for (int i = 0; i < 4; i++) block.read(20000);
+    block.read(2000000);
+    std::vector<DiskLatencyHistograms> got = collect(mux, "vm1", baselines);
+    CHECK_EQ(got.size(), 1u);
+    if (got.size() == 1) {
+        CHECK_EQ(histogramDiskName(got[0].device, disks), std::string("vda"));
+        CHECK_EQ(got[0].read.count(), 5u);
+        CHECK_EQ(got[0].read.sum_ns, 2080000u);
+        CHECK(got[0].write.empty());
+        CHECK((got[0].read.bins == std::vector<uint64_t>{4, 0, 1}));
+    }
+    // Without the baseline the sum carries the ten earlier reads the bins never saw
+    std::vector<DiskLatencyHistograms> lifetime = collect(mux, "vm1", {});
+    CHECK(lifetime.size() == 1 && lifetime[0].read.sum_ns == 12080000u);
+
+    // Re-arming resets the bins and takes a new baseline
+    CHECK(arm(mux, "vm1", disks, config, baselines));
+    block.read(30000);
+    got = collect(mux, "vm1", baselines);
+    CHECK(got.size() == 1 && got[0].read.count() == 1 && got[0].read.sum_ns == 30000u);
+
+    // After a QEMU restart the histogram is gone until it is armed again
+    block.restart();
+    block.read(40000);
+    CHECK(collect(mux, "vm1", baselines).empty());
+    CHECK(arm(mux, "vm1", disks, config, baselines));
+    block.read(60000);
+    got = collect(mux, "vm1", baselines);
+    CHECK(got.size() == 1 && got[0].read.count() == 1 && got[0].read.sum_ns == 60000u);
+
+    // Totals below a stale baseline restarted from zero and are taken whole
+    std::map<std::string, HistogramBaseline> stale = baselines;
+    for (auto& [device, b] : stale) b.read_ns = 1ull << 40;
+    got = collect(mux, "vm1", stale);
+    CHECK(got.size() == 1 && got[0].read.sum_ns == 100000u);
+
+    // A disk QEMU does not know fails the set
+    std::vector<HistogramDisk> wrong = {{"vdb", "virtio-disk9"}};
+    CHECK(!arm(mux, "vm1", wrong, config, baselines));
+}
+
+static void testQuantilesAndExposition() {
+    LatencyHistogram prev{{100, 1000}, {5, 5, 0}, 3000};
+    LatencyHistogram cur{{100, 1000}, {5, 15, 10}, 30000};
+    LatencyHistogram d = diffLatencyHistogram(prev, cur);
+    CHECK((d.bins == std::vector<uint64_t>{0, 10, 10}));
+    CHECK_EQ(d.sum_ns, 27000u);
+    CHECK_EQ(latencyQuantileNs(d, 0.25), 550.0);
+    CHECK_EQ(latencyQuantileNs(d, 0.99), 1000.0);  // in the unbounded bin: its lower boundary
+    CHECK(latencyQuantileNs(LatencyHistogram{{100}, {0, 0}, 0}, 0.5) < 0);
+    // A reset (bins went backwards) yields the current histogram as is
+    CHECK((diffLatencyHistogram(cur, prev).bins == prev.bins));
+
+    std::map<std::string, std::vector<DiskLatencyHistograms>> all;
+    DiskLatencyHistograms disk;
+    disk.device = "vda";
+    disk.read = d;
+    all["web\"1"].push_back(disk);
+    std::string text = formatLatencyMetrics(all);
+    CHECK(text.find("augustus_block_latency_seconds_bucket{domain=\"web\\\"1\",device=\"vda\",op=\"read\",le=\"0.000001\"} 10\n") !=
+          std::string::npos);
+    CHECK(text.find("le=\"+Inf\"} 20\n") != std::string::npos);
+    CHECK(text.find("_sum{domain=\"web\\\"1\",device=\"vda\",op=\"read\"} 0.000027\n") != std::string::npos);
+    CHECK(text.find("op=\"write\"") == std::string::npos);
+}
+
+int main() {
+    char tmpl[] = "/tmp/augustus-histogram-XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    if (!dir) {
+        std::cerr << "Failed to create a socket directory\n";
+        return 1;
+    }
+    testSumCoversOnlyBinnedOperations(dir);
+    testQuantilesAndExposition();
+    rmdir(dir);
+    return checkResult();
+}
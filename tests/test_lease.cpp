@@ -0,0 +1,77 @@
+// TimerWheel expiry order and cancellation against a brute-force deadline table
+#include "lease.h"
+
+#include <map>
+#include <set>
+#include <random>
+
+#include "check.h"
+
+static void testMatchesBruteForce() {
+    std::mt19937_64 rng(17);
+    TimerWheel wheel(1000);
+    std::map<std::string, uint64_t> deadlines;  // name -> deadline tick
+    uint64_t now = 1000;
+    wheel.advance(now);
+    // Deadlines span all four levels
+    std::uniform_int_distribution<uint64_t> ttl(0, 1ull << 36);
+    for (int step = 0; step < 2000; step++) {
+        for (int i = 0; i < 20; i++) {
+            std::string name = "vm" + std::to_string(rng() % 5000);
+            uint64_t deadline = now + (i % 4 == 0 ? ttl(rng) : ttl(rng) % 100000);
+            wheel.schedule(name, deadline, now);
+            deadlines[name] = (deadline + 999) / 1000;
+        }
+        std::string victim = "vm" + std::to_string(rng() % 5000);
+        CHECK_EQ(wheel.cancel(victim), deadlines.erase(victim) > 0);
+
+        now += rng() % (step % 100 == 99 ? (1ull << 33) : 50000);
+        std::vector<std::string> fired = wheel.advance(now);
+        std::set<std::string> want;
+        for (auto it = deadlines.begin(); it != deadlines.end();) {
+            if (it->second <= now / 1000) {
+                want.insert(it->first);
+                it = deadlines.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        CHECK_EQ(std::set<std::string>(fired.begin(), fired.end()).size(), fired.size());
+        CHECK(std::set<std::string>(fired.begin(), fired.end()) == want);
+        CHECK_EQ(wheel.size(), deadlines.size());
+    }
+}
+
+static void testLeaseMetadata() {
+    Lease lease{"vm1", 1700000000123ull, 30000, "uuid"};
+    Lease back;
+    CHECK(parseLeaseMetadata("<augustus>" + buildLeaseMetadata(lease) + "</augustus>", back));
+    CHECK_EQ(back.expires_ms, lease.expires_ms);
+    CHECK_EQ(back.ttl_ms, lease.ttl_ms);
+    CHECK(!parseLeaseMetadata("<augustus><tenant name='t'/></augustus>", back));
+}
+
+static void testRetryBackoff() {
+    // Failed teardowns back off from one second, doubling up to a minute
+    CHECK_EQ(leaseRetryDelayMs(1), 1000u);
+    CHECK_EQ(leaseRetryDelayMs(2), 2000u);
+    CHECK_EQ(leaseRetryDelayMs(6), 32000u);
+    CHECK_EQ(leaseRetryDelayMs(7), 60000u);
+    CHECK_EQ(leaseRetryDelayMs(1000), 60000u);
+
+    // A retry reschedules the same name, replacing its timer
+    TimerWheel wheel(1000);
+    wheel.advance(10000);
+    wheel.schedule("vm", 10000, 10000);
+    CHECK_EQ(wheel.advance(11000).size(), 1u);
+    wheel.schedule("vm", 11000 + leaseRetryDelayMs(1), 11000);
+    CHECK(wheel.advance(11500).empty());
+    CHECK_EQ(wheel.advance(12000).size(), 1u);
+}
+
+int main() {
+    testMatchesBruteForce();
+    testLeaseMetadata();
+    testRetryBackoff();
+    return checkResult();
+}
@@ -0,0 +1,91 @@
+// LXC system container domain XML: init, root filesystem and resource limits
+#include "spec.h"
+#include "xml.h"
+
+#include "check.h"
+
+static VMSpec containerSpec() {
+    VMSpec spec;
+    spec.name = "web-1";
+    spec.memory = 256;
+    spec.vcpus = 2;
+    spec.type = LXC;
+    LxcSpec lxc;
+    lxc.root_dir = "/var/lib/containers/web-1/rootfs";
+    spec.lxc = lxc;
+    return spec;
+}
+
+static void testDefaults() {
+    std::string xml = buildLXCDomainXML(containerSpec());
+    CHECK_EQ(xmlAttr(xml, "type"), std::string("lxc"));
+    CHECK_EQ(xmlChildText(xml, "name"), std::string("web-1"));
+    std::string memory = xmlElement(xml, "memory");
+    CHECK_EQ(xmlAttr(memory, "unit"), std::string("MiB"));
+    CHECK_EQ(xmlText(memory), std::string("256"));
+    CHECK_EQ(xmlChildText(xml, "vcpu"), std::string("2"));
+
+    // Containers boot an executable, not a kernel
+    std::string os = xmlElement(xml, "os");
+    CHECK_EQ(xmlChildText(os, "type"), std::string("exe"));
+    CHECK_EQ(xmlChildText(os, "init"), std::string("/sbin/init"));
+    CHECK(xmlElements(os, "initarg").empty());
+    CHECK(xmlElement(xml, "disk").empty());
+    CHECK(xmlElement(xml, "emulator").empty());
+
+    // The host directory is mounted as the container's root
+    std::vector<std::string> filesystems = xmlElements(xml, "filesystem");
+    CHECK_EQ(filesystems.size(), 1u);
+    CHECK_EQ(xmlAttr(filesystems[0], "type"), std::string("mount"));
+    CHECK_EQ(xmlAttr(xmlElement(filesystems[0], "source"), "dir"), std::string("/var/lib/containers/web-1/rootfs"));
+    CHECK_EQ(xmlAttr(xmlElement(filesystems[0], "target"), "dir"), std::string("/"));
+}
+
+static void testLimits() {
+    VMSpec spec = containerSpec();
+    spec.vcpus = 3;
+    spec.memory = 1536;
+    spec.lxc->cpu_shares = 512;
+    std::string xml = buildLXCDomainXML(spec);
+
+    // vCPUs become a CFS quota of that many full periods
+    std::string cputune = xmlElement(xml, "cputune");
+    CHECK_EQ(xmlChildText(cputune, "shares"), std::string("512"));
+    CHECK_EQ(xmlChildText(cputune, "period"), std::string("100000"));
+    CHECK_EQ(xmlChildText(cputune, "quota"), std::string("300000"));
+
+    // Memory is a hard cgroup limit equal to the container's memory
+    std::string hard_limit = xmlElement(xmlElement(xml, "memtune"), "hard_limit");
+    CHECK_EQ(xmlAttr(hard_limit, "unit"), std::string("MiB"));
+    CHECK_EQ(xmlText(hard_limit), std::string("1536"));
+}
+
+static void testInitAndEscaping() {
+    VMSpec spec = containerSpec();
+    spec.name = "a&b";
+    spec.lxc->init = "/usr/bin/env";
+    spec.lxc->init_args = {"FOO=<bar>", "/app/server", "--listen='0.0.0.0'"};
+    spec.lxc->root_dir = "/srv/a&b";
+    std::string xml = buildLXCDomainXML(spec);
+
+    std::string os = xmlElement(xml, "os");
+    CHECK_EQ(xmlChildText(os, "init"), std::string("/usr/bin/env"));
+    std::vector<std::string> args = xmlElements(os, "initarg");
+    CHECK_EQ(args.size(), 3u);
+    if (args.size() == 3) {
+        // Arguments keep their order and are escaped
+        CHECK_EQ(xmlText(args[0]), std::string("FOO=&lt;bar&gt;"));
+        CHECK_EQ(xmlText(args[1]), std::string("/app/server"));
+    }
+    CHECK(xml.find("<bar>") == std::string::npos);
+    CHECK(xml.find("'0.0.0.0'") == std::string::npos);
+    CHECK_EQ(xmlChildText(xml, "name"), std::string("a&amp;b"));
+    CHECK_EQ(xmlAttr(xmlElement(xml, "source"), "dir"), std::string("/srv/a&amp;b"));
+}
+
+int main() {
+    testDefaults();
+    testLimits();
+    testInitAndEscaping();
+    return checkResult();
+}
@@ -0,0 +1,109 @@
+// Metering pipeline accounting and usage log torn-tail handling
+#include "metering.h"
+
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+#include "check.h"
+
+namespace fs = std::filesystem;
+
+static MeterBucket bucket(const std::string& tenant, uint64_t start, uint64_t cpu_ns) {
+    MeterBucket b;
+    b.tenant = tenant;
+    b.start_ms = start;
+    b.interval_ms = 3600000;
+    b.usage.cpu_ns = cpu_ns;
+    b.usage.memory_kib_ms = cpu_ns * 3;
+    return b;
+}
+
+static void appendRaw(const fs::path& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::app | std::ios::binary) << bytes;
+}
+
+static void testTornTail(const fs::path& dir) {
+    fs::path log = dir / "usage.log";
+    CHECK(appendMeterBuckets(log, {bucket("acme", 0, 1), bucket("globex", 0, 2), bucket("acme", 3600000, 3)}));
+    uintmax_t clean = fs::file_size(log);
+
+    // A crash mid-write leaves a partial record: loading drops and truncates it
+    appendRaw(log, "U 7200000 3600000 4 12 0 0 4 123");
+    std::vector<MeterBucket> loaded;
+    CHECK(loadMeterBuckets(log, loaded));
+    CHECK_EQ(loaded.size(), 3u);
+    CHECK_EQ(fs::file_size(log), clean);
+
+    // Appending after a torn tail truncates it first, so the new records stay reachable
+    appendRaw(log, "U 7200000 36");
+    CHECK(appendMeterBuckets(log, {bucket("initech", 7200000, 5)}));
+    loaded.clear();
+    CHECK(loadMeterBuckets(log, loaded));
+    CHECK_EQ(loaded.size(), 4u);
+    if (loaded.size() == 4) {
+        CHECK_EQ(loaded[3].tenant, std::string("initech"));
+        CHECK_EQ(loaded[3].usage.memory_kib_ms, 15u);
+    }
+
+    // A record with a bad checksum ends the valid prefix
+    appendRaw(log, "U 1 2 3 4 5 6 1 999\nx\n");
+    loaded.clear();
+    CHECK(loadMeterBuckets(log, loaded));
+    CHECK_EQ(loaded.size(), 4u);
+}
+
+static void testTailWindow(const fs::path& dir) {
+    // Tenant names containing record-like text must not confuse the tail scan
+    fs::path log = dir / "window.log";
+    std::vector<MeterBucket> buckets;
+    for (int i = 0; i < 50; i++) buckets.push_back(bucket("t\nU 1 2 3 " + std::to_string(i), i * 3600000ull, i));
+    CHECK(appendMeterBuckets(log, buckets));
+    std::string torn = "U 99 3600000 1 1";
+    appendRaw(log, torn);
+    uintmax_t size = fs::file_size(log);
+    int fd = ::open(log.c_str(), O_RDONLY);
+    for (size_t window : {16u, 64u, 200u, 100000u}) {
+        size_t valid = 0;
+        CHECK(meterLogValidEnd(fd, size, valid, window));
+        CHECK_EQ(valid, size - torn.size());
+    }
+    ::close(fd);
+}
+
+static void testPipelineRestart() {
+    MeteringPipeline pipeline(1000, 500);
+    MeterSample s;
+    s.vm = "vm1";
+    s.tenant = "acme";
+    s.instance = 1;
+    s.memory_kib = 1024;
+    s.timestamp_ms = 0;
+    s.cpu_ns = 100;
+    pipeline.consume(s);  // baseline
+    s.timestamp_ms = 1500;
+    s.cpu_ns = 400;
+    pipeline.consume(s);  // 300 ns over two buckets, 2/3 and 1/3
+    s.instance = 2;       // restarted: counter is usage since the restart
+    s.timestamp_ms = 2000;
+    s.cpu_ns = 50;
+    pipeline.consume(s);
+    std::vector<MeterBucket> closed = pipeline.closeBuckets(2000);
+    CHECK_EQ(closed.size(), 2u);
+    if (closed.size() == 2) {
+        CHECK_EQ(closed[0].usage.cpu_ns, 200u);
+        CHECK_EQ(closed[1].usage.cpu_ns, 100u + 50u);
+        CHECK_EQ(closed[0].usage.memory_kib_ms, 1024u * 1000);
+        CHECK_EQ(closed[1].usage.memory_kib_ms, 1024u * 1000);
+    }
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("augustus-metering-" + std::to_string(getpid()));
+    fs::create_directories(dir);
+    testTornTail(dir);
+    testTailWindow(dir);
+    testPipelineRestart();
+    fs::remove_all(dir);
+    return checkResult();
+}
@@ -0,0 +1,80 @@
+// NUMA usage from a fake /proc tree, CPU maps around reserved cores, and rebalance planning
+#include "numa_locality.h"
+
+#include <filesystem>
+#include <unistd.h>
+
+#include "check.h"
+
+namespace fs = std::filesystem;
+
+static void writeFile(const fs::path& path, const std::string& content) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path) << content;
+}
+
+static void testFakeProc(const fs::path& root) {
+    fs::path proc = root / "proc", run = root / "run";
+    writeFile(run / "vm1.pid", "4242\n");
+    writeFile(run / "bad.pid", "not-a-pid\n");
+    // 1 GiB of 2 MiB pages on node 1, 256 MiB of 4 KiB pages split over nodes 0 and 1
+    writeFile(proc / "4242" / "numa_maps",
+              "7f0000000000 bind:1 file=/dev/hugepages/libvirt/qemu/vm1 huge dirty=512 N1=512 kernelpagesize_kB=2048\n"
+              "7f8000000000 default anon=65536 dirty=65536 N0=32768 N1=32768 kernelpagesize_kB=4\n"
+              "7fff00000000 default stack anon=3 dirty=3\n");
+
+    CHECK_EQ(readQemuPid("vm1", run.string()), 4242);
+    CHECK_EQ(readQemuPid("bad", run.string()), -1);
+    CHECK_EQ(readQemuPid("missing", run.string()), -1);
+
+    NumaUsage usage;
+    CHECK(readNumaMaps(4242, usage, proc.string()));
+    CHECK_EQ(usage.node_kib[0], 128ull * 1024);
+    CHECK_EQ(usage.node_kib[1], 1024ull * 1024 + 128 * 1024);
+    CHECK_EQ(usage.home_node, 1);
+    CHECK_EQ(usage.remote_kib, 128ull * 1024);
+    CHECK(!readNumaMaps(4243, usage, proc.string()));
+}
+
+static void testCpuMapSkipsReservedCores() {
+    NumaNode node;
+    node.id = 1;
+    node.cpus = {8, 9, 10, 11, 12};
+    std::vector<unsigned char> map = numaNodeCpuMap(node, 16, {9, 11});
+    CHECK_EQ(map.size(), 2u);
+    CHECK_EQ(static_cast<int>(map[0]), 0);
+    CHECK_EQ(static_cast<int>(map[1]), (1 << 0) | (1 << 2) | (1 << 4));
+    // CPUs beyond the map are dropped; a node left with none gives no map
+    CHECK_EQ(static_cast<int>(numaNodeCpuMap(node, 10, {})[1]), 0x3);
+    CHECK(numaNodeCpuMap(node, 16, {8, 9, 10, 11, 12}).empty());
+}
+
+static void testPlanWithinBudget() {
+    std::map<std::string, NumaUsage> usage;
+    auto spread = [](uint64_t n0, uint64_t n1) {
+        std::string maps = "a N0=" + std::to_string(n0 / 4) + " N1=" + std::to_string(n1 / 4) + "\n";
+        return parseNumaMaps(maps);
+    };
+    usage["mostly-local"] = spread(1 << 20, 16 << 10);
+    usage["half"] = spread(1 << 20, 1 << 20);
+    usage["big"] = spread(6 << 20, 3 << 20);
+    std::vector<NumaNode> nodes = {NumaNode{0, 8ull << 20, {0, 1}}, NumaNode{1, 8ull << 20, {2, 3}}};
+    NumaLocalityPolicy policy;
+    policy.budget_kib = 2ull << 20;
+    std::vector<NumaMove> moves = planNumaRebalance(usage, nodes, policy);
+    // "half" is worst and moves 1 GiB; "big" needs 3 GiB, more than the budget left
+    CHECK_EQ(moves.size(), 1u);
+    if (!moves.empty()) {
+        CHECK_EQ(moves[0].vm, std::string("half"));
+        CHECK_EQ(moves[0].move_kib, 1ull << 20);
+    }
+}
+
+int main() {
+    fs::path root = fs::temp_directory_path() / ("augustus-numa-" + std::to_string(getpid()));
+    testFakeProc(root);
+    testCpuMapSkipsReservedCores();
+    testPlanWithinBudget();
+    fs::remove_all(root);
+    return checkResult();
+}
@@ -0,0 +1,119 @@
+// Perf counter extraction from synthetic bulk-stats records and derived IPC / miss-rate metrics
+#include "perf.h"
+
+#include <cstdio>
+
+#include "check.h"
+
+static virTypedParameter param(const char* field, int type, unsigned long long value) {
+    virTypedParameter p{};
+    std::snprintf(p.field, sizeof(p.field), "%s", field);
+    p.type = type;
+    switch (type) {
+        case VIR_TYPED_PARAM_INT: p.value.i = static_cast<int>(value); break;
+        case VIR_TYPED_PARAM_UINT: p.value.ui = static_cast<unsigned>(value); break;
+        case VIR_TYPED_PARAM_LLONG: p.value.l = static_cast<long long>(value); break;
+        default: p.value.ul = value; break;
+    }
+    return p;
+}
+
+static PerfSample sample(unsigned long long instructions, unsigned long long cycles,
+                         unsigned long long references, unsigned long long misses) {
+    std::vector<virTypedParameter> record = {
+        param("perf.instructions", VIR_TYPED_PARAM_ULLONG, instructions),
+        param("perf.cpu_cycles", VIR_TYPED_PARAM_ULLONG, cycles),
+        param("perf.cache_references", VIR_TYPED_PARAM_ULLONG, references),
+        param("perf.cache_misses", VIR_TYPED_PARAM_ULLONG, misses),
+    };
+    return parsePerfStats(record.data(), static_cast<int>(record.size()));
+}
+
+static void testParse() {
+    char text[] = "on";
+    virTypedParameter str = param("perf.cmt", VIR_TYPED_PARAM_STRING, 0);
+    str.value.s = text;
+    // Other stats groups share the record; every integer width is accepted
+    std::vector<virTypedParameter> record = {
+        param("state.state", VIR_TYPED_PARAM_INT, 1),
+        param("perf.instructions", VIR_TYPED_PARAM_ULLONG, 5000000000ull),
+        param("perf.cpu_cycles", VIR_TYPED_PARAM_LLONG, 4000000000ull),
+        param("perf.cache_references", VIR_TYPED_PARAM_UINT, 70000),
+        param("perf.cache_misses", VIR_TYPED_PARAM_INT, 7000),
+        str,
+        param("cpu.time", VIR_TYPED_PARAM_ULLONG, 123),
+    };
+    PerfSample s = parsePerfStats(record.data(), static_cast<int>(record.size()));
+    CHECK_EQ(s.counters.size(), 4u);
+    CHECK_EQ(s.get(VIR_PERF_PARAM_INSTRUCTIONS), 5000000000ull);
+    CHECK_EQ(s.get(VIR_PERF_PARAM_CPU_CYCLES), 4000000000ull);
+    CHECK_EQ(s.get(VIR_PERF_PARAM_CACHE_REFERENCES), 70000u);
+    CHECK_EQ(s.get(VIR_PERF_PARAM_CACHE_MISSES), 7000u);
+    CHECK(!s.has("cmt"));
+    CHECK(!s.has("time"));
+    CHECK(parsePerfStats(nullptr, 0).counters.empty());
+}
+
+static void testMetrics() {
+    PerfSample prev = sample(1000, 2000, 100, 10);
+    PerfSample cur = sample(4000, 4000, 300, 60);
+    PerfMetrics m = computePerfMetrics(&prev, cur);
+    CHECK_EQ(m.instructions, 3000u);
+    CHECK_EQ(m.cpu_cycles, 2000u);
+    CHECK(m.has_ipc);
+    CHECK_EQ(m.ipc, 1.5);
+    CHECK(m.has_miss_rate);
+    CHECK_EQ(m.cache_miss_rate, 0.25);
+    CHECK_EQ(m.mpki, 1000.0 * 50 / 3000);
+    CHECK(!m.has_mem_bandwidth);
+
+    // Without a previous sample the totals since enablement are used
+    m = computePerfMetrics(nullptr, prev);
+    CHECK_EQ(m.ipc, 0.5);
+    CHECK_EQ(m.cache_miss_rate, 0.1);
+
+    // A counter that went backwards was reset: its current value is the delta
+    PerfSample restarted = sample(600, 300, 50, 5);
+    m = computePerfMetrics(&cur, restarted);
+    CHECK_EQ(m.instructions, 600u);
+    CHECK_EQ(m.ipc, 2.0);
+    CHECK_EQ(m.cache_miss_rate, 0.1);
+}
+
+static void testZeroGuards() {
+    // An idle interval: no cycles, references or instructions elapsed
+    PerfSample prev = sample(1000, 2000, 100, 10);
+    PerfMetrics m = computePerfMetrics(&prev, prev);
+    CHECK(!m.has_ipc);
+    CHECK_EQ(m.ipc, 0.0);
+    CHECK(!m.has_miss_rate);
+    CHECK_EQ(m.cache_miss_rate, 0.0);
+    CHECK_EQ(m.mpki, 0.0);
+
+    // Instructions retired but no cycles counted (multiplexed out), and misses without references
+    PerfSample cur = sample(5000, 2000, 100, 20);
+    m = computePerfMetrics(&prev, cur);
+    CHECK(!m.has_ipc);
+    CHECK(!m.has_miss_rate);
+    CHECK_EQ(m.mpki, 1000.0 * 10 / 4000);
+
+    // Events that were not collected leave their metrics unset
+    std::vector<virTypedParameter> record = {
+        param("perf.instructions", VIR_TYPED_PARAM_ULLONG, 100),
+        param("perf.mbmt", VIR_TYPED_PARAM_ULLONG, 1 << 20),
+    };
+    m = computePerfMetrics(nullptr, parsePerfStats(record.data(), static_cast<int>(record.size())));
+    CHECK(!m.has_ipc);
+    CHECK(!m.has_miss_rate);
+    CHECK_EQ(m.mpki, 0.0);
+    CHECK(m.has_mem_bandwidth);
+    CHECK_EQ(m.mem_bandwidth_total, 1u << 20);
+    CHECK_EQ(m.mem_bandwidth_local, 0u);
+}
+
+int main() {
+    testParse();
+    testMetrics();
+    testZeroGuards();
+    return checkResult();
+}
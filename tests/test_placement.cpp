@@ -0,0 +1,110 @@
+// Affinity rules and re-placement in PlacementScheduler
+#include "placement.h"
+
+#include "check.h"
+
+static FleetHost makeHost(const std::string& uri, const std::string& rack, const std::string& zone) {
+    FleetHost h;
+    h.uri = uri;
+    h.rack = rack;
+    h.zone = zone;
+    h.memory_kib = 64ull << 20;
+    h.cpus = 32;
+    return h;
+}
+
+static FleetVM makeVM(const std::string& name, const std::string& app) {
+    FleetVM vm;
+    vm.name = name;
+    vm.memory_kib = 4ull << 20;
+    vm.vcpus = 2;
+    vm.labels["app"] = app;
+    return vm;
+}
+
+static void testAntiAffinityPerRack() {
+    FleetModel fleet;
+    fleet.upsertHost(makeHost("h1", "r1", "z1"));
+    fleet.upsertHost(makeHost("h2", "r1", "z1"));
+    fleet.upsertHost(makeHost("h3", "r2", "z1"));
+    PlacementScheduler sched;
+    std::string error;
+    CHECK(sched.addRule(AffinityRule{"db-spread", "app", "db", AffinityType::AntiAffinity, "rack", 1, true}, error));
+    sched.rebuild(fleet);
+
+    std::string a = sched.place(fleet, makeVM("db1", "db"), error);
+    std::string b = sched.place(fleet, makeVM("db2", "db"), error);
+    CHECK(!a.empty() && !b.empty());
+    CHECK(fleet.host(a)->rack != fleet.host(b)->rack);
+    CHECK(sched.place(fleet, makeVM("db3", "db"), error).empty());
+    CHECK(error.find("db-spread") != std::string::npos);
+
+    // Re-placing db1 may stay in its own rack, whatever host the caller passes
+    FleetVM again = makeVM("db1", "db");
+    again.host = "stale";
+    PlacedVM current{fleet.vm("db1"), fleet.host(fleet.vm("db1")->host)};
+    std::vector<size_t> applicable = sched.rulesFor(again);
+    for (const auto& [uri, h] : fleet.getHosts()) {
+        bool own_rack = h.rack == fleet.host(a)->rack;
+        CHECK_EQ(sched.allowed(h, applicable, current), own_rack);
+        // As a new VM it would be a second member in either rack
+        CHECK(!sched.allowed(h, applicable));
+    }
+    std::string moved = sched.place(fleet, again, error);
+    CHECK_EQ(fleet.host(moved)->rack, fleet.host(a)->rack);
+    CHECK_EQ(fleet.getVMs().size(), 2u);
+}
+
+static void testAffinityPerZone() {
+    FleetModel fleet;
+    fleet.upsertHost(makeHost("h1", "r1", "z1"));
+    fleet.upsertHost(makeHost("h2", "r2", "z1"));
+    fleet.upsertHost(makeHost("h3", "r3", "z2"));
+    PlacementScheduler sched;
+    std::string error;
+    CHECK(sched.addRule(AffinityRule{"web-zone", "app", "web", AffinityType::Affinity, "zone", 1, true}, error));
+    sched.rebuild(fleet);
+
+    std::string first = sched.place(fleet, makeVM("web1", "web"), error);
+    CHECK(!first.empty());
+    std::string second = sched.place(fleet, makeVM("web2", "web"), error);
+    CHECK_EQ(fleet.host(second)->zone, fleet.host(first)->zone);
+
+    // A lone member being re-placed is not bound to its own zone
+    FleetModel solo;
+    solo.upsertHost(makeHost("h1", "r1", "z1"));
+    solo.upsertHost(makeHost("h3", "r3", "z2"));
+    PlacementScheduler s2;
+    CHECK(s2.addRule(AffinityRule{"web-zone", "app", "web", AffinityType::Affinity, "zone", 1, true}, error));
+    s2.rebuild(solo);
+    CHECK(!s2.place(solo, makeVM("web1", "web"), error).empty());
+    PlacedVM current{solo.vm("web1"), solo.host(solo.vm("web1")->host)};
+    std::vector<size_t> applicable = s2.rulesFor(*solo.vm("web1"));
+    for (const auto& [uri, h] : solo.getHosts()) CHECK(s2.allowed(h, applicable, current));
+}
+
+static void testRelabelledVMIsNotDiscounted() {
+    // db1 is only counted under app=db: relabelled app=cache, nothing is discounted from the cache rule
+    FleetModel fleet;
+    fleet.upsertHost(makeHost("h1", "r1", "z1"));
+    fleet.upsertHost(makeHost("h2", "r2", "z1"));
+    PlacementScheduler sched;
+    std::string error;
+    CHECK(sched.addRule(AffinityRule{"cache-spread", "app", "cache", AffinityType::AntiAffinity, "host", 1, true},
+                        error));
+    sched.rebuild(fleet);
+    CHECK(!sched.place(fleet, makeVM("c1", "cache"), error).empty());
+    std::string c1 = fleet.vm("c1")->host;
+    std::string db = sched.place(fleet, makeVM("db1", "db"), error);
+    CHECK(!db.empty());
+    FleetVM relabelled = makeVM("db1", "cache");
+    PlacedVM current{fleet.vm("db1"), fleet.host(db)};
+    CHECK(!sched.allowed(*fleet.host(c1), sched.rulesFor(relabelled), current));
+}
+
+int main() {
+    testAntiAffinityPerRack();
+    testAffinityPerZone();
+    testRelabelledVMIsNotDiscounted();
+    return checkResult();
+}
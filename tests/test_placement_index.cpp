@@ -0,0 +1,112 @@
+// PlacementIndex queries against a brute-force scan, and capacity accounting
+#include "placement.h"
+
+#include <random>
+
+#include "check.h"
+
+static FleetHost twoCellHost(const std::string& uri) {
+    FleetHost h;
+    h.uri = uri;
+    h.memory_kib = 64ull << 20;
+    h.cpus = 32;
+    h.cells = {FleetCell{32ull << 20, 16}, FleetCell{32ull << 20, 16}};
+    return h;
+}
+
+static void testUnknownCellReleasedWhereCharged() {
+    FleetModel fleet;
+    fleet.upsertHost(twoCellHost("h1"));
+    FleetVM vm;
+    vm.name = "legacy";
+    vm.host = "h1";
+    vm.memory_kib = 8ull << 20;
+    vm.vcpus = 4;
+    vm.cell = -1;  // e.g. recorded by snapshotFleet, which does not know cells
+    fleet.upsertVM(vm);
+
+    PlacementScheduler sched;
+    sched.rebuild(fleet);
+    const PlacementIndex& index = sched.capacityIndex();
+    // One cell was charged; the other is still whole
+    CHECK(index.bestFitOnHost("h1", 32ull << 20, 16).has_value());
+    CHECK(index.spread(32ull << 20, 16).has_value());
+
+    sched.remove(fleet, "legacy");
+    // Both cells whole again: a VM needing all of one cell fits twice
+    FleetVM big;
+    big.memory_kib = 32ull << 20;
+    big.vcpus = 16;
+    std::string error;
+    big.name = "big1";
+    CHECK_EQ(sched.place(fleet, big, error), std::string("h1"));
+    big.name = "big2";
+    CHECK_EQ(sched.place(fleet, big, error), std::string("h1"));
+
+    // Re-placing a VM of unknown cell releases its inferred cell too
+    FleetModel f2;
+    f2.upsertHost(twoCellHost("h1"));
+    f2.upsertVM(vm);
+    PlacementScheduler s2;
+    s2.rebuild(f2);
+    for (int i = 0; i < 3; i++) CHECK_EQ(s2.place(f2, vm, error), std::string("h1"));
+    big.name = "big1";
+    CHECK_EQ(s2.place(f2, big, error), std::string("h1"));
+}
+
+struct Reference {
+    uint64_t mem;
+    unsigned vcpus;
+};
+
+static void testQueriesMatchScan() {
+    std::mt19937_64 rng(11);
+    PlacementIndex index(64);
+    std::map<std::pair<std::string, int>, Reference> ref;
+    std::uniform_int_distribution<uint64_t> mem(0, 64);
+    std::uniform_int_distribution<unsigned> vcpus(0, 80);  // beyond max_vcpus to exercise the shared top bucket
+    for (int h = 0; h < 200; h++) {
+        for (int c = 0; c < 2; c++) {
+            std::string host = "h" + std::to_string(h);
+            Reference r{mem(rng), vcpus(rng)};
+            index.setCell(host, c, r.mem, r.vcpus);
+            ref[{host, c}] = r;
+        }
+    }
+
+    for (int q = 0; q < 5000; q++) {
+        uint64_t m = mem(rng);
+        unsigned v = vcpus(rng) / 2;
+        std::optional<std::pair<uint64_t, std::pair<std::string, int>>> tight, loose;
+        for (const auto& [key, r] : ref) {
+            if (r.mem < m || r.vcpus < v) continue;
+            if (!tight || r.mem < tight->first) tight = {r.mem, key};
+            if (!loose || r.mem > loose->first) loose = {r.mem, key};
+        }
+        std::optional<CellRef> best = index.bestFit(m, v);
+        std::optional<CellRef> wide = index.spread(m, v);
+        CHECK_EQ(best.has_value(), tight.has_value());
+        CHECK_EQ(wide.has_value(), loose.has_value());
+        if (best && tight) CHECK_EQ(ref[std::make_pair(best->host, best->cell)].mem, tight->first);
+        if (wide && loose) CHECK_EQ(ref[std::make_pair(wide->host, wide->cell)].mem, loose->first);
+
+        // Mutate: reserve on the chosen cell or release somewhere
+        if (best && q % 3 != 0) {
+            CHECK(index.reserve(*best, m, v));
+            ref[{best->host, best->cell}].mem -= m;
+            ref[{best->host, best->cell}].vcpus -= v;
+        } else {
+            auto it = ref.begin();
+            std::advance(it, rng() % ref.size());
+            index.release(CellRef{it->first.first, it->first.second}, 1, 1);
+            it->second.mem += 1;
+            it->second.vcpus += 1;
+        }
+    }
+}
+
+int main() {
+    testUnknownCellReleasedWhereCharged();
+    testQueriesMatchScan();
+    return checkResult();
+}
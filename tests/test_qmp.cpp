@@ -0,0 +1,98 @@
+// QmpMux against fake QEMU monitors: pipelining, events, errors, hang-ups and timeouts
+#include "qmp.h"
+
+#include <memory>
+
+#include "check.h"
+#include "fake_qmp.h"
+
+static std::string socketPath(const std::string& dir, const std::string& name) {
+    return dir + "/" + name + ".sock";
+}
+
+static void testPipelinedReplies(const std::string& dir) {
+    std::vector<std::unique_ptr<FakeQmpMonitor>> monitors;
+    QmpMux mux;
+    for (int i = 0; i < 50; i++) {
+        std::string name = "vm" + std::to_string(i);
+        monitors.push_back(std::make_unique<FakeQmpMonitor>(name, socketPath(dir, name)));
+        CHECK(monitors.back()->listening());
+        mux.add(name, socketPath(dir, name));
+    }
+    std::vector<QmpCommand> commands = {{"query-blockstats", ""}, {"query-stats", "{\"target\":\"vcpu\"}"}};
+    for (int round = 0; round < 3; round++) {
+        std::vector<QmpReply> replies = mux.query(commands, 2000);
+        CHECK_EQ(replies.size(), 100u);
+        for (const auto& r : replies) {
+            CHECK(r.ok);
+            CHECK_EQ(r.value["monitor"].string, r.domain);
+            CHECK_EQ(r.value["execute"].string, commands[r.command].execute);
+        }
+    }
+    // Connections stay open between rounds
+    for (const auto& m : monitors) {
+        CHECK_EQ(m->connections.load(), 1);
+        CHECK_EQ(m->commands.load(), 6);
+    }
+}
+
+static void testReplyBeforeHangUp(const std::string& dir) {
+    // The reply and the end of the stream arrive together; the reply still counts
+    FakeQmpMonitor closing("closing", socketPath(dir, "closing"), FakeQmpMonitor::ReplyThenClose);
+    QmpMux mux;
+    mux.add("closing", socketPath(dir, "closing"));
+    for (int round = 0; round < 20; round++) {
+        std::vector<QmpReply> replies = mux.query(QmpCommand{"query-blockstats", ""}, 2000);
+        CHECK_EQ(replies.size(), 1u);
+        CHECK(replies[0].ok);
+        CHECK_EQ(replies[0].error, std::string());
+        // Once the hang-up lands, the next query finds the connection dead and reconnects
+        for (int waited = 0; closing.hang_ups.load() <= round && waited < 2000; waited++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    CHECK_EQ(closing.connections.load(), 20);
+}
+
+static void testFailures(const std::string& dir) {
+    FakeQmpMonitor good("good", socketPath(dir, "good"));
+    FakeQmpMonitor silent("silent", socketPath(dir, "silent"), FakeQmpMonitor::Silent);
+    FakeQmpMonitor hangup("hangup", socketPath(dir, "hangup"), FakeQmpMonitor::CloseOnCommand);
+    FakeQmpMonitor failing("failing", socketPath(dir, "failing"), FakeQmpMonitor::Error);
+    QmpMux mux;
+    for (const char* name : {"good", "silent", "hangup", "failing"}) mux.add(name, socketPath(dir, name));
+    mux.add("missing", socketPath(dir, "missing"));
+
+    for (int round = 0; round < 2; round++) {
+        std::map<std::string, QmpReply> by_domain;
+        for (auto& r : mux.query(QmpCommand{"query-status", ""}, 300)) by_domain[r.domain] = r;
+        CHECK_EQ(by_domain.size(), 5u);
+        CHECK(by_domain["good"].ok);
+        CHECK_EQ(by_domain["silent"].error, std::string("timed out"));
+        CHECK_EQ(by_domain["hangup"].error, std::string("monitor closed"));
+        CHECK_EQ(by_domain["failing"].error, std::string("no query-status here"));
+        CHECK(by_domain["missing"].error.find("cannot connect") == 0);
+    }
+    // A hung-up monitor is reconnected on the next query; a silent one keeps its connection
+    CHECK_EQ(hangup.connections.load(), 2);
+    CHECK_EQ(silent.connections.load(), 1);
+    CHECK_EQ(good.connections.load(), 1);
+
+    mux.remove("silent");
+    CHECK(!mux.contains("silent"));
+    CHECK_EQ(mux.size(), 4u);
+}
+
+int main() {
+    char tmpl[] = "/tmp/augustus-qmp-XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    if (!dir) {
+        std::cerr << "Failed to create a socket directory\n";
+        return 1;
+    }
+    testPipelinedReplies(dir);
+    testReplyBeforeHangUp(dir);
+    testFailures(dir);
+    rmdir(dir);
+    return checkResult();
+}
@@ -0,0 +1,231 @@
+// Cache and memory-bandwidth admission against host budgets, and cachetune/memorytune XML
+#include "rdt.h"
+#include "spec.h"
+
+#include "check.h"
+
+// L3 bank 0 without CDP, L3 bank 1 with CDP, a monitoring-only L2 bank and one bandwidth node
+static const char* host_caps =
+    "<capabilities><host>"
+    "<cache>"
+    "<bank id='0' level='3' type='both' size='15' unit='MiB' cpus='0-5'>"
+    "<control granularity='768' unit='KiB' type='both' maxAllocs='4'/>"
+    "</bank>"
+    "<bank id='1' level='3' type='both' size='15' unit='MiB' cpus='6-11'>"
+    "<control granularity='768' min='1536' unit='KiB' type='code' maxAllocs='8'/>"
+    "<control granularity='768' min='1536' unit='KiB' type='data' maxAllocs='8'/>"
+    "</bank>"
+    "<bank id='0' level='2' type='both' size='1' unit='MiB' cpus='0'>"
+    "<monitor level='2' reservedMemory='0' maxMonitors='32'/>"
+    "</bank>"
+    "</cache>"
+    "<memory_bandwidth>"
+    "<node id='0' cpus='0-5'><control granularity='10' min='10' maxAllocs='4'/></node>"
+    "</memory_bandwidth>"
+    "</host></capabilities>";
+
+static VMSpec cacheSpec(uint64_t kib, unsigned id = 0, const std::string& type = "both") {
+    VMSpec spec;
+    CacheTuneSpec group;
+    group.vcpus = "0-1";
+    CacheAllocation c;
+    c.id = id;
+    c.type = type;
+    c.size_kib = kib;
+    group.caches.push_back(c);
+    spec.cachetune.push_back(group);
+    return spec;
+}
+
+static VMSpec bandwidthSpec(unsigned pct, unsigned node = 0) {
+    VMSpec spec;
+    MemoryTuneSpec group;
+    group.vcpus = "0-1";
+    group.nodes.push_back({node, pct});
+    spec.memorytune.push_back(group);
+    return spec;
+}
+
+static void testLoad() {
+    RdtBudget budget;
+    CHECK(budget.loadCapabilities(host_caps));
+    // The monitoring-only bank is not allocatable
+    CHECK_EQ(budget.cacheBanks().size(), 2u);
+    const CacheBankBudget& bank0 = budget.cacheBanks().at({3, 0});
+    CHECK_EQ(bank0.size_kib, 15u * 1024);
+    CHECK_EQ(bank0.granularity_kib, 768u);
+    CHECK_EQ(bank0.min_kib, 768u);  // defaults to the granularity
+    CHECK_EQ(bank0.max_allocs, 4u);
+    const CacheBankBudget& bank1 = budget.cacheBanks().at({3, 1});
+    CHECK_EQ(bank1.min_kib, 1536u);
+    CHECK_EQ(bank1.allocated_kib.size(), 2u);
+    CHECK_EQ(budget.bandwidthNodes().at(0).granularity, 10u);
+
+    RdtBudget none;
+    CHECK(!none.loadCapabilities("<capabilities><host><cpu/></host></capabilities>"));
+}
+
+static void testFits() {
+    RdtBudget budget;
+    budget.loadCapabilities(host_caps);
+    std::string error;
+    CHECK(budget.fits(cacheSpec(1536), error));
+    CHECK(budget.fits(VMSpec{}, error));
+
+    CHECK(!budget.fits(cacheSpec(1536, 7), error));
+    CHECK(error.find("does not support allocation") != std::string::npos);
+    // A CDP bank only has separate code and data controls
+    CHECK(!budget.fits(cacheSpec(1536, 1), error));
+    CHECK(error.find("CDP") != std::string::npos);
+    CHECK(budget.fits(cacheSpec(1536, 1, "code"), error));
+    CHECK(!budget.fits(cacheSpec(1000), error));
+    CHECK(error.find("multiple") != std::string::npos);
+    CHECK(!budget.fits(cacheSpec(768, 1, "data"), error));
+    CHECK(error.find("minimum") != std::string::npos);
+    // One granularity unit always stays with the default group
+    CHECK(budget.fits(cacheSpec(15 * 1024 - 768), error));
+    CHECK(!budget.fits(cacheSpec(15 * 1024), error));
+
+    CHECK(budget.fits(bandwidthSpec(100), error));
+    CHECK(!budget.fits(bandwidthSpec(15), error));
+    CHECK(!budget.fits(bandwidthSpec(110), error));
+    CHECK(!budget.fits(bandwidthSpec(0), error));
+    CHECK(!budget.fits(bandwidthSpec(50, 1), error));
+
+    // Allocations of one spec add up
+    VMSpec twice = cacheSpec(7680);
+    twice.cachetune.push_back(twice.cachetune[0]);
+    CHECK(!budget.fits(twice, error));
+}
+
+static void testAdmitRelease() {
+    RdtBudget budget;
+    budget.loadCapabilities(host_caps);
+    std::string error;
+    CHECK(budget.admit("a", cacheSpec(7680), error));
+    CHECK(budget.holds("a"));
+    CHECK_EQ(budget.cacheBanks().at({3, 0}).allocated_kib.at("both"), 7680u);
+    CHECK(!budget.admit("b", cacheSpec(7680), error));
+    CHECK(!budget.holds("b"));
+    CHECK(budget.admit("b", cacheSpec(6912), error));
+
+    budget.release("a");
+    CHECK(!budget.holds("a"));
+    CHECK_EQ(budget.cacheBanks().at({3, 0}).allocated_kib.at("both"), 6912u);
+    budget.release("a");
+    CHECK_EQ(budget.cacheBanks().at({3, 0}).allocated_kib.at("both"), 6912u);
+
+    // Re-admitting replaces the previous reservation, and keeps it when the new one does not fit
+    CHECK(budget.admit("b", cacheSpec(13824), error));
+    CHECK_EQ(budget.cacheBanks().at({3, 0}).allocated_kib.at("both"), 13824u);
+    CHECK(!budget.admit("b", cacheSpec(15360), error));
+    CHECK(budget.holds("b"));
+    CHECK_EQ(budget.cacheBanks().at({3, 0}).allocated_kib.at("both"), 13824u);
+
+    // Reloading capabilities keeps what is reserved
+    CHECK(budget.loadCapabilities(host_caps));
+    CHECK_EQ(budget.cacheBanks().at({3, 0}).allocated_kib.at("both"), 13824u);
+    CHECK_EQ(budget.cacheBanks().at({3, 0}).groups, 1u);
+
+    // Specs without allocations are admitted without holding anything
+    CHECK(budget.admit("plain", VMSpec{}, error));
+    CHECK(!budget.holds("plain"));
+}
+
+static void testGroups() {
+    RdtBudget budget;
+    budget.loadCapabilities(host_caps);
+    std::string error;
+    // maxAllocs counts the host's default group
+    for (int i = 0; i < 3; i++) CHECK(budget.admit("vm" + std::to_string(i), cacheSpec(768), error));
+    CHECK(!budget.admit("vm3", cacheSpec(768), error));
+    CHECK(error.find("allocation groups") != std::string::npos);
+    budget.release("vm0");
+    CHECK(budget.admit("vm3", cacheSpec(768), error));
+
+    // Code and data of one group on a CDP bank take a single group
+    VMSpec cdp = cacheSpec(1536, 1, "code");
+    cdp.cachetune[0].caches.push_back(cdp.cachetune[0].caches[0]);
+    cdp.cachetune[0].caches[1].type = "data";
+    CHECK(budget.admit("cdp", cdp, error));
+    const CacheBankBudget& bank1 = budget.cacheBanks().at({3, 1});
+    CHECK_EQ(bank1.groups, 1u);
+    CHECK_EQ(bank1.allocated_kib.at("code"), 1536u);
+    CHECK_EQ(bank1.allocated_kib.at("data"), 1536u);
+
+    CHECK(budget.admit("bw0", bandwidthSpec(60), error));
+    CHECK(!budget.admit("bw1", bandwidthSpec(50), error));
+    CHECK(budget.admit("bw1", bandwidthSpec(40), error));
+    CHECK_EQ(budget.bandwidthNodes().at(0).allocated, 100u);
+    budget.release("bw0");
+    CHECK_EQ(budget.bandwidthNodes().at(0).allocated, 40u);
+    CHECK_EQ(budget.bandwidthNodes().at(0).groups, 1u);
+}
+
+static void testResctrlXML() {
+    VMSpec spec = cacheSpec(1536, 1, "code");
+    spec.cachetune[0].caches.push_back({1, 3, "data", 3072});
+    CacheTuneSpec second;
+    second.vcpus = "2";
+    second.caches.push_back({0, 3, "both", 768});
+    spec.cachetune.push_back(second);
+    MemoryTuneSpec bw;
+    bw.vcpus = "0-2";
+    bw.nodes = {{0, 30}, {1, 20}};
+    spec.memorytune.push_back(bw);
+
+    std::string xml = buildResctrlXML(spec);
+    std::vector<std::string> groups = xmlElements(xml, "cachetune");
+    CHECK_EQ(groups.size(), 2u);
+    if (groups.size() == 2) {
+        CHECK_EQ(xmlAttr(groups[0], "vcpus"), std::string("0-1"));
+        std::vector<std::string> caches = xmlElements(groups[0], "cache");
+        CHECK_EQ(caches.size(), 2u);
+        if (caches.size() == 2) {
+            CHECK_EQ(xmlAttr(caches[0], "id"), std::string("1"));
+            CHECK_EQ(xmlAttr(caches[0], "level"), std::string("3"));
+            CHECK_EQ(xmlAttr(caches[0], "type"), std::string("code"));
+            CHECK_EQ(xmlAttr(caches[0], "size"), std::string("1536"));
+            CHECK_EQ(xmlAttr(caches[0], "unit"), std::string("KiB"));
+            CHECK_EQ(xmlAttr(caches[1], "type"), std::string("data"));
+        }
+        CHECK_EQ(xmlAttr(groups[1], "vcpus"), std::string("2"));
+    }
+    std::string memorytune = xmlElement(xml, "memorytune");
+    CHECK_EQ(xmlAttr(memorytune, "vcpus"), std::string("0-2"));
+    std::vector<std::string> nodes = xmlElements(memorytune, "node");
+    CHECK_EQ(nodes.size(), 2u);
+    if (nodes.size() == 2) {
+        CHECK_EQ(xmlAttr(nodes[1], "id"), std::string("1"));
+        CHECK_EQ(xmlAttr(nodes[1], "bandwidth"), std::string("20"));
+    }
+
+    // What the domain XML carries parses back into the same allocations
+    std::string domain = buildDomainXML(spec, "kvm", "/usr/bin/qemu-system-x86_64", "/images/rdt.qcow2");
+    std::string cputune = xmlElement(domain, "cputune");
+    CHECK(cputune.find(xml) != std::string::npos);
+    std::vector<CacheTuneSpec> cachetune;
+    std::vector<MemoryTuneSpec> memorytune_parsed;
+    parseResctrl(domain, cachetune, memorytune_parsed);
+    CHECK_EQ(cachetune.size(), 2u);
+    if (cachetune.size() == 2) {
+        CHECK_EQ(cachetune[0].caches.size(), 2u);
+        if (cachetune[0].caches.size() == 2) CHECK_EQ(cachetune[0].caches[1].size_kib, 3072u);
+    }
+    CHECK_EQ(memorytune_parsed.size(), 1u);
+    if (memorytune_parsed.size() == 1) CHECK_EQ(memorytune_parsed[0].nodes[0].bandwidth, 30u);
+
+    // No groups: no resctrl elements and no empty cputune
+    CHECK(buildResctrlXML(VMSpec{}).empty());
+    CHECK(xmlElement(buildDomainXML(VMSpec{}, "kvm", "/usr/bin/qemu-system-x86_64", "/images/plain.qcow2"),
+                     "cputune").empty());
+}
+
+int main() {
+    testLoad();
+    testFits();
+    testAdmitRelease();
+    testGroups();
+    testResctrlXML();
+    return checkResult();
+}
@@ -0,0 +1,144 @@
+// Console pattern matching and readiness modes fed with chunked console bytes
+#include "readiness.h"
+
+#include <thread>
+
+#include "check.h"
+
+static bool feed(ReadinessMonitor& monitor, const std::string& name, const std::string& bytes) {
+    return monitor.feed(name, bytes.data(), bytes.size());
+}
+
+static void testMatcher() {
+    PatternMatcher matcher({"login:", "in:", "", "ready"});
+    int32_t state = 0;
+    // A pattern split across chunks is still found; the state carries the prefix
+    std::string first = "Ubuntu 24.04 host ttyS0\r\nhost log", second = "in: ";
+    CHECK_EQ(matcher.feed(state, first.data(), first.size()), -1);
+    CHECK(state != 0);
+    // "login:" and its suffix "in:" end on the same byte: the lower index wins
+    CHECK_EQ(matcher.feed(state, second.data(), second.size()), 0);
+
+    // Overlapping prefixes fall back through failure links
+    state = 0;
+    std::string text = "rereadready";
+    CHECK_EQ(matcher.feed(state, text.data(), text.size()), 3);
+
+    // One byte at a time
+    state = 0;
+    int match = -1;
+    for (char c : std::string("xxin:")) {
+        match = matcher.feed(state, &c, 1);
+        if (match >= 0) break;
+    }
+    CHECK_EQ(match, 1);
+
+    // Empty patterns never match
+    PatternMatcher empty({""});
+    state = 0;
+    CHECK_EQ(empty.feed(state, text.data(), text.size()), -1);
+}
+
+static void testChunkedConsole() {
+    ReadinessMonitor monitor({"login:"});
+    // Unwatched guests need no console data
+    CHECK(feed(monitor, "vm", "login:"));
+    CHECK(!monitor.isReady("vm"));
+
+    monitor.watch("vm");
+    CHECK(!feed(monitor, "vm", "[  OK  ] Reached target Multi-User System.\r\nvm lo"));
+    CHECK(!feed(monitor, "vm", "g"));
+    CHECK(!monitor.isReady("vm"));
+    CHECK(monitor.timeToReady("vm").count() < 0);
+    CHECK(feed(monitor, "vm", "in: "));
+    CHECK(monitor.isReady("vm"));
+    CHECK_EQ(monitor.matchedPattern("vm"), std::string("login:"));
+    CHECK(monitor.timeToReady("vm").count() >= 0);
+    CHECK(monitor.waitReady("vm", std::chrono::milliseconds(0)));
+
+    // Watching again starts over
+    monitor.watch("vm");
+    CHECK(!monitor.isReady("vm"));
+    CHECK(monitor.matchedPattern("vm").empty());
+
+    monitor.forget("vm");
+    CHECK(!monitor.waitReady("vm", std::chrono::milliseconds(0)));
+}
+
+static void testConfigureResets() {
+    ReadinessMonitor monitor({"login:"});
+    monitor.watch("vm");
+    CHECK(!feed(monitor, "vm", "vm log"));
+    // Reconfiguring drops the partial match, even for an identical pattern set
+    monitor.configure({"login:"}, ReadinessMode::Console);
+    CHECK(!feed(monitor, "vm", "in:"));
+    CHECK(!monitor.isReady("vm"));
+
+    // A prefix of an old, longer automaton must not index past the new one
+    monitor.configure({"a-much-longer-readiness-banner"}, ReadinessMode::Console);
+    CHECK(!feed(monitor, "vm", "a-much-longer-readiness"));
+    monitor.configure({"ok"}, ReadinessMode::Console);
+    CHECK(!feed(monitor, "vm", "-banner"));
+    CHECK(feed(monitor, "vm", "ok"));
+    CHECK(monitor.isReady("vm"));
+    CHECK_EQ(monitor.matchedPattern("vm"), std::string("ok"));
+}
+
+static void testModes() {
+    ReadinessMonitor both({"login:"}, ReadinessMode::Both);
+    both.watch("vm");
+    // The console is done once matched, but the guest also needs its agent
+    CHECK(feed(both, "vm", "login:"));
+    CHECK(!both.isReady("vm"));
+    CHECK(!both.waitReady("vm", std::chrono::milliseconds(10)));
+    both.agentConnected("vm");
+    CHECK(both.isReady("vm"));
+
+    both.watch("vm");
+    both.agentConnected("vm");
+    CHECK(!both.isReady("vm"));
+    CHECK(!feed(both, "vm", "logi"));
+    CHECK(feed(both, "vm", "n:"));
+    CHECK(both.isReady("vm"));
+
+    ReadinessMonitor either({"login:"}, ReadinessMode::Either);
+    either.watch("console");
+    either.watch("agent");
+    CHECK(feed(either, "console", "login:"));
+    CHECK(either.isReady("console"));
+    either.agentConnected("agent");
+    CHECK(either.isReady("agent"));
+    // Once ready through the agent, the console stream can be dropped
+    CHECK(feed(either, "agent", "booting"));
+
+    ReadinessMonitor agent({"login:"}, ReadinessMode::Agent);
+    agent.watch("vm");
+    CHECK(feed(agent, "vm", "login:"));
+    CHECK(!agent.isReady("vm"));
+    agent.agentConnected("vm");
+    CHECK(agent.isReady("vm"));
+    // Agent events for unwatched guests are ignored
+    agent.agentConnected("other");
+    CHECK(!agent.isReady("other"));
+}
+
+static void testWaitWakesOnReady() {
+    ReadinessMonitor monitor({"login:"});
+    monitor.watch("vm");
+    std::thread console([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        feed(monitor, "vm", "log");
+        feed(monitor, "vm", "in:");
+    });
+    CHECK(monitor.waitReady("vm", std::chrono::milliseconds(5000)));
+    console.join();
+}
+
+int main() {
+    testMatcher();
+    testChunkedConsole();
+    testConfigureResets();
+    testModes();
+    testWaitWakesOnReady();
+    return checkResult();
+}
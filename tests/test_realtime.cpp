@@ -0,0 +1,158 @@
+// Realtime core admission and cputune XML
+#include "realtime.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "check.h"
+
+static VMSpec realtimeSpec(const std::string& name, std::vector<unsigned> cores, std::vector<unsigned> emulator) {
+    VMSpec spec;
+    spec.name = name;
+    spec.memory = 1024;
+    spec.vcpus = static_cast<int>(cores.size());
+    RealtimeSpec rt;
+    rt.cores = std::move(cores);
+    rt.emulator_cores = std::move(emulator);
+    spec.realtime = rt;
+    return spec;
+}
+
+static void testFitsRejectsBadSpecs() {
+    RealtimeAdmission adm;
+    std::string error;
+
+    VMSpec plain;
+    plain.vcpus = 4;
+    CHECK(adm.fits("plain", plain, error));
+
+    VMSpec short_cores = realtimeSpec("a", {2, 3}, {0});
+    short_cores.vcpus = 3;
+    CHECK(!adm.fits("a", short_cores, error));
+    CHECK(error.find("3 dedicated cores") != std::string::npos);
+
+    VMSpec sched = realtimeSpec("a", {2}, {0});
+    sched.realtime->scheduler = "deadline";
+    CHECK(!adm.fits("a", sched, error));
+
+    VMSpec prio = realtimeSpec("a", {2}, {0});
+    prio.realtime->priority = 100;
+    CHECK(!adm.fits("a", prio, error));
+    prio.realtime->priority = 0;
+    CHECK(!adm.fits("a", prio, error));
+
+    CHECK(!adm.fits("a", realtimeSpec("a", {2}, {}), error));
+    CHECK(!adm.fits("a", realtimeSpec("a", {2, 2}, {0}), error));
+    CHECK(error.find("two vCPUs") != std::string::npos);
+    CHECK(!adm.fits("a", realtimeSpec("a", {2, 3}, {3}), error));
+    CHECK(error.find("overlaps") != std::string::npos);
+}
+
+static void testIsolation() {
+    RealtimeAdmission adm;
+    std::string error;
+    adm.setIsolated({2, 3, 4, 5});
+    CHECK(adm.fits("a", realtimeSpec("a", {2, 3}, {0}), error));
+    CHECK(!adm.fits("a", realtimeSpec("a", {1, 2}, {0}), error));
+    CHECK(error.find("not isolated") != std::string::npos);
+}
+
+static void testAdmitAndRelease() {
+    RealtimeAdmission adm;
+    std::string error;
+    CHECK(adm.admit("a", realtimeSpec("a", {2, 3}, {0}), error));
+    CHECK_EQ(adm.vcpuCores().size(), 2u);
+    CHECK_EQ(adm.vcpuCores().at(2), std::string("a"));
+
+    // vCPU cores are exclusive
+    CHECK(!adm.admit("b", realtimeSpec("b", {3, 4}, {1}), error));
+    CHECK(error.find("'a'") != std::string::npos);
+    // Emulator threads may share housekeeping cores, but never a vCPU core
+    CHECK(adm.admit("b", realtimeSpec("b", {4, 5}, {0}), error));
+    CHECK(!adm.admit("c", realtimeSpec("c", {6}, {2}), error));
+    // And a vCPU may not land on another guest's emulator core
+    CHECK(!adm.admit("c", realtimeSpec("c", {0}, {1}), error));
+    CHECK(error.find("emulator threads") != std::string::npos);
+
+    // A guest's own holdings do not block re-admission with a changed spec
+    CHECK(adm.admit("a", realtimeSpec("a", {3, 6}, {0}), error));
+    CHECK(adm.vcpuCores().count(2) == 0);
+    CHECK_EQ(adm.vcpuCores().at(6), std::string("a"));
+
+    adm.release("a");
+    CHECK(adm.vcpuCores().count(3) == 0);
+    CHECK(adm.admit("c", realtimeSpec("c", {3}, {1}), error));
+    // Core 0 still hosts b's emulator thread after a released it
+    CHECK(!adm.admit("d", realtimeSpec("d", {0}, {1}), error));
+    adm.release("b");
+    CHECK(adm.admit("d", realtimeSpec("d", {0}, {1}), error));
+
+    // Releasing an unknown domain is harmless
+    adm.release("nobody");
+    CHECK_EQ(adm.vcpuCores().size(), 2u);
+}
+
+static void testCputuneXML() {
+    RealtimeSpec rt;
+    rt.cores = {4, 6, 5};
+    rt.emulator_cores = {1, 0, 1};
+    rt.scheduler = "rr";
+    rt.priority = 10;
+    std::string xml = "<cputune>" + buildRealtimeCputuneXML(rt) + "</cputune>";
+
+    std::vector<std::string> pins = xmlElements(xml, "vcpupin");
+    CHECK_EQ(pins.size(), 3u);
+    for (size_t v = 0; v < pins.size(); v++) {
+        CHECK_EQ(xmlAttr(pins[v], "vcpu"), std::to_string(v));
+        CHECK_EQ(xmlAttr(pins[v], "cpuset"), std::to_string(rt.cores[v]));
+    }
+    CHECK_EQ(xmlAttr(xmlElement(xml, "emulatorpin"), "cpuset"), std::string("0-1"));
+    std::string sched = xmlElement(xml, "vcpusched");
+    CHECK_EQ(xmlAttr(sched, "vcpus"), std::string("0-2"));
+    CHECK_EQ(xmlAttr(sched, "scheduler"), std::string("rr"));
+    CHECK_EQ(xmlAttr(sched, "priority"), std::string("10"));
+
+    CHECK(buildRealtimeCputuneXML(RealtimeSpec{}).empty());
+
+    // The XML reads back to the same spec
+    auto parsed = parseRealtime("<domain>" + xml + "<memoryBacking><locked/></memoryBacking></domain>");
+    CHECK(parsed.has_value());
+    CHECK(parsed->cores == rt.cores);
+    CHECK(parsed->emulator_cores == std::vector<unsigned>({0, 1}));
+    CHECK_EQ(parsed->scheduler, std::string("rr"));
+    CHECK_EQ(parsed->priority, 10);
+    CHECK(parsed->lock_memory);
+    CHECK(!parseRealtime("<domain><cputune><vcpupin vcpu='0' cpuset='1'/></cputune></domain>").has_value());
+}
+
+static void testDomainXML() {
+    VMSpec spec = realtimeSpec("rt", {2, 3}, {0});
+    std::string xml = buildDomainXML(spec, "kvm", "/usr/bin/qemu-system-x86_64", "/var/lib/rt.qcow2");
+    std::string cputune = xmlElement(xml, "cputune");
+    CHECK_EQ(xmlElements(cputune, "vcpupin").size(), 2u);
+    CHECK_EQ(xmlAttr(xmlElement(cputune, "vcpusched"), "scheduler"), std::string("fifo"));
+    CHECK(!xmlElement(xmlElement(xml, "memoryBacking"), "locked").empty());
+    // memlock limit covers guest RAM plus QEMU's overhead
+    CHECK_EQ(xmlChildText(xmlElement(xml, "memtune"), "hard_limit"), std::string("1280"));
+}
+
+static void testReadIsolatedCpus() {
+    std::string path = "test_realtime_isolated";
+    {
+        std::ofstream out(path);
+        out << "2-5,8\n";
+    }
+    CHECK(readIsolatedCpus(path) == std::set<unsigned>({2, 3, 4, 5, 8}));
+    std::remove(path.c_str());
+    CHECK(readIsolatedCpus(path).empty());
+}
+
+int main() {
+    testFitsRejectsBadSpecs();
+    testIsolation();
+    testAdmitAndRelease();
+    testCputuneXML();
+    testDomainXML();
+    testReadIsolatedCpus();
+    return checkResult();
+}
@@ -0,0 +1,182 @@
+// Capacity timelines against a brute-force scan, reservation admission, and placement under reservations
+#include "placement.h"
+
+#include <random>
+
+#include "check.h"
+
+static FleetHost makeHost(const std::string& uri) {
+    FleetHost h;
+    h.uri = uri;
+    h.memory_kib = 64ull << 20;
+    h.cpus = 32;
+    return h;
+}
+
+static FleetVM makeVM(const std::string& name, uint64_t gib) {
+    FleetVM vm;
+    vm.name = name;
+    vm.memory_kib = gib << 20;
+    vm.vcpus = 2;
+    return vm;
+}
+
+static void testTimelineMatchesScan() {
+    // Usage per time slot, kept by hand
+    const uint64_t slots = 300;
+    std::vector<int64_t> mem(slots, 0), cpu(slots, 0);
+    struct Interval {
+        uint64_t start, end;
+        int64_t mem, cpu;
+    };
+    std::vector<Interval> live;
+    CapacityTimeline timeline;
+    std::mt19937_64 rng(5);
+
+    for (int q = 0; q < 15000; q++) {
+        if (q % 3 == 2 && !live.empty()) {
+            size_t k = rng() % live.size();
+            Interval iv = live[k];
+            timeline.add(iv.start, iv.end, -iv.mem, -iv.cpu);
+            for (uint64_t t = iv.start; t < std::min(iv.end, slots); t++) {
+                mem[t] -= iv.mem;
+                cpu[t] -= iv.cpu;
+            }
+            live[k] = live.back();
+            live.pop_back();
+        } else {
+            uint64_t start = rng() % slots;
+            uint64_t end = q % 7 == 0 ? reservation_forever : start + 1 + rng() % 50;
+            Interval iv{start, end, static_cast<int64_t>(rng() % 1000), static_cast<int64_t>(rng() % 16)};
+            timeline.add(iv.start, iv.end, iv.mem, iv.cpu);
+            for (uint64_t t = iv.start; t < std::min(iv.end, slots); t++) {
+                mem[t] += iv.mem;
+                cpu[t] += iv.cpu;
+            }
+            live.push_back(iv);
+        }
+
+        uint64_t a = rng() % slots, b = a + 1 + rng() % 80;
+        int64_t want_mem = 0, want_cpu = 0;
+        for (uint64_t t = a; t < std::min(b, slots); t++) {
+            want_mem = std::max(want_mem, mem[t]);
+            want_cpu = std::max(want_cpu, cpu[t]);
+        }
+        auto [got_mem, got_cpu] = timeline.peak(a, b);
+        CHECK_EQ(got_mem, want_mem);
+        CHECK_EQ(got_cpu, want_cpu);
+    }
+    for (const auto& iv : live) timeline.add(iv.start, iv.end, -iv.mem, -iv.cpu);
+    CHECK_EQ(timeline.changePoints(), 0u);
+}
+
+static void testAdmission() {
+    ReservationBook book;
+    book.setHost("h1", 64ull << 20, 32);
+    std::string error;
+    Reservation r{"r1", "team-a", "h1", 48ull << 20, 16, 1000, 2000};
+    CHECK(book.reserve(r, error));
+    CHECK(!book.reserve(r, error));  // id already used
+
+    // A VM that runs from now on overlaps the reservation's window
+    CHECK(!book.admitVM("big", "h1", 32ull << 20, 4, 0, error));
+    CHECK(error.find("free at the peak") != std::string::npos);
+    CHECK(book.admitVM("small", "h1", 16ull << 20, 4, 0, error));
+    CHECK(!book.admitVM("small", "h1", 1, 1, 0, error));  // already admitted
+
+    // Claiming: only while active, only within the unclaimed part
+    CHECK(!book.admitVM("owner1", "h1", 40ull << 20, 8, 500, error, "r1"));
+    CHECK(book.admitVM("owner1", "h1", 40ull << 20, 8, 1500, error, "r1"));
+    CHECK(!book.admitVM("owner2", "h1", 16ull << 20, 4, 1500, error, "r1"));
+    CHECK(error.find("unclaimed") != std::string::npos);
+    CHECK(!book.cancel("r1", error));  // claimed
+    CHECK_EQ(book.admittedHost("owner1"), std::string("h1"));
+
+    // After the window the claiming VM holds its own capacity: 16 + 40 of 64 GiB
+    CHECK(book.fits("h1", 8ull << 20, 1, 2000, reservation_forever, error));
+    CHECK(!book.fits("h1", 9ull << 20, 1, 2000, reservation_forever, error));
+    CHECK_EQ(book.expire(2000), 1u);
+    CHECK(!book.reservation("r1"));
+    CHECK(!book.fits("h1", 9ull << 20, 1, 2000, reservation_forever, error));
+
+    book.releaseVM("owner1");
+    CHECK_EQ(book.admittedHost("owner1"), std::string());
+    CHECK(book.fits("h1", 48ull << 20, 1, 2000, reservation_forever, error));
+
+    // Cancelling returns the window
+    CHECK(book.reserve(Reservation{"r2", "team-b", "h1", 48ull << 20, 16, 3000, 4000}, error));
+    CHECK(!book.fits("h1", 1ull << 20, 1, 3500, 3600, error));
+    CHECK(book.cancel("r2", error));
+    CHECK(book.fits("h1", 48ull << 20, 1, 3500, 3600, error));
+
+    // Moved VMs hold capacity on their new host only
+    book.setHost("h2", 64ull << 20, 32);
+    book.moveVM("small", "h2", 5000);
+    CHECK_EQ(book.admittedHost("small"), std::string("h2"));
+    CHECK(book.fits("h1", 64ull << 20, 32, 5000, reservation_forever, error));
+    CHECK(!book.fits("h2", 64ull << 20, 32, 5000, reservation_forever, error));
+}
+
+static void testReserveInPool() {
+    ReservationBook book;
+    book.setHost("h1", 64ull << 20, 32);
+    book.setHost("h2", 64ull << 20, 32);
+    std::string error;
+    CHECK(book.reserve(Reservation{"a", "t", "h1", 32ull << 20, 8, 0, 100}, error));
+    // Tightest fit: h1 is left with less free memory at its peak
+    CHECK_EQ(book.reserveInPool(Reservation{"b", "t", "", 16ull << 20, 8, 50, 150}, {"h1", "h2"}, error),
+             std::string("h1"));
+    CHECK_EQ(book.reserveInPool(Reservation{"c", "t", "", 32ull << 20, 8, 50, 150}, {"h1", "h2"}, error),
+             std::string("h2"));
+    CHECK(book.reserveInPool(Reservation{"d", "t", "", 48ull << 20, 8, 60, 70}, {"h1", "h2"}, error).empty());
+    CHECK_EQ(book.getReservations("h1").size(), 2u);
+}
+
+static void testPlacementHonoursReservations() {
+    FleetModel fleet;
+    fleet.upsertHost(makeHost("h1"));
+    fleet.upsertHost(makeHost("h2"));
+    ReservationBook book;
+    book.syncFleet(fleet, 0);
+    PlacementScheduler sched;
+    sched.rebuild(fleet);
+    sched.useReservations(&book);
+    std::string error;
+    // h1 is held for a team from t=1000 on; a VM placed now would still run then
+    CHECK(book.reserve(Reservation{"r1", "team", "h1", 60ull << 20, 16, 1000, reservation_forever}, error));
+
+    for (int i = 0; i < 4; i++) {
+        std::string name = "vm" + std::to_string(i);
+        CHECK_EQ(sched.place(fleet, makeVM(name, 8), error, "", 10), std::string("h2"));
+        CHECK_EQ(book.admittedHost(name), std::string("h2"));
+    }
+    // h2 has 32 GiB left, h1 only 4 GiB outside the reservation
+    CHECK(sched.place(fleet, makeVM("large", 40), error, "", 10).empty());
+    CHECK(error.find("outside its reservations") != std::string::npos);
+    CHECK(!fleet.vm("large"));
+
+    // The reservation's owner lands on the reserved host once the window is open
+    CHECK(sched.place(fleet, makeVM("owned", 40), error, "r1", 10).empty());
+    CHECK_EQ(sched.place(fleet, makeVM("owned", 40), error, "r1", 1500), std::string("h1"));
+    CHECK(sched.place(fleet, makeVM("owned2", 30), error, "r1", 1500).empty());
+    CHECK(sched.place(fleet, makeVM("owned3", 8), error, "nope", 1500).empty());
+
+    // Re-placing does not count the VM against itself, and a failed move leaves it admitted where it was
+    CHECK_EQ(sched.place(fleet, makeVM("vm0", 8), error, "", 1600), std::string("h2"));
+    CHECK(sched.place(fleet, makeVM("vm0", 48), error, "", 1600).empty());
+    CHECK_EQ(book.admittedHost("vm0"), std::string("h2"));
+    CHECK(!book.fits("h2", 33ull << 20, 1, 1600, reservation_forever, error));
+
+    sched.remove(fleet, "owned");
+    CHECK_EQ(book.admittedHost("owned"), std::string());
+    CHECK(book.cancel("r1", error));
+    CHECK_EQ(sched.place(fleet, makeVM("large", 40), error, "", 1700), std::string("h1"));
+}
+
+int main() {
+    testTimelineMatchesScan();
+    testAdmission();
+    testReserveInPool();
+    testPlacementHonoursReservations();
+    return checkResult();
+}
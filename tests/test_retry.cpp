@@ -0,0 +1,186 @@
+// Retry classification, backoff and budget against a simulated libvirt backend
+#include "retry.h"
+
+#include <deque>
+#include <vector>
+
+#include "check.h"
+
+/**
+ * @brief Stands in for a libvirt call: each attempt pops the next scripted outcome.
+ *
+ * An outcome is either success (code VIR_ERR_OK) or an error code and message
+ * that the executor reads through its injected last-error hook.
+ */
+struct SimulatedBackend {
+    std::deque<LibvirtError> script;
+    LibvirtError last;
+    int calls = 0;
+    bool effective = false;  // the operation took effect, whatever the caller was told
+
+    static LibvirtError fail(int code, const std::string& message = "") {
+        LibvirtError e;
+        e.code = code;
+        e.message = message;
+        return e;
+    }
+
+    static LibvirtError ok() { return LibvirtError{}; }
+
+    bool call() {
+        calls++;
+        last = script.empty() ? ok() : script.front();
+        if (!script.empty()) script.pop_front();
+        return last.code == VIR_ERR_OK;
+    }
+};
+
+struct Harness {
+    SimulatedBackend backend;
+    RetryExecutor executor;
+    std::vector<std::chrono::milliseconds> sleeps;
+
+    explicit Harness(double budget_ratio = 0.2) : executor(budget_ratio) {
+        executor.last_error = [this] { return backend.last; };
+        executor.sleep = [this](std::chrono::milliseconds d) { sleeps.push_back(d); };
+    }
+
+    bool run(const RetryPolicy& policy = RetryPolicy{}) {
+        LibvirtError err;
+        return executor.run("simulated call", policy, [this] { return backend.call(); }, &err);
+    }
+};
+
+static void testClassification() {
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_OPERATION_TIMEOUT)) == ErrorClass::Retryable);
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_RPC)) == ErrorClass::Retryable);
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_AGENT_UNRESPONSIVE)) == ErrorClass::Retryable);
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_RESOURCE_BUSY)) == ErrorClass::Retryable);
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_OPERATION_FAILED,
+                                               "Timed out during operation: cannot acquire state change lock")) ==
+          ErrorClass::Retryable);
+
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_NO_CONNECT)) == ErrorClass::NonRetryable);
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_NO_DOMAIN)) == ErrorClass::NonRetryable);
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_XML_ERROR)) == ErrorClass::NonRetryable);
+    CHECK(classifyError(SimulatedBackend::fail(VIR_ERR_OPERATION_INVALID, "domain is already running")) ==
+          ErrorClass::NonRetryable);
+}
+
+static void testTransientThenSuccess() {
+    Harness h;
+    h.backend.script = {SimulatedBackend::fail(VIR_ERR_OPERATION_TIMEOUT), SimulatedBackend::fail(VIR_ERR_RPC)};
+    CHECK(h.run());
+    CHECK_EQ(h.backend.calls, 3);
+    CHECK_EQ(h.sleeps.size(), 2u);
+    RetryStats stats = h.executor.stats();
+    CHECK_EQ(stats.retries, 2u);
+    CHECK_EQ(stats.attempts, 3u);
+}
+
+static void testNonRetryableStops() {
+    Harness h;
+    h.backend.script = {SimulatedBackend::fail(VIR_ERR_XML_ERROR)};
+    CHECK(!h.run());
+    CHECK_EQ(h.backend.calls, 1);
+    CHECK_EQ(h.executor.stats().non_retryable, 1u);
+
+    // A dead connection fails the same way on every retry
+    Harness closed;
+    closed.backend.script = {SimulatedBackend::fail(VIR_ERR_NO_CONNECT), SimulatedBackend::fail(VIR_ERR_NO_CONNECT)};
+    CHECK(!closed.run());
+    CHECK_EQ(closed.backend.calls, 1);
+}
+
+static void testAttemptsAndBackoffCap() {
+    Harness h;
+    RetryPolicy policy;
+    policy.max_attempts = 5;
+    policy.base_delay = std::chrono::milliseconds(100);
+    policy.max_delay = std::chrono::milliseconds(300);
+    for (int i = 0; i < 10; i++) h.backend.script.push_back(SimulatedBackend::fail(VIR_ERR_OPERATION_TIMEOUT));
+    CHECK(!h.run(policy));
+    CHECK_EQ(h.backend.calls, 5);
+    CHECK_EQ(h.executor.stats().exhausted, 1u);
+    CHECK_EQ(h.sleeps.size(), 4u);
+    // Full jitter: attempt n sleeps in [0, min(max_delay, base * 2^n)]
+    const int64_t caps[] = {100, 200, 300, 300};
+    for (size_t i = 0; i < h.sleeps.size(); i++) {
+        CHECK(h.sleeps[i].count() >= 0);
+        CHECK(h.sleeps[i].count() <= caps[i]);
+    }
+}
+
+static void testBudgetStopsRetryStorm() {
+    // 10 initial tokens, 0.1 per request: a backend failing every call gets
+    // about 10 + 0.1 * calls retries in total, not calls * (max_attempts - 1)
+    Harness h(0.1);
+    RetryPolicy policy;
+    policy.max_attempts = 4;
+    int calls = 100;
+    for (int i = 0; i < calls; i++) {
+        for (int k = 0; k < policy.max_attempts; k++) {
+            h.backend.script.push_back(SimulatedBackend::fail(VIR_ERR_OPERATION_TIMEOUT));
+        }
+        h.run(policy);
+        h.backend.script.clear();
+    }
+    RetryStats stats = h.executor.stats();
+    CHECK(stats.retries <= 10 + static_cast<uint64_t>(calls * 0.1) + 1);
+    CHECK(stats.budget_denied > 0);
+    CHECK_EQ(stats.calls, static_cast<uint64_t>(calls));
+}
+
+static void testNonIdempotentNotRepeated() {
+    // The start times out but the domain comes up anyway; a blind retry
+    // would fail with "domain is already running"
+    Harness h;
+    h.backend.script = {SimulatedBackend::fail(VIR_ERR_OPERATION_TIMEOUT),
+                        SimulatedBackend::fail(VIR_ERR_OPERATION_INVALID, "domain is already running")};
+    h.backend.effective = true;
+    LibvirtError err;
+    bool ok = h.executor.run("start", RetryPolicy{}, [&] { return h.backend.call(); }, &err,
+                             [&] { return h.backend.effective; });
+    CHECK(ok);
+    CHECK_EQ(h.backend.calls, 1);
+    CHECK_EQ(h.executor.stats().applied, 1u);
+
+    // The start was still in flight when checked; the retry then reports
+    // "already running", which the second check recognises as success
+    Harness late;
+    late.backend.script = {SimulatedBackend::fail(VIR_ERR_OPERATION_TIMEOUT),
+                           SimulatedBackend::fail(VIR_ERR_OPERATION_INVALID, "domain is already running")};
+    int checks = 0;
+    ok = late.executor.run("start", RetryPolicy{}, [&] { return late.backend.call(); }, &err,
+                           [&] { return ++checks > 1; });
+    CHECK(ok);
+    CHECK_EQ(late.backend.calls, 2);
+
+    // Not applied: the non-retryable error is reported
+    Harness failed;
+    failed.backend.script = {SimulatedBackend::fail(VIR_ERR_OPERATION_TIMEOUT),
+                             SimulatedBackend::fail(VIR_ERR_OPERATION_INVALID, "domain is already running")};
+    ok = failed.executor.run("start", RetryPolicy{}, [&] { return failed.backend.call(); }, &err,
+                             [] { return false; });
+    CHECK(!ok);
+    CHECK_EQ(err.code, static_cast<int>(VIR_ERR_OPERATION_INVALID));
+
+    // A first-attempt non-retryable error never consults the check
+    Harness direct;
+    direct.backend.script = {SimulatedBackend::fail(VIR_ERR_XML_ERROR)};
+    bool consulted = false;
+    ok = direct.executor.run("start", RetryPolicy{}, [&] { return direct.backend.call(); }, &err,
+                             [&] { return consulted = true; });
+    CHECK(!ok);
+    CHECK(!consulted);
+}
+
+int main() {
+    testClassification();
+    testTransientThenSuccess();
+    testNonRetryableStops();
+    testAttemptsAndBackoffCap();
+    testBudgetStopsRetryStorm();
+    testNonIdempotentNotRepeated();
+    return checkResult();
+}
@@ -0,0 +1,177 @@
+// Hash ring balance, wire format, and shards routing to each other across processes
+#include "shard.h"
+
+#include <random>
+#include <sys/wait.h>
+
+#include "check.h"
+
+static void testRingBalanceAndMovement() {
+    HashRing ring;
+    for (const char* s : {"a", "b", "c"}) ring.addShard(s);
+    std::map<std::string, std::string> before;
+    std::map<std::string, size_t> share;
+    for (int i = 0; i < 30000; i++) {
+        std::string key = "qemu+ssh://host" + std::to_string(i) + "/system";
+        before[key] = ring.owner(key);
+        share[before[key]]++;
+    }
+    for (const auto& [shard, n] : share) CHECK(n > 8000 && n < 12000);
+
+    // A joining shard takes about a quarter of the keys, all of them from the others
+    ring.addShard("d");
+    size_t moved = 0;
+    for (const auto& [key, owner] : before) {
+        std::string now = ring.owner(key);
+        if (now == owner) continue;
+        moved++;
+        CHECK_EQ(now, std::string("d"));
+    }
+    CHECK(moved > 6000 && moved < 9000);
+    ring.removeShard("d");
+    for (const auto& [key, owner] : before) CHECK_EQ(ring.owner(key), owner);
+}
+
+static void testWireFormat() {
+    ShardRequest req;
+    req.op = "start";
+    req.host = "qemu+ssh://h1/system";
+    req.args = {"tab\there", "line\nbreak", "back\\slash", ""};
+    req.forwarded = true;
+    std::string line = encodeShardRequest(req);
+    CHECK_EQ(line.find('\n'), line.size() - 1);
+    ShardRequest back;
+    CHECK(decodeShardRequest(line.substr(0, line.size() - 1), back));
+    CHECK(back.forwarded);
+    CHECK_EQ(back.op, req.op);
+    CHECK_EQ(back.host, req.host);
+    CHECK(back.args == req.args);
+    CHECK(!decodeShardRequest("X\tstart\thost", back));
+}
+
+static std::string socketPath(const std::string& dir, const std::string& name) {
+    return dir + "/" + name + ".sock";
+}
+
+static bool waitFor(const std::function<bool()>& cond, int timeout_ms = 3000) {
+    for (int waited = 0; waited < timeout_ms; waited += 10) {
+        if (cond()) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return cond();
+}
+
+static void testServerReapsClients(const std::string& dir) {
+    ShardServer server;
+    std::string path = socketPath(dir, "echo");
+    CHECK(server.start(path, [](const ShardRequest& req) {
+        ShardResponse resp;
+        resp.ok = true;
+        resp.payload = req.op + " " + req.host;
+        return resp;
+    }));
+    for (int i = 0; i < 100; i++) {
+        ShardRequest req;
+        req.op = "state";
+        req.host = "h" + std::to_string(i);
+        ShardResponse resp = sendShardRequest(path, req);
+        CHECK(resp.ok);
+        CHECK_EQ(resp.payload, "state " + req.host);
+    }
+    CHECK(waitFor([&] { return server.clientThreads() == 0; }));
+    server.stop();
+}
+
+static std::string hostOwnedBy(const ShardNode& node, const std::string& shard) {
+    for (int i = 0;; i++) {
+        std::string host = "qemu+ssh://host" + std::to_string(i) + "/system";
+        if (node.ownerOf(host) == shard) return host;
+    }
+}
+
+static void testForwardingAcrossProcesses(const std::string& dir) {
+    std::map<std::string, std::string> members = {{"a", socketPath(dir, "a")}, {"b", socketPath(dir, "b")}};
+
+    // Shard b runs in a child process until the parent closes the pipe
+    int done[2];
+    CHECK(pipe(done) == 0);
+    pid_t child = fork();
+    if (child == 0) {
+        close(done[1]);
+        ShardNode b("b", DomainType::KVM);
+        b.setMembers(members);
+        if (!b.serve()) _exit(1);
+        char c;
+        while (read(done[0], &c, 1) > 0) {}
+        _exit(0);
+    }
+    close(done[0]);
+
+    ShardNode a("a", DomainType::KVM);
+    a.setMembers(members);
+    CHECK(a.serve());
+    CHECK(waitFor([&] { return access(members["b"].c_str(), F_OK) == 0; }));
+
+    // No shard has host connections: the reply names the shard that handled it
+    ShardRequest req;
+    req.op = "state";
+    req.args = {"vm1"};
+    req.host = hostOwnedBy(a, "b");
+    ShardResponse resp = a.route(req);
+    CHECK(!resp.ok);
+    CHECK_EQ(resp.payload, "shard 'b' has no connection to " + req.host);
+
+    // Through b's socket, a request for a's host is forwarded back to a
+    req.host = hostOwnedBy(a, "a");
+    resp = sendShardRequest(members["b"], req);
+    CHECK_EQ(resp.payload, "shard 'a' has no connection to " + req.host);
+
+    // A forwarded request is never forwarded again
+    req.forwarded = true;
+    resp = sendShardRequest(members["b"], req);
+    CHECK_EQ(resp.payload, "shard 'b' does not own " + req.host);
+
+    close(done[1]);
+    int status = 0;
+    CHECK_EQ(waitpid(child, &status, 0), child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void testRoutingDuringMembershipChanges() {
+    // Routing reads the ring while another thread rebuilds it
+    ShardNode node("a", DomainType::KVM, 16);
+    std::map<std::string, std::string> one = {{"a", "/nonexistent/a.sock"}};
+    std::map<std::string, std::string> two = {{"a", "/nonexistent/a.sock"}, {"b", "/nonexistent/b.sock"}};
+    node.setMembers(one);
+    std::atomic<bool> stop{false};
+    std::thread changer([&] {
+        for (int i = 0; i < 200; i++) node.setMembers(i % 2 ? one : two);
+        stop = true;
+    });
+    size_t routed = 0;
+    while (!stop) {
+        ShardRequest req;
+        req.op = "state";
+        req.host = "qemu+ssh://host" + std::to_string(routed++ % 64) + "/system";
+        req.args = {"vm"};
+        req.forwarded = true;
+        ShardResponse resp = node.route(req);
+        CHECK(!resp.ok);
+    }
+    changer.join();
+    CHECK(routed > 0);
+}
+
+int main() {
+    char tmpl[] = "/tmp/augustus-shard-XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    CHECK(dir != nullptr);
+    if (!dir) return checkResult();
+    testRingBalanceAndMovement();
+    testWireFormat();
+    testServerReapsClients(dir);
+    testForwardingAcrossProcesses(dir);
+    testRoutingDuringMembershipChanges();
+    rmdir(dir);
+    return checkResult();
+}
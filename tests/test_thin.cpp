@@ -0,0 +1,164 @@
+// Thin-disk parsing and growth, and ENOSPC resumption against a simulated libvirt backend
+#include "thin.h"
+
+#include <atomic>
+#include <map>
+
+#include "check.h"
+
+/**
+ * @brief Stands in for the domain state, disk errors and resume calls of a few domains.
+ *
+ * Domains are told apart by fake handles; nothing is dereferenced.
+ */
+struct SimulatedBackend {
+    struct Domain {
+        int state = VIR_DOMAIN_RUNNING;
+        int reason = 0;
+        std::vector<int> disk_errors;
+        bool resume_fails = false;
+        int resumes = 0;
+    };
+    std::map<virDomainPtr, Domain> domains;
+
+    static virDomainPtr handle(uintptr_t id) { return reinterpret_cast<virDomainPtr>(id); }
+
+    void attach(NoSpacePauses& pauses) {
+        pauses.get_state = [this](virDomainPtr vm, int& state, int& reason) {
+            auto it = domains.find(vm);
+            if (it == domains.end()) return false;
+            state = it->second.state;
+            reason = it->second.reason;
+            return true;
+        };
+        pauses.disk_errors = [this](virDomainPtr vm) { return domains[vm].disk_errors; };
+        pauses.resume = [this](virDomainPtr vm) {
+            Domain& d = domains[vm];
+            d.resumes++;
+            if (d.resume_fails) return false;
+            d.state = VIR_DOMAIN_RUNNING;
+            d.reason = 0;
+            d.disk_errors.clear();
+            return true;
+        };
+    }
+
+    void pauseOnError(virDomainPtr vm, std::vector<int> errors) {
+        Domain& d = domains[vm];
+        d.state = VIR_DOMAIN_PAUSED;
+        d.reason = VIR_DOMAIN_PAUSED_IOERROR;
+        d.disk_errors = std::move(errors);
+    }
+};
+
+static void testParseAndGrow() {
+    std::string xml =
+        "<domain><devices>"
+        "<disk type='block' device='disk'><driver name='qemu' type='qcow2'/><source dev='/dev/vg/a'/>"
+        "<target dev='vda'/></disk>"
+        "<disk type='block' device='disk'><driver name='qemu' type='raw'/><source dev='/dev/vg/b'/>"
+        "<target dev='vdb'/></disk>"
+        "<disk type='file' device='disk'><driver name='qemu' type='qcow2'/><source file='/img/c.qcow2'/>"
+        "<target dev='vdc'/></disk>"
+        "<disk type='block' device='cdrom'><driver name='qemu' type='qcow2'/><source dev='/dev/sr0'/>"
+        "<target dev='sda'/></disk>"
+        "</devices></domain>";
+    std::vector<ThinDisk> disks = parseThinDisks(xml);
+    CHECK_EQ(disks.size(), 1u);
+    if (!disks.empty()) {
+        CHECK_EQ(disks[0].dev, std::string("vda"));
+        CHECK_EQ(disks[0].path, std::string("/dev/vg/a"));
+    }
+
+    ThinPolicy policy;
+    policy.max_capacity_bytes = 12ull << 30;
+    CHECK_EQ(thinThreshold(10ull << 30, policy), 8ull << 30);
+    CHECK_EQ(thinExtension(2ull << 30, policy), 3ull << 30);    // at least min_extend_bytes
+    CHECK_EQ(thinExtension(8ull << 30, policy), 10ull << 30);   // extend_fraction of the size
+    CHECK_EQ(thinExtension(10ull << 30, policy), 12ull << 30);  // capped
+    CHECK_EQ(thinExtension(12ull << 30, policy), 0u);           // at the maximum
+}
+
+static void testConfirmNeedsNoSpaceError() {
+    SimulatedBackend backend;
+    NoSpacePauses pauses;
+    backend.attach(pauses);
+    virDomainPtr running = SimulatedBackend::handle(1), eio = SimulatedBackend::handle(2),
+                 full = SimulatedBackend::handle(3), unknown = SimulatedBackend::handle(4);
+    backend.domains[running];
+    backend.pauseOnError(eio, {VIR_DOMAIN_DISK_ERROR_NONE, VIR_DOMAIN_DISK_ERROR_UNSPEC});
+    backend.pauseOnError(full, {VIR_DOMAIN_DISK_ERROR_NONE, VIR_DOMAIN_DISK_ERROR_NO_SPACE});
+
+    CHECK(!pauses.confirm(running));
+    CHECK(!pauses.confirm(eio));
+    CHECK(pauses.confirm(full));
+    CHECK(!pauses.confirm(unknown));
+
+    // Paused by the user with a stale no-space error: not ours to resume
+    backend.domains[running].state = VIR_DOMAIN_PAUSED;
+    backend.domains[running].disk_errors = {VIR_DOMAIN_DISK_ERROR_NO_SPACE};
+    CHECK(!pauses.confirm(running));
+}
+
+static void testResumeOnlyConfirmedNoSpace() {
+    SimulatedBackend backend;
+    NoSpacePauses pauses;
+    backend.attach(pauses);
+    virDomainPtr eio = SimulatedBackend::handle(1), full = SimulatedBackend::handle(2),
+                 stuck = SimulatedBackend::handle(3), gone = SimulatedBackend::handle(4);
+    backend.pauseOnError(eio, {VIR_DOMAIN_DISK_ERROR_UNSPEC});
+    backend.pauseOnError(full, {VIR_DOMAIN_DISK_ERROR_NO_SPACE});
+    backend.pauseOnError(stuck, {VIR_DOMAIN_DISK_ERROR_NO_SPACE});
+    backend.domains[stuck].resume_fails = true;
+    backend.domains[gone];  // resumed by hand meanwhile
+    for (const char* name : {"eio", "full", "stuck", "gone"}) pauses.track(name);
+
+    CHECK(!pauses.resumeIfNoSpace(eio, "eio"));
+    CHECK_EQ(backend.domains[eio].resumes, 0);
+    CHECK_EQ(backend.domains[eio].state, static_cast<int>(VIR_DOMAIN_PAUSED));
+    CHECK(!pauses.isTracked("eio"));
+
+    CHECK(pauses.resumeIfNoSpace(full, "full"));
+    CHECK_EQ(backend.domains[full].resumes, 1);
+    CHECK(!pauses.isTracked("full"));
+
+    // A failed resume is retried later
+    CHECK(!pauses.resumeIfNoSpace(stuck, "stuck"));
+    CHECK(pauses.isTracked("stuck"));
+    backend.domains[stuck].resume_fails = false;
+    CHECK(pauses.resumeIfNoSpace(stuck, "stuck"));
+    CHECK(!pauses.isTracked("stuck"));
+
+    CHECK(!pauses.resumeIfNoSpace(gone, "gone"));
+    CHECK_EQ(backend.domains[gone].resumes, 0);
+    CHECK(pauses.names().empty());
+}
+
+static void testEventQueueOrder() {
+    ThinEventQueue queue;
+    std::mutex mutex;
+    std::vector<std::string> seen;
+    std::atomic<int> handled{0};
+    queue.start([&](const ThinEvent& e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        seen.push_back(e.domain);
+        handled++;
+    });
+    for (int i = 0; i < 100; i++) {
+        ThinEvent e;
+        e.domain = "vm" + std::to_string(i);
+        queue.push(e);
+    }
+    while (handled < 100) std::this_thread::yield();
+    queue.stop();
+    CHECK_EQ(seen.size(), 100u);
+    for (size_t i = 0; i < seen.size(); i++) CHECK_EQ(seen[i], "vm" + std::to_string(i));
+}
+
+int main() {
+    testParseAndGrow();
+    testConfirmNeedsNoSpaceError();
+    testResumeOnlyConfirmedNoSpace();
+    testEventQueueOrder();
+    return checkResult();
+}
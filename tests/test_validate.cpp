@@ -0,0 +1,86 @@
+// Spec validation against hypervisor limits parsed from capabilities XML
+#include "validate.h"
+
+#include "check.h"
+
+static const char* host_caps =
+    "<capabilities><host><cpu><arch>x86_64</arch></cpu></host>"
+    "<guest><os_type>hvm</os_type><arch name='i686'><emulator>/usr/bin/qemu-system-i386</emulator>"
+    "<domain type='qemu'/></arch></guest>"
+    "<guest><os_type>hvm</os_type><arch name='x86_64'><wordsize>64</wordsize>"
+    "<emulator>/usr/libexec/qemu-kvm</emulator>"
+    "<machine maxCpus='255'>pc-i440fx-8.2</machine><machine canonical='pc-q35-8.2' maxCpus='4096'>q35</machine>"
+    "<domain type='qemu'/><domain type='kvm'><emulator>/usr/bin/qemu-system-x86_64</emulator></domain>"
+    "</arch></guest></capabilities>";
+
+static const char* domain_caps =
+    "<domainCapabilities><path>/usr/bin/qemu-system-x86_64</path><domain>kvm</domain>"
+    "<machine>pc-q35-8.2</machine><arch>x86_64</arch><vcpu max='4096'/>"
+    "<cpu><mode name='host-model' supported='yes'><model>Icelake-Server</model>"
+    "<feature policy='require' name='vmx'/><feature policy='disable' name='hle'/></mode></cpu>"
+    "</domainCapabilities>";
+
+static void testEmulatorFromCapabilities() {
+    // A domain's own emulator wins over the arch's; a remote host's path is taken as given
+    CHECK_EQ(capabilitiesEmulator(host_caps, "kvm"), std::string("/usr/bin/qemu-system-x86_64"));
+    CHECK_EQ(capabilitiesEmulator(host_caps, "qemu"), std::string("/usr/libexec/qemu-kvm"));
+    CHECK_EQ(capabilitiesEmulator(host_caps, "xen"), std::string(""));
+    CHECK_EQ(capabilitiesEmulator("", "kvm"), std::string(""));
+}
+
+static VMSpec baseSpec() {
+    VMSpec spec;
+    spec.name = "vm1";
+    spec.memory = 2048;
+    spec.vcpus = 4;
+    return spec;
+}
+
+static bool hasError(const std::vector<SpecError>& errors, const std::string& field) {
+    for (const auto& e : errors) {
+        if (e.field == field) return true;
+    }
+    return false;
+}
+
+static void testLimits() {
+    HypervisorLimits limits = parseHypervisorLimits(host_caps, domain_caps, "kvm");
+    limits.host_cpus = 8;
+    CHECK(validateVMSpec(baseSpec(), "kvm", &limits).empty());
+    CHECK(hasError(validateVMSpec(baseSpec(), "xen", &limits), "type"));
+
+    VMSpec spec = baseSpec();
+    spec.machine = "pc-i440fx-8.2";
+    spec.vcpus = 256;
+    CHECK(hasError(validateVMSpec(spec, "kvm", &limits), "vcpus"));
+    spec.machine = "q35";
+    CHECK(validateVMSpec(spec, "kvm", &limits).empty());
+    spec.machine = "pc-1.0";
+    CHECK(hasError(validateVMSpec(spec, "kvm", &limits), "machine"));
+
+    spec = baseSpec();
+    spec.cpu_features = {"vmx"};
+    CHECK(validateVMSpec(spec, "kvm", &limits).empty());
+    spec.cpu_features = {"hle"};
+    CHECK(hasError(validateVMSpec(spec, "kvm", &limits), "cpu_features"));
+
+    spec = baseSpec();
+    spec.realtime = RealtimeSpec{};
+    spec.realtime->cores = {2, 8};
+    CHECK(hasError(validateVMSpec(spec, "kvm", &limits), "realtime.cores"));
+}
+
+static void testOvercommitAccepted() {
+    // libvirt defines guests larger than the host; so must the validator
+    HypervisorLimits limits = parseHypervisorLimits(host_caps, domain_caps, "kvm");
+    VMSpec spec = baseSpec();
+    spec.memory = 16 * 1024 * 1024;
+    CHECK(validateVMSpec(spec, "kvm", &limits).empty());
+}
+
+int main() {
+    testEmulatorFromCapabilities();
+    testLimits();
+    testOvercommitAccepted();
+    return checkResult();
+}
@@ -0,0 +1,120 @@
+// virtio-mem domain XML, live device parsing and resize controller decisions
+#include "spec.h"
+#include "virtio_mem.h"
+
+#include "check.h"
+
+static VMSpec elasticSpec() {
+    VMSpec spec;
+    spec.name = "elastic";
+    spec.memory = 2048;
+    spec.vcpus = 4;
+    VirtioMemSpec vmem;
+    vmem.max_mib = 8192;
+    vmem.block_mib = 2;
+    vmem.requested_mib = 1024;
+    spec.virtio_mem = vmem;
+    return spec;
+}
+
+static void testDomainXML() {
+    VMSpec spec = elasticSpec();
+    std::string xml = buildDomainXML(spec, "kvm", "/usr/bin/qemu-system-x86_64", "/images/elastic.qcow2");
+
+    // The device needs a maxMemory ceiling covering boot memory plus the device
+    std::string max_memory = xmlElement(xml, "maxMemory");
+    CHECK_EQ(xmlAttr(max_memory, "slots"), std::string("16"));
+    CHECK_EQ(xmlText(max_memory), std::string("10240"));
+    CHECK_EQ(xmlText(xmlElement(xml, "memory")), std::string("2048"));
+
+    // ... and a guest NUMA cell holding the boot memory and every vCPU
+    std::string cell = xmlElement(xmlElement(xmlElement(xml, "cpu"), "numa"), "cell");
+    CHECK_EQ(xmlAttr(cell, "cpus"), std::string("0-3"));
+    CHECK_EQ(xmlAttr(cell, "memory"), std::string("2048"));
+
+    std::string device = findVirtioMemDevice(xml);
+    CHECK(!device.empty());
+    CHECK_EQ(xmlText(xmlElement(xmlElement(device, "target"), "node")), std::string("0"));
+    VirtioMemState state = parseVirtioMem(device);
+    CHECK_EQ(state.size_kib, 8192u * 1024);
+    CHECK_EQ(state.block_kib, 2048u);
+    CHECK_EQ(state.requested_kib, 1024u * 1024);
+    CHECK_EQ(state.current_kib, 0u);
+
+    // Without virtio-mem there is no ceiling, topology or device
+    spec = elasticSpec();
+    spec.virtio_mem.reset();
+    xml = buildDomainXML(spec, "kvm", "/usr/bin/qemu-system-x86_64", "/images/plain.qcow2");
+    CHECK(xmlElement(xml, "maxMemory").empty());
+    CHECK(xmlElement(xml, "numa").empty());
+    CHECK(findVirtioMemDevice(xml).empty());
+}
+
+static void testLiveXML() {
+    // Live XML reports sizes in KiB and adds the plugged size; other memory devices are skipped
+    std::string live =
+        "<domain><devices>"
+        "<memory model='dimm'><target><size unit='GiB'>1</size><node>0</node></target></memory>"
+        "<memory model='virtio-mem'><target>"
+        "<size unit='GiB'>8</size><node>0</node><block unit='KiB'>2048</block>"
+        "<requested unit='KiB'>1048576</requested><current unit='KiB'>524288</current>"
+        "</target><alias name='virtiomem0'/></memory>"
+        "</devices></domain>";
+    std::string device = findVirtioMemDevice(live);
+    CHECK(device.find("virtiomem0") != std::string::npos);
+    VirtioMemState state = parseVirtioMem(device);
+    CHECK_EQ(state.size_kib, 8u * 1024 * 1024);
+    CHECK_EQ(state.block_kib, 2048u);
+    CHECK_EQ(state.requested_kib, 1048576u);
+    CHECK_EQ(state.current_kib, 524288u);
+
+    std::string resized = setVirtioMemRequested(device, 2097152);
+    VirtioMemState after = parseVirtioMem(resized);
+    CHECK_EQ(after.requested_kib, 2097152u);
+    CHECK_EQ(after.size_kib, state.size_kib);
+    CHECK(resized.find("virtiomem0") != std::string::npos);
+}
+
+static void testController() {
+    const uint64_t GiB = 1024 * 1024;
+    VirtioMemState dev;
+    dev.size_kib = 8 * GiB;
+    dev.block_kib = 2048;
+    dev.requested_kib = GiB;
+    ElasticityPolicy policy;
+
+    // Free memory inside the band: leave the device alone
+    CHECK_EQ(decideVirtioMemRequest(dev, 4 * GiB, GiB, policy), GiB);
+
+    // Under pressure: grow, capped at one step
+    CHECK_EQ(decideVirtioMemRequest(dev, 4 * GiB, 4 * GiB / 20, policy), 2 * GiB);
+
+    // A small grow still moves by whole blocks, rounded up
+    uint64_t grown = decideVirtioMemRequest(dev, 4 * GiB, 400000, policy);
+    CHECK(grown > dev.requested_kib);
+    CHECK_EQ(grown % dev.block_kib, 0u);
+    CHECK_EQ(grown, 1914880u);
+
+    // Mostly idle: shrink by at most one step, never below zero
+    dev.requested_kib = 2 * GiB;
+    CHECK_EQ(decideVirtioMemRequest(dev, 4 * GiB, 4 * GiB * 6 / 10, policy), GiB);
+    dev.requested_kib = 512 * 1024;
+    CHECK_EQ(decideVirtioMemRequest(dev, 4 * GiB, 4 * GiB * 6 / 10, policy), 0u);
+
+    // Never past the device size
+    dev.size_kib = GiB + GiB / 2;
+    dev.requested_kib = GiB;
+    CHECK_EQ(decideVirtioMemRequest(dev, 4 * GiB, 4 * GiB / 20, policy), GiB + GiB / 2);
+
+    // No stats yet, or a device without a block size: no decision
+    CHECK_EQ(decideVirtioMemRequest(dev, 0, 0, policy), GiB);
+    dev.block_kib = 0;
+    CHECK_EQ(decideVirtioMemRequest(dev, 4 * GiB, 0, policy), GiB);
+}
+
+int main() {
+    testDomainXML();
+    testLiveXML();
+    testController();
+    return checkResult();
+}